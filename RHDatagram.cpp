@@ -36,6 +36,18 @@ bool RHDatagram::sendto(uint8_t* buf, uint8_t len, uint8_t address)
     return _driver.send(buf, len);
 }
 
+bool RHDatagram::sendtoSegments(const RHGenericDriver::Segment* segments, uint8_t address)
+{
+    setHeaderTo(address);
+    return _driver.sendSegments(segments);
+}
+
+bool RHDatagram::sendtoQueued(uint8_t* buf, uint8_t len, uint8_t address)
+{
+    setHeaderTo(address);
+    return _driver.sendQueued(buf, len);
+}
+
 bool RHDatagram::recvfrom(uint8_t* buf, uint8_t* len, uint8_t* from, uint8_t* to, uint8_t* id, uint8_t* flags)
 {
     if (_driver.recv(buf, len))
@@ -49,6 +61,24 @@ bool RHDatagram::recvfrom(uint8_t* buf, uint8_t* len, uint8_t* from, uint8_t* to
     return false;
 }
 
+bool RHDatagram::recvfromLease(const uint8_t** buf, uint8_t* len, uint8_t* from, uint8_t* to, uint8_t* id, uint8_t* flags)
+{
+    if (_driver.lease(buf, len))
+    {
+	if (from)  *from =  headerFrom();
+	if (to)    *to =    headerTo();
+	if (id)    *id =    headerId();
+	if (flags) *flags = headerFlags();
+	return true;
+    }
+    return false;
+}
+
+void RHDatagram::release()
+{
+    _driver.release();
+}
+
 bool RHDatagram::available()
 {
     return _driver.available();
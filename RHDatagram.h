@@ -42,6 +42,12 @@
 /// \b FLAGS A bitmask of flags. The most significant 4 bits are reserved for use by RadioHead. The least
 /// significant 4 bits are reserved for applications.<br>
 ///
+/// \par Compile Time Driver Binding
+///
+/// RHDatagram calls the driver through an RHGenericDriver reference, so every call is a virtual function call.
+/// In programs with only one radio, RHDatagramT can be used instead, with the same API. It is bound to
+/// the driver class at compile time, so calls to the driver can be inlined. See RHDatagramT.
+///
 class RHDatagram
 {
 public:
@@ -70,6 +76,22 @@ public:
     /// \return true if the message not too loing fot eh driver, and the message was transmitted.
     bool sendto(uint8_t* buf, uint8_t len, uint8_t address);
 
+    /// Like sendto(), but the message is made of a list of segments, which the driver sends
+    /// without copying them together first (if it can). See RHGenericDriver::Segment
+    /// \param[in] segments The first segment of the message
+    /// \param[in] address The address to send the message to.
+    /// \return true if the message not too long for the driver, and the message was transmitted.
+    bool sendtoSegments(const RHGenericDriver::Segment* segments, uint8_t address);
+
+    /// Sends a message to the node(s) with the given address, without waiting for any previous 
+    /// message to be transmitted, using the transmit queue of the driver, if enabled.
+    /// See RHGenericDriver::sendQueued()
+    /// \param[in] buf Pointer to the binary message to send
+    /// \param[in] len Number of octets to send (> 0)
+    /// \param[in] address The address to send the message to.
+    /// \return true if the message was sent or queued, false if it was too long or the queue was full
+    bool sendtoQueued(uint8_t* buf, uint8_t len, uint8_t address);
+
     /// Turns the receiver on if it not already on.
     /// If there is a valid message available for this node, copy it to buf and return true
     /// The SRC address is placed in *from if present and not NULL.
@@ -87,6 +109,22 @@ public:
     /// \return true if a valid message was copied to buf
     bool recvfrom(uint8_t* buf, uint8_t* len, uint8_t* from = NULL, uint8_t* to = NULL, uint8_t* id = NULL, uint8_t* flags = NULL);
 
+    /// Like recvfrom(), but instead of copying the message, sets *buf to point to it inside the driver.
+    /// The message remains valid until release(). Do not send before calling release().
+    /// See RHGenericDriver::lease()
+    /// \param[out] buf Set to the address of the message
+    /// \param[out] len Set to the length of the message
+    /// \param[in] from If present and not NULL, the referenced uint8_t will be set to the FROM address
+    /// \param[in] to If present and not NULL, the referenced uint8_t will be set to the TO address
+    /// \param[in] id If present and not NULL, the referenced uint8_t will be set to the ID
+    /// \param[in] flags If present and not NULL, the referenced uint8_t will be set to the FLAGS
+    /// \return true if a message was leased. false if there is none, or the driver can not lease it 
+    /// (in which case recvfrom() will return it)
+    bool recvfromLease(const uint8_t** buf, uint8_t* len, uint8_t* from = NULL, uint8_t* to = NULL, uint8_t* id = NULL, uint8_t* flags = NULL);
+
+    /// Releases the message leased by recvfromLease()
+    void release();
+
     /// Tests whether a new message is available
     /// from the Driver.
     /// On most drivers, this will also put the Driver into RHModeRx mode until
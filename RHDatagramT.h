@@ -0,0 +1,269 @@
+// RHDatagramT.h
+// Author: Mike McCauley (mikem@airspayce.com)
+// Copyright (C) 2016 Mike McCauley
+
+#ifndef RHDatagramT_h
+#define RHDatagramT_h
+
+#include <RHGenericDriver.h>
+
+/////////////////////////////////////////////////////////////////////
+/// \class RHDatagramT RHDatagramT.h <RHDatagramT.h>
+/// \brief Manager class for addressed, unreliable messages, bound to one driver class at compile time
+///
+/// RHDatagramT has the same API and the same behaviour as RHDatagram, but it is a template with
+/// the driver class as its parameter, for example:
+/// \code
+/// #include <RH_RF95.h>
+/// #include <RHDatagramT.h>
+/// RH_RF95 driver;
+/// RHDatagramT<RH_RF95> manager(driver, CLIENT_ADDRESS);
+/// \endcode
+///
+/// RHDatagram holds an RHGenericDriver&, so every call it makes to the driver (send(), recv(),
+/// available(), the header functions etc) is a virtual function call,
+/// which can not be inlined. RHDatagramT calls the functions of the given driver class directly,
+/// so the compiler can inline them. This makes the per-message paths a little faster and smaller, which
+/// is useful in single radio builds on small processors such as AVR.
+///
+/// The driver class is still derived from RHGenericDriver, so it still has a vtable, and calls made from
+/// inside the driver (for example by RHGenericDriver::waitAvailableTimeout() to available()) are still virtual.
+///
+/// The driver passed to the constructor must be of exactly the class given as the template parameter, and
+/// not a class derived from it, since functions overridden by a derived class would not be called.
+/// The template parameter must be a concrete driver class, not RHGenericDriver.
+/// If you need to choose the driver at run time, or to use driver wrappers such as RHDutyCycle
+/// through a base class reference, use RHDatagram.
+///
+/// RHReliableDatagram, RHRouter and RHMesh are built on RHDatagram, and continue to use virtual calls.
+///
+/// RHDatagramT is defined entirely in this header, so there is no corresponding .cpp file.
+template <class Driver>
+class RHDatagramT
+{
+public:
+    /// Constructor.
+    /// \param[in] driver The RadioHead driver to use to transport messages.
+    /// \param[in] thisAddress The address to assign to this node. Defaults to 0
+    RHDatagramT(Driver& driver, uint8_t thisAddress = 0)
+	:
+	_driver(driver),
+	_thisAddress(thisAddress)
+    {
+    }
+
+    /// Initialise this instance and the
+    /// driver connected to it.
+    bool init()
+    {
+	bool ret = _driver.Driver::init();
+	if (ret)
+	    setThisAddress(_thisAddress);
+	return ret;
+    }
+
+    /// Sets the address of this node. Defaults to 0.
+    /// See RHDatagram::setThisAddress()
+    /// \param[in] thisAddress The address of this node
+    void setThisAddress(uint8_t thisAddress)
+    {
+	_driver.Driver::setThisAddress(thisAddress);
+	// Use this address in the transmitted FROM header
+	setHeaderFrom(thisAddress);
+	_thisAddress = thisAddress;
+    }
+
+    /// Sends a message to the node(s) with the given address
+    /// See RHDatagram::sendto()
+    /// \param[in] buf Pointer to the binary message to send
+    /// \param[in] len Number of octets to send (> 0)
+    /// \param[in] address The address to send the message to.
+    /// \return true if the message not too long for the driver, and the message was transmitted.
+    bool sendto(uint8_t* buf, uint8_t len, uint8_t address)
+    {
+	setHeaderTo(address);
+	return _driver.Driver::send(buf, len);
+    }
+
+    /// Like sendto(), but the message is made of a list of segments. See RHDatagram::sendtoSegments()
+    /// \param[in] segments The first segment of the message
+    /// \param[in] address The address to send the message to.
+    /// \return true if the message not too long for the driver, and the message was transmitted.
+    bool sendtoSegments(const RHGenericDriver::Segment* segments, uint8_t address)
+    {
+	setHeaderTo(address);
+	return _driver.Driver::sendSegments(segments);
+    }
+
+    /// Sends a message using the transmit queue of the driver, if enabled. See RHDatagram::sendtoQueued()
+    /// \param[in] buf Pointer to the binary message to send
+    /// \param[in] len Number of octets to send (> 0)
+    /// \param[in] address The address to send the message to.
+    /// \return true if the message was sent or queued, false if it was too long or the queue was full
+    bool sendtoQueued(uint8_t* buf, uint8_t len, uint8_t address)
+    {
+	setHeaderTo(address);
+	return _driver.sendQueued(buf, len);
+    }
+
+    /// If there is a valid message available for this node, copy it to buf and return true.
+    /// See RHDatagram::recvfrom()
+    /// \param[in] buf Location to copy the received message
+    /// \param[in,out] len Pointer to available space in buf. Set to the actual number of octets copied.
+    /// \param[in] from If present and not NULL, the referenced uint8_t will be set to the FROM address
+    /// \param[in] to If present and not NULL, the referenced uint8_t will be set to the TO address
+    /// \param[in] id If present and not NULL, the referenced uint8_t will be set to the ID
+    /// \param[in] flags If present and not NULL, the referenced uint8_t will be set to the FLAGS
+    /// \return true if a valid message was copied to buf
+    bool recvfrom(uint8_t* buf, uint8_t* len, uint8_t* from = NULL, uint8_t* to = NULL, uint8_t* id = NULL, uint8_t* flags = NULL)
+    {
+	if (_driver.Driver::recv(buf, len))
+	{
+	    if (from)  *from =  headerFrom();
+	    if (to)    *to =    headerTo();
+	    if (id)    *id =    headerId();
+	    if (flags) *flags = headerFlags();
+	    return true;
+	}
+	return false;
+    }
+
+    /// Like recvfrom(), but instead of copying the message, sets *buf to point to it inside the driver.
+    /// See RHDatagram::recvfromLease()
+    /// \param[out] buf Set to the address of the message
+    /// \param[out] len Set to the length of the message
+    /// \param[in] from If present and not NULL, the referenced uint8_t will be set to the FROM address
+    /// \param[in] to If present and not NULL, the referenced uint8_t will be set to the TO address
+    /// \param[in] id If present and not NULL, the referenced uint8_t will be set to the ID
+    /// \param[in] flags If present and not NULL, the referenced uint8_t will be set to the FLAGS
+    /// \return true if a message was leased
+    bool recvfromLease(const uint8_t** buf, uint8_t* len, uint8_t* from = NULL, uint8_t* to = NULL, uint8_t* id = NULL, uint8_t* flags = NULL)
+    {
+	if (_driver.Driver::lease(buf, len))
+	{
+	    if (from)  *from =  headerFrom();
+	    if (to)    *to =    headerTo();
+	    if (id)    *id =    headerId();
+	    if (flags) *flags = headerFlags();
+	    return true;
+	}
+	return false;
+    }
+
+    /// Releases the message leased by recvfromLease()
+    void release()
+    {
+	_driver.Driver::release();
+    }
+
+    /// Tests whether a new message is available from the Driver.
+    /// \return true if a new, complete, error-free uncollected message is available to be retreived by recv()
+    bool            available()
+    {
+	return _driver.Driver::available();
+    }
+
+    /// Starts the Driver receiver and blocks until a valid received
+    /// message is available.
+    void            waitAvailable()
+    {
+	_driver.Driver::waitAvailable();
+    }
+
+    /// Blocks until the transmitter
+    /// is no longer transmitting.
+    bool            waitPacketSent()
+    {
+	return _driver.Driver::waitPacketSent();
+    }
+
+    /// Blocks until the transmitter is no longer transmitting.
+    /// or until the timeout occuers, whichever happens first
+    /// \param[in] timeout Maximum time to wait in milliseconds.
+    /// \return true if the radio completed transmission within the timeout period. False if it timed out.
+    bool            waitPacketSent(uint16_t timeout)
+    {
+	return _driver.Driver::waitPacketSent(timeout);
+    }
+
+    /// Starts the Driver receiver and blocks until a received message is available or a timeout
+    /// \param[in] timeout Maximum time to wait in milliseconds.
+    /// \return true if a message is available
+    bool            waitAvailableTimeout(uint16_t timeout)
+    {
+	return _driver.Driver::waitAvailableTimeout(timeout);
+    }
+
+    /// Sets the TO header to be sent in all subsequent messages
+    /// \param[in] to The new TO header value
+    void           setHeaderTo(uint8_t to)
+    {
+	_driver.Driver::setHeaderTo(to);
+    }
+
+    /// Sets the FROM header to be sent in all subsequent messages
+    /// \param[in] from The new FROM header value
+    void           setHeaderFrom(uint8_t from)
+    {
+	_driver.Driver::setHeaderFrom(from);
+    }
+
+    /// Sets the ID header to be sent in all subsequent messages
+    /// \param[in] id The new ID header value
+    void           setHeaderId(uint8_t id)
+    {
+	_driver.Driver::setHeaderId(id);
+    }
+
+    /// Sets and clears bits in the FLAGS header to be sent in all subsequent messages
+    /// \param[in] set bitmask of bits to be set
+    /// \param[in] clear bitmask of flags to clear
+    void           setHeaderFlags(uint8_t set, uint8_t clear = RH_FLAGS_NONE)
+    {
+	_driver.Driver::setHeaderFlags(set, clear);
+    }
+
+    /// Returns the TO header of the last received message
+    /// \return The TO header of the most recently received message.
+    uint8_t        headerTo()
+    {
+	return _driver.Driver::headerTo();
+    }
+
+    /// Returns the FROM header of the last received message
+    /// \return The FROM header of the most recently received message.
+    uint8_t        headerFrom()
+    {
+	return _driver.Driver::headerFrom();
+    }
+
+    /// Returns the ID header of the last received message
+    /// \return The ID header of the most recently received message.
+    uint8_t        headerId()
+    {
+	return _driver.Driver::headerId();
+    }
+
+    /// Returns the FLAGS header of the last received message
+    /// \return The FLAGS header of the most recently received message.
+    uint8_t        headerFlags()
+    {
+	return _driver.Driver::headerFlags();
+    }
+
+    /// Returns the address of this node.
+    /// \return The address of this node
+    uint8_t         thisAddress()
+    {
+	return _thisAddress;
+    }
+
+protected:
+    /// The Driver we are to use
+    Driver&         _driver;
+
+    /// The address of this node
+    uint8_t         _thisAddress;
+};
+
+#endif
@@ -0,0 +1,326 @@
+// RHDutyCycle.cpp
+//
+// Copyright (C) 2016 Mike McCauley
+
+#include <RHDutyCycle.h>
+
+RHDutyCycle::RHDutyCycle(RHGenericDriver& driver, uint32_t window)
+    :
+    _driver(driver)
+{
+    _slotLength = window / RH_DUTY_CYCLE_SLOTS;
+    if (_slotLength == 0)
+	_slotLength = 1;
+    for (uint8_t i = 0; i < RH_DUTY_CYCLE_MAX_SUB_BANDS; i++)
+	_limit[i] = RH_DUTY_CYCLE_DEFAULT_LIMIT;
+    _subBand = 0;
+    _maxDelay = 0;
+    _dutyCycleRejects = 0;
+    _measuring = false;
+    _slot = 0;
+    _slotStart = 0;
+    memset(_airtime, 0, sizeof(_airtime));
+}
+
+bool RHDutyCycle::init()
+{
+    _slot = 0;
+    _slotStart = millis();
+    _measuring = false;
+    memset(_airtime, 0, sizeof(_airtime));
+    bool ret = _driver.init();
+    sync();
+    return ret;
+}
+
+bool RHDutyCycle::available()
+{
+    bool ret = _driver.available();
+    sync();
+    return ret;
+}
+
+bool RHDutyCycle::recv(uint8_t* buf, uint8_t* len)
+{
+    bool ret = _driver.recv(buf, len);
+    sync();
+    return ret;
+}
+
+bool RHDutyCycle::lease(const uint8_t** buf, uint8_t* len)
+{
+    bool ret = _driver.lease(buf, len);
+    sync();
+    return ret;
+}
+
+void RHDutyCycle::release()
+{
+    _driver.release();
+}
+
+bool RHDutyCycle::send(const uint8_t* data, uint8_t len)
+{
+    Segment segment = { data, len, NULL };
+    return sendSegments(&segment);
+}
+
+bool RHDutyCycle::sendSegments(const Segment* segments)
+{
+    uint16_t len = segmentsLength(segments);
+    if (len > _driver.maxMessageLength())
+	return false;
+    // Charge any previous message before deciding whether there is room for this one
+    finishMeasuring();
+    uint32_t airtime = _driver.timeOnAir(len);
+
+    unsigned long starttime = millis();
+    uint32_t wait;
+    while ((wait = timeUntilAirtime(airtime)) != 0)
+    {
+	if (   wait == RH_DUTY_CYCLE_NEVER
+	    || (millis() - starttime) + wait > _maxDelay)
+	{
+	    _dutyCycleRejects++;
+	    return false;
+	}
+	delay(wait);
+    }
+
+    bool ret = _driver.sendSegments(segments);
+    if (ret)
+    {
+	if (airtime)
+	    charge(airtime);
+	else
+	{
+	    // Measure it instead
+	    _measuring = true;
+	    _measureStart = millis();
+	}
+    }
+    sync();
+    return ret;
+}
+
+uint8_t RHDutyCycle::maxMessageLength()
+{
+    return _driver.maxMessageLength();
+}
+
+uint32_t RHDutyCycle::timeOnAir(uint8_t len)
+{
+    return _driver.timeOnAir(len);
+}
+
+void RHDutyCycle::waitAvailable()
+{
+    _driver.waitAvailable();
+    sync();
+}
+
+bool RHDutyCycle::waitPacketSent()
+{
+    bool ret = _driver.waitPacketSent();
+    finishMeasuring();
+    sync();
+    return ret;
+}
+
+bool RHDutyCycle::waitPacketSent(uint16_t timeout)
+{
+    bool ret = _driver.waitPacketSent(timeout);
+    if (ret)
+	finishMeasuring();
+    sync();
+    return ret;
+}
+
+bool RHDutyCycle::waitAvailableTimeout(uint16_t timeout)
+{
+    bool ret = _driver.waitAvailableTimeout(timeout);
+    sync();
+    return ret;
+}
+
+void RHDutyCycle::setThisAddress(uint8_t thisAddress)
+{
+    _driver.setThisAddress(thisAddress);
+}
+
+void RHDutyCycle::setHeaderTo(uint8_t to)
+{
+    _driver.setHeaderTo(to);
+}
+
+void RHDutyCycle::setHeaderFrom(uint8_t from)
+{
+    _driver.setHeaderFrom(from);
+}
+
+void RHDutyCycle::setHeaderId(uint8_t id)
+{
+    _driver.setHeaderId(id);
+}
+
+void RHDutyCycle::setHeaderFlags(uint8_t set, uint8_t clear)
+{
+    _driver.setHeaderFlags(set, clear);
+}
+
+void RHDutyCycle::setPromiscuous(bool promiscuous)
+{
+    _driver.setPromiscuous(promiscuous);
+}
+
+uint8_t RHDutyCycle::headerTo()
+{
+    return _driver.headerTo();
+}
+
+uint8_t RHDutyCycle::headerFrom()
+{
+    return _driver.headerFrom();
+}
+
+uint8_t RHDutyCycle::headerId()
+{
+    return _driver.headerId();
+}
+
+uint8_t RHDutyCycle::headerFlags()
+{
+    return _driver.headerFlags();
+}
+
+bool RHDutyCycle::sleep()
+{
+    bool ret = _driver.sleep();
+    sync();
+    return ret;
+}
+
+bool RHDutyCycle::isChannelActive()
+{
+    bool ret = _driver.isChannelActive();
+    sync();
+    return ret;
+}
+
+bool RHDutyCycle::setSubBand(uint8_t subBand)
+{
+    if (subBand >= RH_DUTY_CYCLE_MAX_SUB_BANDS)
+	return false;
+    // The previous message was sent in the previous sub-band
+    finishMeasuring();
+    _subBand = subBand;
+    return true;
+}
+
+bool RHDutyCycle::setLimit(uint8_t subBand, uint16_t limit)
+{
+    if (subBand >= RH_DUTY_CYCLE_MAX_SUB_BANDS)
+	return false;
+    _limit[subBand] = limit;
+    return true;
+}
+
+void RHDutyCycle::setMaxDelay(uint32_t maxDelay)
+{
+    _maxDelay = maxDelay;
+}
+
+uint32_t RHDutyCycle::usedAirtime(uint8_t subBand)
+{
+    if (subBand >= RH_DUTY_CYCLE_MAX_SUB_BANDS)
+	return 0;
+    expire();
+    uint32_t used = 0;
+    for (uint8_t i = 0; i < RH_DUTY_CYCLE_SLOTS; i++)
+	used += _airtime[subBand][i];
+    return used;
+}
+
+uint32_t RHDutyCycle::remainingAirtime(uint8_t subBand)
+{
+    if (subBand >= RH_DUTY_CYCLE_MAX_SUB_BANDS)
+	return 0;
+    // Limit is in parts per thousand of the window, and airtime is in microseconds
+    uint64_t budget = (uint64_t)_slotLength * RH_DUTY_CYCLE_SLOTS * _limit[subBand];
+    uint32_t used = usedAirtime(subBand);
+    return used < budget ? budget - used : 0;
+}
+
+uint32_t RHDutyCycle::timeUntilAvailable(uint8_t len)
+{
+    finishMeasuring();
+    return timeUntilAirtime(_driver.timeOnAir(len));
+}
+
+uint32_t RHDutyCycle::timeUntilAirtime(uint32_t airtime)
+{
+    if (airtime == 0)
+	airtime = 1; // Unknown, but there must be some airtime left
+    uint64_t budget = (uint64_t)_slotLength * RH_DUTY_CYCLE_SLOTS * _limit[_subBand];
+    if (airtime > budget)
+	return RH_DUTY_CYCLE_NEVER;
+    uint32_t used = usedAirtime(_subBand);
+    if (used + (uint64_t)airtime <= budget)
+	return 0;
+
+    // Find the oldest slot that has to expire to make enough room
+    uint32_t excess = used + airtime - budget;
+    uint32_t freed = 0;
+    uint32_t wait = _slotStart + _slotLength - millis(); // Until the oldest slot expires
+    for (uint8_t i = 1; i <= RH_DUTY_CYCLE_SLOTS; i++)
+    {
+	freed += _airtime[_subBand][(_slot + i) % RH_DUTY_CYCLE_SLOTS];
+	if (freed >= excess)
+	    break;
+	wait += _slotLength;
+    }
+    return wait ? wait : 1;
+}
+
+void RHDutyCycle::expire()
+{
+    uint32_t now = millis();
+    if (now - _slotStart >= _slotLength * RH_DUTY_CYCLE_SLOTS)
+    {
+	// Everything has expired
+	memset(_airtime, 0, sizeof(_airtime));
+	_slotStart = now;
+	return;
+    }
+    while (now - _slotStart >= _slotLength)
+    {
+	_slotStart += _slotLength;
+	_slot = (_slot + 1) % RH_DUTY_CYCLE_SLOTS;
+	for (uint8_t i = 0; i < RH_DUTY_CYCLE_MAX_SUB_BANDS; i++)
+	    _airtime[i][_slot] = 0;
+    }
+}
+
+void RHDutyCycle::charge(uint32_t airtime)
+{
+    expire();
+    _airtime[_subBand][_slot] += airtime;
+}
+
+void RHDutyCycle::finishMeasuring()
+{
+    if (!_measuring)
+	return;
+    if (_driver.mode() == RHModeTx)
+	_driver.waitPacketSent();
+    _measuring = false;
+    charge((millis() - _measureStart + 1) * 1000); // Round up
+}
+
+void RHDutyCycle::sync()
+{
+    _mode = _driver.mode();
+    _lastRssi = _driver.lastRssi();
+    _rxTimestamp = _driver.rxTimestamp();
+    _txTimestamp = _driver.txTimestamp();
+}
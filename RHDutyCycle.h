@@ -0,0 +1,284 @@
+// RHDutyCycle.h
+// Author: Mike McCauley (mikem@airspayce.com)
+// Limits the transmit duty cycle of any RadioHead driver
+// Copyright (C) 2016 Mike McCauley
+
+#ifndef RHDutyCycle_h
+#define RHDutyCycle_h
+
+#include <RHGenericDriver.h>
+
+// Maximum number of sub-bands with separate duty cycle limits
+#ifndef RH_DUTY_CYCLE_MAX_SUB_BANDS
+#define RH_DUTY_CYCLE_MAX_SUB_BANDS 4
+#endif
+
+// Number of slots the sliding window is divided into. More slots track the window more closely,
+// but each costs 4 octets of RAM per sub-band
+#ifndef RH_DUTY_CYCLE_SLOTS
+#define RH_DUTY_CYCLE_SLOTS 12
+#endif
+
+// Default length of the sliding window in milliseconds: 1 hour, as in ETSI EN 300 220
+#define RH_DUTY_CYCLE_WINDOW 3600000
+
+// Default duty cycle limit of each sub-band in parts per thousand: 1%
+#define RH_DUTY_CYCLE_DEFAULT_LIMIT 10
+
+// Returned by timeUntilAvailable() when the message can never be sent, because it needs more airtime
+// than the whole window allows
+#define RH_DUTY_CYCLE_NEVER 0xffffffff
+
+/////////////////////////////////////////////////////////////////////
+/// \class RHDutyCycle RHDutyCycle.h <RHDutyCycle.h>
+/// \brief Driver wrapper that keeps transmissions within a regulatory duty cycle limit.
+///
+/// In many places, such as the EU 868 MHz bands, each transmitter must stay within a duty cycle
+/// limit (typically 0.1%, 1% or 10%, depending on the sub-band), measured over a period of 1 hour.
+/// RHDutyCycle wraps any other driver, and counts the airtime of every message sent through it,
+/// including the retransmissions and ACKs sent by RHReliableDatagram, RHRouter and RHMesh.
+/// When a message would exceed the limit of the current sub-band, send() waits until enough
+/// airtime has expired from the window, up to the maximum delay set by setMaxDelay(), and if that
+/// is not long enough, refuses to send the message and returns false.
+///
+/// The airtime of each message is the timeOnAir() of the wrapped driver. If the wrapped driver can not
+/// calculate it, the time from send() until the transmitter is idle is measured instead (in milliseconds).
+///
+/// The window is divided into RH_DUTY_CYCLE_SLOTS slots. Airtime is only forgotten when its whole slot
+/// has left the window, so the limit is never exceeded, but a message may be delayed for up to 1 slot
+/// longer than strictly necessary.
+///
+/// RadioHead does not know which sub-band a frequency falls in, so when you change the frequency, also tell
+/// RHDutyCycle which sub-band it is in with setSubBand(). Each sub-band has its own limit, set with setLimit().
+/// \code
+/// RH_RF95 rf95;
+/// RHDutyCycle driver(rf95);
+/// RHReliableDatagram manager(driver, CLIENT_ADDRESS);
+/// ...
+/// manager.init();
+/// rf95.setFrequency(868.1);
+/// driver.setSubBand(0);
+/// driver.setLimit(0, 10);     // 1% in sub-band 0 (863.0 to 868.6 MHz)
+/// driver.setMaxDelay(2000);   // Wait up to 2 seconds for airtime to become available
+/// ...
+/// if (driver.timeUntilAvailable(sizeof(data)) == 0)
+///     manager.sendtoWait(data, sizeof(data), SERVER_ADDRESS);
+/// \endcode
+/// Configure the wrapped driver (frequency, power, modem configuration etc) directly, but send and receive
+/// through the RHDutyCycle. The counters in statistics() etc are those of the wrapped driver.
+class RHDutyCycle : public RHGenericDriver
+{
+public:
+    /// Constructor
+    /// \param[in] driver The driver to send and receive with
+    /// \param[in] window Length of the sliding window in milliseconds
+    RHDutyCycle(RHGenericDriver& driver, uint32_t window = RH_DUTY_CYCLE_WINDOW);
+
+    /// Initialises the wrapped driver, and forgets all previous transmissions.
+    /// \return true if initialisation succeeded.
+    virtual bool init();
+
+    /// Tests whether a new message is available from the wrapped driver
+    /// \return true if a new, complete, error-free uncollected message is available to be retreived by recv().
+    virtual bool available();
+
+    /// Receives a message from the wrapped driver. See RHGenericDriver::recv()
+    /// \param[in] buf Location to copy the received message
+    /// \param[in,out] len Pointer to available space in buf. Set to the actual number of octets copied.
+    /// \return true if a valid message was copied to buf
+    virtual bool recv(uint8_t* buf, uint8_t* len);
+
+    /// Leases a message from the wrapped driver. See RHGenericDriver::lease()
+    /// \param[out] buf Set to the address of the message
+    /// \param[out] len Set to the length of the message
+    /// \return true if a message was leased
+    virtual bool lease(const uint8_t** buf, uint8_t* len);
+
+    /// Releases the message leased by lease()
+    virtual void release();
+
+    /// Sends a message with the wrapped driver, if the current sub-band has enough airtime left.
+    /// If not, waits up to the maximum delay for airtime to become available.
+    /// \param[in] data Array of data to be sent
+    /// \param[in] len Number of bytes of data to send (> 0)
+    /// \return true if the message was sent. false if it was refused by the wrapped driver, or because
+    /// it would exceed the duty cycle limit. See dutyCycleRejects()
+    virtual bool send(const uint8_t* data, uint8_t len);
+
+    /// Like send(), but the message is made of a list of segments. See RHGenericDriver::sendSegments()
+    /// \param[in] segments The first segment of the message
+    /// \return true if the message was sent
+    virtual bool sendSegments(const Segment* segments);
+
+    /// Returns the maximum message length of the wrapped driver
+    /// \return The maximum legal message length
+    virtual uint8_t maxMessageLength();
+
+    /// Returns the time on air of the wrapped driver
+    /// \param[in] len Length of the message payload, not including the RadioHead headers
+    /// \return The time on air in microseconds, or 0 if unknown
+    virtual uint32_t timeOnAir(uint8_t len);
+
+    /// Waits for a message with the wrapped driver
+    virtual void waitAvailable();
+
+    /// Waits for the wrapped driver to finish transmitting
+    /// \return true
+    virtual bool waitPacketSent();
+
+    /// Waits for the wrapped driver to finish transmitting, or a timeout
+    /// \param[in] timeout Maximum time to wait in milliseconds.
+    /// \return true if the transmission completed within the timeout period. False if it timed out.
+    virtual bool waitPacketSent(uint16_t timeout);
+
+    /// Waits for a message with the wrapped driver, or a timeout
+    /// \param[in] timeout Maximum time to wait in milliseconds.
+    /// \return true if a message is available
+    virtual bool waitAvailableTimeout(uint16_t timeout);
+
+    /// Sets the address of this node in the wrapped driver
+    /// \param[in] thisAddress The address of this node.
+    virtual void setThisAddress(uint8_t thisAddress);
+
+    /// Sets the TO header in the wrapped driver
+    /// \param[in] to The new TO header value
+    virtual void setHeaderTo(uint8_t to);
+
+    /// Sets the FROM header in the wrapped driver
+    /// \param[in] from The new FROM header value
+    virtual void setHeaderFrom(uint8_t from);
+
+    /// Sets the ID header in the wrapped driver
+    /// \param[in] id The new ID header value
+    virtual void setHeaderId(uint8_t id);
+
+    /// Sets and clears bits in the FLAGS header in the wrapped driver
+    /// \param[in] set bitmask of bits to be set.
+    /// \param[in] clear bitmask of flags to clear.
+    virtual void setHeaderFlags(uint8_t set, uint8_t clear = RH_FLAGS_APPLICATION_SPECIFIC);
+
+    /// Sets promiscuous mode in the wrapped driver
+    /// \param[in] promiscuous true if you wish to receive messages with any TO address
+    virtual void setPromiscuous(bool promiscuous);
+
+    /// Returns the TO header of the last message received by the wrapped driver
+    /// \return The TO header
+    virtual uint8_t headerTo();
+
+    /// Returns the FROM header of the last message received by the wrapped driver
+    /// \return The FROM header
+    virtual uint8_t headerFrom();
+
+    /// Returns the ID header of the last message received by the wrapped driver
+    /// \return The ID header
+    virtual uint8_t headerId();
+
+    /// Returns the FLAGS header of the last message received by the wrapped driver
+    /// \return The FLAGS header
+    virtual uint8_t headerFlags();
+
+    /// Puts the wrapped driver to sleep
+    /// \return true if sleep mode was successfully entered.
+    virtual bool sleep();
+
+    /// Tells whether the wrapped driver can hear another node transmitting
+    /// \return true if the channel is busy
+    virtual bool isChannelActive();
+
+    /// Selects the sub-band that subsequent messages are sent in, and charged to.
+    /// Call this whenever you change the frequency of the wrapped driver.
+    /// \param[in] subBand The sub-band, 0 to RH_DUTY_CYCLE_MAX_SUB_BANDS-1
+    /// \return true if subBand is valid
+    bool setSubBand(uint8_t subBand);
+
+    /// Returns the sub-band that messages are sent in
+    /// \return The current sub-band
+    uint8_t subBand() { return _subBand; }
+
+    /// Sets the duty cycle limit of a sub-band. Defaults to RH_DUTY_CYCLE_DEFAULT_LIMIT (1%).
+    /// \param[in] subBand The sub-band, 0 to RH_DUTY_CYCLE_MAX_SUB_BANDS-1
+    /// \param[in] limit Maximum duty cycle in parts per thousand. For example 1 is 0.1%, 10 is 1% and
+    /// 1000 is no limit.
+    /// \return true if subBand is valid
+    bool setLimit(uint8_t subBand, uint16_t limit);
+
+    /// Sets the maximum time that send() waits for airtime to become available, before refusing to send.
+    /// Defaults to 0: messages that would exceed the limit are refused immediately.
+    /// \param[in] maxDelay Maximum delay in milliseconds
+    void setMaxDelay(uint32_t maxDelay);
+
+    /// Returns the airtime used in a sub-band during the window
+    /// \param[in] subBand The sub-band
+    /// \return The airtime in microseconds
+    uint32_t usedAirtime(uint8_t subBand);
+
+    /// Returns the airtime left in a sub-band before it reaches its limit
+    /// \param[in] subBand The sub-band
+    /// \return The airtime in microseconds
+    uint32_t remainingAirtime(uint8_t subBand);
+
+    /// Returns how long it will be until a message could be sent in the current sub-band without
+    /// exceeding its limit. Schedulers can use this to plan their transmissions.
+    /// \param[in] len Length of the message payload, not including the RadioHead headers
+    /// \return The time in milliseconds, 0 if it can be sent now, or RH_DUTY_CYCLE_NEVER
+    uint32_t timeUntilAvailable(uint8_t len);
+
+    /// Returns the number of messages that were refused because they would have exceeded the limit
+    /// \return The number of messages refused
+    uint32_t dutyCycleRejects() { return _dutyCycleRejects; }
+
+protected:
+    /// Expires the slots that have left the window
+    void expire();
+
+    /// Charges airtime to the current sub-band
+    /// \param[in] airtime Airtime in microseconds
+    void charge(uint32_t airtime);
+
+    /// Charges the measured airtime of the previous message, if its airtime was not known when it was sent
+    void finishMeasuring();
+
+    /// Calculates how long until airtime is available in the current sub-band
+    /// \param[in] airtime The airtime needed in microseconds
+    /// \return The time in milliseconds, 0 if it is available now, or RH_DUTY_CYCLE_NEVER
+    uint32_t timeUntilAirtime(uint32_t airtime);
+
+    /// Copies the mode and RSSI of the wrapped driver, so mode() and lastRssi() work
+    void sync();
+
+private:
+    /// The driver we are wrapping
+    RHGenericDriver&    _driver;
+
+    /// Length of each slot in milliseconds
+    uint32_t            _slotLength;
+
+    /// Time in millis when the current slot started
+    uint32_t            _slotStart;
+
+    /// Index of the current slot in _airtime
+    uint8_t             _slot;
+
+    /// Airtime in microseconds used in each slot of each sub-band
+    uint32_t            _airtime[RH_DUTY_CYCLE_MAX_SUB_BANDS][RH_DUTY_CYCLE_SLOTS];
+
+    /// Duty cycle limit of each sub-band in parts per thousand
+    uint16_t            _limit[RH_DUTY_CYCLE_MAX_SUB_BANDS];
+
+    /// The sub-band that messages are sent in
+    uint8_t             _subBand;
+
+    /// Maximum time in milliseconds that send() waits for airtime
+    uint32_t            _maxDelay;
+
+    /// Number of messages refused
+    uint32_t            _dutyCycleRejects;
+
+    /// True if the airtime of the last message sent is being measured
+    bool                _measuring;
+
+    /// Time in millis when the message being measured was sent
+    uint32_t            _measureStart;
+};
+
+#endif
@@ -0,0 +1,478 @@
+// RHEther.cpp
+//
+// Copyright (C) 2016 Mike McCauley
+
+#include <RadioHead.h>
+
+// This can only build on Linux and compatible systems
+#if (RH_PLATFORM == RH_PLATFORM_UNIX)
+
+#include <RHEther.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+
+RHEther::RHEther()
+    : _sequence(0),
+      _useLinks(false),
+      _pathLossExponent(RH_ETHER_DEFAULT_PATHLOSS_EXPONENT),
+      _referenceLoss(RH_ETHER_DEFAULT_REFERENCE_LOSS),
+      _capture(RH_ETHER_DEFAULT_CAPTURE),
+      _sensitivity(RH_ETHER_DEFAULT_SENSITIVITY),
+      _bps(RH_ETHER_DEFAULT_BPS),
+      _pcap(NULL),
+      _recordFile(NULL),
+      _replayFile(NULL),
+      _replayed(0),
+      _diverged(false),
+      _transmitted(0),
+      _delivered(0),
+      _dropped(0),
+      _collided(0)
+{
+    uint16_t i, j;
+    for (i = 0; i < 256; i++)
+    {
+	for (j = 0; j < 256; j++)
+	{
+	    _probability[i][j] = 1.0;
+	    _linked[i][j] = false;
+	}
+	_hasPosition[i] = false;
+	_txPower[i] = RH_ETHER_DEFAULT_TX_POWER;
+    }
+    setSeed(getpid() ^ (unsigned) time(NULL));
+}
+
+RHEther::~RHEther()
+{
+    int i;
+    for (i = 0; i < (int)_nodes.size(); i++)
+	cancelReceptions(i);
+    stopRecordReplay();
+}
+
+bool RHEther::readConfig(const char* filename)
+{
+    FILE* f = fopen(filename, "r");
+    if (!f)
+    {
+	fprintf(stderr, "RHEther::readConfig could not open config file %s: %s\n", filename, strerror(errno));
+	return false;
+    }
+    char line[200];
+    while (fgets(line, sizeof(line), f))
+    {
+	unsigned int a, b;
+	float p, q;
+	if (sscanf(line, "probability:%u:%u:%f", &a, &b, &p) == 3 && a <= 255 && b <= 255)
+	    setProbability(a, b, p);
+	else if (sscanf(line, "link:%u:%u", &a, &b) == 2 && a <= 255 && b <= 255)
+	    setLink(a, b);
+	else if (sscanf(line, "position:%u:%f:%f", &a, &p, &q) == 3 && a <= 255)
+	    setPosition(a, p, q);
+	else if (sscanf(line, "txpower:%u:%f", &a, &p) == 2 && a <= 255)
+	    setTxPower(a, p);
+	else if (sscanf(line, "pathloss:%f:%f", &p, &q) == 2)
+	    setPathLoss(p, q);
+	else if (sscanf(line, "capture:%f", &p) == 1)
+	    setCaptureThreshold(p);
+	else if (sscanf(line, "sensitivity:%f", &p) == 1)
+	    setSensitivity(p);
+    }
+    fclose(f);
+    return true;
+}
+
+void RHEther::setProbability(uint8_t a, uint8_t b, float probability)
+{
+    _probability[a][b] = probability;
+    _probability[b][a] = probability; // Bidirectional
+}
+
+float RHEther::probability(uint8_t from, uint8_t to)
+{
+    return _probability[from][to];
+}
+
+void RHEther::setLink(uint8_t a, uint8_t b, bool linked)
+{
+    _linked[a][b] = linked;
+    _linked[b][a] = linked; // Bidirectional
+    _useLinks = true;
+}
+
+void RHEther::clearLinks()
+{
+    memset(_linked, 0, sizeof(_linked));
+    _useLinks = false;
+}
+
+void RHEther::setPosition(uint8_t address, float x, float y)
+{
+    _x[address] = x;
+    _y[address] = y;
+    _hasPosition[address] = true;
+}
+
+void RHEther::setTxPower(uint8_t address, float power)
+{
+    _txPower[address] = power;
+}
+
+void RHEther::setPathLoss(float exponent, float referenceLoss)
+{
+    _pathLossExponent = exponent;
+    _referenceLoss = referenceLoss;
+}
+
+void RHEther::setCaptureThreshold(float threshold)
+{
+    _capture = threshold;
+}
+
+void RHEther::setSensitivity(float sensitivity)
+{
+    _sensitivity = sensitivity;
+}
+
+float RHEther::receivedPower(uint8_t from, uint8_t to)
+{
+    if (!_hasPosition[from] || !_hasPosition[to])
+	return _txPower[from]; // No path loss
+    float dx = _x[from] - _x[to];
+    float dy = _y[from] - _y[to];
+    float distance = sqrtf(dx * dx + dy * dy);
+    if (distance < 1.0)
+	distance = 1.0; // Near field, model is not valid
+    return _txPower[from] - (_referenceLoss + 10.0 * _pathLossExponent * log10f(distance));
+}
+
+void RHEther::setBitsPerSecond(uint32_t bps)
+{
+    if (bps)
+	_bps = bps;
+}
+
+void RHEther::setSeed(uint32_t seed)
+{
+    _randState[0] = 0x330e;
+    _randState[1] = seed & 0xffff;
+    _randState[2] = seed >> 16;
+}
+
+double RHEther::uniform()
+{
+    double u;
+    char line[100];
+    if (_replayFile && !_diverged)
+    {
+	if (nextReplayLine(line, sizeof(line)) && sscanf(line, "rand %la", &u) == 1)
+	    _replayed++;
+	else
+	{
+	    replayDiverged(line[0] ? line : NULL, "rand");
+	    u = erand48(_randState);
+	}
+    }
+    else
+	u = erand48(_randState);
+    if (_recordFile)
+	fprintf(_recordFile, "rand %a\n", u); // Exact
+    return u;
+}
+
+long RHEther::randomNumber(long from, long to)
+{
+    if (to <= from)
+	return from;
+    return from + (long)(uniform() * (to - from));
+}
+
+bool RHEther::record(const char* filename)
+{
+    if (_recordFile)
+	fclose(_recordFile);
+    _recordFile = fopen(filename, "w");
+    if (!_recordFile)
+    {
+	fprintf(stderr, "RHEther::record could not create %s: %s\n", filename, strerror(errno));
+	return false;
+    }
+    fprintf(_recordFile, "# RHEther log\n");
+    return true;
+}
+
+bool RHEther::replay(const char* filename)
+{
+    if (_replayFile)
+	fclose(_replayFile);
+    _replayFile = fopen(filename, "r");
+    if (!_replayFile)
+    {
+	fprintf(stderr, "RHEther::replay could not open %s: %s\n", filename, strerror(errno));
+	return false;
+    }
+    _replayed = 0;
+    _diverged = false;
+    return true;
+}
+
+void RHEther::stopRecordReplay()
+{
+    if (_recordFile)
+	fclose(_recordFile);
+    if (_replayFile)
+	fclose(_replayFile);
+    _recordFile = _replayFile = NULL;
+}
+
+bool RHEther::nextReplayLine(char* line, int len)
+{
+    line[0] = '\0';
+    while (fgets(line, len, _replayFile))
+    {
+	line[strcspn(line, "\n")] = '\0';
+	if (line[0] != '#')
+	    return true;
+    }
+    line[0] = '\0';
+    return false;
+}
+
+void RHEther::replayDiverged(const char* expected, const char* actual)
+{
+    _diverged = true;
+    fprintf(stderr, "RHEther::replay diverged from the log after %llu lines\n", (unsigned long long)_replayed);
+    fprintf(stderr, "  expected: %s\n", expected ? expected : "end of log");
+    fprintf(stderr, "  actual:   %s\n", actual);
+}
+
+void RHEther::logEvent(const char* line)
+{
+    if (_recordFile)
+	fprintf(_recordFile, "%s\n", line);
+    if (_replayFile && !_diverged)
+    {
+	char expected[RH_ETHER_MAX_FRAME_LEN * 2 + 100];
+	if (nextReplayLine(expected, sizeof(expected)) && !strcmp(expected, line))
+	    _replayed++;
+	else
+	    replayDiverged(expected[0] ? expected : NULL, line);
+    }
+}
+
+int RHEther::addNode()
+{
+    int node;
+    if (_freeNodes.size())
+    {
+	node = _freeNodes.back();
+	_freeNodes.pop_back();
+    }
+    else
+    {
+	node = _nodes.size();
+	_nodes.resize(node + 1);
+	_nodes[node].generation = 0;
+    }
+    _nodes[node].inUse = true;
+    _nodes[node].address = RH_BROADCAST_ADDRESS;
+    _nodes[node].collisions = 0;
+    return node;
+}
+
+void RHEther::removeNode(int node)
+{
+    if (node < 0 || node >= (int)_nodes.size() || !_nodes[node].inUse)
+	return;
+    cancelReceptions(node);
+    _nodes[node].generation++; // Any scheduled deliveries are now stale
+    _nodes[node].inUse = false;
+    _freeNodes.push_back(node);
+}
+
+void RHEther::setNodeAddress(int node, uint8_t address)
+{
+    if (node >= 0 && node < (int)_nodes.size())
+	_nodes[node].address = address;
+}
+
+uint32_t RHEther::numNodes()
+{
+    return _nodes.size() - _freeNodes.size();
+}
+
+uint64_t RHEther::airtime(uint8_t len)
+{
+    return ((uint64_t)len * 8 * 1000000) / _bps;
+}
+
+bool RHEther::channelActive(int node, uint64_t now)
+{
+    std::vector<Reception>& receptions = _nodes[node].receptions;
+    int i;
+    for (i = 0; i < (int)receptions.size(); i++)
+	if (receptions[i].end > now) // Else finished, but not yet delivered
+	    return true;
+    return false;
+}
+
+void RHEther::cancelReceptions(int node)
+{
+    std::vector<Reception>& receptions = _nodes[node].receptions;
+    int i;
+    for (i = 0; i < (int)receptions.size(); i++)
+	release(receptions[i].transmission);
+    receptions.clear();
+}
+
+void RHEther::release(Transmission* t)
+{
+    if (--t->refs == 0)
+	delete t;
+}
+
+void RHEther::transmit(int node, const uint8_t* frame, uint8_t len, uint64_t now)
+{
+    transmit(node, frame, len, now, airtime(len));
+}
+
+void RHEther::transmit(int node, const uint8_t* frame, uint8_t len, uint64_t now, uint64_t airtime)
+{
+    _transmitted++;
+    if (_pcap)
+	_pcap->writeFrame(now, frame, len);
+    if (_recordFile || _replayFile)
+    {
+	char line[RH_ETHER_MAX_FRAME_LEN * 2 + 100];
+	int i, n = sprintf(line, "tx %llu %d %u %llu ", (unsigned long long)now, node, _nodes[node].address,
+			   (unsigned long long)airtime);
+	for (i = 0; i < len; i++)
+	    n += sprintf(line + n, "%02x", frame[i]);
+	logEvent(line);
+    }
+    Transmission* t = new Transmission;
+    t->refs = 1; // Our own reference, released below
+    t->len = len;
+    memcpy(t->frame, frame, len);
+
+    uint64_t when = now + airtime;
+    uint8_t from = _nodes[node].address;
+    int i, j;
+    for (i = 0; i < (int)_nodes.size(); i++)
+    {
+	Node* n = &_nodes[i];
+	if (i == node || !n->inUse)
+	    continue; // Dont deliver back to the same node
+	if (!linked(from, n->address))
+	    continue; // Not within earshot in this topology
+
+	// Check the network config and see if delivery to this node is possible
+	if (uniform() >= _probability[from][n->address])
+	{
+	    _dropped++;
+	    continue;
+	}
+	float power = receivedPower(from, n->address);
+	if (_hasPosition[from] && _hasPosition[n->address] && power < _sensitivity)
+	{
+	    _dropped++; // Out of range
+	    continue;
+	}
+
+	// The frame reached this destination, see if it collides with
+	// other frames being received
+	Reception r;
+	r.transmission = t;
+	r.end = when;
+	r.power = power;
+	r.collided = false;
+	r.sequence = _sequence++;
+	for (j = 0; j < (int)n->receptions.size(); j++)
+	{
+	    Reception* other = &n->receptions[j];
+	    if (other->end <= now)
+		continue; // Finished, but not yet delivered
+	    if (power >= other->power + _capture)
+		other->collided = true; // The new frame captures the receiver
+	    else if (other->power >= power + _capture)
+		r.collided = true; // The other frame is strong enough to survive
+	    else
+		other->collided = r.collided = true; // Lose them both
+	}
+
+	// Deliver it to the node after the transmission time is complete,
+	// unless it collided
+	t->refs++;
+	n->receptions.push_back(r);
+	Event e;
+	e.when = when;
+	e.sequence = r.sequence;
+	e.node = i;
+	e.generation = n->generation;
+	_events.push(e);
+    }
+    release(t);
+}
+
+bool RHEther::nextEventTime(uint64_t* when)
+{
+    // Discard stale events so the caller does not wake up for nothing
+    while (!_events.empty())
+    {
+	const Event& e = _events.top();
+	if (_nodes[e.node].generation == e.generation)
+	{
+	    *when = e.when;
+	    return true;
+	}
+	_events.pop();
+    }
+    return false;
+}
+
+void RHEther::processEvents(uint64_t now)
+{
+    while (!_events.empty() && _events.top().when <= now)
+    {
+	Event e = _events.top();
+	_events.pop();
+	Node* n = &_nodes[e.node];
+	if (n->generation != e.generation)
+	    continue; // Node was removed
+
+	// Find the reception ended by this event
+	int i;
+	for (i = 0; i < (int)n->receptions.size(); i++)
+	    if (n->receptions[i].sequence == e.sequence)
+		break;
+	if (i >= (int)n->receptions.size())
+	    continue;
+	Reception r = n->receptions[i];
+	n->receptions.erase(n->receptions.begin() + i);
+	if (_recordFile || _replayFile)
+	{
+	    char line[100];
+	    sprintf(line, "%s %llu %d %u", r.collided ? "col" : "rx", (unsigned long long)e.when, e.node,
+		    r.transmission->len);
+	    logEvent(line);
+	}
+	if (r.collided)
+	{
+	    _collided++;
+	    n->collisions++;
+	}
+	else
+	{
+	    _delivered++;
+	    deliver(e.node, r.transmission->frame, r.transmission->len);
+	}
+	release(r.transmission);
+    }
+}
+
+#endif
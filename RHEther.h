@@ -0,0 +1,450 @@
+// RHEther.h
+// Author: Mike McCauley (mikem@airspayce.com)
+// Model of the 'Luminiferous Ether' shared by simulated RadioHead nodes
+// Copyright (C) 2016 Mike McCauley
+
+#ifndef RHEther_h
+#define RHEther_h
+
+#include <RadioHead.h>
+
+// This can only build on Linux and compatible systems
+#if (RH_PLATFORM == RH_PLATFORM_UNIX)
+
+#include <RHTcpProtocol.h>
+#include <RHPcap.h>
+#include <stdio.h>
+#include <vector>
+#include <queue>
+#include <stdlib.h>
+
+// Maximum length of a frame carried by the ether: TO, FROM, ID, FLAGS and payload
+#define RH_ETHER_MAX_FRAME_LEN RH_TCP_MAX_PAYLOAD_LEN
+
+// Default simulated bit rate, same as etherSimulator.pl
+#define RH_ETHER_DEFAULT_BPS 10000
+
+// Defaults for the radio propagation model. See RHEther
+#define RH_ETHER_DEFAULT_TX_POWER         13.0  // dBm
+#define RH_ETHER_DEFAULT_PATHLOSS_EXPONENT 3.0
+#define RH_ETHER_DEFAULT_REFERENCE_LOSS   40.0  // dB at 1 metre
+#define RH_ETHER_DEFAULT_CAPTURE           6.0  // dB
+#define RH_ETHER_DEFAULT_SENSITIVITY    -120.0  // dBm
+
+/////////////////////////////////////////////////////////////////////
+/// \class RHEther RHEther.h <RHEther.h>
+/// \brief Model of the radio medium shared by a number of simulated RadioHead nodes.
+///
+/// RHEther knows nothing about how the simulated nodes are connected to it. It keeps track of
+/// the nodes, the probability of successful delivery between each pair of nodes, and the
+/// frames that are currently in flight. When a node transmits a frame, transmit() decides which
+/// of the other nodes will hear it, and schedules delivery to each of them after the nominal
+/// transmission time of the frame at the simulated bit rate.
+/// processEvents() delivers any frames whose time has come by calling deliver(),
+/// which must be implemented by a subclass to pass the frame to the receiving node.
+///
+/// All times are in microseconds, in whatever timebase the subclass chooses to use.
+///
+/// Subclasses are used by tools/etherSimulator.cpp, which connects simulated sketches using RH_TCP over
+/// TCP sockets.
+///
+/// \par Configuration
+///
+/// readConfig() reads the same config file format as tools/etherSimulator.pl.
+/// Each line of the form
+/// \code
+/// probability:nodea:nodeb:probability
+/// \endcode
+/// specifies the probability (0.0 to 1.0) of correct delivery between nodea and nodeb
+/// (bidirectional). Lines starting with # are comments.
+/// The probability of delivery between nodes not mentioned in the config file is 1.0.
+/// See tools/chain.conf for an example.
+///
+/// The network topology can be given as an adjacency table, with lines of the form
+/// \code
+/// link:nodea:nodeb
+/// \endcode
+/// which mean that nodea and nodeb can hear each other (bidirectional). If there are any link lines,
+/// nodes can only hear the nodes they are linked to, and frames are not delivered to any other nodes.
+/// Link probabilities and the radio propagation model still apply to linked nodes.
+/// tools/topology.pl generates config files for chains, grids, stars and random geometric graphs,
+/// and tools/testnetwork1.conf to tools/testnetwork4.conf are the test networks formerly built into RHRouter
+/// with RH_TEST_NETWORK.
+///
+/// The radio propagation model is configured with these lines, all optional:
+/// \code
+/// position:node:x:y
+/// txpower:node:dBm
+/// pathloss:exponent:referenceloss
+/// capture:dB
+/// sensitivity:dBm
+/// \endcode
+/// position gives the location of a node in metres. txpower gives the transmitter power of a node
+/// (default RH_ETHER_DEFAULT_TX_POWER). pathloss gives the path loss exponent and the path loss at 1 metre in dB
+/// for the log-distance path loss model (defaults RH_ETHER_DEFAULT_PATHLOSS_EXPONENT and 
+/// RH_ETHER_DEFAULT_REFERENCE_LOSS). capture gives the capture threshold (default RH_ETHER_DEFAULT_CAPTURE), and
+/// sensitivity the weakest signal a receiver can hear (default RH_ETHER_DEFAULT_SENSITIVITY).
+/// See tools/capture.conf for an example.
+///
+/// \par Collisions
+///
+/// RHEther tracks the frames being received by each node, from the start to the end of their transmission time.
+/// If a frame arrives at a node while other frames are being received by it, the frames collide. 
+/// The received power of each frame is computed from the transmitter power less the path loss over the distance
+/// between the 2 nodes: 
+/// \code
+/// loss = referenceloss + 10 * exponent * log10(distance)
+/// \endcode
+/// If one of the colliding frames is stronger than the other by at least the capture threshold, it is 
+/// received (the capture effect), and the other is lost. Otherwise both are lost.
+/// If either node has no position, there is no path loss, so frames from nodes with the same transmitter power
+/// always destroy each other, as with etherSimulator.pl.
+/// If both nodes have positions and the received power is below the sensitivity, the frame is not heard at all,
+/// and does not interfere with other frames.
+///
+/// The number of frames lost by collisions is counted for each receiving node (see collisions()), and
+/// in total (see collided()).
+///
+/// \par Record and Replay
+///
+/// record() logs every transmission, delivery and collision, and every random number drawn by the ether,
+/// to a text file, one event per line, with the time of the event. replay() reads such a log, and while the run
+/// follows the same course, takes the random numbers from the log instead of the random number generator,
+/// so the run is reproduced exactly, whatever the seed. Every event is compared with the log, and the first
+/// difference is reported on stderr (see diverged()), after which the run continues with live random numbers.
+/// This is useful for finding out exactly when and why a rare failure happens: record many runs, then replay
+/// the one that failed with a modified or instrumented build, or with an older release to find the change
+/// responsible. A run can be recorded and replayed at the same time, to make a new log for comparison.
+///
+/// Runs can only be reproduced if the nodes are deterministic too. This is the case in virtual time
+/// (see RHEtherSimulator, and etherSimulator -v) where the nodes random number generators are seeded
+/// with fixed seeds, and Arduino random() calls in RHEtherSimulator tasks are drawn through randomNumber(),
+/// so they are recorded and replayed too.
+class RHEther
+{
+public:
+    /// Constructor
+    RHEther();
+
+    /// Destructor
+    virtual ~RHEther();
+
+    /// Reads link probabilities from a config file. See the class description for the format.
+    /// \param[in] filename Name of the config file to read
+    /// \return true if the file was read successfully
+    bool readConfig(const char* filename);
+
+    /// Sets the probability of successful delivery between 2 nodes (bidirectional)
+    /// \param[in] a Address of one node
+    /// \param[in] b Address of the other node
+    /// \param[in] probability Probability of successful delivery, 0.0 to 1.0
+    void setProbability(uint8_t a, uint8_t b, float probability);
+
+    /// Returns the probability of successful delivery from one node to another
+    /// \param[in] from Address of the transmitting node
+    /// \param[in] to Address of the receiving node
+    /// \return The probability of successful delivery, 0.0 to 1.0
+    float probability(uint8_t from, uint8_t to);
+
+    /// Sets whether 2 nodes can hear each other (bidirectional). After the first call, 
+    /// nodes can only hear the nodes they are linked to.
+    /// \param[in] a Address of one node
+    /// \param[in] b Address of the other node
+    /// \param[in] linked true if the nodes can hear each other
+    void setLink(uint8_t a, uint8_t b, bool linked = true);
+
+    /// Removes all links set by setLink(), so that all nodes can hear each other again
+    void clearLinks();
+
+    /// Tells whether one node can hear another according to the adjacency table
+    /// \param[in] from Address of the transmitting node
+    /// \param[in] to Address of the receiving node
+    /// \return true if there is no adjacency table, or the nodes are linked
+    bool linked(uint8_t from, uint8_t to) { return !_useLinks || _linked[from][to]; }
+
+    /// Sets the position of a node for the radio propagation model.
+    /// \param[in] address Address of the node
+    /// \param[in] x X coordinate in metres
+    /// \param[in] y Y coordinate in metres
+    void setPosition(uint8_t address, float x, float y);
+
+    /// Sets the transmitter power of a node for the radio propagation model.
+    /// \param[in] address Address of the node
+    /// \param[in] power Transmitter power in dBm
+    void setTxPower(uint8_t address, float power);
+
+    /// Sets the parameters of the log-distance path loss model
+    /// \param[in] exponent The path loss exponent, typically 2.0 (free space) to 4.0
+    /// \param[in] referenceLoss The path loss at 1 metre in dB
+    void setPathLoss(float exponent, float referenceLoss);
+
+    /// Sets the capture threshold. When frames collide at a receiver, 
+    /// a frame stronger than all the others by at least the threshold is received.
+    /// \param[in] threshold The capture threshold in dB
+    void setCaptureThreshold(float threshold);
+
+    /// Sets the sensitivity of all receivers. Frames weaker than this are not heard.
+    /// \param[in] sensitivity The sensitivity in dBm
+    void setSensitivity(float sensitivity);
+
+    /// Returns the power received by one node from another, according to the propagation model
+    /// \param[in] from Address of the transmitting node
+    /// \param[in] to Address of the receiving node
+    /// \return The received power in dBm
+    float receivedPower(uint8_t from, uint8_t to);
+
+    /// Sets the simulated bit rate used to compute the transmission time of each frame.
+    /// \param[in] bps Bits per second. Defaults to RH_ETHER_DEFAULT_BPS
+    void setBitsPerSecond(uint32_t bps);
+
+    /// Sets a capture file to which every frame transmitted is written, timestamped with 
+    /// the time passed to transmit(). 
+    /// \param[in] pcap The capture file, already opened. NULL to stop capturing
+    void setPcap(RHPcap* pcap) { _pcap = pcap; }
+
+    /// Seeds the random number generator used to decide whether frames are delivered.
+    /// \param[in] seed The new seed
+    void setSeed(uint32_t seed);
+
+    /// Starts recording every event and random number to a log file. See the class description
+    /// \param[in] filename Name of the log file to create
+    /// \return true if the file was created
+    bool record(const char* filename);
+
+    /// Starts replaying a log file made by record(). See the class description
+    /// \param[in] filename Name of the log file to read
+    /// \return true if the file was opened
+    bool replay(const char* filename);
+
+    /// Stops recording and replaying, and closes the log files
+    void stopRecordReplay();
+
+    /// Tells whether a replayed run has differed from the log
+    /// \return true if the run has diverged from the log, or the log has been exhausted
+    bool diverged() { return _diverged; }
+
+    /// Returns the number of events and random numbers replayed so far, that matched the log
+    /// \return The number of lines of the log replayed
+    uint64_t replayed() { return _replayed; }
+
+    /// Returns a random number drawn from the ether random number generator, which is recorded
+    /// and replayed with the other ether events.
+    /// \param[in] from The lowest value to return
+    /// \param[in] to One more than the highest value to return
+    /// \return A random number from from to to - 1
+    long randomNumber(long from, long to);
+
+    /// Adds a new node to the ether. Its address is RH_BROADCAST_ADDRESS until
+    /// setNodeAddress() is called.
+    /// \return The index of the new node, to be used in subsequent calls.
+    /// Indexes of removed nodes are reused.
+    int addNode();
+
+    /// Removes a node from the ether. Any frames in flight to it are discarded.
+    /// \param[in] node Index of the node as returned by addNode()
+    void removeNode(int node);
+
+    /// Sets the node address of a node. Used to look up delivery probabilities.
+    /// \param[in] node Index of the node as returned by addNode()
+    /// \param[in] address The new node address
+    void setNodeAddress(int node, uint8_t address);
+
+    /// Returns the node address of a node
+    /// \param[in] node Index of the node as returned by addNode()
+    /// \return The node address
+    uint8_t nodeAddress(int node) { return _nodes[node].address; }
+
+    /// Returns the number of nodes currently in the ether
+    /// \return The number of nodes
+    uint32_t numNodes();
+
+    /// Called when a node transmits a frame. Schedules delivery of the frame to
+    /// all other nodes that are able to hear it.
+    /// \param[in] node Index of the transmitting node
+    /// \param[in] frame The frame transmitted: TO, FROM, ID, FLAGS and payload
+    /// \param[in] len Length of the frame in octets
+    /// \param[in] now The current time in microseconds
+    void transmit(int node, const uint8_t* frame, uint8_t len, uint64_t now);
+
+    /// Called when a node transmits a frame with a known transmission time, for example
+    /// when the node models its own radio. Schedules delivery of the frame to
+    /// all other nodes that are able to hear it.
+    /// \param[in] node Index of the transmitting node
+    /// \param[in] frame The frame transmitted: TO, FROM, ID, FLAGS and payload
+    /// \param[in] len Length of the frame in octets
+    /// \param[in] now The current time in microseconds
+    /// \param[in] airtime The transmission time of the frame in microseconds
+    void transmit(int node, const uint8_t* frame, uint8_t len, uint64_t now, uint64_t airtime);
+
+    /// Returns the time of the next scheduled event
+    /// \param[out] when Set to the time of the next event in microseconds, if any
+    /// \return true if there is an event pending
+    bool nextEventTime(uint64_t* when);
+
+    /// Delivers all frames due for delivery at or before now
+    /// \param[in] now The current time in microseconds
+    void processEvents(uint64_t now);
+
+    /// \return The number of frames transmitted by all nodes
+    uint64_t transmitted() { return _transmitted; }
+
+    /// \return The number of frames delivered to all nodes
+    uint64_t delivered() { return _delivered; }
+
+    /// \return The number of frames not delivered due to link probabilities
+    uint64_t dropped() { return _dropped; }
+
+    /// \return The number of frames lost due to collisions
+    uint64_t collided() { return _collided; }
+
+    /// Returns the number of frames lost by collisions at a node since it was added
+    /// \param[in] node Index of the node as returned by addNode()
+    /// \return The number of frames lost
+    uint32_t collisions(int node) { return _nodes[node].collisions; }
+
+    /// Tells whether a node can hear another node transmitting, including frames that have collided
+    /// \param[in] node Index of the node as returned by addNode()
+    /// \param[in] now The current time in microseconds
+    /// \return true if the node is receiving at least one frame
+    bool channelActive(int node, uint64_t now);
+
+    /// Returns the transmission time of a frame
+    /// \param[in] len Length of the frame in octets
+    /// \return Transmission time in microseconds
+    virtual uint64_t airtime(uint8_t len);
+
+protected:
+    /// Called by processEvents() when a frame is to be delivered to a node.
+    /// Subclasses must implement this to pass the frame to the receiving node.
+    /// \param[in] node Index of the receiving node
+    /// \param[in] frame The frame: TO, FROM, ID, FLAGS and payload
+    /// \param[in] len Length of the frame in octets
+    virtual void deliver(int node, const uint8_t* frame, uint8_t len) = 0;
+
+    /// Returns a random number uniformly distributed over 0.0 to 1.0
+    double uniform();
+
+private:
+    /// \brief A frame transmitted by a node, shared by all the nodes that will receive it
+    typedef struct
+    {
+	uint32_t           refs;                         ///< Number of pending deliveries of this frame
+	uint8_t            len;                          ///< Length of the frame
+	uint8_t            frame[RH_ETHER_MAX_FRAME_LEN]; ///< TO, FROM, ID, FLAGS and payload
+    } Transmission;
+
+    /// \brief A frame being received by a node
+    typedef struct
+    {
+	Transmission*      transmission; ///< The frame
+	uint64_t           end;          ///< When the reception ends, in microseconds
+	float              power;        ///< Received power in dBm
+	bool               collided;     ///< The frame was destroyed by a collision
+	uint64_t           sequence;     ///< Sequence number of the Event that ends the reception
+    } Reception;
+
+    /// \brief The state of one node in the ether
+    typedef struct
+    {
+	bool               inUse;      ///< This index is allocated to a node
+	uint8_t            address;    ///< The node address
+	std::vector<Reception> receptions; ///< Frames being received by this node
+	uint32_t           generation; ///< Incremented when the node is removed
+	uint32_t           collisions; ///< Number of frames lost by collisions at this node
+    } Node;
+
+    /// \brief The end of a reception, when the frame is delivered unless it collided
+    typedef struct
+    {
+	uint64_t           when;       ///< When to deliver, in microseconds
+	uint64_t           sequence;   ///< Order of scheduling, breaks ties between equal times
+	int                node;       ///< Index of the receiving node
+	uint32_t           generation; ///< Node generation when scheduled. Stale if different
+    } Event;
+
+    /// Orders Events by time, earliest first
+    struct EventLater
+    {
+	bool operator()(const Event& a, const Event& b) const
+	{
+	    return a.when > b.when || (a.when == b.when && a.sequence > b.sequence);
+	}
+    };
+
+    /// Cancels all receptions in progress at a node
+    void cancelReceptions(int node);
+
+    /// Drops a reference to a Transmission, deleting it when no longer needed
+    void release(Transmission* t);
+
+    /// Records an event, and compares it with the log if replaying
+    /// \param[in] line The event, formatted as a line of the log
+    void logEvent(const char* line);
+
+    /// Reads the next line of the log being replayed, skipping comments
+    /// \param[out] line Buffer for the line
+    /// \param[in] len Size of the buffer
+    /// \return true if a line was read, false if the log is exhausted
+    bool nextReplayLine(char* line, int len);
+
+    /// Reports the first difference between a replayed run and the log
+    /// \param[in] expected The line from the log, or NULL if the log is exhausted
+    /// \param[in] actual The event that actually happened
+    void replayDiverged(const char* expected, const char* actual);
+
+    /// All nodes, indexed by node index
+    std::vector<Node>   _nodes;
+
+    /// Indexes of removed nodes available for reuse
+    std::vector<int>    _freeNodes;
+
+    /// Scheduled deliveries
+    std::priority_queue<Event, std::vector<Event>, EventLater> _events;
+
+    /// Count of events scheduled so far
+    uint64_t            _sequence;
+
+    /// Probability of delivery indexed by [from][to]
+    float               _probability[256][256];
+
+    /// Adjacency table indexed by [from][to], used if _useLinks
+    bool                _linked[256][256];
+    bool                _useLinks;
+
+    /// Propagation model, indexed by node address
+    float               _x[256];
+    float               _y[256];
+    bool                _hasPosition[256];
+    float               _txPower[256];
+
+    /// Propagation model parameters
+    float               _pathLossExponent;
+    float               _referenceLoss;
+    float               _capture;
+    float               _sensitivity;
+
+    /// Simulated bit rate
+    uint32_t            _bps;
+
+    /// Where to capture transmitted frames, if anywhere
+    RHPcap*             _pcap;
+
+    /// State of the random number generator
+    unsigned short      _randState[3];
+
+    /// Log files for record() and replay()
+    FILE*               _recordFile;
+    FILE*               _replayFile;
+    uint64_t            _replayed;
+    bool                _diverged;
+
+    /// Statistics
+    uint64_t            _transmitted;
+    uint64_t            _delivered;
+    uint64_t            _dropped;
+    uint64_t            _collided;
+};
+
+#endif
+
+#endif
@@ -0,0 +1,170 @@
+// RHEtherSimulator.cpp
+//
+// Copyright (C) 2016 Mike McCauley
+
+#include <RadioHead.h>
+
+// This can only build on Linux and compatible systems
+#if (RH_PLATFORM == RH_PLATFORM_UNIX)
+
+#include <RHEtherSimulator.h>
+#include <RH_Ether.h>
+
+RHEtherSimulator* RHEtherSimulator::_running = NULL;
+
+RHEtherSimulator::RHEtherSimulator(uint32_t stackSize)
+    : _stackSize(stackSize),
+      _current(-1),
+      _now(0),
+      _seed(1)
+{
+    RHEther::setSeed(_seed);
+}
+
+RHEtherSimulator::~RHEtherSimulator()
+{
+    int i;
+    for (i = 0; i < (int)_tasks.size(); i++)
+    {
+	free(_tasks[i]->stack);
+	delete _tasks[i];
+    }
+}
+
+void RHEtherSimulator::setSeed(uint32_t seed)
+{
+    _seed = seed;
+    RHEther::setSeed(seed);
+}
+
+int RHEtherSimulator::addTask(TaskFunction setup, TaskFunction loop, void* arg)
+{
+    Task* t = new Task;
+    t->setup = setup;
+    t->loop = loop;
+    t->arg = arg;
+    t->until = _now; // Run as soon as possible
+    t->wakeOnPacket = false;
+    t->woken = false;
+    t->stack = (uint8_t*)malloc(_stackSize);
+    if (!t->stack || getcontext(&t->context) < 0)
+    {
+	fprintf(stderr, "RHEtherSimulator::addTask could not create task\n");
+	free(t->stack);
+	delete t;
+	return -1;
+    }
+    t->context.uc_stack.ss_sp = t->stack;
+    t->context.uc_stack.ss_size = _stackSize;
+    t->context.uc_link = NULL; // Tasks never return
+    makecontext(&t->context, taskMain, 0);
+    _tasks.push_back(t);
+    return _tasks.size() - 1;
+}
+
+void RHEtherSimulator::taskMain()
+{
+    Task* t = _running->_tasks[_running->_current];
+    if (t->setup)
+	t->setup(t->arg);
+    while (1)
+	t->loop(t->arg);
+}
+
+void RHEtherSimulator::taskDelay(unsigned long ms)
+{
+    _running->wait(_running->_now + (uint64_t)ms * 1000, false);
+}
+
+long RHEtherSimulator::taskRandom(long from, long to)
+{
+    return _running->randomNumber(from, to);
+}
+
+void RHEtherSimulator::run(uint64_t until)
+{
+    if (!_running)
+	srandom(_seed); // First run, make sketch random numbers repeatable
+    _running = this;
+    simulator_set_virtual_time(_now);
+    simulator_set_delay_handler(taskDelay);
+    simulator_set_random_handler(taskRandom);
+
+    while (1)
+    {
+	// Run every task due at this time, in order
+	bool ran = false;
+	int i;
+	for (i = 0; i < (int)_tasks.size(); i++)
+	{
+	    Task* t = _tasks[i];
+	    if (t->woken || t->until <= _now)
+	    {
+		t->woken = false;
+		_current = i;
+		simulator_set_virtual_time(_now);
+		swapcontext(&_schedulerContext, &t->context);
+		_current = -1;
+		ran = true;
+	    }
+	}
+	if (ran)
+	    continue; // Maybe some want to run again at the same time
+
+	// Everyone is waiting for the future, advance to the next delivery or wakeup time
+	uint64_t when = RH_ETHER_SIMULATOR_FOREVER;
+	nextEventTime(&when);
+	for (i = 0; i < (int)_tasks.size(); i++)
+	    if (_tasks[i]->until < when)
+		when = _tasks[i]->until;
+	if (when == RH_ETHER_SIMULATOR_FOREVER || when > until)
+	    break;
+	_now = when;
+	processEvents(_now);
+    }
+    if (until != RH_ETHER_SIMULATOR_FOREVER)
+	_now = until;
+    simulator_set_virtual_time(_now);
+    simulator_set_delay_handler(NULL);
+    simulator_set_random_handler(NULL);
+}
+
+void RHEtherSimulator::wait(uint64_t until, bool wakeOnPacket)
+{
+    if (_current < 0)
+	return; // Not called from a task
+    Task* t = _tasks[_current];
+    t->until = until;
+    t->wakeOnPacket = wakeOnPacket;
+    t->woken = false;
+    swapcontext(&t->context, &_schedulerContext);
+}
+
+int RHEtherSimulator::attach(RH_Ether* driver)
+{
+    int node = addNode();
+    if (node >= (int)_drivers.size())
+    {
+	_drivers.resize(node + 1, NULL);
+	_owners.resize(node + 1, -1);
+    }
+    _drivers[node] = driver;
+    _owners[node] = _current;
+    return node;
+}
+
+uint64_t RHEtherSimulator::send(int node, const uint8_t* frame, uint8_t len)
+{
+    transmit(node, frame, len, _now);
+    return _now + airtime(len);
+}
+
+void RHEtherSimulator::deliver(int node, const uint8_t* frame, uint8_t len)
+{
+    _drivers[node]->receive(frame, len);
+    int owner = _owners[node];
+    if (owner >= 0 && _tasks[owner]->wakeOnPacket)
+	_tasks[owner]->woken = true;
+}
+
+#endif
@@ -0,0 +1,186 @@
+// RHEtherSimulator.h
+// Author: Mike McCauley (mikem@airspayce.com)
+// Runs many simulated RadioHead nodes within a single process
+// Copyright (C) 2016 Mike McCauley
+
+#ifndef RHEtherSimulator_h
+#define RHEtherSimulator_h
+
+#include <RHEther.h>
+
+// This can only build on Linux and compatible systems
+#if (RH_PLATFORM == RH_PLATFORM_UNIX)
+
+#include <ucontext.h>
+
+// Default size of the stack for each simulated task, in bytes
+#define RH_ETHER_SIMULATOR_STACK_SIZE 65536
+
+// Wait time meaning wait forever
+#define RH_ETHER_SIMULATOR_FOREVER 0xffffffffffffffffULL
+
+class RH_Ether;
+
+/////////////////////////////////////////////////////////////////////
+/// \class RHEtherSimulator RHEtherSimulator.h <RHEtherSimulator.h>
+/// \brief Runs many simulated RadioHead nodes within a single process,
+/// connected by an in-memory simulated ether.
+///
+/// RHEtherSimulator lets a single simulator executable host hundreds of simulated nodes,
+/// each with its own RH_Ether driver and manager(s). Each node runs a pair of setup and loop functions,
+/// just like an Arduino sketch, as a task (a coroutine with its own stack).
+/// Packets are passed between RH_Ether drivers through in-memory queues, without any sockets or other processes,
+/// so large RHMesh networks can be simulated quickly.
+///
+/// The simulation runs in virtual time: millis(), delay() and all the RH_Ether wait functions
+/// use a simulated clock, which is advanced whenever all the tasks are waiting.
+/// Only one task runs at a time, and tasks due to run at the same time run in the order in which they were added,
+/// so simulations give the same results on every run. The sketch random number generator is seeded with
+/// the seed given to setSeed() (default 1) when run() starts, and while run() is running, the Arduino
+/// random(from, to) function used by the RadioHead managers draws from the ether random number generator,
+/// so it can be recorded and replayed (see RHEther::record()).
+///
+/// The ether model (link probabilities, transmission times and collisions) is provided by RHEther, so
+/// readConfig(), setProbability() and setBitsPerSecond() can be used to configure the simulated network.
+///
+/// Tasks must not spin waiting for millis() to change without calling delay() or one of the driver wait functions,
+/// since virtual time will not advance. An unsuccessful call to RH_Ether::available()
+/// takes RH_ETHER_POLL_INTERVAL microseconds of virtual time, so the usual polling loops are OK.
+///
+/// Caution: each task has a fixed size stack, allocated when the task is added.
+/// The default is RH_ETHER_SIMULATOR_STACK_SIZE octets.
+/// The RadioHead managers are safe to use from many tasks, but global or static variables in your own
+/// task functions are shared by all tasks.
+///
+/// Use tools/simBuild to build a simulator sketch which creates the
+/// RHEtherSimulator, adds the tasks and then calls run() from its setup() function.
+/// See the simulator_inprocess_mesh example.
+/// \code
+/// RHEtherSimulator ether;
+/// RH_Ether driver1(ether);
+/// RHMesh manager1(driver1, 1);
+/// ...
+/// void node1Setup(void* arg) { manager1.init(); }
+/// void node1Loop(void* arg) { ... }
+/// ...
+/// void setup()
+/// {
+///   ether.addTask(node1Setup, node1Loop);
+///   ...
+///   ether.run(60000000); // Run for 60 seconds of virtual time
+///   exit(0);
+/// }
+/// void loop() {}
+/// \endcode
+class RHEtherSimulator : public RHEther
+{
+public:
+    /// Type of the setup and loop functions of a task
+    typedef void (*TaskFunction)(void* arg);
+
+    /// Constructor
+    /// \param[in] stackSize Size of the stack to allocate for each task, in octets
+    RHEtherSimulator(uint32_t stackSize = RH_ETHER_SIMULATOR_STACK_SIZE);
+
+    /// Destructor. Frees all tasks
+    virtual ~RHEtherSimulator();
+
+    /// Adds a new task to the simulation. The task will first call setup(arg) and then call
+    /// loop(arg) repeatedly, the same as an Arduino sketch.
+    /// \param[in] setup Function called once when the task starts. May be NULL
+    /// \param[in] loop Function called repeatedly after setup
+    /// \param[in] arg Argument passed to setup and loop
+    /// \return The index of the new task, or -1 if it could not be created
+    int addTask(TaskFunction setup, TaskFunction loop, void* arg = NULL);
+
+    /// Runs all the tasks in virtual time, until virtual time reaches until,
+    /// or all tasks are waiting forever. May be called again to continue the simulation.
+    /// \param[in] until Virtual time to stop, in microseconds
+    void run(uint64_t until = RH_ETHER_SIMULATOR_FOREVER);
+
+    /// Returns the current virtual time
+    /// \return The virtual time in microseconds
+    uint64_t now() { return _now; }
+
+    /// Seeds the random number generators used by the ether, and by the tasks (random()).
+    /// \param[in] seed The new seed
+    void setSeed(uint32_t seed);
+
+    /// Connects a driver to the ether, as a new node belonging to the current task.
+    /// Called by RH_Ether::init().
+    /// \param[in] driver The driver to connect
+    /// \return The node index of the driver in the ether
+    int attach(RH_Ether* driver);
+
+    /// Transmits a frame from a node. Called by RH_Ether::send().
+    /// \param[in] node Index of the transmitting node, as returned by attach()
+    /// \param[in] frame The frame: TO, FROM, ID, FLAGS and payload
+    /// \param[in] len Length of the frame
+    /// \return The virtual time at which the transmission will be complete
+    uint64_t send(int node, const uint8_t* frame, uint8_t len);
+
+    /// Blocks the current task until a virtual time, or optionally until a frame is delivered
+    /// to any of its drivers. Called by RH_Ether wait functions, and by delay().
+    /// Does nothing if there is no current task.
+    /// \param[in] until Virtual time to wait until in microseconds
+    /// \param[in] wakeOnPacket If true, wake as soon as a frame is delivered to the task
+    void wait(uint64_t until, bool wakeOnPacket);
+
+protected:
+    /// Passes a frame delivered by RHEther to the receiving driver, and wakes its task if necessary
+    virtual void deliver(int node, const uint8_t* frame, uint8_t len);
+
+private:
+    /// \brief The state of one task
+    typedef struct
+    {
+	TaskFunction       setup;        ///< Called once at start
+	TaskFunction       loop;         ///< Called repeatedly
+	void*              arg;          ///< Argument to setup and loop
+	ucontext_t         context;      ///< Saved registers and stack
+	uint8_t*           stack;        ///< Stack allocated for the task
+	uint64_t           until;        ///< Virtual time to wake up
+	bool               wakeOnPacket; ///< Wake up early if a frame is delivered
+	bool               woken;        ///< A frame was delivered, wake now
+    } Task;
+
+    /// Entry point of all tasks
+    static void taskMain();
+
+    /// Handles delay() for the current task
+    static void taskDelay(unsigned long ms);
+
+    /// Random number handler installed while running. Draws from the ether random number generator
+    static long taskRandom(long from, long to);
+
+    /// The simulator running the current task, used by taskMain and taskDelay
+    static RHEtherSimulator* _running;
+
+    /// Size of each task stack
+    uint32_t                _stackSize;
+
+    /// All tasks in order of creation
+    std::vector<Task*>      _tasks;
+
+    /// Index of the task now running, or -1 if none
+    int                     _current;
+
+    /// Context of the scheduler in run()
+    ucontext_t              _schedulerContext;
+
+    /// Drivers indexed by ether node index
+    std::vector<RH_Ether*>  _drivers;
+
+    /// Task owning each driver, indexed by ether node index
+    std::vector<int>        _owners;
+
+    /// Virtual time in microseconds
+    uint64_t                _now;
+
+    /// Seed for random()
+    uint32_t                _seed;
+};
+
+#endif
+
+#endif
@@ -5,18 +5,65 @@
 
 #include <RHGenericDriver.h>
 
+#if (RH_PLATFORM == RH_PLATFORM_UNIX) || (RH_PLATFORM == RH_PLATFORM_RASPI)
+ #include <unistd.h>
+ #include <fcntl.h>
+ #include <errno.h>
+ #include <sys/select.h>
+#endif
+
 RHGenericDriver::RHGenericDriver()
     :
     _mode(RHModeInitialising),
     _thisAddress(RH_BROADCAST_ADDRESS),
+    _promiscuous(false),
+    _rxHeaderTo(RH_BROADCAST_ADDRESS),
+    _rxHeaderFrom(RH_BROADCAST_ADDRESS),
+    _rxHeaderId(0),
+    _rxHeaderFlags(0),
     _txHeaderTo(RH_BROADCAST_ADDRESS),
     _txHeaderFrom(RH_BROADCAST_ADDRESS),
     _txHeaderId(0),
     _txHeaderFlags(0),
+    _lastRssi(0),
+    _rxTimestamp(0),
+    _txTimestamp(0),
     _rxBad(0),
     _rxGood(0),
-    _txGood(0)
+    _txGood(0),
+    _rxCrcErrors(0),
+    _rxFiltered(0),
+    _rxOverruns(0),
+    _txTimeouts(0),
+    _rxUntracked(0),
+    _txCadTimeouts(0),
+    _cadTimeout(0),
+    _cadThreshold(RH_CAD_DEFAULT_THRESHOLD),
+    _cadBackoff(RH_CAD_DEFAULT_BACKOFF_SLOT),
+    _peerTable(NULL),
+    _peerTableSize(0),
+    _rxQueue(NULL),
+    _rxQueueFrameSize(0),
+    _rxQueueCapacity(0),
+    _rxQueueHead(0),
+    _rxQueueCount(0),
+    _rxQueueOverflows(0),
+    _rxQueueLeased(false),
+    _txQueue(NULL),
+    _txQueueFrameSize(0),
+    _txQueueCapacity(0),
+    _txQueueHead(0),
+    _txQueueCount(0),
+    _txDoneCallback(NULL),
+    _txQueueCurrentValid(false),
+    _txQueueSending(false),
+    _rxCallback(NULL),
+    _errorCallback(NULL)
 {
+#if (RH_PLATFORM == RH_PLATFORM_UNIX) || (RH_PLATFORM == RH_PLATFORM_RASPI)
+    _wakePipe[0] = _wakePipe[1] = -1;
+    _waitPollInterval = RH_WAIT_POLL_INTERVAL;
+#endif
 }
 
 bool RHGenericDriver::init()
@@ -28,7 +75,7 @@ bool RHGenericDriver::init()
 void RHGenericDriver::waitAvailable()
 {
     while (!available())
-	YIELD;
+	waitEvent(1000);
 }
 
 // Blocks until a valid message is received or timeout expires
@@ -43,7 +90,7 @@ bool RHGenericDriver::waitAvailableTimeout(uint16_t timeout)
 	{
            return true;
 	}
-	YIELD;
+	waitEvent(timeout - (millis() - starttime));
     }
     return false;
 }
@@ -51,7 +98,7 @@ bool RHGenericDriver::waitAvailableTimeout(uint16_t timeout)
 bool RHGenericDriver::waitPacketSent()
 {
     while (_mode == RHModeTx)
-	YIELD; // Wait for any previous transmit to finish
+	waitEvent(1000); // Wait for any previous transmit to finish
     return true;
 }
 
@@ -62,11 +109,63 @@ bool RHGenericDriver::waitPacketSent(uint16_t timeout)
     {
         if (_mode != RHModeTx) // Any previous transmit finished?
            return true;
-	YIELD;
+	waitEvent(timeout - (millis() - starttime));
     }
+    _txTimeouts++;
     return false;
 }
 
+uint32_t RHGenericDriver::timeOnAir(uint8_t /*len*/)
+{
+    return 0; // Unknown
+}
+
+bool RHGenericDriver::isChannelActive()
+{
+    return false; // Unknown
+}
+
+void RHGenericDriver::setCADTimeout(unsigned long cadTimeout)
+{
+    _cadTimeout = cadTimeout;
+}
+
+void RHGenericDriver::setCADThreshold(int8_t threshold)
+{
+    _cadThreshold = threshold;
+}
+
+void RHGenericDriver::setCADBackoff(uint16_t slot)
+{
+    _cadBackoff = slot;
+}
+
+bool RHGenericDriver::waitCAD()
+{
+    if (!_cadTimeout || _txQueueSending)
+	return true;
+
+    // Random binary exponential backoff while the channel is busy
+    unsigned long starttime = millis();
+    uint16_t slots = 2;
+    while (isChannelActive())
+    {
+	if (millis() - starttime > _cadTimeout)
+	{
+	    _txCadTimeouts++;
+	    return false;
+	}
+#if (RH_PLATFORM == RH_PLATFORM_RASPI) // use standard library random(), bugs in random(min, max)
+	delay(((random() % slots) + 1) * _cadBackoff);
+#else
+	delay(random(1, slots + 1) * _cadBackoff);
+#endif
+	if (slots < RH_CAD_MAX_BACKOFF_SLOTS)
+	    slots *= 2;
+    }
+    return true;
+}
+
 void RHGenericDriver::setPromiscuous(bool promiscuous)
 {
     _promiscuous = promiscuous;
@@ -98,31 +197,397 @@ void RHGenericDriver::setHeaderFlags(uint8_t set, uint8_t clear)
     _txHeaderFlags |= set;
 }
 
+// With a receive queue, the interrupt handler may overwrite _rxHeaderTo etc at any time, 
+// so return the headers of the message last returned by recv()
 uint8_t RHGenericDriver::headerTo()
 {
-    return _rxHeaderTo;
+    return _rxQueue ? _rxQueueLast.to : _rxHeaderTo;
 }
 
 uint8_t RHGenericDriver::headerFrom()
 {
-    return _rxHeaderFrom;
+    return _rxQueue ? _rxQueueLast.from : _rxHeaderFrom;
 }
 
 uint8_t RHGenericDriver::headerId()
 {
-    return _rxHeaderId;
+    return _rxQueue ? _rxQueueLast.id : _rxHeaderId;
 }
 
 uint8_t RHGenericDriver::headerFlags()
 {
-    return _rxHeaderFlags;
+    return _rxQueue ? _rxQueueLast.flags : _rxHeaderFlags;
 }
 
 int8_t RHGenericDriver::lastRssi()
 {
-    return _lastRssi;
+    return _rxQueue ? _rxQueueLast.rssi : _lastRssi;
 }
 
+uint32_t RHGenericDriver::rxTimestamp()
+{
+    uint32_t timestamp;
+    if (_rxQueue)
+	memcpy(&timestamp, _rxQueueLast.timestamp, sizeof(timestamp));
+    else
+    {
+	ATOMIC_BLOCK_START;
+	timestamp = _rxTimestamp;
+	ATOMIC_BLOCK_END;
+    }
+    return timestamp;
+}
+
+uint32_t RHGenericDriver::txTimestamp()
+{
+    uint32_t timestamp;
+    ATOMIC_BLOCK_START;
+    timestamp = _txTimestamp;
+    ATOMIC_BLOCK_END;
+    return timestamp;
+}
+
+bool RHGenericDriver::setRxQueue(uint8_t* buf, uint16_t len)
+{
+    uint16_t frameSize = RH_RX_QUEUE_FRAME_SIZE(maxMessageLength());
+    uint16_t capacity = buf ? len / frameSize : 0;
+    if (buf && capacity == 0)
+	return false; // Too small for even one message
+    if (capacity > 255)
+	capacity = 255;
+    ATOMIC_BLOCK_START;
+    _rxQueue = buf;
+    _rxQueueFrameSize = frameSize;
+    _rxQueueCapacity = capacity;
+    _rxQueueHead = 0;
+    _rxQueueCount = 0;
+    _rxQueueLeased = false;
+    ATOMIC_BLOCK_END;
+    memset(&_rxQueueLast, 0, sizeof(_rxQueueLast));
+    return true;
+}
+
+uint8_t RHGenericDriver::rxQueueCount()
+{
+    return _rxQueueCount;
+}
+
+uint32_t RHGenericDriver::rxQueueOverflows()
+{
+    uint32_t count;
+    ATOMIC_BLOCK_START;
+    count = _rxQueueOverflows;
+    ATOMIC_BLOCK_END;
+    return count;
+}
+
+// Called with interrupts disabled, or from the interrupt handler.
+// Only writes to the entry after the last one, which recv() does not touch
+bool RHGenericDriver::rxQueuePut(const uint8_t* payload, uint8_t len)
+{
+    if (_rxQueueCount >= _rxQueueCapacity)
+    {
+	_rxQueueOverflows++;
+	errorNotify(RHErrorRxQueueOverflow);
+	return false;
+    }
+    uint16_t index = _rxQueueHead + _rxQueueCount;
+    if (index >= _rxQueueCapacity)
+	index -= _rxQueueCapacity;
+    RxQueueHeader* h = (RxQueueHeader*)(_rxQueue + index * _rxQueueFrameSize);
+    if (len > _rxQueueFrameSize - sizeof(RxQueueHeader))
+	len = _rxQueueFrameSize - sizeof(RxQueueHeader);
+    h->len   = len;
+    h->to    = _rxHeaderTo;
+    h->from  = _rxHeaderFrom;
+    h->id    = _rxHeaderId;
+    h->flags = _rxHeaderFlags;
+    h->rssi  = _lastRssi;
+    uint32_t timestamp = _rxTimestamp;
+    memcpy(h->timestamp, &timestamp, sizeof(timestamp));
+    memcpy(h + 1, payload, len);
+    _rxQueueCount++;
+    rxNotify();
+    return true;
+}
+
+bool RHGenericDriver::rxQueueGet(uint8_t* buf, uint8_t* len)
+{
+    const uint8_t* data;
+    uint8_t        dataLen;
+    if (!rxQueueLease(&data, &dataLen))
+	return false;
+    if (buf && len)
+    {
+	if (*len > dataLen)
+	    *len = dataLen;
+	memcpy(buf, data, *len);
+    }
+    rxQueueRelease();
+    return true;
+}
+
+// The entry at the head can not be changed by the interrupt handler while _rxQueueCount
+// includes it, so only the removal needs to be atomic
+bool RHGenericDriver::rxQueueLease(const uint8_t** buf, uint8_t* len)
+{
+    if (!_rxQueueCount)
+	return false;
+    RxQueueHeader* h = (RxQueueHeader*)(_rxQueue + _rxQueueHead * _rxQueueFrameSize);
+    _rxQueueLast = *h;
+    *buf = (const uint8_t*)(h + 1);
+    *len = h->len;
+    _rxQueueLeased = true;
+    return true;
+}
+
+bool RHGenericDriver::rxQueueRelease()
+{
+    if (!_rxQueueLeased)
+	return false;
+    _rxQueueLeased = false;
+    ATOMIC_BLOCK_START;
+    if (++_rxQueueHead >= _rxQueueCapacity)
+	_rxQueueHead = 0;
+    _rxQueueCount--;
+    ATOMIC_BLOCK_END;
+    return true;
+}
+
+bool RHGenericDriver::lease(const uint8_t** buf, uint8_t* len)
+{
+    return available() && rxQueueLease(buf, len);
+}
+
+void RHGenericDriver::release()
+{
+    rxQueueRelease();
+}
+
+bool RHGenericDriver::setTxQueue(uint8_t* buf, uint16_t len)
+{
+    if (buf && !txQueueSupported())
+	return false;
+    uint16_t frameSize = RH_TX_QUEUE_FRAME_SIZE(maxMessageLength());
+    uint16_t capacity = buf ? len / frameSize : 0;
+    if (buf && capacity == 0)
+	return false; // Too small for even one message
+    if (capacity > 255)
+	capacity = 255;
+    ATOMIC_BLOCK_START;
+    _txQueue = buf;
+    _txQueueFrameSize = frameSize;
+    _txQueueCapacity = capacity;
+    _txQueueHead = 0;
+    _txQueueCount = 0;
+    ATOMIC_BLOCK_END;
+    return true;
+}
+
+uint8_t RHGenericDriver::txQueueCount()
+{
+    return _txQueueCount;
+}
+
+void RHGenericDriver::setTxDoneCallback(TxDoneCallback callback)
+{
+    _txDoneCallback = callback;
+}
+
+void RHGenericDriver::setRxCallback(RxCallback callback)
+{
+    _rxCallback = callback;
+}
+
+void RHGenericDriver::setErrorCallback(ErrorCallback callback)
+{
+    _errorCallback = callback;
+}
+
+// Only the application adds to the transmit queue, and only the interrupt handler takes messages 
+// out of it. The transmitter can only become busy when the application sends, so if it is idle 
+// and the queue is empty, it stays that way until we send.
+bool RHGenericDriver::sendQueued(const uint8_t* data, uint8_t len)
+{
+    if (_txQueue && (_mode == RHModeTx || _txQueueCount))
+    {
+	if (len > maxMessageLength())
+	    return false;
+	uint16_t index;
+	uint8_t  count;
+	ATOMIC_BLOCK_START;
+	index = _txQueueHead + _txQueueCount;
+	count = _txQueueCount;
+	ATOMIC_BLOCK_END;
+	if (count >= _txQueueCapacity)
+	    return false; // Full
+	if (index >= _txQueueCapacity)
+	    index -= _txQueueCapacity;
+	// The interrupt handler does not touch this entry until it is counted
+	TxQueueHeader* h = (TxQueueHeader*)(_txQueue + index * _txQueueFrameSize);
+	h->len   = len;
+	h->to    = _txHeaderTo;
+	h->from  = _txHeaderFrom;
+	h->id    = _txHeaderId;
+	h->flags = _txHeaderFlags;
+	memcpy(h + 1, data, len);
+	bool queued = false;
+	ATOMIC_BLOCK_START;
+	// The transmitter may have finished the last message while we were copying
+	if (_mode == RHModeTx || _txQueueCount)
+	{
+	    _txQueueCount++;
+	    queued = true;
+	}
+	ATOMIC_BLOCK_END;
+	if (queued)
+	    return true;
+    }
+    // Transmitter is idle, send it now
+    _txQueueCurrent.len   = len;
+    _txQueueCurrent.to    = _txHeaderTo;
+    _txQueueCurrent.from  = _txHeaderFrom;
+    _txQueueCurrent.id    = _txHeaderId;
+    _txQueueCurrent.flags = _txHeaderFlags;
+    _txQueueCurrentValid = true;
+    if (send(data, len))
+	return true;
+    _txQueueCurrentValid = false;
+    return false;
+}
+
+bool RHGenericDriver::sendSegments(const Segment* segments)
+{
+    uint16_t len = segmentsLength(segments);
+    if (len > maxMessageLength())
+	return false;
+    if (!segments->next)
+	return send(segments->data, len);
+    // Drivers that can not send from segments get a single buffer on the stack.
+    // All the microcontroller drivers override sendSegments(), so only the Linux
+    // drivers (RH_TCP, RH_Ether) get here, and they are not short of stack
+    uint8_t buf[255]; // maxMessageLength() is at most 255
+    uint8_t* p = buf;
+    for (; segments; segments = segments->next)
+    {
+	memcpy(p, segments->data, segments->len);
+	p += segments->len;
+    }
+    return send(buf, len);
+}
+
+uint16_t RHGenericDriver::segmentsLength(const Segment* segments)
+{
+    uint16_t len = 0;
+    for (; segments; segments = segments->next)
+	len += segments->len;
+    return len;
+}
+
+// Called from the interrupt handler when the transmitter has finished a message
+void RHGenericDriver::txQueueNext()
+{
+    TxQueueHeader sent = _txQueueCurrent;
+    bool sentValid = _txQueueCurrentValid;
+    _txQueueCurrentValid = false;
+    if (_txQueueCount)
+    {
+	// Send the next message with its own headers, leaving the application's headers alone
+	TxQueueHeader* h = (TxQueueHeader*)(_txQueue + _txQueueHead * _txQueueFrameSize);
+	uint8_t to    = _txHeaderTo;
+	uint8_t from  = _txHeaderFrom;
+	uint8_t id    = _txHeaderId;
+	uint8_t flags = _txHeaderFlags;
+	_txHeaderTo    = h->to;
+	_txHeaderFrom  = h->from;
+	_txHeaderId    = h->id;
+	_txHeaderFlags = h->flags;
+	_txQueueCurrent = *h;
+	_txQueueSending = true;
+	_txQueueCurrentValid = send((uint8_t*)(h + 1), h->len);
+	_txQueueSending = false;
+	_txHeaderTo    = to;
+	_txHeaderFrom  = from;
+	_txHeaderId    = id;
+	_txHeaderFlags = flags;
+	if (++_txQueueHead >= _txQueueCapacity)
+	    _txQueueHead = 0;
+	_txQueueCount--;
+    }
+    if (sentValid && _txDoneCallback)
+	_txDoneCallback(this, sent.to, sent.id);
+    wakeup();
+}
+
+#if (RH_PLATFORM == RH_PLATFORM_UNIX) || (RH_PLATFORM == RH_PLATFORM_RASPI)
+void RHGenericDriver::setWaitPollInterval(uint32_t interval)
+{
+    _waitPollInterval = interval;
+}
+
+int RHGenericDriver::waitFd()
+{
+    if (_wakePipe[0] < 0)
+    {
+	if (pipe(_wakePipe) < 0)
+	{
+	    fprintf(stderr, "RHGenericDriver::waitFd pipe failed: %s\n", strerror(errno));
+	    _wakePipe[0] = _wakePipe[1] = -1;
+	    return -1;
+	}
+	// wakeup() must never block in the interrupt handler, and clearWaitFd() must not block either
+	fcntl(_wakePipe[0], F_SETFL, fcntl(_wakePipe[0], F_GETFL) | O_NONBLOCK);
+	fcntl(_wakePipe[1], F_SETFL, fcntl(_wakePipe[1], F_GETFL) | O_NONBLOCK);
+    }
+    return _wakePipe[0];
+}
+
+void RHGenericDriver::clearWaitFd()
+{
+    uint8_t buf[64];
+    if (_wakePipe[0] >= 0)
+	while (read(_wakePipe[0], buf, sizeof(buf)) > 0)
+	    ;
+}
+
+// If the pipe is full, there is already a wakeup pending, so failed writes dont matter
+void RHGenericDriver::wakeup()
+{
+    if (_wakePipe[1] >= 0)
+    {
+	uint8_t c = 0;
+	if (write(_wakePipe[1], &c, 1) < 0)
+	{
+	    // Pipe full, already woken
+	}
+    }
+}
+
+void RHGenericDriver::waitEvent(unsigned long timeout)
+{
+    // The first time, create the pipe and return so the caller polls again: 
+    // a wakeup before the pipe existed would have been lost
+    if (_wakePipe[0] < 0)
+    {
+	if (waitFd() >= 0)
+	    return;
+	usleep(_waitPollInterval ? _waitPollInterval : 1000); // No pipe, fall back to polling
+	return;
+    }
+    uint64_t usecs = (uint64_t)timeout * 1000;
+    if (_waitPollInterval && usecs > _waitPollInterval)
+	usecs = _waitPollInterval;
+    struct timeval timer;
+    timer.tv_sec = usecs / 1000000;
+    timer.tv_usec = usecs % 1000000;
+    fd_set input;
+    FD_ZERO(&input);
+    FD_SET(_wakePipe[0], &input);
+    if (select(_wakePipe[0] + 1, &input, NULL, NULL, &timer) > 0)
+	clearWaitFd();
+}
+#endif
+
 RHGenericDriver::RHMode  RHGenericDriver::mode()
 {
     return _mode;
@@ -159,19 +624,134 @@ void RHGenericDriver::printBuffer(const char* prompt, const uint8_t* buf, uint8_
 #endif
 }
 
-uint16_t RHGenericDriver::rxBad()
+// 32 bit counters are not read atomically on 8 bit processors
+uint32_t RHGenericDriver::rxBad()
+{
+    uint32_t count;
+    ATOMIC_BLOCK_START;
+    count = _rxBad;
+    ATOMIC_BLOCK_END;
+    return count;
+}
+
+uint32_t RHGenericDriver::rxGood()
+{
+    uint32_t count;
+    ATOMIC_BLOCK_START;
+    count = _rxGood;
+    ATOMIC_BLOCK_END;
+    return count;
+}
+
+uint32_t RHGenericDriver::txGood()
+{
+    uint32_t count;
+    ATOMIC_BLOCK_START;
+    count = _txGood;
+    ATOMIC_BLOCK_END;
+    return count;
+}
+
+void RHGenericDriver::statistics(Statistics* stats)
+{
+    ATOMIC_BLOCK_START;
+    stats->rxBad            = _rxBad;
+    stats->rxGood           = _rxGood;
+    stats->txGood           = _txGood;
+    stats->rxCrcErrors      = _rxCrcErrors;
+    stats->rxFiltered       = _rxFiltered;
+    stats->rxOverruns       = _rxOverruns;
+    stats->rxQueueOverflows = _rxQueueOverflows;
+    stats->txTimeouts       = _txTimeouts;
+    stats->rxUntracked      = _rxUntracked;
+    stats->txCadTimeouts    = _txCadTimeouts;
+    ATOMIC_BLOCK_END;
+}
+
+void RHGenericDriver::clearStatistics()
 {
-    return _rxBad;
+    ATOMIC_BLOCK_START;
+    _rxBad = _rxGood = _txGood = 0;
+    _rxCrcErrors = _rxFiltered = _rxOverruns = 0;
+    _rxQueueOverflows = _txTimeouts = _rxUntracked = 0;
+    _txCadTimeouts = 0;
+    uint8_t i;
+    for (i = 0; i < _peerTableSize; i++)
+	_peerTable[i].valid = false;
+    ATOMIC_BLOCK_END;
 }
 
-uint16_t RHGenericDriver::rxGood()
+void RHGenericDriver::setPeerTable(PeerStatistics* table, uint8_t size)
 {
-    return _rxGood;
+    ATOMIC_BLOCK_START;
+    _peerTable = table;
+    _peerTableSize = table ? size : 0;
+    uint8_t i;
+    for (i = 0; i < _peerTableSize; i++)
+	_peerTable[i].valid = false;
+    ATOMIC_BLOCK_END;
 }
 
-uint16_t RHGenericDriver::txGood()
+bool RHGenericDriver::peerStatistics(uint8_t address, PeerStatistics* stats)
 {
-    return _txGood;
+    bool found = false;
+    ATOMIC_BLOCK_START;
+    uint8_t i;
+    for (i = 0; i < _peerTableSize; i++)
+    {
+	if (_peerTable[i].valid && _peerTable[i].address == address)
+	{
+	    *stats = _peerTable[i];
+	    found = true;
+	    break;
+	}
+    }
+    ATOMIC_BLOCK_END;
+    return found;
+}
+
+// Called from the interrupt handler
+void RHGenericDriver::countRxGood()
+{
+    _rxGood++;
+    RH_TRACE_EVENT(RHTrace::RHTraceRxGood, ((uint16_t)_rxHeaderFrom << 8) | _rxHeaderId);
+    if (!_peerTable)
+	return;
+    PeerStatistics* p = NULL;
+    uint8_t i;
+    for (i = 0; i < _peerTableSize; i++)
+    {
+	if (!_peerTable[i].valid)
+	{
+	    if (!p)
+		p = &_peerTable[i]; // First free entry, in case this is a new node
+	}
+	else if (_peerTable[i].address == _rxHeaderFrom)
+	{
+	    p = &_peerTable[i];
+	    break;
+	}
+    }
+    if (!p)
+    {
+	_rxUntracked++; // Table is full
+	return;
+    }
+    if (!p->valid)
+    {
+	p->address = _rxHeaderFrom;
+	p->valid = true;
+	p->minRssi = p->maxRssi = _lastRssi;
+	p->rssiSum = 0;
+	p->rxGood = 0;
+    }
+    p->lastRssi = _lastRssi;
+    if (_lastRssi < p->minRssi)
+	p->minRssi = _lastRssi;
+    if (_lastRssi > p->maxRssi)
+	p->maxRssi = _lastRssi;
+    p->rssiSum += _lastRssi;
+    p->rxGood++;
 }
 
 #if (RH_PLATFORM == RH_PLATFORM_ARDUINO) && defined(RH_PLATFORM_ATTINY)
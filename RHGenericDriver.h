@@ -7,6 +7,7 @@
 #define RHGenericDriver_h
 
 #include <RadioHead.h>
+#include <RHTrace.h>
 
 // Defines bits of the FLAGS header reserved for use by the RadioHead library and 
 // the flags available for use by applications
@@ -14,6 +15,28 @@
 #define RH_FLAGS_APPLICATION_SPECIFIC     0x0f
 #define RH_FLAGS_NONE                     0
 
+// Octets of receive queue memory needed for each message of up to maxlen octets. See RHGenericDriver::setRxQueue()
+#define RH_RX_QUEUE_FRAME_SIZE(maxlen) (sizeof(RHGenericDriver::RxQueueHeader) + (maxlen))
+
+// Octets of transmit queue memory needed for each message of up to maxlen octets. See RHGenericDriver::setTxQueue()
+#define RH_TX_QUEUE_FRAME_SIZE(maxlen) (sizeof(RHGenericDriver::TxQueueHeader) + (maxlen))
+
+// On Linux and compatible systems, the default maximum time in microseconds that the wait functions sleep 
+// between polls of the driver. See RHGenericDriver::setWaitPollInterval()
+#define RH_WAIT_POLL_INTERVAL 500
+
+// Default RSSI in dBm above which drivers that detect channel activity by RSSI consider the channel busy. 
+// See RHGenericDriver::setCADThreshold()
+#define RH_CAD_DEFAULT_THRESHOLD -90
+
+// Default backoff slot time in milliseconds when the channel is busy. See RHGenericDriver::setCADBackoff()
+#define RH_CAD_DEFAULT_BACKOFF_SLOT 10
+
+// Maximum number of slots in the random backoff when the channel is busy
+#ifndef RH_CAD_MAX_BACKOFF_SLOTS
+#define RH_CAD_MAX_BACKOFF_SLOTS 32
+#endif
+
 /////////////////////////////////////////////////////////////////////
 /// \class RHGenericDriver RHGenericDriver.h <RHGenericDriver.h>
 /// \brief Abstract base class for a RadioHead driver.
@@ -35,6 +58,171 @@
 /// -ID A message ID, distinct (over short time scales) for each message sent by a particilar node
 /// -FLAGS A bitmask of flags. The most significant 4 bits are reserved for use by RadioHead. The least
 /// significant 4 bits are reserved for applications.
+///
+/// \par Receive Queue
+///
+/// Most drivers have a single receive buffer, and stop receiving once it holds a good message, until
+/// the message is collected with recv(). Messages that arrive while the application is busy are lost.
+/// Drivers that support it (RH_RF95, RH_RF22, RH_RF69, RH_CC110, RH_MRF89 and RH_NRF24) can instead queue
+/// received messages, and go straight back to receiving. The queue is optional, and its messages are
+/// stored in memory provided by the application, RH_RX_QUEUE_FRAME_SIZE() octets (the message plus 10 octets
+/// of headers) for each one. The queue is not free when not used: its state takes about 22 octets of RAM in
+/// every driver, and most of its code (several hundred octets of program memory) is linked into every
+/// program that uses a driver that supports it, because the driver calls it when a message arrives:
+/// \code
+/// uint8_t queue[4 * RH_RX_QUEUE_FRAME_SIZE(RH_RF95_MAX_MESSAGE_LEN)];
+/// ...
+/// driver.init();
+/// driver.setRxQueue(queue, sizeof(queue)); // Up to 4 messages
+/// \endcode
+/// recv() returns the queued messages in the order they arrived, and headerTo(), headerFrom(), headerId(),
+/// headerFlags() and lastRssi() return the headers and RSSI of the message most recently returned by recv().
+/// Messages that arrive when the queue is full are dropped, and counted by rxQueueOverflows().
+///
+/// \par Receiving Without Copying
+///
+/// recv() copies each message into your buffer. Alternatively, lease() gives you a read-only pointer to the 
+/// message where it lies in the driver (or in the receive queue), and the driver keeps it there until you call 
+/// release():
+/// \code
+/// const uint8_t* data;
+/// uint8_t len;
+/// if (driver.lease(&data, &len))
+/// {
+///     // Use data[0] to data[len-1], and headerFrom() etc
+///     driver.release();
+/// }
+/// \endcode
+/// While you hold a lease, do not call send(), recv() or lease() on the driver: some drivers (such as RH_RF22)
+/// share their receive and transmit buffers, and the others receive nothing more until you release it.
+/// All drivers can lease messages from the receive queue, but some can not lease from their own buffers. 
+/// They return false from lease() although a message is available, so use recv() if lease() returns
+/// false but available() is true. RHDatagram,
+/// RHReliableDatagram, RHRouter and RHMesh have leasing versions of their receive functions, so a message
+/// can be delivered to your program without being copied on its way up through the layers.
+///
+/// \par Transmit Queue
+///
+/// send() waits for any previous message to be completely transmitted before starting the next one,
+/// so a program that sends several messages in a row spends most of its time waiting for the radio.
+/// Drivers that have a 'packet sent' interrupt (RH_RF95, RH_RF22, RH_RF69 and RH_MRF89) can instead queue
+/// messages with sendQueued(), which returns immediately. The interrupt handler starts
+/// the next queued message as soon as the previous one has been sent, and can tell the application
+/// with a callback. Like the receive queue, the transmit queue is optional and stores its messages in memory
+/// provided by the application, RH_TX_QUEUE_FRAME_SIZE() octets (the message plus 5 octets of headers) for each
+/// one. It is not free when not used either: its state takes about 16 octets of RAM in every driver, and
+/// the interrupt handlers of the drivers that support it always link in the code that starts the next message:
+/// \code
+/// uint8_t txqueue[4 * RH_TX_QUEUE_FRAME_SIZE(RH_RF95_MAX_MESSAGE_LEN)];
+/// ...
+/// void sent(RHGenericDriver* driver, uint8_t to, uint8_t id)
+/// {
+///     // Called from the interrupt handler: keep it short
+/// }
+/// ...
+/// driver.init();
+/// driver.setTxQueue(txqueue, sizeof(txqueue)); // Up to 4 messages waiting, plus 1 being transmitted
+/// driver.setTxDoneCallback(sent);
+/// ...
+/// driver.setHeaderId(id++);
+/// if (!driver.sendQueued(data, sizeof(data)))
+///     ; // Queue full: try again later
+/// \endcode
+/// Each message is sent with the headers that were set when sendQueued() was called.
+/// Your program can poll txQueueCount() to see how many messages are still waiting, or mode() to see
+/// whether the transmitter is still busy. waitPacketSent() waits until all queued messages have been sent, and
+/// send() waits for the queue to empty before sending its message.
+///
+/// \par Event Callbacks
+///
+/// Instead of polling available() in a loop, your program can ask the driver to call a function when
+/// something happens: setRxCallback() when a good message has been received, setErrorCallback() when
+/// a bad message was received or a good one was dropped, and setTxDoneCallback() when a message sent with
+/// sendQueued() has been transmitted. The callbacks are called by drivers that have interrupts for these
+/// events (RH_RF95, RH_RF22, RH_RF69, RH_CC110 and RH_MRF89, although RH_CC110 has no TX done interrupt).
+/// They are called from the interrupt handler, so they should be short: typically they set a flag or
+/// wake a task, and the main program calls recv() when it sees the flag, then goes back to sleep.
+/// Callbacks must not send, sleep or wait for anything.
+/// \code
+/// volatile bool received = false;
+/// void rx(RHGenericDriver* driver)
+/// {
+///     received = true;
+/// }
+/// ...
+/// driver.setRxCallback(rx);
+/// driver.available(); // Start the receiver
+/// ...
+/// if (received)
+/// {
+///     received = false;
+///     while (driver.recv(buf, &len))
+///         ...
+///     driver.available(); // Make sure the receiver is on again
+/// }
+/// \endcode
+/// Without a receive queue, the driver stops receiving after each good message until recv() and 
+/// available() are called. With a receive queue it keeps receiving.
+///
+/// \par Waiting on Linux
+///
+/// On microcontrollers, waitAvailable(), waitAvailableTimeout() and waitPacketSent() spin, calling YIELD.
+/// On Linux and compatible systems (RH_PLATFORM_UNIX and RH_PLATFORM_RASPI) they sleep instead, so a gateway
+/// uses almost no CPU while it waits. Each driver has a pipe that its interrupt handler writes to whenever it 
+/// calls the callbacks above, which wakes any wait immediately. Since the
+/// hardware of many drivers is polled (such as RH_NRF24 on Raspberry Pi), the waits also wake every
+/// RH_WAIT_POLL_INTERVAL microseconds to poll the driver. If all the events of your driver are delivered
+/// by its interrupt handler, you can call setWaitPollInterval(0) to sleep until woken. Programs with their 
+/// own select() or poll() loop can include waitFd() in it.
+///
+/// \par Statistics
+///
+/// Drivers count good and bad messages, CRC errors, messages addressed to other nodes, FIFO overruns
+/// and transmit timeouts in 32 bit counters. statistics() copies them all at once.
+/// To find weak links, give the driver a table with an entry for each node you expect to hear from:
+/// \code
+/// RHGenericDriver::PeerStatistics peers[10];
+/// driver.setPeerTable(peers, 10);
+/// ...
+/// RHGenericDriver::PeerStatistics p;
+/// if (driver.peerStatistics(3, &p))
+///     Serial.println(p.rssiSum / (int32_t)p.rxGood); // Average RSSI from node 3
+/// \endcode
+/// RHReliableDatagram also counts retransmissions and keeps a histogram of ACK latencies.
+///
+/// \par Listen Before Talk
+///
+/// By default, send() transmits at once, even if another node is already transmitting, and both
+/// messages are lost. If you call setCADTimeout(), send() first checks the channel with isChannelActive(),
+/// and while it is busy, waits for a random backoff before checking again (carrier sense multiple access). 
+/// The backoff window starts at 2 slots and doubles each time the channel is found busy, up to
+/// RH_CAD_MAX_BACKOFF_SLOTS slots. If the channel is still busy after the CAD timeout, send() returns false.
+/// RH_RF95 uses LoRa Channel Activity Detection. RH_RF22, RH_RF69 and RH_CC110 compare the RSSI with a 
+/// threshold (see setCADThreshold()). RH_Ether asks the simulated ether. Other drivers never report 
+/// activity. Messages sent from the transmit queue follow the previous message at once, without checking.
+/// \code
+/// driver.init();
+/// driver.setCADTimeout(10000); // Wait up to 10 seconds for a clear channel
+/// \endcode
+///
+/// \par Timestamps
+///
+/// Drivers stamp each message with the time of the radio event that ends it, in microseconds from micros():
+/// the packet received interrupt for received messages (rxTimestamp()), and the packet sent interrupt for 
+/// transmitted messages (txTimestamp()). The time is taken as soon as the interrupt handler is entered, 
+/// before any SPI traffic. Since both are taken at the end of the frame, the rxTimestamp() of a message and 
+/// the txTimestamp() of the same message at its sender differ only by the fixed delays of the radios, which makes 
+/// them suitable for latency measurement, time synchronisation and slotted protocols. Subtract timeOnAir() to 
+/// find when a message started. Drivers without interrupts (RH_NRF24, RH_NRF905, RH_NRF51, RH_Serial and RH_TCP, 
+/// and RH_CC110 for transmitted messages) stamp messages when they notice them, so their timestamps are only as 
+/// precise as your polling. RH_Ether uses the virtual time of the simulated ether.
+/// \code
+/// manager.sendtoWait(data, sizeof(data), SERVER_ADDRESS);
+/// uint32_t sent = driver.txTimestamp();
+/// ...
+/// if (manager.recvfromAck(buf, &len, &from))
+///     Serial.println(driver.rxTimestamp() - sent); // Round trip time in microseconds
+/// \endcode
 class RHGenericDriver
 {
 public:
@@ -48,9 +236,97 @@ public:
 	RHModeSleep,            ///< Transport hardware is in low power sleep mode (if supported)
 	RHModeIdle,             ///< Transport is idle.
 	RHModeTx,               ///< Transport is in the process of transmitting a message.
-	RHModeRx                ///< Transport is in the process of receiving a message.
+	RHModeRx,               ///< Transport is in the process of receiving a message.
+	RHModeCad               ///< Transport is in the process of detecting channel activity (if supported)
     } RHMode;
 
+    /// \brief Headers and RSSI of a message in the receive queue, followed by the message itself.
+    /// See setRxQueue()
+    typedef struct
+    {
+	uint8_t         len;    ///< Length of the message
+	uint8_t         to;     ///< TO header
+	uint8_t         from;   ///< FROM header
+	uint8_t         id;     ///< ID header
+	uint8_t         flags;  ///< FLAGS header
+	int8_t          rssi;   ///< RSSI of the message
+	uint8_t         timestamp[4]; ///< rxTimestamp() of the message. Octets, because the queue may not be aligned
+    } RxQueueHeader;
+
+    /// \brief Headers of a message in the transmit queue, followed by the message itself.
+    /// See setTxQueue()
+    typedef struct
+    {
+	uint8_t         len;    ///< Length of the message
+	uint8_t         to;     ///< TO header
+	uint8_t         from;   ///< FROM header
+	uint8_t         id;     ///< ID header
+	uint8_t         flags;  ///< FLAGS header
+    } TxQueueHeader;
+
+    /// \brief One segment of a message sent with sendSegments()
+    /// A message is a list of segments, which are sent one after the other as if they had been
+    /// copied into a single buffer. This lets each layer of a protocol add its own header
+    /// in front of the message without copying the message.
+    typedef struct Segment
+    {
+	const uint8_t*        data;   ///< The octets in this segment
+	uint8_t               len;    ///< Number of octets in this segment
+	const struct Segment* next;   ///< The next segment, or NULL if this is the last
+    } Segment;
+
+    /// \brief Snapshot of the counters of a driver. See statistics()
+    typedef struct
+    {
+	uint32_t        rxBad;            ///< Bad messages received (bad CRC, length etc). See rxBad()
+	uint32_t        rxGood;           ///< Good messages received for this node. See rxGood()
+	uint32_t        txGood;           ///< Messages transmitted. See txGood()
+	uint32_t        rxCrcErrors;      ///< Messages received with a bad CRC or FCS, also counted in rxBad
+	uint32_t        rxFiltered;       ///< Good messages discarded because they were addressed to another node
+	uint32_t        rxOverruns;       ///< Messages lost because a receive FIFO or buffer overflowed
+	uint32_t        rxQueueOverflows; ///< Good messages dropped because the receive queue was full
+	uint32_t        txTimeouts;       ///< Number of times waitPacketSent(timeout) timed out
+	uint32_t        rxUntracked;      ///< Good messages from nodes that did not fit in the peer table
+	uint32_t        txCadTimeouts;    ///< Messages not sent because the channel stayed busy. See setCADTimeout()
+    } Statistics;
+
+    /// \brief Counters for messages received from one node. See setPeerTable()
+    typedef struct
+    {
+	uint8_t         address;    ///< The FROM address of the node
+	bool            valid;      ///< Whether this entry is in use
+	int8_t          lastRssi;   ///< RSSI of the most recent message
+	int8_t          minRssi;    ///< Lowest RSSI seen
+	int8_t          maxRssi;    ///< Highest RSSI seen
+	int32_t         rssiSum;    ///< Sum of the RSSI of all messages. Divide by rxGood for the average
+	uint32_t        rxGood;     ///< Good messages received from the node
+    } PeerStatistics;
+
+    /// \brief Type of function called when a message sent with sendQueued() has been transmitted.
+    /// It is called from the interrupt handler, so it must be short and must not send or receive.
+    /// \param[in] driver The driver that sent the message
+    /// \param[in] to The TO header of the message
+    /// \param[in] id The ID header of the message
+    typedef void (*TxDoneCallback)(RHGenericDriver* driver, uint8_t to, uint8_t id);
+
+    /// \brief Type of function called when a good message has been received and can be collected
+    /// with recv(). It is called from the interrupt handler. See setRxCallback()
+    /// \param[in] driver The driver that received the message
+    typedef void (*RxCallback)(RHGenericDriver* driver);
+
+    /// \brief Errors reported to an ErrorCallback
+    typedef enum
+    {
+	RHErrorRxBad = 0,       ///< A bad message was received (bad CRC, length etc). See rxBad()
+	RHErrorRxQueueOverflow  ///< A good message was dropped because the receive queue was full
+    } RHError;
+
+    /// \brief Type of function called when an error occurs.
+    /// It is called from the interrupt handler. See setErrorCallback()
+    /// \param[in] driver The driver that had the error
+    /// \param[in] error The error
+    typedef void (*ErrorCallback)(RHGenericDriver* driver, RHError error);
+
     /// Constructor
     RHGenericDriver();
 
@@ -79,6 +355,20 @@ public:
     /// \return true if a valid message was copied to buf
     virtual bool recv(uint8_t* buf, uint8_t* len) = 0;
 
+    /// Like recv(), but instead of copying the message, returns a read-only pointer to it inside the driver.
+    /// The message remains valid, and the driver does not receive another, until release() is called.
+    /// Do not send while holding a lease. See the class description.
+    /// The default implementation only supports leases from the receive queue.
+    /// \param[out] buf Set to the address of the message
+    /// \param[out] len Set to the length of the message
+    /// \return true if a message was leased. false if there is no message, or if the driver can not lease 
+    /// this message, in which case recv() will return it.
+    virtual bool lease(const uint8_t** buf, uint8_t* len);
+
+    /// Releases the message leased by lease(), which can then be overwritten.
+    /// Only call this after a successful lease().
+    virtual void release();
+
     /// Waits until any previous transmit packet is finished being transmitted with waitPacketSent().
     /// Then loads a message into the transmitter and starts the transmitter. Note that a message length
     /// of 0 is NOT permitted. If the message is too long for the underlying radio technology, send() will
@@ -88,11 +378,43 @@ public:
     /// \return true if the message length was valid and it was correctly queued for transmit
     virtual bool send(const uint8_t* data, uint8_t len) = 0;
 
+    /// Like send(), but the message is made of a list of segments. See Segment.
+    /// Drivers write the segments straight into their transmit FIFO or transmit buffer. The default
+    /// implementation, used only by drivers that do not override this (RH_TCP and RH_Ether on Linux), copies
+    /// them into a 255 octet buffer on the stack and calls send().
+    /// \param[in] segments The first segment of the message
+    /// \return true if the message length was valid and it was correctly queued for transmit
+    virtual bool sendSegments(const Segment* segments);
+
+    /// Returns the total length of a list of segments
+    /// \param[in] segments The first segment
+    /// \return The sum of the lengths of all the segments
+    static uint16_t segmentsLength(const Segment* segments);
+
+    /// Sends a message without waiting for any previous message to be transmitted.
+    /// If the transmitter is idle, the message is sent immediately with send(). Otherwise it is copied
+    /// to the transmit queue, along with the current headers, and will be sent by the interrupt handler
+    /// when the transmitter becomes free. If the transmit queue is not enabled, this is the same as send().
+    /// See the class description.
+    /// \param[in] data Array of data to be sent
+    /// \param[in] len Number of bytes of data to send (> 0)
+    /// \return true if the message was sent or queued, false if it was too long or the queue was full
+    bool          sendQueued(const uint8_t* data, uint8_t len);
+
     /// Returns the maximum message length 
     /// available in this Driver.
     /// \return The maximum legal message length
     virtual uint8_t maxMessageLength() = 0;
 
+    /// Returns the time the transmitter will occupy the channel when sending a message
+    /// of the given length with the current modem configuration, including preamble, sync words, 
+    /// RadioHead headers and CRC. Useful for sizing retry timers, duty cycle budgets and transmit schedules.
+    /// The base class does not know the modem configuration, and returns 0. Drivers that can
+    /// calculate it override this.
+    /// \param[in] len Length of the message payload, not including the RadioHead headers
+    /// \return The time on air in microseconds, or 0 if unknown
+    virtual uint32_t timeOnAir(uint8_t len);
+
     /// Starts the receiver and blocks until a valid received 
     /// message is available.
     virtual void            waitAvailable();
@@ -168,9 +490,82 @@ public:
     /// Returns the most recent RSSI (Receiver Signal Strength Indicator).
     /// Usually it is the RSSI of the last received message, which is measured when the preamble is received.
     /// If you called readRssi() more recently, it will return that more recent value.
+    /// If the receive queue is enabled, it is the RSSI of the message most recently returned by recv().
     /// \return The most recent RSSI measurement in dBm.
     int8_t        lastRssi();
 
+    /// Returns the time when the last message received ended. 
+    /// If the receive queue is enabled, it is the time of the message most recently returned by recv().
+    /// See the class description.
+    /// \return The time in microseconds, in the timebase of micros()
+    uint32_t      rxTimestamp();
+
+    /// Returns the time when the last message sent finished transmitting. See the class description.
+    /// \return The time in microseconds, in the timebase of micros()
+    uint32_t      txTimestamp();
+
+    /// Enables the receive queue, if supported by the driver. See the class description.
+    /// Call after init().
+    /// \param[in] buf Memory for the queue. Each message needs RH_RX_QUEUE_FRAME_SIZE(maxMessageLength())
+    /// octets. The memory must remain valid while the queue is in use. NULL disables the queue.
+    /// \param[in] len Length of buf in octets
+    /// \return true if buf is big enough for at least 1 message (or NULL)
+    bool          setRxQueue(uint8_t* buf, uint16_t len);
+
+    /// Returns the number of messages waiting in the receive queue
+    /// \return The number of messages in the queue
+    uint8_t       rxQueueCount();
+
+    /// Returns the number of good messages dropped because the receive queue was full
+    /// \return The number of messages dropped
+    uint32_t      rxQueueOverflows();
+
+    /// Enables the transmit queue, if supported by the driver. See the class description.
+    /// Call after init(). Any messages in the queue are discarded.
+    /// \param[in] buf Memory for the queue. Each message needs RH_TX_QUEUE_FRAME_SIZE(maxMessageLength())
+    /// octets. The memory must remain valid while the queue is in use. NULL disables the queue.
+    /// \param[in] len Length of buf in octets
+    /// \return true if the driver supports a transmit queue and buf is big enough for
+    /// at least 1 message (or NULL)
+    bool          setTxQueue(uint8_t* buf, uint16_t len);
+
+    /// Returns the number of messages in the transmit queue waiting for the transmitter. 
+    /// Does not include any message currently being transmitted.
+    /// \return The number of messages in the queue
+    uint8_t       txQueueCount();
+
+    /// Sets a function to be called each time a message sent with sendQueued() has been transmitted.
+    /// \param[in] callback The function to call, from the interrupt handler. NULL for none
+    void          setTxDoneCallback(TxDoneCallback callback);
+
+    /// Sets a function to be called each time a good message for this node has been received, and is 
+    /// available to recv(). See the class description.
+    /// \param[in] callback The function to call, from the interrupt handler. NULL for none
+    void          setRxCallback(RxCallback callback);
+
+    /// Sets a function to be called each time a bad message is received, or a good message is lost.
+    /// See the class description.
+    /// \param[in] callback The function to call, from the interrupt handler. NULL for none
+    void          setErrorCallback(ErrorCallback callback);
+
+#if (RH_PLATFORM == RH_PLATFORM_UNIX) || (RH_PLATFORM == RH_PLATFORM_RASPI)
+    /// Sets the maximum time the wait functions sleep between polls of the driver. See the class description.
+    /// Only available on Linux and compatible systems.
+    /// \param[in] interval Maximum sleep in microseconds. 0 means sleep until woken by the interrupt handler.
+    /// Defaults to RH_WAIT_POLL_INTERVAL
+    void          setWaitPollInterval(uint32_t interval);
+
+    /// Returns a file descriptor that becomes readable when the interrupt handler of the driver
+    /// has received a message, had an error or finished transmitting. After it becomes readable, 
+    /// call available() etc as usual, then clearWaitFd().
+    /// Only available on Linux and compatible systems.
+    /// \return the file descriptor, or -1 if it could not be created
+    int           waitFd();
+
+    /// Clears any pending wakeups from waitFd(). 
+    void          clearWaitFd();
+#endif
+
     /// Returns the operating mode of the library.
     /// \return the current mode, one of RF69_MODE_*
     RHMode          mode();
@@ -186,6 +581,27 @@ public:
     ///         was successfully entered. If sleep mode is not suported, return false.
     virtual bool    sleep();
 
+    /// Tells whether another node is transmitting on the channel. Used by send() for listen before talk
+    /// if setCADTimeout() has been called. The base class can not tell, and returns false.
+    /// Drivers that can detect channel activity override this.
+    /// \return true if the channel is busy
+    virtual bool    isChannelActive();
+
+    /// Enables listen before talk in send(). See the class description.
+    /// \param[in] cadTimeout Maximum time in milliseconds that send() waits for a clear channel. 
+    /// 0 (the default) disables listen before talk.
+    void            setCADTimeout(unsigned long cadTimeout);
+
+    /// Sets the RSSI threshold used by drivers that detect channel activity by RSSI (RH_RF22, RH_RF69 and 
+    /// RH_CC110). Defaults to RH_CAD_DEFAULT_THRESHOLD. Set it a few dB above the noise floor at your site.
+    /// \param[in] threshold RSSI in dBm above which the channel is busy
+    void            setCADThreshold(int8_t threshold);
+
+    /// Sets the backoff slot time used when the channel is busy. A good choice is about the time on air
+    /// of a short message. Defaults to RH_CAD_DEFAULT_BACKOFF_SLOT.
+    /// \param[in] slot Slot time in milliseconds
+    void            setCADBackoff(uint16_t slot);
+
     /// Prints a data buffer in HEX.
     /// For diagnostic use
     /// \param[in] prompt string to preface the print
@@ -198,17 +614,38 @@ public:
     /// Caution: not all drivers can correctly report this count. Some underlying hardware only report
     /// good packets.
     /// \return The number of bad packets received.
-    uint16_t       rxBad();
+    uint32_t       rxBad();
 
     /// Returns the count of the number of 
     /// good received packets
     /// \return The number of good packets received.
-    uint16_t       rxGood();
+    uint32_t       rxGood();
 
     /// Returns the count of the number of 
     /// packets successfully transmitted (though not necessarily received by the destination)
     /// \return The number of packets successfully transmitted
-    uint16_t       txGood();
+    uint32_t       txGood();
+
+    /// Copies all the counters of the driver at once, with interrupts disabled so they are consistent.
+    /// Not all drivers can report all the counters: those that a driver can not detect remain 0.
+    /// \param[out] stats The counters are copied here
+    void           statistics(Statistics* stats);
+
+    /// Sets all the counters, including those in the peer table, to 0
+    void           clearStatistics();
+
+    /// Enables counting of the good messages received from each node, along with their RSSI.
+    /// The table is searched by the interrupt handler for each message, so keep it small.
+    /// Messages from nodes that arrive after the table is full are counted in Statistics::rxUntracked.
+    /// \param[in] table Array of entries, which must remain valid while in use. NULL disables the table.
+    /// \param[in] size Number of entries in table
+    void           setPeerTable(PeerStatistics* table, uint8_t size);
+
+    /// Copies the counters for one node from the peer table.
+    /// \param[in] address The FROM address of the node
+    /// \param[out] stats The counters are copied here
+    /// \return true if the node is in the peer table
+    bool           peerStatistics(uint8_t address, PeerStatistics* stats);
 
 protected:
 
@@ -248,15 +685,190 @@ protected:
     /// The value of the last received RSSI value, in some transport specific units
     volatile int8_t     _lastRssi;
 
+    /// micros() at the end of the last message received
+    volatile uint32_t   _rxTimestamp;
+
+    /// micros() at the end of the last message transmitted
+    volatile uint32_t   _txTimestamp;
+
     /// Count of the number of bad messages (eg bad checksum etc) received
-    volatile uint16_t   _rxBad;
+    volatile uint32_t   _rxBad;
 
-    /// Count of the number of successfully transmitted messaged
-    volatile uint16_t   _rxGood;
+    /// Count of the number of good messages received
+    volatile uint32_t   _rxGood;
+
+    /// Count of the number of successfully transmitted messages
+    volatile uint32_t   _txGood;
+
+    /// Count of the number of messages received with a bad CRC or FCS
+    volatile uint32_t   _rxCrcErrors;
+
+    /// Count of the number of good messages addressed to other nodes
+    volatile uint32_t   _rxFiltered;
+
+    /// Count of the number of messages lost to receive FIFO or buffer overflows
+    volatile uint32_t   _rxOverruns;
+
+    /// Count of the number of times waitPacketSent(timeout) timed out
+    volatile uint32_t   _txTimeouts;
+
+    /// Count of the number of good messages from nodes not in the peer table
+    volatile uint32_t   _rxUntracked;
+
+    /// Count of the number of messages not sent because the channel stayed busy
+    volatile uint32_t   _txCadTimeouts;
+
+    /// Maximum time in milliseconds to wait for a clear channel, 0 to not check. See setCADTimeout()
+    unsigned long       _cadTimeout;
+
+    /// RSSI threshold in dBm for drivers that detect channel activity by RSSI
+    int8_t              _cadThreshold;
+
+    /// Backoff slot time in milliseconds
+    uint16_t            _cadBackoff;
+
+    /// Called by drivers from send() before transmitting. If listen before talk is enabled, waits 
+    /// with random backoff until isChannelActive() returns false, or the CAD timeout.
+    /// \return true if the channel is clear, false if it stayed busy until the timeout
+    bool                waitCAD();
+
+    /// The peer table, or NULL. See setPeerTable()
+    PeerStatistics*     _peerTable;
+
+    /// Number of entries in _peerTable
+    uint8_t             _peerTableSize;
+
+    /// Called by drivers instead of _rxGood++ when a good message for this node has been received,
+    /// with its headers in _rxHeaderTo etc and its RSSI in _lastRssi. Counts it, and
+    /// updates the peer table if enabled
+    void                countRxGood();
+
+    /// Tells whether the receive queue is enabled. 
+    /// \return true if received messages are to be queued with rxQueuePut()
+    bool                rxQueueEnabled() { return _rxQueue != NULL; }
+
+    /// Called by drivers, usually from their interrupt handler, to add a good received message to
+    /// the receive queue, with the headers in _rxHeaderTo etc and the RSSI in _lastRssi.
+    /// \param[in] payload The message, without headers
+    /// \param[in] len Length of the message
+    /// \return true if the message was queued, false if the queue was full
+    bool                rxQueuePut(const uint8_t* payload, uint8_t len);
+
+    /// Called by drivers from recv() to remove the oldest message from the receive queue.
+    /// \param[in] buf Location to copy the message. May be NULL
+    /// \param[in,out] len Available space in buf. Set to the actual number of octets copied. May be NULL
+    /// \return true if a message was removed from the queue, false if it was empty or not enabled
+    bool                rxQueueGet(uint8_t* buf, uint8_t* len);
+
+    /// Called by drivers from lease() to lease the oldest message in the receive queue
+    /// \param[out] buf Set to the address of the message
+    /// \param[out] len Set to the length of the message
+    /// \return true if a message was leased, false if the queue was empty or not enabled
+    bool                rxQueueLease(const uint8_t** buf, uint8_t* len);
+
+    /// Called by drivers from release() to remove a leased message from the receive queue
+    /// \return true if a message leased by rxQueueLease() was removed, false if there was none
+    bool                rxQueueRelease();
+
+    /// Memory for the receive queue, or NULL if not enabled
+    uint8_t*            _rxQueue;
+
+    /// Size of each entry in the receive queue in octets
+    uint16_t            _rxQueueFrameSize;
+
+    /// Number of entries in the receive queue
+    uint8_t             _rxQueueCapacity;
+
+    /// Index of the oldest message in the receive queue
+    uint8_t             _rxQueueHead;
+
+    /// Number of messages in the receive queue
+    volatile uint8_t    _rxQueueCount;
+
+    /// Number of messages dropped because the receive queue was full
+    volatile uint32_t   _rxQueueOverflows;
+
+    /// Headers and RSSI of the message most recently removed from the receive queue
+    RxQueueHeader       _rxQueueLast;
+
+    /// Whether the oldest message in the receive queue is leased
+    bool                _rxQueueLeased;
+
+    /// Tells whether this driver can start the next queued message from its interrupt handler.
+    /// Drivers that call txQueueNext() override this to return true.
+    /// \return true if setTxQueue() is supported
+    virtual bool        txQueueSupported() { return false; }
+
+    /// Called by drivers from their interrupt handler when a message has been transmitted and the
+    /// transmitter is idle. Starts transmitting the next message in the transmit queue (if any), and
+    /// calls the TxDoneCallback for the message just sent.
+    void                txQueueNext();
+
+    /// Memory for the transmit queue, or NULL if not enabled
+    uint8_t*            _txQueue;
+
+    /// Size of each entry in the transmit queue in octets
+    uint16_t            _txQueueFrameSize;
+
+    /// Number of entries in the transmit queue
+    uint8_t             _txQueueCapacity;
+
+    /// Index of the oldest message in the transmit queue
+    volatile uint8_t    _txQueueHead;
+
+    /// Number of messages in the transmit queue
+    volatile uint8_t    _txQueueCount;
+
+    /// Function to call when a message sent with sendQueued() has been transmitted
+    TxDoneCallback      _txDoneCallback;
+
+    /// Headers of the message being transmitted, if sent with sendQueued()
+    TxQueueHeader       _txQueueCurrent;
+
+    /// Whether _txQueueCurrent describes the message being transmitted
+    volatile bool       _txQueueCurrentValid;
+
+    /// True while txQueueNext() is sending from the interrupt handler, when waitCAD() must not wait
+    volatile bool       _txQueueSending;
+
+    /// Called by drivers from their interrupt handler when a good message is available to recv().
+    /// Calls the RxCallback, if any. rxQueuePut() calls this for queued messages.
+    void                rxNotify() { if (_rxCallback) _rxCallback(this); wakeup(); }
+
+    /// Called by drivers from their interrupt handler when an error occurs.
+    /// Calls the ErrorCallback, if any
+    /// \param[in] error The error that occurred
+    void                errorNotify(RHError error) { RH_TRACE_EVENT(RHTrace::RHTraceError, error); if (_errorCallback) _errorCallback(this, error); wakeup(); }
+
+    /// Called instead of YIELD in the wait functions. On Linux and compatible systems, sleeps until woken 
+    /// by wakeup(), the wait poll interval, or the timeout, whichever is first.
+    /// Elsewhere it is the same as YIELD
+    /// \param[in] timeout Maximum time to sleep in milliseconds
+#if (RH_PLATFORM == RH_PLATFORM_UNIX) || (RH_PLATFORM == RH_PLATFORM_RASPI)
+    void                waitEvent(unsigned long timeout);
+#else
+    void                waitEvent(unsigned long /*timeout*/) { YIELD; }
+#endif
+
+    /// Wakes any wait in progress. Called from the interrupt handler by rxNotify() etc.
+#if (RH_PLATFORM == RH_PLATFORM_UNIX) || (RH_PLATFORM == RH_PLATFORM_RASPI)
+    void                wakeup();
+
+    /// Pipe written to by wakeup(), or -1 until it is needed
+    int                 _wakePipe[2];
+
+    /// Maximum sleep in the wait functions in microseconds
+    uint32_t            _waitPollInterval;
+#else
+    void                wakeup() {}
+#endif
+
+    /// Function to call when a good message has been received
+    RxCallback          _rxCallback;
+
+    /// Function to call when an error occurs
+    ErrorCallback       _errorCallback;
 
-    /// Count of the number of bad messages (correct checksum etc) received
-    volatile uint16_t   _txGood;
-    
 private:
 
 };
@@ -0,0 +1,356 @@
+// RHLowPowerListen.cpp
+//
+// Copyright (C) 2016 Mike McCauley
+
+#include <RHLowPowerListen.h>
+
+RHLowPowerListen::RHLowPowerListen(RHGenericDriver& driver, uint16_t interval)
+    :
+    _driver(driver)
+{
+    setInterval(interval);
+    _listenTime = RH_LPL_DEFAULT_LISTEN_TIME;
+    _holdTime = RH_LPL_DEFAULT_HOLD_TIME;
+    _nextListen = 0;
+    _awakeUntil = 0;
+    _quietUntil = 0;
+    _sleepTime = 0;
+    _strobeTrains = 0;
+    memset(_peerAddress, RH_BROADCAST_ADDRESS, sizeof(_peerAddress));
+    memset(_peerUntil, 0, sizeof(_peerUntil));
+    _lastFrom = RH_BROADCAST_ADDRESS;
+    _lastId = 0;
+    _lastFlags = 0;
+    _lastUntil = 0;
+    _rxBufValid = false;
+    _rxBufLen = 0;
+}
+
+bool RHLowPowerListen::init()
+{
+    uint32_t now = millis();
+    _nextListen = now;
+    _awakeUntil = now + _holdTime;
+    _quietUntil = now;
+    _lastUntil = now;
+    memset(_peerUntil, 0, sizeof(_peerUntil));
+    _rxBufValid = false;
+    bool ret = _driver.init();
+    sync();
+    return ret;
+}
+
+bool RHLowPowerListen::available()
+{
+    while (!_rxBufValid && _driver.available())
+    {
+	uint8_t len = sizeof(_rxBuf);
+	if (!_driver.recv(_rxBuf, &len) || len < RH_LPL_HEADER_LEN)
+	    continue;
+	// It may have waited in a receive queue, so time it from when it was received
+	uint32_t now = millis() - (micros() - _driver.rxTimestamp()) / 1000;
+	uint16_t header = _rxBuf[0] | ((uint16_t)_rxBuf[1] << 8);
+	uint32_t trainEnd = now + (header & ~RH_LPL_ALWAYS_AWAKE);
+	uint8_t from = _driver.headerFrom();
+	uint8_t id = _driver.headerId();
+	uint8_t flags = _driver.headerFlags();
+
+	// The sender can not hear anything until the end of its train, then stays awake for the reply
+	if ((int32_t)(trainEnd - _quietUntil) > 0)
+	    _quietUntil = trainEnd;
+	holdUntil(trainEnd + _holdTime);
+	noteAwake(from, header & RH_LPL_ALWAYS_AWAKE ? now + RH_LPL_ALWAYS_AWAKE_TIME : trainEnd + _holdTime / 2);
+
+	if (   from == _lastFrom
+	    && id == _lastId
+	    && flags == _lastFlags
+	    && (int32_t)(now - _lastUntil) <= 0)
+	    continue; // Another copy from the same strobe train
+	_lastFrom = from;
+	_lastId = id;
+	_lastFlags = flags;
+	_lastUntil = trainEnd;
+
+	_rxHeaderTo = _driver.headerTo();
+	_rxHeaderFrom = from;
+	_rxHeaderId = id;
+	_rxHeaderFlags = flags;
+	_rxTimestamp = _driver.rxTimestamp();
+	_lastRssi = _driver.lastRssi();
+	_rxBufLen = len;
+	_rxBufValid = true;
+    }
+    sync();
+    return _rxBufValid;
+}
+
+bool RHLowPowerListen::recv(uint8_t* buf, uint8_t* len)
+{
+    if (!available())
+	return false;
+    if (buf && len)
+    {
+	if (*len > _rxBufLen - RH_LPL_HEADER_LEN)
+	    *len = _rxBufLen - RH_LPL_HEADER_LEN;
+	memcpy(buf, _rxBuf + RH_LPL_HEADER_LEN, *len);
+    }
+    _rxBufValid = false;
+    return true;
+}
+
+bool RHLowPowerListen::lease(const uint8_t** buf, uint8_t* len)
+{
+    if (!available())
+	return false;
+    *buf = _rxBuf + RH_LPL_HEADER_LEN;
+    *len = _rxBufLen - RH_LPL_HEADER_LEN;
+    return true;
+}
+
+void RHLowPowerListen::release()
+{
+    _rxBufValid = false;
+}
+
+bool RHLowPowerListen::send(const uint8_t* data, uint8_t len)
+{
+    Segment segment = { data, len, NULL };
+    return sendSegments(&segment);
+}
+
+bool RHLowPowerListen::sendSegments(const Segment* segments)
+{
+    uint16_t len = segmentsLength(segments);
+    if (len > maxMessageLength())
+	return false;
+    // The sender of a strobe train we heard can not hear us until it ends
+    int32_t quiet = _quietUntil - millis();
+    if (quiet > 0)
+	delay(quiet);
+
+    // Long enough for every sleeping node to listen during it, and hear a whole copy
+    bool train = _interval && (_txHeaderTo == RH_BROADCAST_ADDRESS || !isAwake(_txHeaderTo));
+    uint32_t airtime = (_driver.timeOnAir(len + RH_LPL_HEADER_LEN) + 999) / 1000;
+    uint32_t length = train ? (uint32_t)_interval + _listenTime + airtime : 0;
+
+    uint8_t header[RH_LPL_HEADER_LEN];
+    Segment first = { header, sizeof(header), segments };
+    unsigned long start = millis();
+    uint32_t elapsed;
+    do
+    {
+	// No copy starts after the end of the train, so from the end of this copy, the rest of
+	// the train takes no longer than this
+	elapsed = millis() - start;
+	uint16_t remaining = length > elapsed ? length - elapsed : 0;
+	if (!_interval)
+	    remaining |= RH_LPL_ALWAYS_AWAKE;
+	header[0] = remaining;
+	header[1] = remaining >> 8;
+	if (!_driver.sendSegments(&first))
+	{
+	    sync();
+	    return false;
+	}
+	if (train)
+	    _driver.waitPacketSent();
+    } while (train && millis() - start < length);
+    if (train)
+	_strobeTrains++;
+
+    // Stay awake for the reply
+    holdUntil(millis() + airtime + _holdTime);
+    sync();
+    return true;
+}
+
+uint8_t RHLowPowerListen::maxMessageLength()
+{
+    uint8_t max = _driver.maxMessageLength();
+#if RH_LPL_MAX_MESSAGE_LEN < 255
+    // _rxBuf has been made shorter than the longest message any driver can send
+    if (max > RH_LPL_MAX_MESSAGE_LEN)
+	max = RH_LPL_MAX_MESSAGE_LEN;
+#endif
+    return max - RH_LPL_HEADER_LEN;
+}
+
+uint32_t RHLowPowerListen::timeOnAir(uint8_t len)
+{
+    return _driver.timeOnAir(len + RH_LPL_HEADER_LEN);
+}
+
+void RHLowPowerListen::waitAvailable()
+{
+    while (!waitAvailableTimeout(0xffff))
+	;
+}
+
+bool RHLowPowerListen::waitPacketSent()
+{
+    bool ret = _driver.waitPacketSent();
+    sync();
+    return ret;
+}
+
+bool RHLowPowerListen::waitPacketSent(uint16_t timeout)
+{
+    bool ret = _driver.waitPacketSent(timeout);
+    sync();
+    return ret;
+}
+
+bool RHLowPowerListen::waitAvailableTimeout(uint16_t timeout)
+{
+    unsigned long starttime = millis();
+    int32_t timeLeft;
+    while ((timeLeft = timeout - (millis() - starttime)) > 0)
+    {
+	if (available())
+	    return true;
+	uint32_t now = millis();
+	int32_t awake = _awakeUntil - now;
+	int32_t asleep = _nextListen - now;
+	if (_interval == 0 || awake > 0)
+	    _driver.waitAvailableTimeout(_interval == 0 || timeLeft < awake ? timeLeft : awake);
+	else if (asleep > 0)
+	    sleepFor(timeLeft < asleep ? timeLeft : asleep);
+	else
+	{
+	    _nextListen = now + _interval;
+	    if (listen())
+	    {
+		// Someone is transmitting: stay awake long enough to hear a whole copy of the longest message
+		uint32_t catchTime = (2 * timeOnAir(maxMessageLength()) + 999) / 1000 + 1;
+		holdUntil(millis() + (catchTime > 1 ? catchTime : _listenTime));
+	    }
+	}
+    }
+    return available();
+}
+
+void RHLowPowerListen::setThisAddress(uint8_t thisAddress)
+{
+    RHGenericDriver::setThisAddress(thisAddress);
+    _driver.setThisAddress(thisAddress);
+}
+
+// The TO header is kept here as well, to decide whether a strobe train is needed
+void RHLowPowerListen::setHeaderTo(uint8_t to)
+{
+    RHGenericDriver::setHeaderTo(to);
+    _driver.setHeaderTo(to);
+}
+
+void RHLowPowerListen::setHeaderFrom(uint8_t from)
+{
+    RHGenericDriver::setHeaderFrom(from);
+    _driver.setHeaderFrom(from);
+}
+
+void RHLowPowerListen::setHeaderId(uint8_t id)
+{
+    RHGenericDriver::setHeaderId(id);
+    _driver.setHeaderId(id);
+}
+
+void RHLowPowerListen::setHeaderFlags(uint8_t set, uint8_t clear)
+{
+    RHGenericDriver::setHeaderFlags(set, clear);
+    _driver.setHeaderFlags(set, clear);
+}
+
+void RHLowPowerListen::setPromiscuous(bool promiscuous)
+{
+    RHGenericDriver::setPromiscuous(promiscuous);
+    _driver.setPromiscuous(promiscuous);
+}
+
+bool RHLowPowerListen::sleep()
+{
+    bool ret = _driver.sleep();
+    sync();
+    return ret;
+}
+
+bool RHLowPowerListen::isChannelActive()
+{
+    bool ret = _driver.isChannelActive();
+    sync();
+    return ret;
+}
+
+void RHLowPowerListen::setInterval(uint16_t interval)
+{
+    _interval = interval > 30000 ? 30000 : interval;
+}
+
+void RHLowPowerListen::setListenTime(uint16_t listenTime)
+{
+    _listenTime = listenTime;
+}
+
+void RHLowPowerListen::setHoldTime(uint16_t holdTime)
+{
+    _holdTime = holdTime;
+}
+
+bool RHLowPowerListen::listen()
+{
+    unsigned long start = millis();
+    do
+    {
+	if (_driver.isChannelActive() || _driver.waitAvailableTimeout(1))
+	    return true;
+    } while (millis() - start < _listenTime);
+    return false;
+}
+
+void RHLowPowerListen::sleepFor(uint32_t ms)
+{
+    // Drivers that can not sleep stay in receive mode
+    if (_driver.sleep())
+	_sleepTime += ms;
+    sync();
+    delay(ms);
+}
+
+void RHLowPowerListen::noteAwake(uint8_t address, uint32_t until)
+{
+    // Replace the entry for this node, or else the one that expires first
+    uint8_t i, replace = 0;
+    for (i = 0; i < RH_LPL_MAX_PEERS; i++)
+    {
+	if (_peerAddress[i] == address)
+	{
+	    replace = i;
+	    break;
+	}
+	if ((int32_t)(_peerUntil[i] - _peerUntil[replace]) < 0)
+	    replace = i;
+    }
+    if (_peerAddress[replace] == address && (int32_t)(until - _peerUntil[replace]) < 0)
+	return; // Already known to be awake for longer
+    _peerAddress[replace] = address;
+    _peerUntil[replace] = until;
+}
+
+bool RHLowPowerListen::isAwake(uint8_t address)
+{
+    for (uint8_t i = 0; i < RH_LPL_MAX_PEERS; i++)
+	if (_peerAddress[i] == address)
+	    return (int32_t)(_peerUntil[i] - millis()) > 0;
+    return false;
+}
+
+void RHLowPowerListen::holdUntil(uint32_t until)
+{
+    if ((int32_t)(until - _awakeUntil) > 0)
+	_awakeUntil = until;
+}
+
+void RHLowPowerListen::sync()
+{
+    _mode = _driver.mode();
+    _txTimestamp = _driver.txTimestamp();
+}
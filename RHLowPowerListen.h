@@ -0,0 +1,300 @@
+// RHLowPowerListen.h
+// Author: Mike McCauley (mikem@airspayce.com)
+// Duty cycled low power listening for any RadioHead driver
+// Copyright (C) 2016 Mike McCauley
+
+#ifndef RHLowPowerListen_h
+#define RHLowPowerListen_h
+
+#include <RHGenericDriver.h>
+
+// Octets added before every message: the time in milliseconds until the end of its strobe train,
+// and the RH_LPL_ALWAYS_AWAKE bit
+#define RH_LPL_HEADER_LEN 2
+
+// Bit in the header of messages from nodes that never sleep (interval 0), such as gateways
+#define RH_LPL_ALWAYS_AWAKE 0x8000
+
+// How long in milliseconds a node that never sleeps is remembered to be awake, after the last message from it
+#ifndef RH_LPL_ALWAYS_AWAKE_TIME
+#define RH_LPL_ALWAYS_AWAKE_TIME 600000
+#endif
+
+// Default time in milliseconds between the times a sleeping node listens
+#define RH_LPL_DEFAULT_INTERVAL 1000
+
+// Default time in milliseconds a node listens for each time it wakes up
+#define RH_LPL_DEFAULT_LISTEN_TIME 10
+
+// Default time in milliseconds a node stays awake after sending or receiving, for the reply
+#ifndef RH_LPL_DEFAULT_HOLD_TIME
+#define RH_LPL_DEFAULT_HOLD_TIME 250
+#endif
+
+// Number of other nodes remembered to be awake, so messages to them need no strobe train.
+// Each costs 5 octets of RAM
+#ifndef RH_LPL_MAX_PEERS
+#define RH_LPL_MAX_PEERS 4
+#endif
+
+// Longest message that can be received, including the RH_LPL_HEADER_LEN octets. This many octets of RAM are used.
+// At most 255. Make it smaller to save RAM with drivers that have shorter messages
+#ifndef RH_LPL_MAX_MESSAGE_LEN
+#define RH_LPL_MAX_MESSAGE_LEN 255
+#endif
+
+/////////////////////////////////////////////////////////////////////
+/// \class RHLowPowerListen RHLowPowerListen.h <RHLowPowerListen.h>
+/// \brief Driver wrapper that keeps the radio asleep most of the time, but still able to receive messages.
+///
+/// A node that has to be reachable (such as a node in an RHMesh network) normally keeps its radio in
+/// receive mode all the time, which uses far more current than anything else on a battery powered node.
+/// RHLowPowerListen wraps any other driver, and puts the radio to sleep with sleep(), waking it up
+/// to listen for a short time (see setListenTime()) once every interval (see setInterval()). So the
+/// receiver is on for only about listen time / interval of the time: 1% by default.
+///
+/// To make sure sleeping nodes hear it, a message is sent as a strobe train: the same message over and over
+/// again, for one interval plus the listen time, so that every node in range wakes up during it.
+/// Each copy carries the time until the end of the train. A node that hears one copy discards the other
+/// copies, and waits until the end of the train before replying, since the sender can not hear anything
+/// until then.
+///
+/// After sending or receiving a message, a node stays awake for the hold time (see setHoldTime()), so replies
+/// (such as the ACKs of RHReliableDatagram, and the route replies of RHMesh) can be sent to it as one
+/// ordinary message, without a strobe train. RHLowPowerListen remembers the RH_LPL_MAX_PEERS nodes it has
+/// heard from most recently, and sends messages to them without a strobe train while they are still awake.
+/// Broadcasts always use a strobe train.
+///
+/// A node with an interval of 0 never sleeps, which suits gateways and other nodes with mains power.
+/// Other nodes learn that from any message it sends, and send it ordinary messages, without strobe trains.
+///
+/// The radio sleeps only within the wait functions of RHLowPowerListen, such as waitAvailableTimeout()
+/// (which recvfromAckTimeout() etc. use), so wait for messages with them, rather than by polling available().
+/// delay() is used while the radio sleeps, so the processor does not sleep, unless your delay() does so.
+///
+/// If the wrapped driver can tell when the channel is busy (see RHGenericDriver::isChannelActive()),
+/// a listen time of a few milliseconds is enough: if the channel is busy, the node stays awake until it has
+/// received a whole copy. Otherwise, the listen time must be long enough to receive 2 copies of the
+/// longest message.
+///
+/// All nodes must use the same interval and hold time. RHLowPowerListen adds RH_LPL_HEADER_LEN octets to
+/// each message, so nodes using it can not talk to nodes that do not.
+///
+/// Some radios can do all this in hardware (such as the wake up timer of the RF22, Wake On Radio
+/// of the CC110 and Listen mode of the RF69), which also lets the processor sleep. RHLowPowerListen
+/// works with any of them, and with radios without such features.
+/// \code
+/// RH_RF95 rf95;
+/// RHLowPowerListen driver(rf95, 2000); // Listen every 2 seconds
+/// RHMesh manager(driver, NODE_ADDRESS);
+/// ...
+/// manager.init();
+/// while (1)
+///     if (manager.recvfromAckTimeout(buf, &len, 10000, &from))
+///         ...
+/// \endcode
+/// Configure the wrapped driver (frequency, power, modem configuration etc) directly, but send and receive
+/// through the RHLowPowerListen. The counters in statistics() etc are those of the wrapped driver, which counts
+/// every copy in a strobe train.
+class RHLowPowerListen : public RHGenericDriver
+{
+public:
+    /// Constructor
+    /// \param[in] driver The driver to send and receive with
+    /// \param[in] interval Time in milliseconds between the times the radio listens
+    RHLowPowerListen(RHGenericDriver& driver, uint16_t interval = RH_LPL_DEFAULT_INTERVAL);
+
+    /// Initialises the wrapped driver. The node stays awake for the hold time
+    /// \return true if initialisation succeeded.
+    virtual bool init();
+
+    /// Tests whether a new message is available from the wrapped driver. Duplicate copies from strobe trains
+    /// are discarded. Puts the radio in receive mode, if the wrapped driver does so.
+    /// \return true if a new, complete, error-free uncollected message is available to be retreived by recv().
+    virtual bool available();
+
+    /// Receives a message. See RHGenericDriver::recv()
+    /// \param[in] buf Location to copy the received message
+    /// \param[in,out] len Pointer to available space in buf. Set to the actual number of octets copied.
+    /// \return true if a valid message was copied to buf
+    virtual bool recv(uint8_t* buf, uint8_t* len);
+
+    /// Leases a message. See RHGenericDriver::lease()
+    /// \param[out] buf Set to the address of the message
+    /// \param[out] len Set to the length of the message
+    /// \return true if a message was leased
+    virtual bool lease(const uint8_t** buf, uint8_t* len);
+
+    /// Releases the message leased by lease()
+    virtual void release();
+
+    /// Sends a message, as a strobe train unless the addressee is known to be awake.
+    /// Waits first for the end of any strobe train being received. Returns after the last copy has started.
+    /// \param[in] data Array of data to be sent
+    /// \param[in] len Number of bytes of data to send (> 0)
+    /// \return true if the message was sent
+    virtual bool send(const uint8_t* data, uint8_t len);
+
+    /// Like send(), but the message is made of a list of segments. See RHGenericDriver::sendSegments()
+    /// \param[in] segments The first segment of the message
+    /// \return true if the message was sent
+    virtual bool sendSegments(const Segment* segments);
+
+    /// Returns the maximum message length: RH_LPL_HEADER_LEN less than the wrapped driver
+    /// \return The maximum legal message length
+    virtual uint8_t maxMessageLength();
+
+    /// Returns the time on air of a single copy of a message
+    /// \param[in] len Length of the message payload, not including the RadioHead headers
+    /// \return The time on air in microseconds, or 0 if unknown
+    virtual uint32_t timeOnAir(uint8_t len);
+
+    /// Waits for a message, with the radio asleep except when listening or holding
+    virtual void waitAvailable();
+
+    /// Waits for the wrapped driver to finish transmitting
+    /// \return true
+    virtual bool waitPacketSent();
+
+    /// Waits for the wrapped driver to finish transmitting, or a timeout
+    /// \param[in] timeout Maximum time to wait in milliseconds.
+    /// \return true if the transmission completed within the timeout period. False if it timed out.
+    virtual bool waitPacketSent(uint16_t timeout);
+
+    /// Waits for a message, or a timeout, with the radio asleep except when listening or holding
+    /// \param[in] timeout Maximum time to wait in milliseconds.
+    /// \return true if a message is available
+    virtual bool waitAvailableTimeout(uint16_t timeout);
+
+    /// Sets the address of this node in the wrapped driver
+    /// \param[in] thisAddress The address of this node.
+    virtual void setThisAddress(uint8_t thisAddress);
+
+    /// Sets the TO header in the wrapped driver
+    /// \param[in] to The new TO header value
+    virtual void setHeaderTo(uint8_t to);
+
+    /// Sets the FROM header in the wrapped driver
+    /// \param[in] from The new FROM header value
+    virtual void setHeaderFrom(uint8_t from);
+
+    /// Sets the ID header in the wrapped driver
+    /// \param[in] id The new ID header value
+    virtual void setHeaderId(uint8_t id);
+
+    /// Sets and clears bits in the FLAGS header in the wrapped driver
+    /// \param[in] set bitmask of bits to be set.
+    /// \param[in] clear bitmask of flags to clear.
+    virtual void setHeaderFlags(uint8_t set, uint8_t clear = RH_FLAGS_APPLICATION_SPECIFIC);
+
+    /// Sets promiscuous mode in the wrapped driver
+    /// \param[in] promiscuous true if you wish to receive messages with any TO address
+    virtual void setPromiscuous(bool promiscuous);
+
+    /// Puts the wrapped driver to sleep
+    /// \return true if sleep mode was successfully entered.
+    virtual bool sleep();
+
+    /// Tells whether the wrapped driver can hear another node transmitting
+    /// \return true if the channel is busy
+    virtual bool isChannelActive();
+
+    /// Sets the time between the times the radio listens. Strobe trains last this long, plus the listen time.
+    /// \param[in] interval Interval in milliseconds, up to 30000. 0 keeps the radio awake all the time.
+    void setInterval(uint16_t interval);
+
+    /// Sets how long the radio listens each time it wakes up. Defaults to RH_LPL_DEFAULT_LISTEN_TIME.
+    /// \param[in] listenTime Listen time in milliseconds
+    void setListenTime(uint16_t listenTime);
+
+    /// Sets how long the radio stays awake after sending or receiving a message. Defaults to RH_LPL_DEFAULT_HOLD_TIME.
+    /// \param[in] holdTime Hold time in milliseconds
+    void setHoldTime(uint16_t holdTime);
+
+    /// Returns the total time the radio has been asleep
+    /// \return The time in milliseconds
+    uint32_t sleepTime() { return _sleepTime; }
+
+    /// Returns the number of messages sent as strobe trains
+    /// \return The number of strobe trains
+    uint32_t strobeTrains() { return _strobeTrains; }
+
+protected:
+    /// Listens for up to the listen time
+    /// \return true if the channel was busy or a message arrived
+    bool listen();
+
+    /// Puts the radio to sleep for a while
+    /// \param[in] ms Time to sleep in milliseconds
+    void sleepFor(uint32_t ms);
+
+    /// Notes that another node will be awake until a time
+    /// \param[in] address The node
+    /// \param[in] until millis() when it will go back to sleep
+    void noteAwake(uint8_t address, uint32_t until);
+
+    /// Tells whether another node is known to be awake
+    /// \param[in] address The node
+    /// \return true if the node will be awake long enough to receive a message without a strobe train
+    bool isAwake(uint8_t address);
+
+    /// Makes the radio stay awake until at least a time
+    /// \param[in] until millis() when the radio may go back to sleep
+    void holdUntil(uint32_t until);
+
+    /// Copies the mode of the wrapped driver, so mode() works
+    void sync();
+
+private:
+    /// The driver we are wrapping
+    RHGenericDriver&    _driver;
+
+    /// Time in milliseconds between the times the radio listens
+    uint16_t            _interval;
+
+    /// Time in milliseconds the radio listens for
+    uint16_t            _listenTime;
+
+    /// Time in milliseconds the radio stays awake after sending or receiving
+    uint16_t            _holdTime;
+
+    /// millis() when the radio next listens
+    uint32_t            _nextListen;
+
+    /// millis() until when the radio stays awake
+    uint32_t            _awakeUntil;
+
+    /// millis() at the end of the last strobe train received. Nothing is sent until then
+    uint32_t            _quietUntil;
+
+    /// Total time the radio has been asleep in milliseconds
+    uint32_t            _sleepTime;
+
+    /// Number of messages sent as strobe trains
+    uint32_t            _strobeTrains;
+
+    /// Nodes known to be awake
+    uint8_t             _peerAddress[RH_LPL_MAX_PEERS];
+
+    /// millis() until when each of _peerAddress can receive without a strobe train
+    uint32_t            _peerUntil[RH_LPL_MAX_PEERS];
+
+    /// The headers of the last message received, so copies of it can be discarded until _lastUntil
+    uint8_t             _lastFrom;
+    uint8_t             _lastId;
+    uint8_t             _lastFlags;
+
+    /// millis() at the end of the strobe train of the last message received
+    uint32_t            _lastUntil;
+
+    /// True if _rxBuf holds a message
+    bool                _rxBufValid;
+
+    /// Length of the message in _rxBuf, including the RH_LPL_HEADER_LEN octets
+    uint8_t             _rxBufLen;
+
+    /// The last message received
+    uint8_t             _rxBuf[RH_LPL_MAX_MESSAGE_LEN];
+};
+
+#endif
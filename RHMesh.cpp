@@ -13,8 +13,6 @@
 
 #include <RHMesh.h>
 
-uint8_t RHMesh::_tmpMessage[RH_ROUTER_MAX_MESSAGE_LEN];
-
 ////////////////////////////////////////////////////////////////////
 // Constructors
 RHMesh::RHMesh(RHGenericDriver& driver, uint8_t thisAddress) 
@@ -40,11 +38,12 @@ uint8_t RHMesh::sendtoWait(uint8_t* buf, uint8_t len, uint8_t address, uint8_t f
 	    return RH_ROUTER_ERROR_NO_ROUTE;
     }
 
-    // Now have a route. Contruct an application layer message and send it via that route
-    MeshApplicationMessage* a = (MeshApplicationMessage*)&_tmpMessage;
-    a->header.msgType = RH_MESH_MESSAGE_TYPE_APPLICATION;
-    memcpy(a->data, buf, len);
-    return RHRouter::sendtoWait(_tmpMessage, sizeof(RHMesh::MeshMessageHeader) + len, address, flags);
+    // Now have a route. Send an application layer header followed by the message via that route
+    MeshMessageHeader header;
+    header.msgType = RH_MESH_MESSAGE_TYPE_APPLICATION;
+    RHGenericDriver::Segment data = { buf, len, NULL };
+    RHGenericDriver::Segment h = { (const uint8_t*)&header, sizeof(header), &data };
+    return RHRouter::sendtoWaitSegments(&h, address, flags);
 }
 
 ////////////////////////////////////////////////////////////////////
@@ -120,24 +119,24 @@ void RHMesh::peekAtMessage(RoutedMessage* message, uint8_t messageLen)
 
 ////////////////////////////////////////////////////////////////////
 // This is called when a message is to be delivered to the next hop
-uint8_t RHMesh::route(RoutedMessage* message, uint8_t messageLen)
+uint8_t RHMesh::routeSegments(RoutedMessageHeader* header, const RHGenericDriver::Segment* payload)
 {
-    uint8_t from = headerFrom(); // Might get clobbered during call to superclass route()
-    uint8_t ret = RHRouter::route(message, messageLen);
+    uint8_t from = headerFrom(); // Might get clobbered during call to superclass routeSegments()
+    uint8_t ret = RHRouter::routeSegments(header, payload);
     if (   ret == RH_ROUTER_ERROR_NO_ROUTE
 	|| ret == RH_ROUTER_ERROR_UNABLE_TO_DELIVER)
     {
 	// Cant deliver to the next hop. Delete the route
-	deleteRouteTo(message->header.dest);
-	if (message->header.source != _thisAddress)
+	deleteRouteTo(header->dest);
+	if (header->source != _thisAddress)
 	{
 	    // This is being proxied, so tell the originator about it
 	    MeshRouteFailureMessage* p = (MeshRouteFailureMessage*)&_tmpMessage;
 	    p->header.msgType = RH_MESH_MESSAGE_TYPE_ROUTE_FAILURE;
-	    p->dest = message->header.dest; // Who you were trying to deliver to
+	    p->dest = header->dest; // Who you were trying to deliver to
 	    // Make sure there is a route back towards whoever sent the original message
-	    addRouteTo(message->header.source, from);
-	    ret = RHRouter::sendtoWait((uint8_t*)p, sizeof(RHMesh::MeshMessageHeader) + 1, message->header.source);
+	    addRouteTo(header->source, from);
+	    ret = RHRouter::sendtoWait((uint8_t*)p, sizeof(RHMesh::MeshMessageHeader) + 1, header->source);
 	}
     }
     return ret;
@@ -154,36 +153,55 @@ bool RHMesh::isPhysicalAddress(uint8_t* address, uint8_t addresslen)
 ////////////////////////////////////////////////////////////////////
 bool RHMesh::recvfromAck(uint8_t* buf, uint8_t* len, uint8_t* source, uint8_t* dest, uint8_t* id, uint8_t* flags)
 {     
-    uint8_t tmpMessageLen = sizeof(_tmpMessage);
+    const uint8_t* data;
+    uint8_t dataLen;
+    if (recvfromAckLease(&data, &dataLen, source, dest, id, flags))
+    {
+	if (*len > dataLen)
+	    *len = dataLen;
+	memcpy(buf, data, *len);
+	release();
+	return true;
+    }
+    return false;
+}
+
+////////////////////////////////////////////////////////////////////
+bool RHMesh::recvfromAckLease(const uint8_t** buf, uint8_t* len, uint8_t* source, uint8_t* dest, uint8_t* id, uint8_t* flags)
+{     
+    const uint8_t* message;
+    uint8_t tmpMessageLen;
     uint8_t _source;
     uint8_t _dest;
     uint8_t _id;
     uint8_t _flags;
-    if (RHRouter::recvfromAck(_tmpMessage, &tmpMessageLen, &_source, &_dest, &_id, &_flags))
+    if (RHRouter::recvfromAckLease(&message, &tmpMessageLen, &_source, &_dest, &_id, &_flags))
     {
-	MeshMessageHeader* p = (MeshMessageHeader*)&_tmpMessage;
+	const MeshMessageHeader* h = (const MeshMessageHeader*)message;
 
 	if (   tmpMessageLen >= 1 
-	    && p->msgType == RH_MESH_MESSAGE_TYPE_APPLICATION)
+	    && h->msgType == RH_MESH_MESSAGE_TYPE_APPLICATION)
 	{
-	    MeshApplicationMessage* a = (MeshApplicationMessage*)p;
+	    const MeshApplicationMessage* a = (const MeshApplicationMessage*)h;
 	    // Handle application layer messages, presumably for our caller
 	    if (source) *source = _source;
 	    if (dest)   *dest   = _dest;
 	    if (id)     *id     = _id;
 	    if (flags)  *flags  = _flags;
-	    uint8_t msgLen = tmpMessageLen - sizeof(MeshMessageHeader);
-	    if (*len > msgLen)
-		*len = msgLen;
-	    memcpy(buf, a->data, *len);
-	    
-	    return true;
+	    *buf = a->data;
+	    *len = tmpMessageLen - sizeof(MeshMessageHeader);
+	    return true; // Until release()
 	}
 	else if (   _dest == RH_BROADCAST_ADDRESS 
 		 && tmpMessageLen > 1 
-		 && p->msgType == RH_MESH_MESSAGE_TYPE_ROUTE_DISCOVERY_REQUEST)
+		 && h->msgType == RH_MESH_MESSAGE_TYPE_ROUTE_DISCOVERY_REQUEST)
 	{
-	    MeshRouteDiscoveryMessage* d = (MeshRouteDiscoveryMessage*)p;
+	    // We may have to modify and resend it, so copy it and release the original
+	    if (tmpMessageLen > sizeof(_tmpMessage))
+		tmpMessageLen = sizeof(_tmpMessage);
+	    memcpy(_tmpMessage, message, tmpMessageLen);
+	    release();
+	    MeshRouteDiscoveryMessage* d = (MeshRouteDiscoveryMessage*)&_tmpMessage;
 	    // Handle Route discovery requests
 	    // Message is an array of node addresses the route request has already passed through
 	    // If it originally came from us, ignore it
@@ -219,6 +237,8 @@ bool RHMesh::recvfromAck(uint8_t* buf, uint8_t* len, uint8_t* source, uint8_t* d
 		RHRouter::sendtoFromSourceWait(_tmpMessage, tmpMessageLen, RH_BROADCAST_ADDRESS, _source);
 	    }
 	}
+	else
+	    release();
     }
     return false;
 }
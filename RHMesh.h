@@ -155,7 +155,7 @@ public:
 
     /// Sends a message to the destination node. Initialises the RHRouter message header 
     /// (the SOURCE address is set to the address of this node, HOPS to 0) and calls 
-    /// route() which looks up in the routing table the next hop to deliver to.
+    /// routeSegments() which looks up in the routing table the next hop to deliver to.
     /// If no route is known, initiates route discovery and waits for a reply.
     /// Then sends the message to the next hop
     /// Then waits for an acknowledgement from the next hop 
@@ -198,6 +198,19 @@ public:
     /// \return true if a valid message was received for this node and copied to buf
     bool recvfromAck(uint8_t* buf, uint8_t* len, uint8_t* source = NULL, uint8_t* dest = NULL, uint8_t* id = NULL, uint8_t* flags = NULL);
 
+    /// Like recvfromAck(), but instead of copying the application message, sets *buf to point to it.
+    /// If the driver can lease messages (see RHGenericDriver::lease()), that is inside the driver,
+    /// so the message is not copied at all on its way from the driver to your program.
+    /// The message remains valid until release(). Call it promptly, since it sends the ACK.
+    /// \param[out] buf Set to the address of the message
+    /// \param[out] len Set to the length of the message
+    /// \param[in] source If present and not NULL, the referenced uint8_t will be set to the SOURCE address
+    /// \param[in] dest If present and not NULL, the referenced uint8_t will be set to the DEST address
+    /// \param[in] id If present and not NULL, the referenced uint8_t will be set to the ID
+    /// \param[in] flags If present and not NULL, the referenced uint8_t will be set to the FLAGS
+    /// \return true if a valid application message was received for this node
+    bool recvfromAckLease(const uint8_t** buf, uint8_t* len, uint8_t* source = NULL, uint8_t* dest = NULL, uint8_t* id = NULL, uint8_t* flags = NULL);
+
     /// Starts the receiver if it is not running already.
     /// Similar to recvfromAck(), this will block until either a valid application layer 
     /// message available for this node
@@ -222,11 +235,11 @@ protected:
     virtual void peekAtMessage(RoutedMessage* message, uint8_t messageLen);
 
     /// Internal function that inspects messages being received and adjusts the routing table if necessary.
-    /// This is virtual, which lets subclasses override or intercept the route() function.
+    /// This is virtual, which lets subclasses override or intercept the routeSegments() function.
     /// Called by sendtoWait after the message header has been filled in.
-    /// \param [in] message Pointer to the RHRouter message to be sent.
-    /// \param [in] messageLen Length of message in octets
-    virtual uint8_t route(RoutedMessage* message, uint8_t messageLen);
+    /// \param [in] header Pointer to the RHRouter header of the message to be sent.
+    /// \param [in] payload The first segment of the rest of the message
+    virtual uint8_t routeSegments(RoutedMessageHeader* header, const RHGenericDriver::Segment* payload);
 
     /// Try to resolve a route for the given address. Blocks while discovering the route
     /// which may take up to 4000 msec.
@@ -248,8 +261,9 @@ protected:
     virtual bool isPhysicalAddress(uint8_t* address, uint8_t addresslen);
 
 private:
-    /// Temporary message buffer
-    static uint8_t _tmpMessage[RH_ROUTER_MAX_MESSAGE_LEN];
+    /// Temporary message buffer.
+    /// Not static, so that multiple instances can be simulated in one process (see RHEtherSimulator)
+    uint8_t _tmpMessage[RH_ROUTER_MAX_MESSAGE_LEN];
 
 };
 
@@ -105,6 +105,26 @@ uint8_t RHNRFSPIDriver::spiBurstWrite(uint8_t reg, const uint8_t* src, uint8_t l
     return status;
 }
 
+uint8_t RHNRFSPIDriver::spiBurstWrite(uint8_t reg, const Segment* segments)
+{
+    uint8_t status = 0;
+    ATOMIC_BLOCK_START;
+    _spi.beginTransaction();
+    digitalWrite(_slaveSelectPin, LOW);
+    status = _spi.transfer(reg); // Send the start address
+    for (; segments; segments = segments->next)
+    {
+	const uint8_t* src = segments->data;
+	uint8_t len = segments->len;
+	while (len--)
+	    _spi.transfer(*src++);
+    }
+    digitalWrite(_slaveSelectPin, HIGH);
+    _spi.endTransaction();
+    ATOMIC_BLOCK_END;
+    return status;
+}
+
 void RHNRFSPIDriver::setSlaveSelectPin(uint8_t slaveSelectPin)
 {
     _slaveSelectPin = slaveSelectPin;
@@ -78,6 +78,12 @@ public:
     ///  it may or may not be meaningfule depending on the the type of device being accessed.
     uint8_t           spiBurstWrite(uint8_t reg, const uint8_t* src, uint8_t len);
 
+    /// Write a list of segments to consecutive registers (or a FIFO) in a single burst
+    /// \param[in] reg Register number of the first register
+    /// \param[in] segments The first segment to write. See RHGenericDriver::Segment
+    /// \return Some devices return a status byte during the first data transfer. This byte is returned.
+    uint8_t           spiBurstWrite(uint8_t reg, const Segment* segments);
+
     /// Set or change the pin to be used for SPI slave select.
     /// This can be called at any time to change the
     /// pin that will be used for slave select in subsquent SPI operations.
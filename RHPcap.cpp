@@ -0,0 +1,132 @@
+// RHPcap.cpp
+//
+// Copyright (C) 2016 Mike McCauley
+
+#include <RadioHead.h>
+
+// This can only build on Linux and compatible systems
+#if (RH_PLATFORM == RH_PLATFORM_UNIX) || (RH_PLATFORM == RH_PLATFORM_RASPI)
+
+#include <RHPcap.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/time.h>
+
+#pragma pack(push, 1) // No padding
+
+// pcap file header, in host byte order. Readers detect the byte order from the magic number
+typedef struct
+{
+    uint32_t magic;
+    uint16_t versionMajor;
+    uint16_t versionMinor;
+    int32_t  thiszone;
+    uint32_t sigfigs;
+    uint32_t snaplen;
+    uint32_t network;
+} PcapFileHeader;
+
+// pcap record header, in host byte order
+typedef struct
+{
+    uint32_t tsSec;
+    uint32_t tsUsec;
+    uint32_t inclLen;
+    uint32_t origLen;
+} PcapRecordHeader;
+
+#pragma pack(pop)
+
+RHPcap::RHPcap()
+    : _file(NULL)
+{
+}
+
+RHPcap::~RHPcap()
+{
+    close();
+}
+
+bool RHPcap::open(const char* filename)
+{
+    close();
+    _file = strcmp(filename, "-") ? fopen(filename, "wb") : stdout;
+    if (!_file)
+    {
+	fprintf(stderr, "RHPcap::open could not open %s: %s\n", filename, strerror(errno));
+	return false;
+    }
+    PcapFileHeader h;
+    h.magic = 0xa1b2c3d4; // Microsecond timestamps
+    h.versionMajor = 2;
+    h.versionMinor = 4;
+    h.thiszone = 0;
+    h.sigfigs = 0;
+    h.snaplen = RH_PCAP_HEADER_LEN + 255;
+    h.network = RH_PCAP_LINKTYPE;
+    if (fwrite(&h, sizeof(h), 1, _file) != 1)
+    {
+	fprintf(stderr, "RHPcap::open could not write to %s: %s\n", filename, strerror(errno));
+	close();
+	return false;
+    }
+    return true;
+}
+
+void RHPcap::close()
+{
+    if (_file)
+    {
+	if (_file == stdout)
+	    fflush(_file);
+	else
+	    fclose(_file);
+	_file = NULL;
+    }
+}
+
+void RHPcap::flush()
+{
+    if (_file)
+	fflush(_file);
+}
+
+bool RHPcap::write(uint64_t micros, uint8_t to, uint8_t from, uint8_t id, uint8_t flags, int16_t rssi,
+		   const uint8_t* payload, uint8_t len)
+{
+    if (!_file)
+	return false;
+
+    PcapRecordHeader r;
+    r.tsSec = micros / 1000000;
+    r.tsUsec = micros % 1000000;
+    r.inclLen = r.origLen = RH_PCAP_HEADER_LEN + len;
+
+    uint8_t header[RH_PCAP_HEADER_LEN];
+    header[0] = to;
+    header[1] = from;
+    header[2] = id;
+    header[3] = flags;
+    header[4] = (uint16_t)rssi >> 8;
+    header[5] = (uint16_t)rssi & 0xff;
+
+    return    fwrite(&r, sizeof(r), 1, _file) == 1
+	   && fwrite(header, sizeof(header), 1, _file) == 1
+	   && fwrite(payload, 1, len, _file) == len;
+}
+
+bool RHPcap::writeFrame(uint64_t micros, const uint8_t* frame, uint8_t len, int16_t rssi)
+{
+    if (len < 4)
+	return false;
+    return write(micros, frame[0], frame[1], frame[2], frame[3], rssi, frame + 4, len - 4);
+}
+
+uint64_t RHPcap::timeNow()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+#endif
@@ -0,0 +1,126 @@
+// RHPcap.h
+// Author: Mike McCauley (mikem@airspayce.com)
+// Writes RadioHead frames to pcap capture files
+// Copyright (C) 2016 Mike McCauley
+
+#ifndef RHPcap_h
+#define RHPcap_h
+
+#include <RHGenericDriver.h>
+
+// This can only build on Linux and compatible systems
+#if (RH_PLATFORM == RH_PLATFORM_UNIX) || (RH_PLATFORM == RH_PLATFORM_RASPI)
+
+#include <stdio.h>
+
+// pcap link type for RadioHead frames. User defined link type 0
+#define RH_PCAP_LINKTYPE 147
+
+// Length of the RHPcap header in each record: TO, FROM, ID, FLAGS and RSSI
+#define RH_PCAP_HEADER_LEN 6
+
+// Value of the RSSI in a record when the RSSI is not known
+#define RH_PCAP_RSSI_UNKNOWN -32768
+
+/////////////////////////////////////////////////////////////////////
+/// \class RHPcap RHPcap.h <RHPcap.h>
+/// \brief Writes RadioHead frames to a pcap capture file, for later analysis with standard tools.
+///
+/// RHPcap writes a pcap file (the classic libpcap format, readable by Wireshark, tcpdump, tshark etc)
+/// containing one record for each frame written. Each record has a microsecond timestamp and contains:
+/// \code
+/// octet 0    TO header
+/// octet 1    FROM header
+/// octet 2    ID header
+/// octet 3    FLAGS header
+/// octets 4-5 RSSI in dBm, signed, network byte order. RH_PCAP_RSSI_UNKNOWN if not known
+/// octets 6-  payload
+/// \endcode
+/// The link type of the file is RH_PCAP_LINKTYPE (LINKTYPE_USER0). In Wireshark, you can decode the headers by
+/// adding a DLT_USER entry for User 0, or just look at the raw octets.
+///
+/// Records are buffered, so writing is fast enough for busy networks. Call flush() or close() to make sure
+/// all the records are written to the file.
+///
+/// RHPcap is used by etherSimulator (-w option) and by RHEther (see RHEther::setPcap()) to capture every frame
+/// transmitted in a simulation. On a Linux gateway, you can capture the frames received by a
+/// promiscuous driver:
+/// \code
+/// RHPcap pcap;
+/// pcap.open("gateway.pcap");
+/// driver.setPromiscuous(true);
+/// ...
+/// uint8_t len = sizeof(buf);
+/// if (driver.recv(buf, &len))
+///     pcap.capture(driver, buf, len);
+/// \endcode
+class RHPcap
+{
+public:
+    /// Constructor
+    RHPcap();
+
+    /// Destructor. Closes the file if open
+    ~RHPcap();
+
+    /// Creates a new capture file and writes the pcap file header
+    /// \param[in] filename Name of the file to create. "-" means stdout
+    /// \return true if successful
+    bool open(const char* filename);
+
+    /// Flushes and closes the capture file.
+    void close();
+
+    /// Flushes any buffered records to the file
+    void flush();
+
+    /// Tells whether a capture file is open
+    /// \return true if open
+    bool isOpen() { return _file != NULL; }
+
+    /// Writes a record containing a frame
+    /// \param[in] micros Timestamp of the frame in microseconds since 1970-01-01 UTC
+    /// (or since the start of a simulation in virtual time)
+    /// \param[in] to The TO header
+    /// \param[in] from The FROM header
+    /// \param[in] id The ID header
+    /// \param[in] flags The FLAGS header
+    /// \param[in] rssi The RSSI in dBm, or RH_PCAP_RSSI_UNKNOWN
+    /// \param[in] payload The payload
+    /// \param[in] len Length of the payload
+    /// \return true if successful
+    bool write(uint64_t micros, uint8_t to, uint8_t from, uint8_t id, uint8_t flags, int16_t rssi,
+	       const uint8_t* payload, uint8_t len);
+
+    /// Writes a record containing a frame of TO, FROM, ID, FLAGS and payload, such as
+    /// those passed by RH_TCP and RHEther
+    /// \param[in] micros Timestamp of the frame in microseconds
+    /// \param[in] frame The frame
+    /// \param[in] len Length of the frame, at least 4
+    /// \param[in] rssi The RSSI in dBm, or RH_PCAP_RSSI_UNKNOWN
+    /// \return true if successful
+    bool writeFrame(uint64_t micros, const uint8_t* frame, uint8_t len, int16_t rssi = RH_PCAP_RSSI_UNKNOWN);
+
+    /// Writes a record containing the message just received by a driver, using the current time, the
+    /// received headers and RSSI of the driver.
+    /// \param[in] driver The driver that received the message
+    /// \param[in] payload The message received by recv()
+    /// \param[in] len Length of the message
+    /// \return true if successful
+    bool capture(RHGenericDriver& driver, const uint8_t* payload, uint8_t len)
+    {
+	return write(timeNow(), driver.headerTo(), driver.headerFrom(), driver.headerId(), driver.headerFlags(),
+		     driver.lastRssi(), payload, len);
+    }
+
+    /// Returns the current time in microseconds since 1970-01-01 UTC
+    static uint64_t timeNow();
+
+private:
+    /// The capture file
+    FILE*        _file;
+};
+
+#endif
+
+#endif
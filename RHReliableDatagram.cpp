@@ -22,6 +22,8 @@ RHReliableDatagram::RHReliableDatagram(RHGenericDriver& driver, uint8_t thisAddr
     _lastSequenceNumber = 0;
     _timeout = RH_DEFAULT_TIMEOUT;
     _retries = RH_DEFAULT_RETRIES;
+    _ackPending = false;
+    resetAckLatencyHistogram();
 }
 
 ////////////////////////////////////////////////////////////////////
@@ -45,6 +47,13 @@ uint8_t RHReliableDatagram::retries()
 
 ////////////////////////////////////////////////////////////////////
 bool RHReliableDatagram::sendtoWait(uint8_t* buf, uint8_t len, uint8_t address)
+{
+    RHGenericDriver::Segment segment = { buf, len, NULL };
+    return sendtoWaitSegments(&segment, address);
+}
+
+////////////////////////////////////////////////////////////////////
+bool RHReliableDatagram::sendtoWaitSegments(const RHGenericDriver::Segment* segments, uint8_t address)
 {
     // Assemble the message
     uint8_t thisSequenceNumber = ++_lastSequenceNumber;
@@ -53,7 +62,9 @@ bool RHReliableDatagram::sendtoWait(uint8_t* buf, uint8_t len, uint8_t address)
     {
 	setHeaderId(thisSequenceNumber);
 	setHeaderFlags(RH_FLAGS_NONE, RH_FLAGS_ACK); // Clear the ACK flag
-	sendto(buf, len, address);
+	// If the driver refused to send it (such as RHDutyCycle when over its limit), there is no ACK to wait for
+	if (!sendtoSegments(segments, address))
+	    return false;
 	waitPacketSent();
 
 	// Never wait for ACKS to broadcasts:
@@ -87,6 +98,11 @@ bool RHReliableDatagram::sendtoWait(uint8_t* buf, uint8_t len, uint8_t address)
 			   && (id == thisSequenceNumber))
 		    {
 			// Its the ACK we are waiting for
+			unsigned long latency = millis() - thisSendTime;
+			uint8_t bin = 0;
+			while (bin < RH_ACK_LATENCY_BINS - 1 && latency >= ((unsigned long)RH_ACK_LATENCY_BIN0 << bin))
+			    bin++;
+			_ackLatencies[bin]++;
 			return true;
 		    }
 		    else if (   !(flags & RH_FLAGS_ACK)
@@ -145,6 +161,56 @@ bool RHReliableDatagram::recvfromAck(uint8_t* buf, uint8_t* len, uint8_t* from,
     return false;
 }
 
+// Same as recvfromAck, except the message is not copied, and the ACK has to wait until
+// the message is released, since it might clobber the message
+bool RHReliableDatagram::recvfromAckLease(const uint8_t** buf, uint8_t* len, uint8_t* from, uint8_t* to, uint8_t* id, uint8_t* flags)
+{  
+    uint8_t _from;
+    uint8_t _to;
+    uint8_t _id;
+    uint8_t _flags;
+    if (available() && recvfromLease(buf, len, &_from, &_to, &_id, &_flags))
+    {
+	// Never ACK an ACK
+	if (!(_flags & RH_FLAGS_ACK))
+	{
+	    // Its not a broadcast, so ACK it
+	    bool ack = _to != RH_BROADCAST_ADDRESS;
+	    // If we have not seen this message before, then we are interested in it
+	    if (_id != _seenIds[_from])
+	    {
+		if (from)  *from =  _from;
+		if (to)    *to =    _to;
+		if (id)    *id =    _id;
+		if (flags) *flags = _flags;
+		_seenIds[_from] = _id;
+		_ackPending = ack;
+		_ackId = _id;
+		_ackTo = _from;
+		return true;
+	    }
+	    // Else just re-ack it and wait for a new one
+	    RHDatagram::release();
+	    if (ack)
+		acknowledge(_id, _from);
+	    return false;
+	}
+	RHDatagram::release();
+    }
+    // No message for us available
+    return false;
+}
+
+void RHReliableDatagram::release()
+{
+    RHDatagram::release();
+    if (_ackPending)
+    {
+	_ackPending = false;
+	acknowledge(_ackId, _ackTo);
+    }
+}
+
 bool RHReliableDatagram::recvfromAckTimeout(uint8_t* buf, uint8_t* len, uint16_t timeout, uint8_t* from, uint8_t* to, uint8_t* id, uint8_t* flags)
 {
     unsigned long starttime = millis();
@@ -170,6 +236,16 @@ void RHReliableDatagram::resetRetransmissions()
 {
     _retransmissions = 0;
 }
+
+void RHReliableDatagram::ackLatencyHistogram(uint32_t* bins)
+{
+    memcpy(bins, _ackLatencies, sizeof(_ackLatencies));
+}
+
+void RHReliableDatagram::resetAckLatencyHistogram()
+{
+    memset(_ackLatencies, 0, sizeof(_ackLatencies));
+}
  
 void RHReliableDatagram::acknowledge(uint8_t id, uint8_t from)
 {
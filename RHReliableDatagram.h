@@ -20,6 +20,17 @@
 /// The default number of retries
 #define RH_DEFAULT_RETRIES 3
 
+/// Number of bins in the ACK latency histogram. See ackLatencyHistogram()
+#ifndef RH_ACK_LATENCY_BINS
+#define RH_ACK_LATENCY_BINS 8
+#endif
+
+/// Upper limit of the first bin of the ACK latency histogram, in milliseconds.
+/// Each bin after the first is twice as wide as the one before
+#ifndef RH_ACK_LATENCY_BIN0
+#define RH_ACK_LATENCY_BIN0 4
+#endif
+
 /////////////////////////////////////////////////////////////////////
 /// \class RHReliableDatagram RHReliableDatagram.h <RHReliableDatagram.h>
 /// \brief RHDatagram subclass for sending addressed, acknowledged, retransmitted datagrams.
@@ -113,12 +124,21 @@ public:
     /// If the destination address is the broadcast address RH_BROADCAST_ADDRESS (255), the message will 
     /// be sent as a broadcast, but receiving nodes do not acknowledge, and sendtoWait() returns true immediately
     /// without waiting for any acknowledgements.
+    /// If the driver refuses to send the message (for example an RHDutyCycle that has reached its limit),
+    /// returns false immediately, without waiting for an ACK or retrying.
     /// \param[in] address The address to send the message to.
     /// \param[in] buf Pointer to the binary message to send
     /// \param[in] len Number of octets to send
     /// \return true if the message was transmitted and an acknowledgement was received.
     bool sendtoWait(uint8_t* buf, uint8_t len, uint8_t address);
 
+    /// Like sendtoWait(), but the message is made of a list of segments. See RHGenericDriver::Segment.
+    /// The segments must not change until this returns, since they are sent again for each retry.
+    /// \param[in] segments The first segment of the message
+    /// \param[in] address The address to send the message to.
+    /// \return true if the message was transmitted and an acknowledgement was received.
+    bool sendtoWaitSegments(const RHGenericDriver::Segment* segments, uint8_t address);
+
     /// If there is a valid message available for this node, send an acknowledgement to the SRC
     /// address (blocking until this is complete), then copy the message to buf and return true
     /// else return false. 
@@ -139,6 +159,22 @@ public:
     /// \return true if a valid message was copied to buf
     bool recvfromAck(uint8_t* buf, uint8_t* len, uint8_t* from = NULL, uint8_t* to = NULL, uint8_t* id = NULL, uint8_t* flags = NULL);
 
+    /// Like recvfromAck(), but instead of copying the message, sets *buf to point to it inside the driver.
+    /// The message remains valid until release(). Since some drivers share their receive and transmit buffers,
+    /// the ACK is not sent until release(), so call it promptly.
+    /// \param[out] buf Set to the address of the message
+    /// \param[out] len Set to the length of the message
+    /// \param[in] from If present and not NULL, the referenced uint8_t will be set to the SRC address
+    /// \param[in] to If present and not NULL, the referenced uint8_t will be set to the DEST address
+    /// \param[in] id If present and not NULL, the referenced uint8_t will be set to the ID
+    /// \param[in] flags If present and not NULL, the referenced uint8_t will be set to the FLAGS
+    /// \return true if a new message was leased. false if there is none, or the driver can not lease it 
+    /// (in which case recvfromAck() will return it)
+    bool recvfromAckLease(const uint8_t** buf, uint8_t* len, uint8_t* from = NULL, uint8_t* to = NULL, uint8_t* id = NULL, uint8_t* flags = NULL);
+
+    /// Releases the message leased by recvfromAckLease(), and acknowledges it if necessary
+    void release();
+
     /// Similar to recvfromAck(), this will block until either a valid message available for this node
     /// or the timeout expires. Starts the receiver automatically.
     /// You should be sure to call this function frequently enough to not miss any messages
@@ -163,6 +199,17 @@ public:
     /// to 0. 
     void resetRetransmissions(); 
 
+    /// Copies the histogram of the time taken for the ACKs received by sendtoWait(), measured
+    /// from the end of the transmission that was acknowledged. Bin i counts the ACKs that took less
+    /// than RH_ACK_LATENCY_BIN0 << i milliseconds (and not less than the limit of the bin before), and 
+    /// the last bin counts all the slower ones. A peak near the retransmit timeout means that 
+    /// setTimeout() is too short.
+    /// \param[out] bins Array of RH_ACK_LATENCY_BINS counters
+    void ackLatencyHistogram(uint32_t* bins);
+
+    /// Resets all the bins of the ACK latency histogram to 0
+    void resetAckLatencyHistogram();
+
 protected:
     /// Send an ACK for the message id to the given from address
     /// Blocks until the ACK has been sent
@@ -177,6 +224,9 @@ private:
     /// Count of retransmissions we have had to send
     uint32_t _retransmissions;
 
+    /// Histogram of ACK latencies. See ackLatencyHistogram()
+    uint32_t _ackLatencies[RH_ACK_LATENCY_BINS];
+
     /// The last sequence number to be used
     /// Defaults to 0
     uint8_t _lastSequenceNumber;
@@ -194,6 +244,15 @@ private:
     /// (this is generally due to lost ACKs, causing the sender to retransmit, even though we have already
     /// received that message)
     uint8_t _seenIds[256];
+
+    /// The leased message is to be acknowledged by release()
+    bool    _ackPending;
+
+    /// ID of the leased message to acknowledge
+    uint8_t _ackId;
+
+    /// Address to send the ACK for the leased message to
+    uint8_t _ackTo;
 };
 
 /// @example rf22_reliable_datagram_client.pde
@@ -13,14 +13,14 @@
 
 #include <RHRouter.h>
 
-RHRouter::RoutedMessage RHRouter::_tmpMessage;
-
 ////////////////////////////////////////////////////////////////////
 // Constructors
 RHRouter::RHRouter(RHGenericDriver& driver, uint8_t thisAddress) 
     : RHReliableDatagram(driver, thisAddress)
 {
     _max_hops = RH_DEFAULT_MAX_HOPS;
+    _linkFilter = NULL;
+    _leased = false;
     clearRoutingTable();
 }
 
@@ -160,39 +160,67 @@ uint8_t RHRouter::sendtoWait(uint8_t* buf, uint8_t len, uint8_t dest, uint8_t fl
 // Waits for delivery to the next hop (but not for delivery to the final destination)
 uint8_t RHRouter::sendtoFromSourceWait(uint8_t* buf, uint8_t len, uint8_t dest, uint8_t source, uint8_t flags)
 {
-    if (((uint16_t)len + sizeof(RoutedMessageHeader)) > _driver.maxMessageLength())
+    RHGenericDriver::Segment segment = { buf, len, NULL };
+    return sendtoFromSourceWaitSegments(&segment, dest, source, flags);
+}
+
+////////////////////////////////////////////////////////////////////
+uint8_t RHRouter::sendtoWaitSegments(const RHGenericDriver::Segment* segments, uint8_t dest, uint8_t flags)
+{
+    return sendtoFromSourceWaitSegments(segments, dest, _thisAddress, flags);
+}
+
+////////////////////////////////////////////////////////////////////
+uint8_t RHRouter::sendtoFromSourceWaitSegments(const RHGenericDriver::Segment* segments, uint8_t dest, uint8_t source, uint8_t flags)
+{
+    if ((RHGenericDriver::segmentsLength(segments) + sizeof(RoutedMessageHeader)) > _driver.maxMessageLength())
 	return RH_ROUTER_ERROR_INVALID_LENGTH;
 
-    // Construct a RH RouterMessage message
-    _tmpMessage.header.source = source;
-    _tmpMessage.header.dest = dest;
-    _tmpMessage.header.hops = 0;
-    _tmpMessage.header.id = _lastE2ESequenceNumber++;
-    _tmpMessage.header.flags = flags;
-    memcpy(_tmpMessage.data, buf, len);
+    // Construct a RH RouterMessage header, to be sent in front of the callers segments
+    RoutedMessageHeader header;
+    header.source = source;
+    header.dest = dest;
+    header.hops = 0;
+    header.id = _lastE2ESequenceNumber++;
+    header.flags = flags;
+
+    return routeSegments(&header, segments);
+}
 
-    return route(&_tmpMessage, sizeof(RoutedMessageHeader)+len);
+////////////////////////////////////////////////////////////////////
+void RHRouter::route(RoutedMessage* message, uint8_t messageLen)
+{
+    uint8_t len = messageLen > sizeof(RoutedMessageHeader) ? messageLen - sizeof(RoutedMessageHeader) : 0;
+    RHGenericDriver::Segment payload = { message->data, len, NULL };
+    routeSegments(&message->header, &payload);
 }
 
 ////////////////////////////////////////////////////////////////////
-uint8_t RHRouter::route(RoutedMessage* message, uint8_t messageLen)
+uint8_t RHRouter::routeSegments(RoutedMessageHeader* header, const RHGenericDriver::Segment* payload)
 {
     // Reliably deliver it if possible. See if we have a route:
     uint8_t next_hop = RH_BROADCAST_ADDRESS;
-    if (message->header.dest != RH_BROADCAST_ADDRESS)
+    if (header->dest != RH_BROADCAST_ADDRESS)
     {
-	RoutingTableEntry* route = getRouteTo(message->header.dest);
+	RoutingTableEntry* route = getRouteTo(header->dest);
 	if (!route)
 	    return RH_ROUTER_ERROR_NO_ROUTE;
 	next_hop = route->next_hop;
     }
 
-    if (!RHReliableDatagram::sendtoWait((uint8_t*)message, messageLen, next_hop))
+    RHGenericDriver::Segment h = { (const uint8_t*)header, sizeof(RoutedMessageHeader), payload };
+    if (!RHReliableDatagram::sendtoWaitSegments(&h, next_hop))
 	return RH_ROUTER_ERROR_UNABLE_TO_DELIVER;
 
     return RH_ROUTER_ERROR_NONE;
 }
 
+////////////////////////////////////////////////////////////////////
+void RHRouter::setLinkFilter(LinkFilter filter)
+{
+    _linkFilter = filter;
+}
+
 ////////////////////////////////////////////////////////////////////
 // Subclasses may want to override this to peek at messages going past
 void RHRouter::peekAtMessage(RoutedMessage* message, uint8_t messageLen)
@@ -203,90 +231,101 @@ void RHRouter::peekAtMessage(RoutedMessage* message, uint8_t messageLen)
 ////////////////////////////////////////////////////////////////////
 bool RHRouter::recvfromAck(uint8_t* buf, uint8_t* len, uint8_t* source, uint8_t* dest, uint8_t* id, uint8_t* flags)
 {  
-    uint8_t tmpMessageLen = sizeof(_tmpMessage);
+    const uint8_t* data;
+    uint8_t dataLen;
+    if (recvfromAckLease(&data, &dataLen, source, dest, id, flags))
+    {
+	if (*len > dataLen)
+	    *len = dataLen;
+	memcpy(buf, data, *len);
+	release();
+	return true;
+    }
+    return false;
+}
+
+////////////////////////////////////////////////////////////////////
+bool RHRouter::recvfromAckLease(const uint8_t** buf, uint8_t* len, uint8_t* source, uint8_t* dest, uint8_t* id, uint8_t* flags)
+{  
+    const uint8_t* p;
+    uint8_t messageLen;
     uint8_t _from;
     uint8_t _to;
     uint8_t _id;
     uint8_t _flags;
-    if (RHReliableDatagram::recvfromAck((uint8_t*)&_tmpMessage, &tmpMessageLen, &_from, &_to, &_id, &_flags))
+    // Use the message in the driver if we can, else copy it
+    _leased = RHReliableDatagram::recvfromAckLease(&p, &messageLen, &_from, &_to, &_id, &_flags);
+    if (!_leased)
     {
-	// Here we simulate networks with limited visibility between nodes
-	// so we can test routing
-#ifdef RH_TEST_NETWORK
-	if (
-#if RH_TEST_NETWORK==1
-	    // This network looks like 1-2-3-4
-	       (_thisAddress == 1 && _from == 2)
-	    || (_thisAddress == 2 && (_from == 1 || _from == 3))
-	    || (_thisAddress == 3 && (_from == 2 || _from == 4))
-	    || (_thisAddress == 4 && _from == 3)
-	    
-#elif RH_TEST_NETWORK==2
-	       // This network looks like 1-2-4
-	       //                         | | |
-	       //                         --3--
-	       (_thisAddress == 1 && (_from == 2 || _from == 3))
-	    ||  _thisAddress == 2
-	    ||  _thisAddress == 3
-	    || (_thisAddress == 4 && (_from == 2 || _from == 3))
-
-#elif RH_TEST_NETWORK==3
-	       // This network looks like 1-2-4
-	       //                         |   |
-	       //                         --3--
-	       (_thisAddress == 1 && (_from == 2 || _from == 3))
-	    || (_thisAddress == 2 && (_from == 1 || _from == 4))
-	    || (_thisAddress == 3 && (_from == 1 || _from == 4))
-	    || (_thisAddress == 4 && (_from == 2 || _from == 3))
-
-#elif RH_TEST_NETWORK==4
-	       // This network looks like 1-2-3
-	       //                           |
-	       //                           4
-	       (_thisAddress == 1 && _from == 2)
-	    ||  _thisAddress == 2
-	    || (_thisAddress == 3 && _from == 2)
-	    || (_thisAddress == 4 && _from == 2)
+	messageLen = sizeof(_tmpMessage);
+	if (!RHReliableDatagram::recvfromAck((uint8_t*)&_tmpMessage, &messageLen, &_from, &_to, &_id, &_flags))
+	    return false;
+	p = (const uint8_t*)&_tmpMessage;
+    }
+    // Caution: may be in the driver, and read only
+    RoutedMessage* message = (RoutedMessage*)p;
 
-#endif
-)
-	{
-	    // OK
-	}
-	else
-	{
-	    return false; // Pretend we got nothing
-	}
-#endif
+    // Too short to have a routing header, so there is nothing to deliver or forward
+    if (messageLen < sizeof(RoutedMessageHeader))
+    {
+	release();
+	return false;
+    }
 
-	peekAtMessage(&_tmpMessage, tmpMessageLen);
-	// See if its for us or has to be routed
-	if (_tmpMessage.header.dest == _thisAddress || _tmpMessage.header.dest == RH_BROADCAST_ADDRESS)
-	{
-	    // Deliver it here
-	    if (source) *source  = _tmpMessage.header.source;
-	    if (dest)   *dest    = _tmpMessage.header.dest;
-	    if (id)     *id      = _tmpMessage.header.id;
-	    if (flags)  *flags   = _tmpMessage.header.flags;
-	    uint8_t msgLen = tmpMessageLen - sizeof(RoutedMessageHeader);
-	    if (*len > msgLen)
-		*len = msgLen;
-	    memcpy(buf, _tmpMessage.data, *len);
-	    return true; // Its for you!
-	}
-	else if (   _tmpMessage.header.dest != RH_BROADCAST_ADDRESS
-		 && _tmpMessage.header.hops++ < _max_hops)
-	{
-	    // Maybe it has to be routed to the next hop
-	    // REVISIT: if it fails due to no route or unable to deliver to the next hop, 
-	    // tell the originator. BUT HOW?
-	    route(&_tmpMessage, tmpMessageLen);
-	}
-	// Discard it and maybe wait for another
+    // Here we can simulate networks with limited visibility between nodes
+    // so we can test routing on real radios. See setLinkFilter()
+    if (_linkFilter && !_linkFilter(_thisAddress, _from))
+    {
+	release();
+	return false; // Pretend we got nothing
+    }
+
+    peekAtMessage(message, messageLen);
+    // See if its for us or has to be routed
+    if (message->header.dest == _thisAddress || message->header.dest == RH_BROADCAST_ADDRESS)
+    {
+	// Deliver it here
+	if (source) *source  = message->header.source;
+	if (dest)   *dest    = message->header.dest;
+	if (id)     *id      = message->header.id;
+	if (flags)  *flags   = message->header.flags;
+	*buf = message->data;
+	*len = messageLen - sizeof(RoutedMessageHeader);
+	return true; // Its for you!
+    }
+
+    // We need our own copy to forward, and the driver may be needed to send it
+    if (_leased)
+    {
+	// A leased message can only be longer than _tmpMessage if RH_ROUTER_MAX_MESSAGE_LEN has been reduced
+	uint16_t tmpMessageSize = sizeof(_tmpMessage);
+	if (messageLen > tmpMessageSize)
+	    messageLen = tmpMessageSize;
+	memcpy(&_tmpMessage, message, messageLen);
+	release();
+    }
+    if (   _tmpMessage.header.dest != RH_BROADCAST_ADDRESS
+	&& _tmpMessage.header.hops++ < _max_hops)
+    {
+	// Maybe it has to be routed to the next hop
+	// REVISIT: if it fails due to no route or unable to deliver to the next hop, 
+	// tell the originator. BUT HOW?
+	route(&_tmpMessage, messageLen);
     }
+    // Discard it and maybe wait for another
     return false;
 }
 
+////////////////////////////////////////////////////////////////////
+void RHRouter::release()
+{
+    if (_leased)
+    {
+	_leased = false;
+	RHReliableDatagram::release();
+    }
+}
+
 ////////////////////////////////////////////////////////////////////
 bool RHRouter::recvfromAckTimeout(uint8_t* buf, uint8_t* len, uint16_t timeout, uint8_t* source, uint8_t* dest, uint8_t* id, uint8_t* flags)
 {  
@@ -28,13 +28,6 @@
 #define RH_ROUTER_MAX_MESSAGE_LEN (RH_MAX_MESSAGE_LEN - sizeof(RHRouter::RoutedMessageHeader))
 //#define RH_ROUTER_MAX_MESSAGE_LEN 50
 
-// These allow us to define a simulated network topology for testing purposes
-// See RHRouter.cpp for details
-//#define RH_TEST_NETWORK 1
-//#define RH_TEST_NETWORK 2
-//#define RH_TEST_NETWORK 3
-//#define RH_TEST_NETWORK 4
-
 /////////////////////////////////////////////////////////////////////
 /// \class RHRouter RHRouter.h <RHRouter.h>
 /// \brief RHReliableDatagram subclass for sending addressed, optionally acknowledged datagrams
@@ -94,6 +87,24 @@
 /// if more than RH_ROUTING_TABLE_SIZE are added, the oldest (first) one will be removed by calling 
 /// retireOldestRoute()
 ///
+/// \par Testing Network Topologies
+///
+/// When testing routing with a few radios on the bench, all the nodes can usually hear each other.
+/// To test other topologies, setLinkFilter() can install a function that decides which nodes each node can hear.
+/// Messages from other nodes are ignored by recvfromAck():
+/// \code
+/// // This network looks like 1-2-3-4
+/// bool chain(uint8_t thisAddress, uint8_t from)
+/// {
+///     return from == thisAddress - 1 || from == thisAddress + 1;
+/// }
+/// ...
+/// manager.setLinkFilter(chain);
+/// \endcode
+/// In simulations, it is better to give the topology to the simulated ether with link lines in its
+/// config file (see RHEther), so that nodes do not even hear (or collide with) nodes they are not linked to.
+/// tools/testnetwork1.conf to tools/testnetwork4.conf are the 4 test networks formerly selected with RH_TEST_NETWORK.
+///
 /// \par Message Format
 ///
 /// RHRouter add to the lower level RHReliableDatagram (and even lower level RH) class message formats. 
@@ -215,7 +226,7 @@ public:
 
     /// Sends a message to the destination node. Initialises the RHRouter message header 
     /// (the SOURCE address is set to the address of this node, HOPS to 0) and calls 
-    /// route() which looks up in the routing table the next hop to deliver to and sends the 
+    /// routeSegments() which looks up in the routing table the next hop to deliver to and sends the 
     /// message to the next hop. Waits for an acknowledgement from the next hop 
     /// (but not from the destination node (if that is different).
     /// \param [in] buf The application message data
@@ -247,6 +258,24 @@ public:
     ///           (usually because it dod not acknowledge due to being off the air or out of range
     uint8_t sendtoFromSourceWait(uint8_t* buf, uint8_t len, uint8_t dest, uint8_t source, uint8_t flags = 0);
 
+    /// Like sendtoWait(), but the application message is made of a list of segments. The RHRouter header
+    /// is sent in front of them as another segment, so the message is not copied. 
+    /// See RHGenericDriver::Segment
+    /// \param [in] segments The first segment of the application message
+    /// \param [in] dest The destination node address
+    /// \param [in] flags Optional flags for use by subclasses or application layer
+    /// \return The result code, as for sendtoWait()
+    uint8_t sendtoWaitSegments(const RHGenericDriver::Segment* segments, uint8_t dest, uint8_t flags = 0);
+
+    /// Like sendtoFromSourceWait(), but the application message is made of a list of segments.
+    /// For internal use only during routing
+    /// \param [in] segments The first segment of the application message
+    /// \param [in] dest The destination node address.
+    /// \param [in] source The (fake) originating node address.
+    /// \param [in] flags Optional flags for use by subclasses or application layer
+    /// \return The result code, as for sendtoFromSourceWait()
+    uint8_t sendtoFromSourceWaitSegments(const RHGenericDriver::Segment* segments, uint8_t dest, uint8_t source, uint8_t flags = 0);
+
     /// Starts the receiver if it is not running already.
     /// If there is a valid message available for this node (or RH_BROADCAST_ADDRESS), 
     /// send an acknowledgement to the last hop
@@ -269,6 +298,22 @@ public:
     /// \return true if a valid message was recvived for this node copied to buf
     bool recvfromAck(uint8_t* buf, uint8_t* len, uint8_t* source = NULL, uint8_t* dest = NULL, uint8_t* id = NULL, uint8_t* flags = NULL);
 
+    /// Like recvfromAck(), but instead of copying the message, sets *buf to point to it. If the driver
+    /// can lease messages (see RHGenericDriver::lease()), that is inside the driver, so the message is not 
+    /// copied at all. Messages to be routed to other nodes are handled as in recvfromAck().
+    /// The message remains valid until release(). Call it promptly, since it sends the ACK.
+    /// \param[out] buf Set to the address of the message
+    /// \param[out] len Set to the length of the message
+    /// \param[in] source If present and not NULL, the referenced uint8_t will be set to the SOURCE address
+    /// \param[in] dest If present and not NULL, the referenced uint8_t will be set to the DEST address
+    /// \param[in] id If present and not NULL, the referenced uint8_t will be set to the ID
+    /// \param[in] flags If present and not NULL, the referenced uint8_t will be set to the FLAGS
+    /// \return true if a valid message was received for this node
+    bool recvfromAckLease(const uint8_t** buf, uint8_t* len, uint8_t* source = NULL, uint8_t* dest = NULL, uint8_t* id = NULL, uint8_t* flags = NULL);
+
+    /// Releases the message returned by recvfromAckLease()
+    void release();
+
     /// Starts the receiver if it is not running already.
     /// Similar to recvfromAck(), this will block until either a valid message available for this node
     /// or the timeout expires. 
@@ -283,6 +328,18 @@ public:
     /// \return true if a valid message was copied to buf
     bool recvfromAckTimeout(uint8_t* buf, uint8_t* len,  uint16_t timeout, uint8_t* source = NULL, uint8_t* dest = NULL, uint8_t* id = NULL, uint8_t* flags = NULL);
 
+    /// Type of a function that decides whether a node can hear another node. See setLinkFilter()
+    /// \param[in] thisAddress The address of the receiving node
+    /// \param[in] from The address of the node that transmitted the message
+    /// \return true if the message is to be received
+    typedef bool (*LinkFilter)(uint8_t thisAddress, uint8_t from);
+
+    /// Sets a function that simulates limited visibility between nodes for testing routing.
+    /// Messages received from a node that the filter rejects are ignored by recvfromAck(), 
+    /// as if they had not been heard.
+    /// \param[in] filter The filter function. NULL (the default) receives messages from all nodes
+    void setLinkFilter(LinkFilter filter);
+
 protected:
 
     /// Lets sublasses peek at messages going 
@@ -292,12 +349,23 @@ protected:
     /// \param [in] messageLen Length of message in octets
     virtual void peekAtMessage(RoutedMessage* message, uint8_t messageLen);
 
-    /// Finds the next-hop route and sends the message via RHReliableDatagram::sendtoWait().
-    /// This is virtual, which lets subclasses override or intercept the route() function.
-    /// Called by sendtoWait after the message header has been filled in.
+    /// Finds the next-hop route and sends a complete RHRouter message with routeSegments().
+    /// Called when forwarding a received message to the next hop.
+    /// Routing of all messages, sent and forwarded, now goes through routeSegments(), so subclasses must
+    /// override that instead. route() used to return uint8_t: it is declared virtual and returning void so
+    /// that a subclass that still overrides route(RoutedMessage*, uint8_t) fails to compile
+    /// (conflicting return type), rather than compiling and silently never being called.
     /// \param [in] message Pointer to the RHRouter message to be sent.
     /// \param [in] messageLen Length of message in octets
-    virtual uint8_t route(RoutedMessage* message, uint8_t messageLen);
+    virtual void route(RoutedMessage* message, uint8_t messageLen);
+
+    /// Finds the next-hop route and sends the header followed by the payload segments
+    /// via RHReliableDatagram::sendtoWaitSegments().
+    /// This is virtual, which lets subclasses override or intercept routing of all messages.
+    /// Called by sendtoWait after the message header has been filled in, and by route().
+    /// \param [in] header Pointer to the RHRouter header of the message to be sent.
+    /// \param [in] payload The first segment of the rest of the message
+    virtual uint8_t routeSegments(RoutedMessageHeader* header, const RHGenericDriver::Segment* payload);
 
     /// Deletes a specific rout entry from therouting table
     /// \param [in] index The 0 based index of the routing table entry to delete
@@ -311,10 +379,17 @@ protected:
     /// If a routed message would exceed this number of hops it is dropped and ignored.
     uint8_t              _max_hops;
 
+    /// Simulates limited visibility between nodes, if not NULL
+    LinkFilter           _linkFilter;
+
 private:
 
-    /// Temporary mesage buffer
-    static RoutedMessage _tmpMessage;
+    /// Temporary mesage buffer.
+    /// Not static, so that multiple instances can be simulated in one process (see RHEtherSimulator)
+    RoutedMessage _tmpMessage;
+
+    /// The message returned by recvfromAckLease() is leased from the driver, not copied to _tmpMessage
+    bool          _leased;
 
     /// Local routing table
     RoutingTableEntry    _routes[RH_ROUTING_TABLE_SIZE];
@@ -85,6 +85,26 @@ uint8_t RHSPIDriver::spiBurstWrite(uint8_t reg, const uint8_t* src, uint8_t len)
     return status;
 }
 
+uint8_t RHSPIDriver::spiBurstWrite(uint8_t reg, const Segment* segments)
+{
+    uint8_t status = 0;
+    ATOMIC_BLOCK_START;
+    _spi.beginTransaction();
+    digitalWrite(_slaveSelectPin, LOW);
+    status = _spi.transfer(reg | RH_SPI_WRITE_MASK); // Send the start address with the write mask on
+    for (; segments; segments = segments->next)
+    {
+	const uint8_t* src = segments->data;
+	uint8_t len = segments->len;
+	while (len--)
+	    _spi.transfer(*src++);
+    }
+    digitalWrite(_slaveSelectPin, HIGH);
+    _spi.endTransaction();
+    ATOMIC_BLOCK_END;
+    return status;
+}
+
 void RHSPIDriver::setSlaveSelectPin(uint8_t slaveSelectPin)
 {
     _slaveSelectPin = slaveSelectPin;
@@ -0,0 +1,555 @@
+// RHTDMA.cpp
+//
+// Copyright (C) 2016 Mike McCauley
+
+#include <RHTDMA.h>
+
+// Beacons carry 32 bit times little endian, whatever the byte order of the nodes
+static void putTime(uint8_t* buf, uint32_t time)
+{
+    for (uint8_t i = 0; i < 4; i++)
+	buf[i] = time >> (i * 8);
+}
+
+static uint32_t getTime(const uint8_t* buf)
+{
+    uint32_t time = 0;
+    for (uint8_t i = 0; i < 4; i++)
+	time |= (uint32_t)buf[i] << (i * 8);
+    return time;
+}
+
+RHTDMA::RHTDMA(RHGenericDriver& driver, uint8_t numSlots)
+    :
+    _driver(driver)
+{
+    if (numSlots == 0)
+	numSlots = 1;
+    if (numSlots > RH_TDMA_MAX_SLOTS)
+	numSlots = RH_TDMA_MAX_SLOTS;
+    _numSlots = numSlots;
+    memset(_slots, RH_TDMA_FREE_SLOT, sizeof(_slots));
+    _coordinator = false;
+    _autoAssign = true;
+    _slotLength = 0;
+    _guardTime = 0;
+    _period = 0;
+    _beaconTime = 0;
+    _frameRef = 0;
+    _synced = false;
+    _maxDelay = RH_TDMA_DEFAULT_MAX_DELAY;
+    _tdmaRejects = 0;
+    _canReply = false;
+    _replyTo = RH_BROADCAST_ADDRESS;
+    _replyDeadline = 0;
+    _backoff = 0;
+    _held = false;
+    _heldBuf = NULL;
+    _heldLen = 0;
+}
+
+bool RHTDMA::init()
+{
+    _coordinator = false;
+    _synced = false;
+    _canReply = false;
+    _held = false;
+    bool ret = _driver.init();
+    sync();
+    return ret;
+}
+
+bool RHTDMA::available()
+{
+    poll();
+    while (!_held)
+    {
+	if (!_driver.available())
+	{
+	    sync();
+	    return false;
+	}
+	// Hold on to the message if we can, so its headers stay valid with a receive queue
+	_held = _driver.lease(&_heldBuf, &_heldLen);
+	if (!(_driver.headerFlags() & RH_FLAGS_TDMA_BEACON))
+	    break;
+
+	uint32_t timestamp = _driver.rxTimestamp();
+	if (_held)
+	{
+	    receiveBeacon(_heldBuf, _heldLen, timestamp);
+	    _driver.release();
+	    _held = false;
+	}
+	else
+	{
+	    uint8_t buf[RH_TDMA_BEACON_HEADER_LEN + RH_TDMA_MAX_SLOTS];
+	    uint8_t len = sizeof(buf);
+	    if (_driver.recv(buf, &len))
+		receiveBeacon(buf, len, timestamp);
+	}
+    }
+    sync();
+    return true;
+}
+
+bool RHTDMA::recv(uint8_t* buf, uint8_t* len)
+{
+    if (!available())
+	return false;
+    bool ret;
+    if (_held)
+    {
+	if (buf && len)
+	{
+	    if (*len > _heldLen)
+		*len = _heldLen;
+	    memcpy(buf, _heldBuf, *len);
+	}
+	received();
+	_driver.release();
+	_held = false;
+	ret = true;
+    }
+    else
+    {
+	ret = _driver.recv(buf, len);
+	if (ret)
+	    received();
+    }
+    sync();
+    return ret;
+}
+
+bool RHTDMA::lease(const uint8_t** buf, uint8_t* len)
+{
+    // available() leases the message from the wrapped driver if it can
+    if (!available() || !_held)
+	return false;
+    *buf = _heldBuf;
+    *len = _heldLen;
+    received();
+    return true;
+}
+
+void RHTDMA::release()
+{
+    if (_held)
+    {
+	_driver.release();
+	_held = false;
+    }
+}
+
+bool RHTDMA::send(const uint8_t* data, uint8_t len)
+{
+    Segment segment = { data, len, NULL };
+    return sendSegments(&segment);
+}
+
+bool RHTDMA::sendSegments(const Segment* segments)
+{
+    uint16_t len = segmentsLength(segments);
+    if (len > _driver.maxMessageLength())
+	return false;
+
+    // Where to start in a free slot, so nodes joining at the same time do not all collide
+#if (RH_PLATFORM == RH_PLATFORM_RASPI) // use standard library random(), bugs in random(min, max)
+    _backoff = random() & 0xff;
+#else
+    _backoff = random(0, 256);
+#endif
+    unsigned long starttime = millis();
+    uint32_t wait;
+    while (true)
+    {
+	// Hear any beacon, and send ours if it is due
+	bool pending = available();
+	if ((wait = timeUntilTransmit(len)) == 0)
+	    break;
+	uint32_t elapsed = millis() - starttime;
+	if (!synced())
+	{
+	    // Wait for a beacon. A message waiting to be received would hold up any beacon behind it
+	    if (pending || elapsed >= _maxDelay)
+	    {
+		_tdmaRejects++;
+		return false;
+	    }
+	    uint32_t timeout = _maxDelay - elapsed;
+	    _driver.waitAvailableTimeout(timeout > 0xffff ? 0xffff : timeout);
+	    continue;
+	}
+	if (   wait == RH_TDMA_NEVER
+	    || elapsed + wait / 1000 > _maxDelay)
+	{
+	    _tdmaRejects++;
+	    return false;
+	}
+	// The coordinator must not sleep through its beacon
+	uint32_t beacon = timeUntilBeacon();
+	if (beacon < wait)
+	    wait = beacon;
+	delay((wait + 999) / 1000);
+    }
+
+    bool ret = _driver.sendSegments(segments);
+    if (ret && _txHeaderTo == _replyTo)
+	_canReply = false; // Only 1 reply per message received
+    sync();
+    return ret;
+}
+
+uint8_t RHTDMA::maxMessageLength()
+{
+    return _driver.maxMessageLength();
+}
+
+uint32_t RHTDMA::timeOnAir(uint8_t len)
+{
+    return _driver.timeOnAir(len);
+}
+
+void RHTDMA::waitAvailable()
+{
+    while (!available())
+    {
+	uint32_t beacon = timeUntilBeacon();
+	if (beacon == RH_TDMA_NEVER)
+	    _driver.waitAvailable();
+	else
+	    _driver.waitAvailableTimeout(beacon > 0xffff * 1000UL ? 0xffff : (beacon + 999) / 1000);
+    }
+}
+
+bool RHTDMA::waitPacketSent()
+{
+    bool ret = _driver.waitPacketSent();
+    sync();
+    return ret;
+}
+
+bool RHTDMA::waitPacketSent(uint16_t timeout)
+{
+    bool ret = _driver.waitPacketSent(timeout);
+    sync();
+    return ret;
+}
+
+bool RHTDMA::waitAvailableTimeout(uint16_t timeout)
+{
+    unsigned long starttime = millis();
+    int32_t timeLeft;
+    while ((timeLeft = timeout - (millis() - starttime)) > 0)
+    {
+	if (available())
+	    return true;
+	// Wake up in time for the next beacon
+	uint32_t beacon = timeUntilBeacon();
+	if (beacon != RH_TDMA_NEVER && (beacon + 999) / 1000 < (uint32_t)timeLeft)
+	    timeLeft = (beacon + 999) / 1000;
+	_driver.waitAvailableTimeout(timeLeft);
+    }
+    return available();
+}
+
+void RHTDMA::setThisAddress(uint8_t thisAddress)
+{
+    RHGenericDriver::setThisAddress(thisAddress);
+    _driver.setThisAddress(thisAddress);
+}
+
+// The transmit headers are kept here as well, so they can be restored after each beacon
+void RHTDMA::setHeaderTo(uint8_t to)
+{
+    RHGenericDriver::setHeaderTo(to);
+    _driver.setHeaderTo(to);
+}
+
+void RHTDMA::setHeaderFrom(uint8_t from)
+{
+    RHGenericDriver::setHeaderFrom(from);
+    _driver.setHeaderFrom(from);
+}
+
+void RHTDMA::setHeaderId(uint8_t id)
+{
+    RHGenericDriver::setHeaderId(id);
+    _driver.setHeaderId(id);
+}
+
+void RHTDMA::setHeaderFlags(uint8_t set, uint8_t clear)
+{
+    RHGenericDriver::setHeaderFlags(set, clear);
+    _driver.setHeaderFlags(set, clear);
+}
+
+void RHTDMA::setPromiscuous(bool promiscuous)
+{
+    _driver.setPromiscuous(promiscuous);
+}
+
+uint8_t RHTDMA::headerTo()
+{
+    return _driver.headerTo();
+}
+
+uint8_t RHTDMA::headerFrom()
+{
+    return _driver.headerFrom();
+}
+
+uint8_t RHTDMA::headerId()
+{
+    return _driver.headerId();
+}
+
+uint8_t RHTDMA::headerFlags()
+{
+    return _driver.headerFlags();
+}
+
+bool RHTDMA::sleep()
+{
+    bool ret = _driver.sleep();
+    sync();
+    return ret;
+}
+
+bool RHTDMA::isChannelActive()
+{
+    bool ret = _driver.isChannelActive();
+    sync();
+    return ret;
+}
+
+bool RHTDMA::setCoordinator(uint8_t maxLen)
+{
+    if (maxLen == 0 || maxLen > _driver.maxMessageLength())
+	maxLen = _driver.maxMessageLength();
+    uint32_t messageTime = _driver.timeOnAir(maxLen);
+    uint32_t beaconTime = _driver.timeOnAir(RH_TDMA_BEACON_HEADER_LEN + _numSlots);
+    if (messageTime == 0 || beaconTime == 0)
+	return false;
+
+    // Room for the message, and the reply to it, and for starting up to 1 delay() tick late
+    uint32_t slotTime = messageTime + RH_TDMA_TURNAROUND + _driver.timeOnAir(RH_TDMA_REPLY_LEN) + RH_TDMA_DELAY_RESOLUTION;
+    // The guard times allow for 2 clocks drifting apart in opposite directions while a node misses beacons.
+    // The drift depends on the period, which depends on the guard time, so refine it once
+    uint32_t guardTime = RH_TDMA_MIN_GUARD_TIME;
+    uint32_t period = 0;
+    for (uint8_t i = 0; i < 2; i++)
+    {
+	period = beaconTime + 2 * guardTime + _numSlots * (slotTime + 2 * guardTime);
+	guardTime = RH_TDMA_MIN_GUARD_TIME
+	    + (uint64_t)period * (RH_TDMA_MAX_MISSED_BEACONS + 1) * RH_TDMA_CLOCK_TOLERANCE * 2 / 1000000;
+    }
+    _guardTime = guardTime;
+    _slotLength = slotTime + 2 * guardTime;
+    _period = beaconTime + 2 * guardTime + _numSlots * _slotLength;
+    _beaconTime = beaconTime;
+    _slots[0] = _thisAddress;
+
+    _coordinator = true;
+    _synced = true;
+    _canReply = false;
+    // The first beacon is due now
+    _frameRef = micros() - _period + _beaconTime;
+    return true;
+}
+
+bool RHTDMA::assignSlot(uint8_t slot, uint8_t address)
+{
+    if (slot >= _numSlots)
+	return false;
+    _slots[slot] = address;
+    return true;
+}
+
+void RHTDMA::setAutoAssign(bool autoAssign)
+{
+    _autoAssign = autoAssign;
+}
+
+uint8_t RHTDMA::slotOwner(uint8_t slot)
+{
+    return slot < _numSlots ? _slots[slot] : RH_TDMA_FREE_SLOT;
+}
+
+bool RHTDMA::synced()
+{
+    if (_coordinator)
+	return true;
+    return _synced && (micros() - _frameRef) <= _period * (RH_TDMA_MAX_MISSED_BEACONS + 1);
+}
+
+void RHTDMA::setMaxDelay(uint32_t maxDelay)
+{
+    _maxDelay = maxDelay;
+}
+
+uint32_t RHTDMA::timeUntilTransmit(uint8_t len)
+{
+    if (!synced())
+	return RH_TDMA_NEVER;
+    uint32_t now = micros();
+    uint32_t messageTime = _driver.timeOnAir(len);
+
+    // A reply to the owner of the slot we are in
+    if (_canReply && _txHeaderTo == _replyTo && (int32_t)(_replyDeadline - now - messageTime) >= 0)
+	return 0;
+
+    // Else the next slot we may use, in this frame or the next, with room for the message and its reply
+    uint32_t need = messageTime + RH_TDMA_TURNAROUND + _driver.timeOnAir(RH_TDMA_REPLY_LEN);
+    bool hasSlot = slotOf(_thisAddress) != RH_TDMA_FREE_SLOT;
+    uint32_t frameStart = now - (now - _frameRef) % _period;
+    for (uint8_t frame = 0; frame < 2; frame++, frameStart += _period)
+    {
+	for (uint8_t i = 0; i < _numSlots; i++)
+	{
+	    if (!(   _slots[i] == _thisAddress
+		  || (_slots[i] == RH_TDMA_FREE_SLOT && !hasSlot)))
+		continue;
+	    uint32_t slotStart = frameStart + _guardTime + i * _slotLength;
+	    if (_slotLength < 2 * _guardTime + need)
+		return RH_TDMA_NEVER; // Too long for any slot
+	    uint32_t earliest = slotStart + _guardTime;
+	    uint32_t latest = slotStart + _slotLength - _guardTime - need;
+	    if (_slots[i] == RH_TDMA_FREE_SLOT && latest - earliest > RH_TDMA_DELAY_RESOLUTION)
+		earliest += (uint64_t)(latest - earliest - RH_TDMA_DELAY_RESOLUTION) * _backoff / 256;
+	    if ((int32_t)(latest - now) < 0)
+		continue;
+	    return (int32_t)(earliest - now) > 0 ? earliest - now : 0;
+	}
+    }
+    return RH_TDMA_NEVER;
+}
+
+void RHTDMA::poll()
+{
+    if (!_coordinator)
+	return;
+    // Skip any beacons we are too late for. Nodes carry on with the timing of the previous one
+    while ((int32_t)(micros() - (_frameRef + _period - _beaconTime)) > (int32_t)_guardTime)
+	_frameRef += _period;
+    if ((int32_t)(_frameRef + _period - _beaconTime - micros()) <= (int32_t)(_guardTime / 2))
+	sendBeacon();
+}
+
+uint32_t RHTDMA::timeUntilBeacon()
+{
+    if (!_coordinator)
+	return RH_TDMA_NEVER;
+    int32_t wait = _frameRef + _period - _beaconTime - micros();
+    return wait > 0 ? wait : 0;
+}
+
+void RHTDMA::sendBeacon()
+{
+    _frameRef += _period;
+    uint8_t beacon[RH_TDMA_BEACON_HEADER_LEN + RH_TDMA_MAX_SLOTS];
+    beacon[0] = _numSlots;
+    putTime(beacon + 1, _slotLength);
+    putTime(beacon + 5, _guardTime);
+    putTime(beacon + 9, _period);
+    memcpy(beacon + RH_TDMA_BEACON_HEADER_LEN, _slots, _numSlots);
+
+    _driver.setHeaderTo(RH_BROADCAST_ADDRESS);
+    _driver.setHeaderFrom(_thisAddress);
+    _driver.setHeaderId(0);
+    _driver.setHeaderFlags(RH_FLAGS_TDMA_BEACON, 0xff);
+    // How late it is, so nodes can find the proper frame start from its actual end. May be negative
+    putTime(beacon + 13, micros() + _beaconTime - _frameRef);
+    _driver.send(beacon, RH_TDMA_BEACON_HEADER_LEN + _numSlots);
+    _driver.waitPacketSent();
+    _canReply = false;
+
+    // Restore the headers of the messages being sent through us
+    _driver.setHeaderTo(_txHeaderTo);
+    _driver.setHeaderFrom(_txHeaderFrom);
+    _driver.setHeaderId(_txHeaderId);
+    _driver.setHeaderFlags(_txHeaderFlags, 0xff);
+    sync();
+}
+
+void RHTDMA::receiveBeacon(const uint8_t* buf, uint8_t len, uint32_t timestamp)
+{
+    // Ignore beacons from any other coordinator
+    if (   _coordinator
+	|| len < RH_TDMA_BEACON_HEADER_LEN
+	|| buf[0] == 0
+	|| buf[0] > RH_TDMA_MAX_SLOTS
+	|| len < RH_TDMA_BEACON_HEADER_LEN + buf[0])
+	return;
+    _numSlots = buf[0];
+    _slotLength = getTime(buf + 1);
+    _guardTime = getTime(buf + 5);
+    _period = getTime(buf + 9);
+    if (_period == 0)
+	return;
+    memcpy(_slots, buf + RH_TDMA_BEACON_HEADER_LEN, _numSlots);
+    _frameRef = timestamp - getTime(buf + 13);
+    _synced = true;
+    _canReply = false;
+}
+
+void RHTDMA::received()
+{
+    _canReply = false;
+    uint8_t from = _driver.headerFrom();
+    if (!synced() || from == _thisAddress)
+	return;
+
+    // Which slot did it finish in?
+    uint32_t timestamp = _driver.rxTimestamp();
+    if ((int32_t)(timestamp - _frameRef) < 0)
+	return; // Before the current frame
+    uint32_t offset = (timestamp - _frameRef) % _period;
+    if (offset < _guardTime)
+	return;
+    uint8_t slot = (offset - _guardTime) / _slotLength;
+    if (slot >= _numSlots)
+	return; // During the beacon
+    if (_slots[slot] != from && _slots[slot] != RH_TDMA_FREE_SLOT)
+	return; // Someone elses reply
+
+    // Give a node heard in a free slot its own, keeping 1 free for the next node to join with
+    if (_coordinator && _autoAssign && _slots[slot] == RH_TDMA_FREE_SLOT && slotOf(from) == RH_TDMA_FREE_SLOT)
+    {
+	uint8_t free = 0, first = 0;
+	for (uint8_t i = _numSlots; i-- > 0; )
+	{
+	    if (_slots[i] == RH_TDMA_FREE_SLOT)
+	    {
+		free++;
+		first = i;
+	    }
+	}
+	if (free > 1)
+	    _slots[first] = from;
+    }
+
+    // Only the addressee replies, and the reply must finish before the guard time at the end of the slot
+    if (_driver.headerTo() == _thisAddress)
+    {
+	_canReply = true;
+	_replyTo = from;
+	_replyDeadline = timestamp - offset + (slot + 1) * _slotLength;
+    }
+}
+
+uint8_t RHTDMA::slotOf(uint8_t address)
+{
+    for (uint8_t i = 0; i < _numSlots; i++)
+	if (_slots[i] == address)
+	    return i;
+    return RH_TDMA_FREE_SLOT;
+}
+
+void RHTDMA::sync()
+{
+    _mode = _driver.mode();
+    _lastRssi = _driver.lastRssi();
+    _rxTimestamp = _driver.rxTimestamp();
+    _txTimestamp = _driver.txTimestamp();
+}
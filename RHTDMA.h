@@ -0,0 +1,392 @@
+// RHTDMA.h
+// Author: Mike McCauley (mikem@airspayce.com)
+// Time division multiple access for any RadioHead driver
+// Copyright (C) 2016 Mike McCauley
+
+#ifndef RHTDMA_h
+#define RHTDMA_h
+
+#include <RHGenericDriver.h>
+
+// Maximum number of slots in a frame. Each costs 1 octet of RAM, and 1 octet in every beacon
+#ifndef RH_TDMA_MAX_SLOTS
+#define RH_TDMA_MAX_SLOTS 32
+#endif
+
+// Default number of slots in a frame
+#define RH_TDMA_DEFAULT_SLOTS 8
+
+// Owner of a slot that any node without a slot of its own may use
+#define RH_TDMA_FREE_SLOT RH_BROADCAST_ADDRESS
+
+// Reserved FLAGS header bit that marks beacons
+#define RH_FLAGS_TDMA_BEACON 0x40
+
+// Octets of a beacon before the slot table
+#define RH_TDMA_BEACON_HEADER_LEN 17
+
+// Smallest guard time in microseconds at each end of a slot, for interrupt latency and timestamp errors
+#ifndef RH_TDMA_MIN_GUARD_TIME
+#define RH_TDMA_MIN_GUARD_TIME 2000
+#endif
+
+// Worst clock error of any node in parts per million. The guard times allow for 2 nodes
+// drifting apart by twice this, for RH_TDMA_MAX_MISSED_BEACONS frames
+#ifndef RH_TDMA_CLOCK_TOLERANCE
+#define RH_TDMA_CLOCK_TOLERANCE 100
+#endif
+
+// Number of beacons in a row a node may miss before it stops transmitting
+#ifndef RH_TDMA_MAX_MISSED_BEACONS
+#define RH_TDMA_MAX_MISSED_BEACONS 4
+#endif
+
+// Time in microseconds a node takes to receive a message and start transmitting the reply
+#ifndef RH_TDMA_TURNAROUND
+#define RH_TDMA_TURNAROUND 5000
+#endif
+
+// delay() has a resolution of 1 millisecond, and may return up to 1 millisecond more than asked, so
+// transmissions may start up to this many microseconds late
+#define RH_TDMA_DELAY_RESOLUTION 2000
+
+// Length of the reply each slot has room for: the 1 octet ACK of RHReliableDatagram
+#define RH_TDMA_REPLY_LEN 1
+
+// Default maximum time in milliseconds that send() waits for a slot
+#define RH_TDMA_DEFAULT_MAX_DELAY 10000
+
+// Returned by timeUntilTransmit() when the message can not be sent, because this node is not synchronised
+// to the coordinator, or has no slot long enough for it
+#define RH_TDMA_NEVER 0xffffffff
+
+/////////////////////////////////////////////////////////////////////
+/// \class RHTDMA RHTDMA.h <RHTDMA.h>
+/// \brief Driver wrapper that divides time into slots, so that nodes take turns to transmit.
+///
+/// When many nodes send to one gateway, their messages collide more and more often as the traffic grows,
+/// and the retransmissions make it worse. RHTDMA wraps any other driver, and gives each node its own
+/// slot in a repeating frame, so nodes never transmit at the same time.
+///
+/// One node is the coordinator (usually the gateway). At the start of each frame it broadcasts a beacon,
+/// carrying the slot length, guard time, frame period and the owner of each slot. Other nodes synchronise
+/// to the end of each beacon they hear, using rxTimestamp(), and transmit only in the slots they own.
+/// Each slot has room for one message of up to the length given to setCoordinator(), plus a reply from the
+/// addressee, such as the ACK of RHReliableDatagram. A node may reply to the owner of a slot within that slot.
+/// Slot 0 belongs to the coordinator.
+///
+/// Slots not owned by anyone are free, and shared by all the nodes that do not have a slot.
+/// When the coordinator hears a node in a free slot, it assigns that node a slot of its own, always
+/// leaving 1 free slot for new nodes to join with (see setAutoAssign()). You can also assign slots with
+/// assignSlot().
+///
+/// send() waits for the next slot this node may use, for up to the maximum delay set by setMaxDelay().
+/// If the node has not heard a beacon recently, it waits for one first. If that takes too long, the message is
+/// refused, and send() returns false.
+///
+/// The slots are sized with the timeOnAir() of the coordinator's driver, so the driver must be able to calculate it,
+/// and all nodes must use the same modem configuration. The guard time at each end of a slot allows for
+/// RH_TDMA_MIN_GUARD_TIME of timing error, plus the clock drift between nodes over RH_TDMA_MAX_MISSED_BEACONS frames.
+///
+/// The coordinator sends beacons from within the functions of RHTDMA (and of the managers above it), so the
+/// coordinator must keep calling them, such as with recvfromAckTimeout() in its main loop. If it misses the
+/// time for a beacon, it skips that beacon, and nodes carry on with the timing of the previous one.
+/// Since delay() only has a resolution of 1 millisecond, beacons start a little early or late. Each beacon
+/// carries how far it is from its proper time, so the frames stay put.
+/// Beacons are not relayed, so all the nodes must be in range of the coordinator.
+/// \code
+/// // Gateway
+/// RH_RF95 rf95;
+/// RHTDMA driver(rf95, 16);
+/// RHReliableDatagram manager(driver, SERVER_ADDRESS);
+/// ...
+/// manager.init();
+/// driver.setCoordinator(20);  // Slots for messages of up to 20 octets
+/// while (1)
+///     if (manager.recvfromAckTimeout(buf, &len, 1000, &from))
+///         ...
+///
+/// // Sensors
+/// RH_RF95 rf95;
+/// RHTDMA driver(rf95);
+/// RHReliableDatagram manager(driver, CLIENT_ADDRESS);
+/// ...
+/// manager.init();
+/// manager.sendtoWait(data, sizeof(data), SERVER_ADDRESS); // Waits for a beacon, then a slot
+/// \endcode
+/// Configure the wrapped driver (frequency, power, modem configuration etc) directly, but send and receive
+/// through the RHTDMA. The counters in statistics() etc are those of the wrapped driver.
+class RHTDMA : public RHGenericDriver
+{
+public:
+    /// Constructor
+    /// \param[in] driver The driver to send and receive with
+    /// \param[in] numSlots Number of slots in each frame, if this node is the coordinator.
+    /// Other nodes learn it from the beacons.
+    RHTDMA(RHGenericDriver& driver, uint8_t numSlots = RH_TDMA_DEFAULT_SLOTS);
+
+    /// Initialises the wrapped driver. This node is not the coordinator, and is not synchronised,
+    /// until setCoordinator() is called or a beacon is received.
+    /// \return true if initialisation succeeded.
+    virtual bool init();
+
+    /// Tests whether a new message is available from the wrapped driver. Beacons are processed
+    /// and discarded. On the coordinator, sends a beacon if one is due.
+    /// \return true if a new, complete, error-free uncollected message is available to be retreived by recv().
+    virtual bool available();
+
+    /// Receives a message from the wrapped driver. See RHGenericDriver::recv()
+    /// \param[in] buf Location to copy the received message
+    /// \param[in,out] len Pointer to available space in buf. Set to the actual number of octets copied.
+    /// \return true if a valid message was copied to buf
+    virtual bool recv(uint8_t* buf, uint8_t* len);
+
+    /// Leases a message from the wrapped driver. See RHGenericDriver::lease()
+    /// \param[out] buf Set to the address of the message
+    /// \param[out] len Set to the length of the message
+    /// \return true if a message was leased
+    virtual bool lease(const uint8_t** buf, uint8_t* len);
+
+    /// Releases the message leased by lease()
+    virtual void release();
+
+    /// Waits for a slot this node may use, and sends a message in it with the wrapped driver.
+    /// \param[in] data Array of data to be sent
+    /// \param[in] len Number of bytes of data to send (> 0)
+    /// \return true if the message was sent. false if it was refused by the wrapped driver, or because
+    /// there was no slot for it within the maximum delay. See tdmaRejects()
+    virtual bool send(const uint8_t* data, uint8_t len);
+
+    /// Like send(), but the message is made of a list of segments. See RHGenericDriver::sendSegments()
+    /// \param[in] segments The first segment of the message
+    /// \return true if the message was sent
+    virtual bool sendSegments(const Segment* segments);
+
+    /// Returns the maximum message length of the wrapped driver
+    /// \return The maximum legal message length
+    virtual uint8_t maxMessageLength();
+
+    /// Returns the time on air of the wrapped driver
+    /// \param[in] len Length of the message payload, not including the RadioHead headers
+    /// \return The time on air in microseconds, or 0 if unknown
+    virtual uint32_t timeOnAir(uint8_t len);
+
+    /// Waits for a message with the wrapped driver. On the coordinator, sends the beacons while waiting.
+    virtual void waitAvailable();
+
+    /// Waits for the wrapped driver to finish transmitting
+    /// \return true
+    virtual bool waitPacketSent();
+
+    /// Waits for the wrapped driver to finish transmitting, or a timeout
+    /// \param[in] timeout Maximum time to wait in milliseconds.
+    /// \return true if the transmission completed within the timeout period. False if it timed out.
+    virtual bool waitPacketSent(uint16_t timeout);
+
+    /// Waits for a message with the wrapped driver, or a timeout. On the coordinator, sends the beacons
+    /// while waiting.
+    /// \param[in] timeout Maximum time to wait in milliseconds.
+    /// \return true if a message is available
+    virtual bool waitAvailableTimeout(uint16_t timeout);
+
+    /// Sets the address of this node in the wrapped driver
+    /// \param[in] thisAddress The address of this node.
+    virtual void setThisAddress(uint8_t thisAddress);
+
+    /// Sets the TO header in the wrapped driver
+    /// \param[in] to The new TO header value
+    virtual void setHeaderTo(uint8_t to);
+
+    /// Sets the FROM header in the wrapped driver
+    /// \param[in] from The new FROM header value
+    virtual void setHeaderFrom(uint8_t from);
+
+    /// Sets the ID header in the wrapped driver
+    /// \param[in] id The new ID header value
+    virtual void setHeaderId(uint8_t id);
+
+    /// Sets and clears bits in the FLAGS header in the wrapped driver
+    /// \param[in] set bitmask of bits to be set.
+    /// \param[in] clear bitmask of flags to clear.
+    virtual void setHeaderFlags(uint8_t set, uint8_t clear = RH_FLAGS_APPLICATION_SPECIFIC);
+
+    /// Sets promiscuous mode in the wrapped driver
+    /// \param[in] promiscuous true if you wish to receive messages with any TO address
+    virtual void setPromiscuous(bool promiscuous);
+
+    /// Returns the TO header of the last message received by the wrapped driver
+    /// \return The TO header
+    virtual uint8_t headerTo();
+
+    /// Returns the FROM header of the last message received by the wrapped driver
+    /// \return The FROM header
+    virtual uint8_t headerFrom();
+
+    /// Returns the ID header of the last message received by the wrapped driver
+    /// \return The ID header
+    virtual uint8_t headerId();
+
+    /// Returns the FLAGS header of the last message received by the wrapped driver
+    /// \return The FLAGS header
+    virtual uint8_t headerFlags();
+
+    /// Puts the wrapped driver to sleep. Beacons sent while it sleeps are missed.
+    /// \return true if sleep mode was successfully entered.
+    virtual bool sleep();
+
+    /// Tells whether the wrapped driver can hear another node transmitting
+    /// \return true if the channel is busy
+    virtual bool isChannelActive();
+
+    /// Makes this node the coordinator, and sends the first beacon at the next opportunity.
+    /// Sizes the slots from the timeOnAir() of the wrapped driver, so call it after init(), and after
+    /// configuring the modem. Slot 0 is assigned to this node.
+    /// \param[in] maxLen The longest message (not including the RadioHead headers) that nodes will send.
+    /// 0 means maxMessageLength(). Longer messages will never be sent.
+    /// \return true if the slots could be sized. false if the wrapped driver can not calculate its time on air.
+    bool setCoordinator(uint8_t maxLen = 0);
+
+    /// Tells whether this node is the coordinator
+    /// \return true if setCoordinator() has been called since init()
+    bool isCoordinator() { return _coordinator; }
+
+    /// Assigns a slot to a node. Only meaningful on the coordinator. The new assignment takes effect
+    /// at the next beacon.
+    /// \param[in] slot The slot, from 0 to the number of slots - 1
+    /// \param[in] address The node that may transmit in the slot, or RH_TDMA_FREE_SLOT to free it
+    /// \return true if slot is valid
+    bool assignSlot(uint8_t slot, uint8_t address);
+
+    /// Enables or disables the automatic assignment of slots to nodes heard in free slots. Enabled by default.
+    /// \param[in] autoAssign true to assign slots automatically
+    void setAutoAssign(bool autoAssign);
+
+    /// Returns the owner of a slot, as known to this node
+    /// \param[in] slot The slot
+    /// \return The address of the node that may transmit in the slot, or RH_TDMA_FREE_SLOT
+    uint8_t slotOwner(uint8_t slot);
+
+    /// Returns the number of slots in each frame, as known to this node
+    /// \return The number of slots
+    uint8_t numSlots() { return _numSlots; }
+
+    /// Returns the length of each slot, including its guard times
+    /// \return The slot length in microseconds, or 0 if not yet known
+    uint32_t slotLength() { return _slotLength; }
+
+    /// Returns the length of a frame: the beacon and all the slots
+    /// \return The frame period in microseconds, or 0 if not yet known
+    uint32_t framePeriod() { return _period; }
+
+    /// Tells whether this node knows when the slots are. Nodes lose synchronisation
+    /// if they miss more than RH_TDMA_MAX_MISSED_BEACONS beacons in a row.
+    /// \return true if this node is the coordinator, or has heard a beacon recently
+    bool synced();
+
+    /// Sets the maximum time that send() waits for a slot, including any time spent waiting for a beacon.
+    /// Defaults to RH_TDMA_DEFAULT_MAX_DELAY.
+    /// \param[in] maxDelay Maximum delay in milliseconds
+    void setMaxDelay(uint32_t maxDelay);
+
+    /// Returns how long it will be until this node could start to transmit a message.
+    /// Schedulers can use this to plan their transmissions.
+    /// \param[in] len Length of the message payload, not including the RadioHead headers
+    /// \return The time in microseconds, 0 if it can be sent now, or RH_TDMA_NEVER
+    uint32_t timeUntilTransmit(uint8_t len);
+
+    /// Returns the number of messages that were refused because there was no slot for them in time
+    /// \return The number of messages refused
+    uint32_t tdmaRejects() { return _tdmaRejects; }
+
+protected:
+    /// On the coordinator, sends a beacon if one is due, or skips it if it is too late
+    void poll();
+
+    /// Returns how long until the coordinator must send its next beacon
+    /// \return The time in microseconds, or RH_TDMA_NEVER if this node is not the coordinator
+    uint32_t timeUntilBeacon();
+
+    /// Broadcasts a beacon with the wrapped driver, and starts the next frame
+    void sendBeacon();
+
+    /// Adopts the slots in a beacon, and synchronises to its end
+    /// \param[in] buf The beacon
+    /// \param[in] len Length of the beacon
+    /// \param[in] timestamp rxTimestamp() of the beacon
+    void receiveBeacon(const uint8_t* buf, uint8_t len, uint32_t timestamp);
+
+    /// Notes the slot a message was received in, so a reply can be sent in the same slot.
+    /// The coordinator also assigns a slot to a node heard in a free slot
+    void received();
+
+    /// Finds the slot owned by a node
+    /// \param[in] address The node
+    /// \return The slot, or RH_TDMA_FREE_SLOT if the node has none
+    uint8_t slotOf(uint8_t address);
+
+    /// Copies the mode and RSSI of the wrapped driver, so mode() and lastRssi() work
+    void sync();
+
+private:
+    /// The driver we are wrapping
+    RHGenericDriver&    _driver;
+
+    /// True if this node sends the beacons
+    bool                _coordinator;
+
+    /// True if the coordinator assigns slots to nodes it hears in free slots
+    bool                _autoAssign;
+
+    /// Number of slots in each frame
+    uint8_t             _numSlots;
+
+    /// Owner of each slot
+    uint8_t             _slots[RH_TDMA_MAX_SLOTS];
+
+    /// Length of each slot in microseconds, including its guard times
+    uint32_t            _slotLength;
+
+    /// Guard time at each end of each slot in microseconds
+    uint32_t            _guardTime;
+
+    /// Length of a frame in microseconds
+    uint32_t            _period;
+
+    /// Time on air of a beacon in microseconds
+    uint32_t            _beaconTime;
+
+    /// micros() at the end of the last beacon, if it had been sent on time. The first slot starts 1 guard time later
+    uint32_t            _frameRef;
+
+    /// True if a beacon has been received
+    bool                _synced;
+
+    /// Maximum time in milliseconds that send() waits for a slot
+    uint32_t            _maxDelay;
+
+    /// Number of messages refused
+    uint32_t            _tdmaRejects;
+
+    /// True if a message to _replyTo may be sent before _replyDeadline
+    bool                _canReply;
+
+    /// Owner of the slot the last message was received in
+    uint8_t             _replyTo;
+
+    /// micros() when a reply must be finished by
+    uint32_t            _replyDeadline;
+
+    /// Random point in the free slots to start sending at, in 256ths of the time available
+    uint8_t             _backoff;
+
+    /// True if a message is leased from the wrapped driver by available()
+    bool                _held;
+
+    /// The held message
+    const uint8_t*      _heldBuf;
+
+    /// Length of the held message
+    uint8_t             _heldLen;
+};
+
+#endif
@@ -12,6 +12,12 @@
 #define RH_TCP_MESSAGE_TYPE_NOP               0
 #define RH_TCP_MESSAGE_TYPE_THISADDRESS       1
 #define RH_TCP_MESSAGE_TYPE_PACKET            2
+#define RH_TCP_MESSAGE_TYPE_TIME              3
+#define RH_TCP_MESSAGE_TYPE_WAIT              4
+#define RH_TCP_MESSAGE_TYPE_AIRTIME           5
+
+// Value of RHTcpWait until meaning wait forever
+#define RH_TCP_WAIT_FOREVER 0xffffffffffffffffULL
 
 // Maximum message length (including the headers) we are willing to support
 #define RH_TCP_MAX_PAYLOAD_LEN 255
@@ -61,6 +67,39 @@ typedef struct
     uint8_t         payload[RH_TCP_MAX_MESSAGE_LEN]; ///< 0 or more, length deduced from length above
 }   RHTcpPacket;
 
+/// \brief RH_TCP message from a virtual time simulator giving the current virtual time.
+/// The client may run until it sends a RHTcpWait message.
+/// A simulator running in virtual time sends one immediately after a client connects.
+typedef struct
+{
+    uint32_t        length; ///< Number of octets following, in network byte order
+    uint8_t         type;   ///< == RH_TCP_MESSAGE_TYPE_TIME
+    uint32_t        timeHi; ///< Most significant 32 bits of the virtual time in microseconds, network byte order
+    uint32_t        timeLo; ///< Least significant 32 bits of the virtual time in microseconds, network byte order
+}   RHTcpTime;
+
+/// \brief RH_TCP message to a virtual time simulator, telling it that the client is
+/// blocked until a given virtual time.
+/// The simulator replies with a RHTcpTime message when the client is to run again
+typedef struct
+{
+    uint32_t        length;       ///< Number of octets following, in network byte order
+    uint8_t         type;         ///< == RH_TCP_MESSAGE_TYPE_WAIT
+    uint32_t        untilHi;      ///< Most significant 32 bits of the wake time in microseconds, network byte order
+    uint32_t        untilLo;      ///< Least significant 32 bits of the wake time in microseconds, network byte order
+    uint8_t         wakeOnPacket; ///< If non-zero, wake before until if a packet is delivered to this client
+}   RHTcpWait;
+
+/// \brief RH_TCP message telling the simulator the time on air of the next
+/// RHTcpPacket from this client, as computed by the client from its airtime profile.
+/// Simulators that do not support this message use their own bit rate.
+typedef struct
+{
+    uint32_t        length;  ///< Number of octets following, in network byte order
+    uint8_t         type;    ///< == RH_TCP_MESSAGE_TYPE_AIRTIME
+    uint32_t        airtime; ///< Time on air in microseconds, network byte order
+}   RHTcpAirtime;
+
 #pragma pack(pop)
 
 #endif
@@ -0,0 +1,84 @@
+// RHTrace.cpp
+//
+// Copyright (C) 2016 Mike McCauley
+
+#include <RHTrace.h>
+
+#if RH_ENABLE_TRACE
+
+RHTrace::Entry    RHTrace::_entries[RH_TRACE_SIZE];
+volatile uint8_t  RHTrace::_next = 0;
+volatile uint32_t RHTrace::_recorded = 0;
+volatile bool     RHTrace::_enabled = true;
+
+void RHTrace::setEnabled(bool enabled)
+{
+    _enabled = enabled;
+}
+
+void RHTrace::clear()
+{
+    ATOMIC_BLOCK_START;
+    _next = 0;
+    _recorded = 0;
+    ATOMIC_BLOCK_END;
+}
+
+uint8_t RHTrace::count()
+{
+    uint32_t recorded = RHTrace::recorded();
+    return recorded < RH_TRACE_SIZE ? recorded : RH_TRACE_SIZE;
+}
+
+// 32 bit counters are not read atomically on 8 bit processors
+uint32_t RHTrace::recorded()
+{
+    uint32_t recorded;
+    ATOMIC_BLOCK_START;
+    recorded = _recorded;
+    ATOMIC_BLOCK_END;
+    return recorded;
+}
+
+bool RHTrace::get(uint8_t index, Entry* entry)
+{
+    bool ret = false;
+    ATOMIC_BLOCK_START;
+    uint8_t n = _recorded < RH_TRACE_SIZE ? _recorded : RH_TRACE_SIZE;
+    if (index < n)
+    {
+	// The oldest entry is the next one to be overwritten, once the ring is full
+	*entry = _entries[(uint8_t)(_next - n + index) & (RH_TRACE_SIZE - 1)];
+	ret = true;
+    }
+    ATOMIC_BLOCK_END;
+    return ret;
+}
+
+void RHTrace::dump()
+{
+#ifdef RH_HAVE_SERIAL
+    bool enabled = _enabled;
+    _enabled = false; // So the events do not change while they are printed
+    uint8_t i, n = count();
+    Serial.print("trace: ");
+    Serial.print(recorded());
+    Serial.println(" events");
+    for (i = 0; i < n; i++)
+    {
+	Entry entry;
+	get(i, &entry);
+	Serial.print(entry.time);
+	Serial.print(' ');
+	Serial.print(entry.source);
+	Serial.print(' ');
+	Serial.print(entry.event);
+	Serial.print(' ');
+	Serial.print((unsigned int)entry.value, HEX);
+	Serial.println("");
+    }
+    _enabled = enabled;
+#endif
+}
+
+#endif
@@ -0,0 +1,153 @@
+// RHTrace.h
+// Author: Mike McCauley (mikem@airspayce.com)
+// Copyright (C) 2016 Mike McCauley
+
+#ifndef RHTrace_h
+#define RHTrace_h
+
+#include <RadioHead.h>
+
+// Set to 1 to record events from inside the drivers in the RHTrace ring buffer. See RHTrace.
+// When 0, the drivers contain no tracing code at all
+#ifndef RH_ENABLE_TRACE
+#define RH_ENABLE_TRACE 0
+#endif
+
+// Number of events kept in the RHTrace ring buffer. Must be a power of 2, no more than 128.
+// Each event takes 8 octets of RAM
+#ifndef RH_TRACE_SIZE
+#define RH_TRACE_SIZE 32
+#endif
+
+#if RH_ENABLE_TRACE
+ // Records an event in the RHTrace ring buffer. For use inside RHGenericDriver and its subclasses
+ #define RH_TRACE_EVENT(event, value) RHTrace::record((event), (value), _thisAddress)
+#else
+ #define RH_TRACE_EVENT(event, value)
+#endif
+
+#if RH_ENABLE_TRACE
+/////////////////////////////////////////////////////////////////////
+/// \class RHTrace RHTrace.h <RHTrace.h>
+/// \brief Ring buffer of timestamped events recorded inside the drivers, including their interrupt handlers
+///
+/// When a radio misbehaves in the field, it is usually not possible to see what the driver
+/// and its interrupt handler did, and printing from an interrupt handler is not safe.
+/// When RH_ENABLE_TRACE is defined as 1 (in this file, or on the compiler command line), the drivers
+/// record what they do in a small, fixed size ring buffer in RAM:
+/// - mode changes made by setModeIdle(), setModeRx(), setModeTx(), sleep() and isChannelActive()
+/// - each call to handleInterrupt(), with the interrupt flags read from the radio
+/// - each message given to send(), and the end of each transmission
+/// - each good message received, and errors such as CRC errors (the same as those reported by
+///   RHGenericDriver::setErrorCallback())
+/// - fragments moved to or from the FIFO by RH_RF22 and RH_RF24
+///
+/// Recording an event takes a call to micros() and a few instructions with interrupts disabled.
+/// When RH_ENABLE_TRACE is 0 (the default), RHTrace is not compiled, and the drivers contain no
+/// tracing code.
+///
+/// The buffer keeps the most recent RH_TRACE_SIZE events. Your program can print them at any
+/// time with dump(), for example when a send fails, or read them with get(). Recording is paused
+/// while dump() runs. Applications can record their own events with codes from RHTraceUser upwards,
+/// so they appear in order with the driver events.
+///
+/// \code
+/// #if RH_ENABLE_TRACE
+///     if (!manager.sendtoWait(data, sizeof(data), SERVER_ADDRESS))
+///         RHTrace::dump();
+/// #endif
+/// \endcode
+///
+/// dump() prints one line per event, oldest first: the time in microseconds, the address
+/// of the driver that recorded it (its thisAddress), the event code and the value in hex.
+///
+/// There is one ring buffer for the whole program, shared by all drivers.
+class RHTrace
+{
+public:
+    /// \brief Codes for the events recorded in the ring buffer
+    typedef enum
+    {
+	RHTraceMode = 1,     ///< The radio changed mode. Value is the new RHGenericDriver::RHMode
+	RHTraceInterrupt,    ///< handleInterrupt() was called. Value is the interrupt flags read from the radio, if any
+	RHTraceSend,         ///< A message was given to the radio to send. Value is its length, without headers
+	RHTraceTxDone,       ///< A transmission finished. Value is the TO header << 8 | the ID header
+	RHTraceRxGood,       ///< A good message was received. Value is the FROM header << 8 | the ID header
+	RHTraceError,        ///< An error was reported. Value is the RHGenericDriver::RHError
+	RHTraceFifoRead,     ///< A fragment was read from the receive FIFO. Value is the number of octets
+	RHTraceFifoWrite,    ///< A fragment was written to the transmit FIFO. Value is the number of octets
+	RHTraceUser = 0x80   ///< The first code available for events recorded by applications
+    } Event;
+
+    /// \brief An event in the ring buffer
+    typedef struct
+    {
+	uint32_t time;      ///< micros() when the event was recorded
+	uint16_t value;     ///< Depends on the event
+	uint8_t  event;     ///< One of Event
+	uint8_t  source;    ///< The address of the driver that recorded it, or as given by the application
+    } Entry;
+
+    /// Records an event. Can be called from interrupt handlers. Drivers use the RH_TRACE_EVENT macro.
+    /// \param[in] event The event code, one of Event
+    /// \param[in] value Depends on the event
+    /// \param[in] source The address of the driver, or any value the application chooses
+    static void record(uint8_t event, uint16_t value, uint8_t source)
+    {
+	uint32_t time = micros();
+	ATOMIC_BLOCK_START;
+	if (_enabled)
+	{
+	    Entry* entry = &_entries[_next++ & (RH_TRACE_SIZE - 1)];
+	    entry->time = time;
+	    entry->value = value;
+	    entry->event = event;
+	    entry->source = source;
+	    _recorded++;
+	}
+	ATOMIC_BLOCK_END;
+    }
+
+    /// Enables or disables recording. Recording is enabled by default.
+    /// Disabling it keeps the events in the ring buffer from being overwritten.
+    /// \param[in] enabled true to record events, false to ignore them
+    static void setEnabled(bool enabled);
+
+    /// Discards all the events in the ring buffer.
+    static void clear();
+
+    /// Returns the number of events in the ring buffer, at most RH_TRACE_SIZE.
+    /// \return The number of events that can be read with get()
+    static uint8_t count();
+
+    /// Returns the number of events recorded since the last clear(), including those that have
+    /// since been overwritten.
+    /// \return The number of events recorded
+    static uint32_t recorded();
+
+    /// Reads an event from the ring buffer.
+    /// \param[in] index The event to read: 0 is the oldest, count() - 1 the most recent
+    /// \param[out] entry The event is copied here
+    /// \return true if there is such an event
+    static bool get(uint8_t index, Entry* entry);
+
+    /// Prints all the events in the ring buffer, oldest first, on Serial.
+    /// Recording is paused while they are printed. Do not call from an interrupt handler.
+    static void dump();
+
+private:
+    /// The ring buffer
+    static Entry             _entries[RH_TRACE_SIZE];
+
+    /// Index of the next entry to write, modulo RH_TRACE_SIZE
+    static volatile uint8_t  _next;
+
+    /// Number of events recorded since the last clear()
+    static volatile uint32_t _recorded;
+
+    /// Whether events are being recorded
+    static volatile bool     _enabled;
+};
+#endif
+
+#endif
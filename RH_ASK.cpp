@@ -404,6 +404,7 @@ void INTERRUPT_ATTR RH_ASK::setModeIdle()
 	writePtt(LOW);
 	writeTx(LOW);
 	_mode = RHModeIdle;
+	RH_TRACE_EVENT(RHTrace::RHTraceMode, _mode);
     }
 }
 
@@ -415,6 +416,7 @@ void RH_ASK::setModeRx()
 	writePtt(LOW);
 	writeTx(LOW);
 	_mode = RHModeRx;
+	RH_TRACE_EVENT(RHTrace::RHTraceMode, _mode);
     }
 }
 
@@ -431,6 +433,7 @@ void RH_ASK::setModeTx()
 	writePtt(HIGH);
 
 	_mode = RHModeTx;
+	RH_TRACE_EVENT(RHTrace::RHTraceMode, _mode);
     }
 }
 
@@ -469,18 +472,29 @@ bool RH_ASK::recv(uint8_t* buf, uint8_t* len)
 
 // Caution: this may block
 bool RH_ASK::send(const uint8_t* data, uint8_t len)
+{
+    Segment segment = { data, len, NULL };
+    return sendSegments(&segment);
+}
+
+// The segments are encoded straight into _txBuf, so no other buffer is needed
+bool RH_ASK::sendSegments(const Segment* segments)
 {
     uint8_t i;
     uint16_t index = 0;
     uint16_t crc = 0xffff;
     uint8_t *p = _txBuf + RH_ASK_PREAMBLE_LEN; // start of the message area
-    uint8_t count = len + 3 + RH_ASK_HEADER_LEN; // Added byte count and FCS and headers to get total number of bytes
+    uint16_t len = segmentsLength(segments);
 
     if (len > RH_ASK_MAX_MESSAGE_LEN)
 	return false;
+    uint8_t count = len + 3 + RH_ASK_HEADER_LEN; // Added byte count and FCS and headers to get total number of bytes
 
     // Wait for transmitter to become available
     waitPacketSent();
+    if (!waitCAD())
+	return false; // Channel stayed busy
+    RH_TRACE_EVENT(RHTrace::RHTraceSend, len);
 
     // Encode the message length
     crc = RHcrc_ccitt_update(crc, count);
@@ -503,11 +517,15 @@ bool RH_ASK::send(const uint8_t* data, uint8_t len)
 
     // Encode the message into 6 bit symbols. Each byte is converted into 
     // 2 6-bit symbols, high nybble first, low nybble second
-    for (i = 0; i < len; i++)
+    for (; segments; segments = segments->next)
     {
-	crc = RHcrc_ccitt_update(crc, data[i]);
-	p[index++] = symbols[data[i] >> 4];
-	p[index++] = symbols[data[i] & 0xf];
+	const uint8_t* data = segments->data;
+	for (i = 0; i < segments->len; i++)
+	{
+	    crc = RHcrc_ccitt_update(crc, data[i]);
+	    p[index++] = symbols[data[i] >> 4];
+	    p[index++] = symbols[data[i] & 0xf];
+	}
     }
 
     // Append the fcs, 16 bits before encoding (4 6-bit symbols after encoding)
@@ -569,6 +587,14 @@ uint8_t RH_ASK::maxMessageLength()
     return RH_ASK_MAX_MESSAGE_LEN;
 }
 
+uint32_t RH_ASK::timeOnAir(uint8_t len)
+{
+    // Preamble and start symbol, then count, headers, payload and 2 FCS octets, 
+    // each octet as 2 symbols of 6 bits
+    uint32_t bits = (RH_ASK_PREAMBLE_LEN + ((1 + RH_ASK_HEADER_LEN + len + 2) * 2)) * 6;
+    return ((uint64_t)bits * 1000000) / _speed;
+}
+
 #if (RH_PLATFORM == RH_PLATFORM_ARDUINO) 
  #if defined(RH_PLATFORM_ATTINY)
   #define RH_ASK_TIMER_VECTOR TIM0_COMPA_vect
@@ -700,6 +726,7 @@ void RH_ASK::validateRxBuf()
     {
 	// Reject and drop the message
 	_rxBad++;
+	_rxCrcErrors++;
 	_rxBufValid = false;
 	return;
     }
@@ -713,9 +740,11 @@ void RH_ASK::validateRxBuf()
 	_rxHeaderTo == _thisAddress ||
 	_rxHeaderTo == RH_BROADCAST_ADDRESS)
     {
-	_rxGood++;
+	countRxGood();
 	_rxBufValid = true;
     }
+    else
+	_rxFiltered++;
 }
 
 void INTERRUPT_ATTR RH_ASK::receiveTimer()
@@ -791,6 +820,7 @@ void INTERRUPT_ATTR RH_ASK::receiveTimer()
 		    // Got all the bytes now
 		    _rxActive = false;
 		    _rxBufFull = true;
+		    _rxTimestamp = micros();
 		    setModeIdle();
 		}
 		_rxBitCount = 0;
@@ -819,6 +849,8 @@ void INTERRUPT_ATTR RH_ASK::transmitTimer()
 	{
 	    setModeIdle();
 	    _txGood++;
+	    _txTimestamp = micros();
+	    RH_TRACE_EVENT(RHTrace::RHTraceTxDone, ((uint16_t)_txHeaderTo << 8) | _txHeaderId);
 	}
 	else
 	{
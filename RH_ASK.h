@@ -282,11 +282,23 @@ public:
     /// \return true if the message length was valid and it was correctly queued for transmit
     virtual bool    send(const uint8_t* data, uint8_t len);
 
+    /// Like send(), but the message is made of a list of segments, which are encoded
+    /// straight into the transmit buffer. See RHGenericDriver::sendSegments()
+    /// \param[in] segments The first segment of the message
+    /// \return true if the message length was valid and it was correctly queued for transmit
+    virtual bool    sendSegments(const Segment* segments);
+
     /// Returns the maximum message length 
     /// available in this Driver.
     /// \return The maximum legal message length
     virtual uint8_t maxMessageLength();
 
+    /// Returns the time on air of a message of the given length at the configured speed.
+    /// Each octet after the preamble is sent as 2 symbols of 6 bits.
+    /// \param[in] len Length of the message payload, not including the RadioHead headers
+    /// \return The time on air in microseconds
+    virtual uint32_t timeOnAir(uint8_t len);
+
     /// If current mode is Rx or Tx changes it to Idle. If the transmitter or receiver is running, 
     /// disables them.
     void           setModeIdle();
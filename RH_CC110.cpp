@@ -72,6 +72,7 @@ RH_CC110::RH_CC110(uint8_t slaveSelectPin, uint8_t interruptPin, bool is27MHz, R
 {
     _interruptPin = interruptPin;
     _myInterruptIndex = 0xff; // Not allocated yet
+    memset(_mdmcfg, 0, sizeof(_mdmcfg));
 }
 
 bool RH_CC110::init()
@@ -154,13 +155,15 @@ void RH_CC110::setIs27MHz(bool is27MHz)
 // We use this to get RxDone and TxDone interrupts
 void RH_CC110::handleInterrupt()
 {
-//    Serial.println("I");
+    uint32_t now = micros(); // Before any SPI traffic, for the timestamp
+    RH_TRACE_EVENT(RHTrace::RHTraceInterrupt, 0); // This radio has no interrupt flags
     if (_mode == RHModeRx)
     {
 	// Radio is confgigured to stay in RX until we move it to IDLE after a CRC_OK message for us
 	// We only get interrupts in RX mode, on CRC_OK
 	// CRC OK
 	_lastRssi = spiBurstReadRegister(RH_CC110_REG_34_RSSI); // Was set when sync word was detected
+	_rxTimestamp = now;
 	_bufLen = spiReadRegister(RH_CC110_REG_3F_FIFO);
 	if (_bufLen < 4)
 	{
@@ -173,7 +176,19 @@ void RH_CC110::handleInterrupt()
 	// All good so far. See if its for us
 	validateRxBuf(); 
 	if (_rxBufValid)
-	    setModeIdle(); // Done
+	{
+	    if (rxQueueEnabled())
+	    {
+		// Queue it and stay in RX for the next one
+		rxQueuePut(_buf + RH_CC110_HEADER_LEN, _bufLen - RH_CC110_HEADER_LEN);
+		clearRxBuf();
+	    }
+	    else
+	    {
+		setModeIdle(); // Done
+		rxNotify();
+	    }
+	}
     }
 }
 
@@ -216,6 +231,11 @@ uint8_t  RH_CC110::spiBurstWriteRegister(uint8_t reg, const uint8_t* src, uint8_
     return spiBurstWrite((reg & 0x3f) | RH_CC110_SPI_BURST_MASK, src, len);
 }
 
+uint8_t  RH_CC110::spiBurstWriteRegister(uint8_t reg, const Segment* segments)
+{
+    return spiBurstWrite((reg & 0x3f) | RH_CC110_SPI_BURST_MASK, segments);
+}
+
 bool RH_CC110::printRegisters()
 {
 #ifdef RH_HAVE_SERIAL
@@ -251,16 +271,18 @@ void RH_CC110::validateRxBuf()
 	_rxHeaderTo == _thisAddress ||
 	_rxHeaderTo == RH_BROADCAST_ADDRESS)
     {
-	_rxGood++;
+	countRxGood();
 	_rxBufValid = true;
     }
+    else
+	_rxFiltered++;
 }
 
 bool RH_CC110::available()
 {
     if (_mode == RHModeTx)
 	return false;
-    if (_rxBufValid) // Will be set by the interrupt handler when a good message is received
+    if (_rxBufValid || rxQueueCount()) // Will be set by the interrupt handler when a good message is received
 	return true;
     setModeRx(); // Make sure we are receiving
     return false; // Nothing yet
@@ -278,6 +300,8 @@ bool RH_CC110::recv(uint8_t* buf, uint8_t* len)
 {
     if (!available())
 	return false;
+    if (rxQueueGet(buf, len))
+	return true;
 
     if (buf && len)
     {
@@ -293,20 +317,45 @@ bool RH_CC110::recv(uint8_t* buf, uint8_t* len)
     return true;
 }
 
+bool RH_CC110::lease(const uint8_t** buf, uint8_t* len)
+{
+    if (!available())
+	return false;
+    if (rxQueueLease(buf, len))
+	return true;
+    *buf = _buf + RH_CC110_HEADER_LEN;
+    *len = _bufLen - RH_CC110_HEADER_LEN;
+    return true;
+}
+
+void RH_CC110::release()
+{
+    if (!rxQueueRelease())
+	clearRxBuf(); // This message accepted and cleared
+}
+
 bool RH_CC110::send(const uint8_t* data, uint8_t len)
 {
+    Segment segment = { data, len, NULL };
+    return sendSegments(&segment);
+}
+
+bool RH_CC110::sendSegments(const Segment* segments)
+{
+    uint16_t len = segmentsLength(segments);
     if (len > RH_CC110_MAX_MESSAGE_LEN)
 	return false;
 
     waitPacketSent(); // Make sure we dont interrupt an outgoing message
+    if (!waitCAD())
+	return false; // Channel stayed busy
+    RH_TRACE_EVENT(RHTrace::RHTraceSend, len);
     setModeIdle();
 
-    spiWriteRegister(RH_CC110_REG_3F_FIFO, len + RH_CC110_HEADER_LEN);
-    spiWriteRegister(RH_CC110_REG_3F_FIFO,_txHeaderTo);
-    spiWriteRegister(RH_CC110_REG_3F_FIFO,_txHeaderFrom);
-    spiWriteRegister(RH_CC110_REG_3F_FIFO,_txHeaderId);
-    spiWriteRegister(RH_CC110_REG_3F_FIFO,_txHeaderFlags);
-    spiBurstWriteRegister(RH_CC110_REG_3F_FIFO, data, len);
+    // The length and headers, then the message, in one burst
+    uint8_t headers[] = { (uint8_t)(len + RH_CC110_HEADER_LEN), _txHeaderTo, _txHeaderFrom, _txHeaderId, _txHeaderFlags };
+    Segment h = { headers, sizeof(headers), segments };
+    spiBurstWriteRegister(RH_CC110_REG_3F_FIFO, &h);
 
     // Radio returns to Idle when TX is finished
     // need waitPacketSent() to detect change of _mode and TX completion
@@ -326,7 +375,20 @@ void RH_CC110::setModeIdle()
     {
 	spiCommand(RH_CC110_STROBE_36_SIDLE);
 	_mode = RHModeIdle;
+	RH_TRACE_EVENT(RHTrace::RHTraceMode, _mode);
+    }
+}
+
+bool RH_CC110::isChannelActive()
+{
+    if (_mode != RHModeRx)
+    {
+	setModeRx();
+	delay(1); // Let the RSSI settle
     }
+    // RSSI is in units of 0.5dB, with an offset of 74dB
+    int16_t rssi = (int8_t)spiBurstReadRegister(RH_CC110_REG_34_RSSI) / 2 - 74;
+    return rssi > _cadThreshold;
 }
 
 bool RH_CC110::sleep()
@@ -335,6 +397,7 @@ bool RH_CC110::sleep()
     {
 	spiCommand(RH_CC110_STROBE_39_SPWD);
 	_mode = RHModeSleep;
+	RH_TRACE_EVENT(RHTrace::RHTraceMode, _mode);
     }
     return true;
 }
@@ -347,6 +410,7 @@ void RH_CC110::setModeRx()
 	// only receipt of a CRC_OK wil cause us to return it to IDLE
 	spiCommand(RH_CC110_STROBE_34_SRX);
 	_mode = RHModeRx;
+	RH_TRACE_EVENT(RHTrace::RHTraceMode, _mode);
     }
 }
 
@@ -356,6 +420,7 @@ void RH_CC110::setModeTx()
     {
 	spiCommand(RH_CC110_STROBE_35_STX);
 	_mode = RHModeTx;
+	RH_TRACE_EVENT(RHTrace::RHTraceMode, _mode);
     }
 }
 
@@ -375,7 +440,10 @@ bool RH_CC110::waitPacketSent()
     while ((statusRead() & RH_CC110_STATUS_STATE) != RH_CC110_STATUS_IDLE)
 	YIELD;
 
+    _txTimestamp = micros(); // As near as polling can tell
     _mode = RHModeIdle;
+    RH_TRACE_EVENT(RHTrace::RHTraceMode, _mode);
+    RH_TRACE_EVENT(RHTrace::RHTraceTxDone, ((uint16_t)_txHeaderTo << 8) | _txHeaderId);
     return true;
 }
 
@@ -437,6 +505,9 @@ void RH_CC110::setModemRegisters(const ModemConfig* config)
     spiWriteRegister(RH_CC110_REG_2C_TEST2,    config->reg_2c);
     spiWriteRegister(RH_CC110_REG_2D_TEST1,    config->reg_2d);
     spiWriteRegister(RH_CC110_REG_2E_TEST0,    config->reg_2e);
+    _mdmcfg[0] = config->reg_10;
+    _mdmcfg[1] = config->reg_11;
+    _mdmcfg[2] = config->reg_12;
 }
 
 // Set one of the canned Modem configs
@@ -462,3 +533,18 @@ void RH_CC110::setSyncWords(const uint8_t* syncWords, uint8_t len)
     spiWriteRegister(RH_CC110_REG_04_SYNC1, syncWords[0]);
     spiWriteRegister(RH_CC110_REG_05_SYNC0, syncWords[1]);
 }
+
+uint32_t RH_CC110::timeOnAir(uint8_t len)
+{
+    // From section 12: Rdata = (256 + DRATE_M) * 2^DRATE_E / 2^28 * fxosc
+    uint32_t fxosc = _is27MHz ? 27000000 : 26000000;
+    uint64_t rate = ((((uint64_t)256 + _mdmcfg[1]) << (_mdmcfg[0] & 0x0f)) * fxosc) >> 28;
+    uint8_t syncMode = _mdmcfg[2] & RH_CC110_SYNC_MODE;
+    uint8_t syncLen = syncMode == RH_CC110_SYNC_MODE_NONE || syncMode == RH_CC110_SYNC_MODE_NONE_CARRIER ? 0
+	: (syncMode == RH_CC110_SYNC_MODE_30_32 || syncMode == RH_CC110_SYNC_MODE_30_32_CARRIER) ? 4 : 2;
+    // Preamble, sync, length, headers, payload, 2 CRC octets
+    uint32_t bits = (4 + syncLen + 1 + RH_CC110_HEADER_LEN + len + 2) * 8;
+    if (_mdmcfg[2] & RH_CC110_MANCHESTER_EN)
+	bits *= 2; // Applies to the whole packet
+    return ((uint64_t)bits * 1000000) / rate;
+}
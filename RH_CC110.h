@@ -719,6 +719,16 @@ public:
     /// \return true if a valid message was copied to buf. The message cannot be retreived again.
     virtual bool    recv(uint8_t* buf, uint8_t* len);
 
+    /// Like recv(), but returns a pointer to the message in the driver instead of copying it.
+    /// The message stays valid until release(). See RHGenericDriver::lease()
+    /// \param[out] buf Set to the address of the message
+    /// \param[out] len Set to the length of the message
+    /// \return true if a message was leased
+    virtual bool    lease(const uint8_t** buf, uint8_t* len);
+
+    /// Releases the message leased by lease(), and allows the driver to receive the next one
+    virtual void    release();
+
     /// Waits until any previous transmit packet is finished being transmitted with waitPacketSent().
     /// Then loads a message into the transmitter and starts the transmitter. Note that a message length
     /// of 0 is permitted. 
@@ -727,11 +737,24 @@ public:
     /// \return true if the message length was valid and it was correctly queued for transmit
     virtual bool    send(const uint8_t* data, uint8_t len);
 
+    /// Like send(), but the message is made of a list of segments, which are written to the TX FIFO
+    /// after the length and headers in a single SPI burst.
+    /// \param[in] segments The first segment of the message
+    /// \return true if the message length was valid and it was correctly queued for transmit
+    virtual bool    sendSegments(const Segment* segments);
+
     /// Returns the maximum message length 
     /// available in this Driver.
     /// \return The maximum legal message length
     virtual uint8_t maxMessageLength();
 
+    /// Returns the time on air of a message of the given length, calculated from the data rate,
+    /// sync mode and Manchester encoding in the current modem configuration, and the 
+    /// 4 byte preamble and CRC configured by init().
+    /// \param[in] len Length of the message payload, not including the RadioHead headers
+    /// \return The time on air in microseconds
+    virtual uint32_t timeOnAir(uint8_t len);
+
     /// If current mode is Sleep, Rx or Tx changes it to Idle. If the transmitter or receiver is running, 
     /// disables them.
     void           setModeIdle();
@@ -753,6 +776,11 @@ public:
     /// \return true if sleep mode was successfully entered.
     virtual bool    sleep();
 
+    /// Tells whether another node is transmitting, by measuring the RSSI with the receiver on, and comparing it
+    /// with the threshold set by RHGenericDriver::setCADThreshold(). Used by send() for listen before talk.
+    /// \return true if the RSSI is above the threshold
+    virtual bool    isChannelActive();
+
     /// Set the Power Amplifier power setting.
     /// The PaTable settings are based on are based on the suggested optimum values for 
     /// multilayer inductors in the 915MHz frequency band. Per table 5-15.
@@ -830,6 +858,12 @@ protected:
     /// \param[in] len Number of bytes to write
     /// \return the chip status byte per table 5.2
     uint8_t  spiBurstWriteRegister(uint8_t reg, const uint8_t* src, uint8_t len);
+
+    /// Write a list of segments to a burst capable register
+    /// \param[in] reg Register number of the first register, one of RH_CC110L_REG_*
+    /// \param[in] segments The first segment to write
+    /// \return the chip status byte per table 5.2
+    uint8_t  spiBurstWriteRegister(uint8_t reg, const Segment* segments);
     
     /// Examine the receive buffer to determine whether the message is for this node
     /// Sets _rxBufValid.
@@ -881,6 +915,10 @@ private:
 
     /// True if crystal oscillator is 26 MHz, not 26MHz.
     bool                _is27MHz;
+
+    /// RH_CC110_REG_10_MDMCFG4 to RH_CC110_REG_12_MDMCFG2 from the most recent setModemRegisters(), 
+    /// for timeOnAir()
+    uint8_t             _mdmcfg[3];
 };
 
 /// @example cc110_client.pde
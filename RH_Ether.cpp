@@ -0,0 +1,245 @@
+// RH_Ether.cpp
+//
+// Copyright (C) 2016 Mike McCauley
+
+#include <RadioHead.h>
+
+// This can only build on Linux and compatible systems
+#if (RH_PLATFORM == RH_PLATFORM_UNIX)
+
+#include <RH_Ether.h>
+
+RH_Ether::RH_Ether(RHEtherSimulator& ether)
+    : _ether(ether),
+      _node(-1),
+      _rxHead(0),
+      _rxCount(0),
+      _rxBufValid(false),
+      _txDoneTime(0),
+      _wakeTime(0)
+{
+}
+
+bool RH_Ether::init()
+{
+    if (_node < 0)
+	_node = _ether.attach(this);
+    _ether.setNodeAddress(_node, _thisAddress);
+    return true;
+}
+
+void RH_Ether::setThisAddress(uint8_t address)
+{
+    RHGenericDriver::setThisAddress(address);
+    if (_node >= 0)
+	_ether.setNodeAddress(_node, address);
+}
+
+bool RH_Ether::isChannelActive()
+{
+    wake();
+    return _node >= 0 && _ether.channelActive(_node, _ether.now());
+}
+
+void RH_Ether::receive(const uint8_t* frame, uint8_t len)
+{
+    // A sleeping radio, or one that woke up after the preamble, never hears it
+    if (_mode == RHModeSleep || _ether.now() < _wakeTime + _ether.airtime(len))
+	return;
+    if (_rxCount >= RH_ETHER_RX_QUEUE_LEN || len < RH_ETHER_HEADER_LEN)
+    {
+	_rxBad++; // No room, or no headers
+	if (_rxCount >= RH_ETHER_RX_QUEUE_LEN)
+	    _rxOverruns++;
+	return;
+    }
+    Frame* f = &_rxQueue[(_rxHead + _rxCount) % RH_ETHER_RX_QUEUE_LEN];
+    memcpy(f->frame, frame, len);
+    f->len = len;
+    f->timestamp = _ether.now(); // Delivered at the end of the frame
+    _rxCount++;
+}
+
+bool RH_Ether::checkAvailable()
+{
+    wake();
+    // Discard frames not addressed to us until we find a good one
+    while (!_rxBufValid && _rxCount)
+    {
+	Frame* f = &_rxQueue[_rxHead];
+	_rxHeaderTo    = f->frame[0];
+	_rxHeaderFrom  = f->frame[1];
+	_rxHeaderId    = f->frame[2];
+	_rxHeaderFlags = f->frame[3];
+	if (_promiscuous ||
+	    _rxHeaderTo == _thisAddress ||
+	    _rxHeaderTo == RH_BROADCAST_ADDRESS)
+	{
+	    _rxTimestamp = f->timestamp;
+	    countRxGood();
+	    _rxBufValid = true;
+	}
+	else
+	{
+	    _rxFiltered++;
+	    _rxHead = (_rxHead + 1) % RH_ETHER_RX_QUEUE_LEN;
+	    _rxCount--;
+	}
+    }
+    return _rxBufValid;
+}
+
+bool RH_Ether::available()
+{
+    if (checkAvailable())
+	return true;
+    // Polling a real radio takes time, else polling loops would never end
+    _ether.wait(_ether.now() + RH_ETHER_POLL_INTERVAL, true);
+    return checkAvailable();
+}
+
+void RH_Ether::waitAvailable()
+{
+    while (!checkAvailable())
+	_ether.wait(RH_ETHER_SIMULATOR_FOREVER, true);
+}
+
+bool RH_Ether::waitAvailableTimeout(uint16_t timeout)
+{
+    uint64_t until = _ether.now() + (uint64_t)timeout * 1000;
+    while (!checkAvailable())
+    {
+	if (_ether.now() >= until)
+	    return false;
+	_ether.wait(until, true);
+    }
+    return true;
+}
+
+bool RH_Ether::recv(uint8_t* buf, uint8_t* len)
+{
+    if (!available())
+	return false;
+
+    Frame* f = &_rxQueue[_rxHead];
+    if (buf && len)
+    {
+	uint8_t payloadLen = f->len - RH_ETHER_HEADER_LEN;
+	if (*len > payloadLen)
+	    *len = payloadLen;
+	memcpy(buf, f->frame + RH_ETHER_HEADER_LEN, *len);
+    }
+    _rxHead = (_rxHead + 1) % RH_ETHER_RX_QUEUE_LEN;
+    _rxCount--;
+    _rxBufValid = false;
+    return true;
+}
+
+// New frames are added after the end of the queue, so the leased one is not touched
+bool RH_Ether::lease(const uint8_t** buf, uint8_t* len)
+{
+    if (!available())
+	return false;
+    Frame* f = &_rxQueue[_rxHead];
+    *buf = f->frame + RH_ETHER_HEADER_LEN;
+    *len = f->len - RH_ETHER_HEADER_LEN;
+    return true;
+}
+
+void RH_Ether::release()
+{
+    _rxHead = (_rxHead + 1) % RH_ETHER_RX_QUEUE_LEN;
+    _rxCount--;
+    _rxBufValid = false;
+}
+
+void RH_Ether::checkTransmitDone()
+{
+    if (_mode == RHModeTx && _ether.now() >= _txDoneTime)
+    {
+	_mode = RHModeIdle;
+	RH_TRACE_EVENT(RHTrace::RHTraceMode, _mode);
+	RH_TRACE_EVENT(RHTrace::RHTraceTxDone, ((uint16_t)_txHeaderTo << 8) | _txHeaderId);
+    }
+}
+
+bool RH_Ether::waitPacketSent()
+{
+    if (_mode == RHModeTx)
+	_ether.wait(_txDoneTime, false);
+    checkTransmitDone();
+    return true;
+}
+
+bool RH_Ether::waitPacketSent(uint16_t timeout)
+{
+    if (_mode == RHModeTx)
+    {
+	uint64_t until = _ether.now() + (uint64_t)timeout * 1000;
+	_ether.wait(until < _txDoneTime ? until : _txDoneTime, false);
+    }
+    checkTransmitDone();
+    if (_mode == RHModeTx)
+    {
+	_txTimeouts++;
+	return false;
+    }
+    return true;
+}
+
+bool RH_Ether::send(const uint8_t* data, uint8_t len)
+{
+    if (len > RH_ETHER_MAX_MESSAGE_LEN || _node < 0)
+	return false;
+
+    waitPacketSent(); // Make sure we dont interrupt an outgoing message
+    wake();
+    if (!waitCAD())
+	return false; // Channel stayed busy
+    uint8_t frame[RH_ETHER_MAX_FRAME_LEN];
+    frame[0] = _txHeaderTo;
+    frame[1] = _txHeaderFrom;
+    frame[2] = _txHeaderId;
+    frame[3] = _txHeaderFlags;
+    memcpy(frame + RH_ETHER_HEADER_LEN, data, len);
+    _txDoneTime = _ether.send(_node, frame, len + RH_ETHER_HEADER_LEN);
+    _txTimestamp = _txDoneTime;
+    RH_TRACE_EVENT(RHTrace::RHTraceSend, len);
+    _mode = RHModeTx;
+    RH_TRACE_EVENT(RHTrace::RHTraceMode, _mode);
+    _txGood++;
+    return true;
+}
+
+uint32_t RH_Ether::timeOnAir(uint8_t len)
+{
+    return _ether.airtime(len + RH_ETHER_HEADER_LEN);
+}
+
+bool RH_Ether::sleep()
+{
+    waitPacketSent();
+    if (_mode != RHModeSleep)
+    {
+	_mode = RHModeSleep;
+	RH_TRACE_EVENT(RHTrace::RHTraceMode, _mode);
+    }
+    return true;
+}
+
+void RH_Ether::wake()
+{
+    if (_mode == RHModeSleep)
+    {
+	_mode = RHModeIdle;
+	RH_TRACE_EVENT(RHTrace::RHTraceMode, _mode);
+	_wakeTime = _ether.now();
+    }
+}
+
+uint8_t RH_Ether::maxMessageLength()
+{
+    return RH_ETHER_MAX_MESSAGE_LEN;
+}
+
+#endif
@@ -0,0 +1,190 @@
+// RH_Ether.h
+// Author: Mike McCauley (mikem@airspayce.com)
+// Copyright (C) 2016 Mike McCauley
+#ifndef RH_Ether_h
+#define RH_Ether_h
+
+#include <RHGenericDriver.h>
+#include <RHEtherSimulator.h>
+
+// This can only build on Linux and compatible systems
+#if (RH_PLATFORM == RH_PLATFORM_UNIX)
+
+// The length of the headers we add.
+#define RH_ETHER_HEADER_LEN 4
+
+// This is the maximum message length that can be supported by this driver.
+#define RH_ETHER_MAX_MESSAGE_LEN (RH_ETHER_MAX_FRAME_LEN - RH_ETHER_HEADER_LEN)
+
+// Number of received frames that can be queued awaiting recv()
+// Further frames are dropped
+#define RH_ETHER_RX_QUEUE_LEN 8
+
+// How much virtual time an unsuccessful call to available() takes, in microseconds
+#define RH_ETHER_POLL_INTERVAL 1000
+
+/////////////////////////////////////////////////////////////////////
+/// \class RH_Ether RH_Ether.h <RH_Ether.h>
+/// \brief Driver to send and receive unaddressed, unreliable datagrams between simulated nodes
+/// running in a single process.
+///
+/// \par Overview
+///
+/// This class is a sibling of RH_TCP, intended for simulations of large numbers of nodes.
+/// Instead of connecting to an ether simulator server over a TCP socket,
+/// each RH_Ether driver is connected to a RHEtherSimulator in the same process, which
+/// passes frames between drivers through in-memory queues, and runs all the nodes as tasks in virtual time.
+/// See RHEtherSimulator for details.
+///
+/// Any number of RH_Ether drivers can be created, each with its own manager. init() must be called from
+/// the task that will use the driver, usually in its setup function.
+///
+/// Received frames are queued until collected by recv(). Up to RH_ETHER_RX_QUEUE_LEN frames can be queued.
+/// Frames that arrive when the queue is full are dropped and counted by rxBad().
+///
+/// send() starts the transmission and returns at once. waitPacketSent() waits until the end of the simulated
+/// transmission time of the frame, as computed by RHEther.
+class RH_Ether : public RHGenericDriver
+{
+public:
+    /// Constructor
+    /// \param[in] ether The simulator that will pass messages between this driver and other drivers
+    RH_Ether(RHEtherSimulator& ether);
+
+    /// Initialise the Driver. Connects the driver to the ether as a new node, belonging
+    /// to the task that calls init().
+    /// \return true if initialisation succeeded.
+    virtual bool init();
+
+    /// Tests whether a new message is available
+    /// from the Driver.
+    /// If there is none, takes RH_ETHER_POLL_INTERVAL microseconds of virtual time, and tests again.
+    /// This can be called multiple times in a timeout loop
+    /// \return true if a new, complete, error-free uncollected message is available to be retreived by recv()
+    virtual bool available();
+
+    /// Wait until a new message is available from the driver.
+    /// Blocks until a complete message is received as reported by available()
+    virtual void waitAvailable();
+
+    /// Wait until a new message is available from the driver
+    /// or the timeout expires
+    /// Blocks until a complete message is received as reported by available()
+    /// \param[in] timeout The maximum time to wait in milliseconds
+    /// \return true if a message is available as reported by available()
+    virtual bool waitAvailableTimeout(uint16_t timeout);
+
+    /// If there is a valid message available, copy it to buf and return true
+    /// else return false.
+    /// If a message is copied, *len is set to the length (Caution, 0 length messages are permitted).
+    /// \param[in] buf Location to copy the received message
+    /// \param[in,out] len Pointer to available space in buf. Set to the actual number of octets copied.
+    /// \return true if a valid message was copied to buf
+    virtual bool recv(uint8_t* buf, uint8_t* len);
+
+    /// Like recv(), but returns a pointer to the message in the receive queue instead of copying it.
+    /// The message stays valid until release(). See RHGenericDriver::lease()
+    /// \param[out] buf Set to the address of the message
+    /// \param[out] len Set to the length of the message
+    /// \return true if a message was leased
+    virtual bool lease(const uint8_t** buf, uint8_t* len);
+
+    /// Releases the message leased by lease()
+    virtual void release();
+
+    /// Waits until any previous transmit packet is finished being transmitted with waitPacketSent().
+    /// Then passes the message to the ether for transmission.
+    /// \param[in] data Array of data to be sent
+    /// \param[in] len Number of bytes of data to send (> 0)
+    /// \return true if the message length was valid and it was correctly queued for transmit
+    virtual bool send(const uint8_t* data, uint8_t len);
+
+    /// Blocks until the transmitter is no longer transmitting.
+    virtual bool waitPacketSent();
+
+    /// Blocks until the transmitter is no longer transmitting, or the timeout expires
+    /// \param[in] timeout The maximum time to wait in milliseconds.
+    /// \return true if the radio completed transmission within the timeout period. False if it timed out.
+    virtual bool waitPacketSent(uint16_t timeout);
+
+    /// Returns the maximum message length
+    /// available in this Driver.
+    /// \return The maximum legal message length
+    virtual uint8_t maxMessageLength();
+
+    /// Returns the time the simulated ether takes to transmit a message
+    /// \param[in] len Length of the message payload, not including the RadioHead headers
+    /// \return The time on air in microseconds
+    virtual uint32_t timeOnAir(uint8_t len);
+
+    /// Tells whether another node is transmitting a frame that this node can hear.
+    /// Used by send() for listen before talk. See RHGenericDriver::setCADTimeout()
+    /// \return true if the channel is busy
+    virtual bool isChannelActive();
+
+    /// Puts the simulated radio to sleep. Frames are not received while it sleeps, nor frames that
+    /// started before it woke up again. It wakes up when available(), send() etc are called.
+    /// \return true
+    virtual bool sleep();
+
+    /// Sets the address of this node. Defaults to 0xFF.
+    /// The ether uses the address to look up link probabilities.
+    /// \param[in] address The address of this node.
+    virtual void setThisAddress(uint8_t address);
+
+    /// Called by RHEtherSimulator when a frame is delivered to this driver.
+    /// Queues the frame for recv().
+    /// \param[in] frame The frame: TO, FROM, ID, FLAGS and payload
+    /// \param[in] len Length of the frame
+    void receive(const uint8_t* frame, uint8_t len);
+
+private:
+    /// Check for a valid message at the head of the receive queue.
+    /// Does not take any virtual time
+    /// \return true if a valid message is available
+    bool checkAvailable();
+
+    /// Ends the current transmission if its time is up
+    void checkTransmitDone();
+
+    /// Leaves sleep mode, if the radio is asleep
+    void wake();
+
+    /// \brief A received frame
+    typedef struct
+    {
+	uint8_t             len;                          ///< Length of the frame
+	uint8_t             frame[RH_ETHER_MAX_FRAME_LEN]; ///< TO, FROM, ID, FLAGS and payload
+	uint32_t            timestamp;                    ///< Virtual time when the frame ended, in microseconds
+    } Frame;
+
+    /// The simulator we are connected to
+    RHEtherSimulator&   _ether;
+
+    /// Our node index in the ether, or -1 before init()
+    int                 _node;
+
+    /// Queue of received frames
+    Frame               _rxQueue[RH_ETHER_RX_QUEUE_LEN];
+
+    /// Index of the oldest frame in _rxQueue
+    uint8_t             _rxHead;
+
+    /// Number of frames in _rxQueue
+    uint8_t             _rxCount;
+
+    /// The frame at the head of the queue has been validated
+    bool                _rxBufValid;
+
+    /// Virtual time when the current transmission will be complete
+    uint64_t            _txDoneTime;
+
+    /// Virtual time when the radio last woke up. Frames that started before then were not heard
+    uint64_t            _wakeTime;
+};
+
+/// @example simulator_inprocess_mesh.pde
+
+#endif
+
+#endif
@@ -189,14 +189,18 @@ bool RH_MRF89::printRegisters()
 // We use this to get CRCOK and TXDONE  interrupts
 void RH_MRF89::handleInterrupt()
 {
-//    Serial.println("I");
+    uint32_t now = micros(); // Before any SPI traffic, for the timestamps
+    RH_TRACE_EVENT(RHTrace::RHTraceInterrupt, 0); // The interrupt line and _mode tell what happened
     if (_mode == RHModeTx)
     {
 //    Serial.println("T");
 	// TXDONE
 	// Transmit is complete
 	_txGood++;
+	_txTimestamp = now;
+	RH_TRACE_EVENT(RHTrace::RHTraceTxDone, ((uint16_t)_txHeaderTo << 8) | _txHeaderId);
 	setModeIdle();
+	txQueueNext(); // Start the next queued message, if any
     }
     else if (_mode == RHModeRx)
     {
@@ -208,6 +212,7 @@ void RH_MRF89::handleInterrupt()
 	// REVISIT: Capture last rssi from RSTSREG
 	// based roughly on Figure 3-9
 	_lastRssi = (spiReadRegister(RH_MRF89_REG_14_RSTSREG) >> 1) - 120;
+	_rxTimestamp = now;
 
 	_bufLen = spiReadData();
 	if (_bufLen < 4)
@@ -228,7 +233,19 @@ void RH_MRF89::handleInterrupt()
 	// All good. See if its for us
 	validateRxBuf(); 
 	if (_rxBufValid)
-	    setModeIdle(); // Got one 
+	{
+	    if (rxQueueEnabled())
+	    {
+		// Queue it and stay in receive mode for the next one
+		rxQueuePut(_buf + RH_MRF89_HEADER_LEN, _bufLen - RH_MRF89_HEADER_LEN);
+		clearRxBuf();
+	    }
+	    else
+	    {
+		setModeIdle(); // Got one 
+		rxNotify();
+	    }
+	}
     }
 }
 
@@ -297,6 +314,29 @@ uint8_t RH_MRF89::spiWriteData(const uint8_t* data, uint8_t len)
 
 }
 
+uint8_t RH_MRF89::spiWriteData(const Segment* segments)
+{
+    spiWriteRegister(RH_MRF89_REG_1F_FCRCREG, RH_MRF89_ACFCRC); // Write to FIFO
+    setSlaveSelectPin(_csdatPin);
+    digitalWrite(_csconPin, HIGH);
+
+    uint8_t status = 0;
+    ATOMIC_BLOCK_START;
+    _spi.beginTransaction();
+    digitalWrite(_slaveSelectPin, LOW);
+    for (; segments; segments = segments->next)
+    {
+	const uint8_t* data = segments->data;
+	uint8_t len = segments->len;
+	while (len--)
+	    _spi.transfer(*data++);
+    }
+    digitalWrite(_slaveSelectPin, HIGH);
+    _spi.endTransaction();
+    ATOMIC_BLOCK_END;
+    return status;
+}
+
 uint8_t RH_MRF89::spiReadData()
 {
     spiWriteRegister(RH_MRF89_REG_1F_FCRCREG, RH_MRF89_ACFCRC | RH_MRF89_FRWAXS); // Read from FIFO
@@ -319,6 +359,7 @@ void RH_MRF89::setModeIdle()
     {
 	setOpMode(RH_MRF89_CMOD_STANDBY);
 	_mode = RHModeIdle;
+	RH_TRACE_EVENT(RHTrace::RHTraceMode, _mode);
     }
 }
 
@@ -328,6 +369,7 @@ bool RH_MRF89::sleep()
     {
 	setOpMode(RH_MRF89_CMOD_SLEEP);
 	_mode = RHModeSleep;
+	RH_TRACE_EVENT(RHTrace::RHTraceMode, _mode);
     }
     return true;
 }
@@ -338,6 +380,7 @@ void RH_MRF89::setModeRx()
     {
 	setOpMode(RH_MRF89_CMOD_RECEIVE);
 	_mode = RHModeRx;
+	RH_TRACE_EVENT(RHTrace::RHTraceMode, _mode);
     }
 }
 
@@ -347,6 +390,7 @@ void RH_MRF89::setModeTx()
     {
 	setOpMode(RH_MRF89_CMOD_TRANSMIT);
 	_mode = RHModeTx;
+	RH_TRACE_EVENT(RHTrace::RHTraceMode, _mode);
     }
 }
 
@@ -359,17 +403,22 @@ void RH_MRF89::setTxPower(uint8_t power)
 
 bool RH_MRF89::available()
 {
-    if (_mode == RHModeTx)
-	return false;
-    setModeRx();
+    if (!_rxBufValid)
+    {
+	if (_mode == RHModeTx)
+	    return false;
+	setModeRx(); // Not while a message is in _buf, which may be leased
+    }
 
-    return _rxBufValid; // Will be set by the interrupt handler when a good message is received
+    return _rxBufValid || rxQueueCount(); // Will be set by the interrupt handler when a good message is received
 }
 
 bool RH_MRF89::recv(uint8_t* buf, uint8_t* len)
 {
     if (!available())
 	return false;
+    if (rxQueueGet(buf, len))
+	return true;
 
     if (buf && len)
     {
@@ -385,22 +434,46 @@ bool RH_MRF89::recv(uint8_t* buf, uint8_t* len)
     return true;
 }
 
+bool RH_MRF89::lease(const uint8_t** buf, uint8_t* len)
+{
+    if (!available())
+	return false;
+    if (rxQueueLease(buf, len))
+	return true;
+    *buf = _buf + RH_MRF89_HEADER_LEN;
+    *len = _bufLen - RH_MRF89_HEADER_LEN;
+    return true;
+}
+
+void RH_MRF89::release()
+{
+    if (!rxQueueRelease())
+	clearRxBuf(); // This message accepted and cleared
+}
+
 bool RH_MRF89::send(const uint8_t* data, uint8_t len)
 {
+    Segment segment = { data, len, NULL };
+    return sendSegments(&segment);
+}
+
+bool RH_MRF89::sendSegments(const Segment* segments)
+{
+    uint16_t len = segmentsLength(segments);
     if (len > RH_MRF89_MAX_MESSAGE_LEN)
 	return false;
     
     waitPacketSent(); // Make sure we dont interrupt an outgoing message
+    if (!waitCAD())
+	return false; // Channel stayed busy
+    RH_TRACE_EVENT(RHTrace::RHTraceSend, len);
     setModeIdle();
     
     // First octet is the length of the chip payload
     // 0 length messages are transmitted but never trigger a receive!
-    spiWriteData(len + RH_MRF89_HEADER_LEN);
-    spiWriteData(_txHeaderTo);
-    spiWriteData(_txHeaderFrom);
-    spiWriteData(_txHeaderId);
-    spiWriteData(_txHeaderFlags);
-    spiWriteData(data, len);
+    uint8_t headers[] = { (uint8_t)(len + RH_MRF89_HEADER_LEN), _txHeaderTo, _txHeaderFrom, _txHeaderId, _txHeaderFlags };
+    Segment h = { headers, sizeof(headers), segments };
+    spiWriteData(&h);
     setModeTx(); // Start transmitting
 
     return true;
@@ -425,9 +498,11 @@ void RH_MRF89::validateRxBuf()
 	_rxHeaderTo == _thisAddress ||
 	_rxHeaderTo == RH_BROADCAST_ADDRESS)
     {
-	_rxGood++;
+	countRxGood();
 	_rxBufValid = true;
     }
+    else
+	_rxFiltered++;
 }
 
 void RH_MRF89::clearRxBuf()
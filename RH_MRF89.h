@@ -494,6 +494,16 @@ public:
     /// \return true if a valid message was copied to buf
     virtual bool    recv(uint8_t* buf, uint8_t* len);
 
+    /// Like recv(), but returns a pointer to the message in the driver instead of copying it.
+    /// The message stays valid until release(). See RHGenericDriver::lease()
+    /// \param[out] buf Set to the address of the message
+    /// \param[out] len Set to the length of the message
+    /// \return true if a message was leased
+    virtual bool    lease(const uint8_t** buf, uint8_t* len);
+
+    /// Releases the message leased by lease(), and allows the driver to receive the next one
+    virtual void    release();
+
     /// Waits until any previous transmit packet is finished being transmitted with waitPacketSent().
     /// Then loads a message into the transmitter and starts the transmitter. Note that a message length
     /// of 0 is permitted. 
@@ -502,6 +512,12 @@ public:
     /// \return true if the message length was valid and it was correctly queued for transmit
     virtual bool    send(const uint8_t* data, uint8_t len);
 
+    /// Like send(), but the message is made of a list of segments, which are written to the FIFO
+    /// after the length and headers in a single data SPI burst.
+    /// \param[in] segments The first segment of the message
+    /// \return true if the message length was valid and it was correctly queued for transmit
+    virtual bool    sendSegments(const Segment* segments);
+
     /// Returns the maximum message length 
     /// available in this Driver.
     /// \return The maximum legal message length
@@ -540,6 +556,11 @@ protected:
     /// Handles the interrupt.
     void handleInterrupt();
 
+    /// The interrupt handler starts the next queued message, so the transmit queue is supported.
+    /// See RHGenericDriver::setTxQueue()
+    /// \return true
+    virtual bool txQueueSupported() { return true; }
+
     /// Reads a single register from the MRF89XA
     /// \param[in] reg Register number, one of RH_MRF89_REG
     /// \return The value of the register
@@ -562,6 +583,11 @@ protected:
     /// \return 0;
     uint8_t spiWriteData(const uint8_t* data, uint8_t len);
 
+    /// Write a list of segments to the MRF89XA data FIFO in a single burst.
+    /// \param[in] segments The first segment to write
+    /// \return 0;
+    uint8_t spiWriteData(const Segment* segments);
+
     /// Reads a single byte from the MRF89XA data FIFO.
     /// \return The next data byte in the FIFO
     uint8_t spiReadData();
@@ -12,6 +12,8 @@ RH_NRF24::RH_NRF24(uint8_t chipEnablePin, uint8_t slaveSelectPin, RHGenericSPI&
 {
     _configuration = RH_NRF24_EN_CRC | RH_NRF24_CRCO; // Default: 2 byte CRC enabled
     _chipEnablePin = chipEnablePin;
+    _dataRate = DataRate2Mbps;
+    _addressWidth = 5; // Chip default
 }
 
 bool RH_NRF24::init()
@@ -114,6 +116,7 @@ bool RH_NRF24::setNetworkAddress(uint8_t* address, uint8_t len)
     spiWriteRegister(RH_NRF24_REG_03_SETUP_AW, len-2);	// Mapping [3..5] = [1..3]
     spiBurstWriteRegister(RH_NRF24_REG_0A_RX_ADDR_P0, address, len);
     spiBurstWriteRegister(RH_NRF24_REG_10_TX_ADDR, address, len);
+    _addressWidth = len;
     return true;
 }
 
@@ -131,11 +134,21 @@ bool RH_NRF24::setRF(DataRate data_rate, TransmitPower power)
     value |= RH_NRF24_LNA_HCURR;
     
     spiWriteRegister(RH_NRF24_REG_06_RF_SETUP, value);
+    _dataRate = data_rate;
     // If we were using auto-ack, we would have to set the appropriate timeout in reg 4 here
     // see NRF24::setRF()
     return true;
 }
 
+uint32_t RH_NRF24::timeOnAir(uint8_t len)
+{
+    uint32_t rate = _dataRate == DataRate250kbps ? 250000 : (_dataRate == DataRate1Mbps ? 1000000 : 2000000);
+    uint8_t crcLen = (_configuration & RH_NRF24_EN_CRC) ? ((_configuration & RH_NRF24_CRCO) ? 2 : 1) : 0;
+    // 1 octet preamble, address, 9 bit packet control field, headers, payload, CRC
+    uint32_t bits = ((1 + _addressWidth + RH_NRF24_HEADER_LEN + len + crcLen) * 8) + 9;
+    return ((uint64_t)bits * 1000000) / rate;
+}
+
 void RH_NRF24::setModeIdle()
 {
     if (_mode != RHModeIdle)
@@ -143,6 +156,7 @@ void RH_NRF24::setModeIdle()
 	spiWriteRegister(RH_NRF24_REG_00_CONFIG, _configuration);
 	digitalWrite(_chipEnablePin, LOW);
 	_mode = RHModeIdle;
+	RH_TRACE_EVENT(RHTrace::RHTraceMode, _mode);
     }
 }
 
@@ -153,6 +167,7 @@ bool RH_NRF24::sleep()
 	spiWriteRegister(RH_NRF24_REG_00_CONFIG, 0); // Power Down mode
 	digitalWrite(_chipEnablePin, LOW);
 	_mode = RHModeSleep;
+	RH_TRACE_EVENT(RHTrace::RHTraceMode, _mode);
 	return true;
     }
     return false; // Already there?
@@ -165,6 +180,7 @@ void RH_NRF24::setModeRx()
 	spiWriteRegister(RH_NRF24_REG_00_CONFIG, _configuration | RH_NRF24_PWR_UP | RH_NRF24_PRIM_RX);
 	digitalWrite(_chipEnablePin, HIGH);
 	_mode = RHModeRx;
+	RH_TRACE_EVENT(RHTrace::RHTraceMode, _mode);
     }
 }
 
@@ -180,20 +196,26 @@ void RH_NRF24::setModeTx()
 	spiWriteRegister(RH_NRF24_REG_00_CONFIG, _configuration | RH_NRF24_PWR_UP);
 	digitalWrite(_chipEnablePin, HIGH);
 	_mode = RHModeTx;
+	RH_TRACE_EVENT(RHTrace::RHTraceMode, _mode);
     }
 }
 
 bool RH_NRF24::send(const uint8_t* data, uint8_t len)
 {
+    Segment segment = { data, len, NULL };
+    return sendSegments(&segment);
+}
+
+bool RH_NRF24::sendSegments(const Segment* segments)
+{
+    uint16_t len = segmentsLength(segments);
     if (len > RH_NRF24_MAX_MESSAGE_LEN)
 	return false;
-    // Set up the headers
-    _buf[0] = _txHeaderTo;
-    _buf[1] = _txHeaderFrom;
-    _buf[2] = _txHeaderId;
-    _buf[3] = _txHeaderFlags;
-    memcpy(_buf+RH_NRF24_HEADER_LEN, data, len);
-    spiBurstWrite(RH_NRF24_COMMAND_W_TX_PAYLOAD_NOACK, _buf, len + RH_NRF24_HEADER_LEN);
+    RH_TRACE_EVENT(RHTrace::RHTraceSend, len);
+    // The headers and then the message, in one burst
+    uint8_t headers[RH_NRF24_HEADER_LEN] = { _txHeaderTo, _txHeaderFrom, _txHeaderId, _txHeaderFlags };
+    Segment h = { headers, sizeof(headers), segments };
+    spiBurstWrite(RH_NRF24_COMMAND_W_TX_PAYLOAD_NOACK, &h);
     setModeTx();
     // Radio will return to Standby II mode after transmission is complete
     _txGood++;
@@ -212,6 +234,8 @@ bool RH_NRF24::waitPacketSent()
     uint8_t status;
     while (!((status = statusRead()) & (RH_NRF24_TX_DS | RH_NRF24_MAX_RT)))
 	YIELD;
+    _txTimestamp = micros(); // As near as polling can tell
+    RH_TRACE_EVENT(RHTrace::RHTraceTxDone, ((uint16_t)_txHeaderTo << 8) | _txHeaderId);
 
     // Must clear RH_NRF24_MAX_RT if it is set, else no further comm
     if (status & RH_NRF24_MAX_RT)
@@ -275,9 +299,12 @@ void RH_NRF24::validateRxBuf()
 	_rxHeaderTo == _thisAddress ||
 	_rxHeaderTo == RH_BROADCAST_ADDRESS)
     {
-	_rxGood++;
+	_rxTimestamp = micros(); // As near as polling can tell
+	countRxGood();
 	_rxBufValid = true;
     }
+    else
+	_rxFiltered++;
 }
 
 bool RH_NRF24::available()
@@ -287,28 +314,39 @@ bool RH_NRF24::available()
 	if (_mode == RHModeTx)
 	    return false;
 	setModeRx();
-	if (spiReadRegister(RH_NRF24_REG_17_FIFO_STATUS) & RH_NRF24_RX_EMPTY)
-	    return false;
-	// Manual says that messages > 32 octets should be discarded
-	uint8_t len = spiRead(RH_NRF24_COMMAND_R_RX_PL_WID);
-	if (len > 32)
+	// With a receive queue, move every message in the FIFO to the queue, and stay in RX
+	while (!(spiReadRegister(RH_NRF24_REG_17_FIFO_STATUS) & RH_NRF24_RX_EMPTY))
 	{
-	    flushRx();
-	    clearRxBuf();
-	    setModeIdle();
-	    return false;
+	    // Manual says that messages > 32 octets should be discarded
+	    uint8_t len = spiRead(RH_NRF24_COMMAND_R_RX_PL_WID);
+	    if (len > 32)
+	    {
+		flushRx();
+		clearRxBuf();
+		setModeIdle();
+		break;
+	    }
+	    // Clear read interrupt
+	    spiWriteRegister(RH_NRF24_REG_07_STATUS, RH_NRF24_RX_DR);
+	    // Get the message into the RX buffer, so we can inspect the headers
+	    spiBurstRead(RH_NRF24_COMMAND_R_RX_PAYLOAD, _buf, len);
+	    _bufLen = len;
+	    // 140 microsecs (32 octet payload)
+	    validateRxBuf(); 
+	    if (_rxBufValid && rxQueueEnabled())
+	    {
+		rxQueuePut(_buf + RH_NRF24_HEADER_LEN, _bufLen - RH_NRF24_HEADER_LEN);
+		clearRxBuf();
+	    }
+	    else
+	    {
+		if (_rxBufValid)
+		    setModeIdle(); // Got one
+		break;
+	    }
 	}
-	// Clear read interrupt
-	spiWriteRegister(RH_NRF24_REG_07_STATUS, RH_NRF24_RX_DR);
-	// Get the message into the RX buffer, so we can inspect the headers
-	spiBurstRead(RH_NRF24_COMMAND_R_RX_PAYLOAD, _buf, len);
-	_bufLen = len;
-	// 140 microsecs (32 octet payload)
-	validateRxBuf(); 
-	if (_rxBufValid)
-	    setModeIdle(); // Got one
     }
-    return _rxBufValid;
+    return _rxBufValid || rxQueueCount();
 }
 
 void RH_NRF24::clearRxBuf()
@@ -321,6 +359,8 @@ bool RH_NRF24::recv(uint8_t* buf, uint8_t* len)
 {
     if (!available())
 	return false;
+    if (rxQueueGet(buf, len))
+	return true;
     if (buf && len)
     {
 	// Skip the 4 headers that are at the beginning of the rxBuf
@@ -332,6 +372,23 @@ bool RH_NRF24::recv(uint8_t* buf, uint8_t* len)
     return true;
 }
 
+bool RH_NRF24::lease(const uint8_t** buf, uint8_t* len)
+{
+    if (!available())
+	return false;
+    if (rxQueueLease(buf, len))
+	return true;
+    *buf = _buf + RH_NRF24_HEADER_LEN;
+    *len = _bufLen - RH_NRF24_HEADER_LEN;
+    return true;
+}
+
+void RH_NRF24::release()
+{
+    if (!rxQueueRelease())
+	clearRxBuf(); // This message accepted and cleared
+}
+
 uint8_t RH_NRF24::maxMessageLength()
 {
     return RH_NRF24_MAX_MESSAGE_LEN;
@@ -554,6 +554,12 @@ public:
     /// successfully transmitted).
     bool send(const uint8_t* data, uint8_t len);
 
+    /// Like send(), but the message is made of a list of segments, which are written to the TX payload
+    /// after the headers in a single SPI burst.
+    /// \param [in] segments The first segment of the message
+    /// \return true on success
+    bool sendSegments(const Segment* segments);
+
     /// Blocks until the current message (if any) 
     /// has been transmitted
     /// \return true on success, false if the chip is not in transmit mode or other transmit failure
@@ -587,10 +593,27 @@ public:
     /// \return true if a valid message was copied to buf
     bool        recv(uint8_t* buf, uint8_t* len);
 
+    /// Like recv(), but returns a pointer to the message in the driver instead of copying it.
+    /// The message stays valid until release(). See RHGenericDriver::lease()
+    /// \param[out] buf Set to the address of the message
+    /// \param[out] len Set to the length of the message
+    /// \return true if a message was leased
+    bool        lease(const uint8_t** buf, uint8_t* len);
+
+    /// Releases the message leased by lease(), and allows the driver to receive the next one
+    void        release();
+
     /// The maximum message length supported by this driver
     /// \return The maximum message length supported by this driver
     uint8_t maxMessageLength();
 
+    /// Returns the time on air of an Enhanced ShockBurst packet carrying a message of the given length, 
+    /// calculated from the data rate set by setRF(), the address width set by setNetworkAddress()
+    /// and the CRC length in the configuration set by setOpMode() (by default a 2 octet CRC).
+    /// \param[in] len Length of the message payload, not including the RadioHead headers
+    /// \return The time on air in microseconds
+    virtual uint32_t timeOnAir(uint8_t len);
+
     /// Sets the radio into Power Down mode.
     /// If successful, the radio will stay in Power Down mode until woken by 
     /// changing mode it idle, transmit or receive (eg by calling send(), recv(), available() etc)
@@ -628,6 +651,12 @@ private:
 
     /// True when there is a valid message in the buffer
     bool                _rxBufValid;
+
+    /// The data rate set by setRF(), for timeOnAir()
+    DataRate            _dataRate;
+
+    /// The address width in octets set by setNetworkAddress(), for timeOnAir()
+    uint8_t             _addressWidth;
 };
 
 /// @example nrf24_client.pde
@@ -133,6 +133,7 @@ void RH_NRF51::setModeIdle()
     {
 	NRF_RADIO->TASKS_DISABLE = 1;
 	_mode = RHModeIdle;
+	RH_TRACE_EVENT(RHTrace::RHTraceMode, _mode);
     }
 }
 
@@ -146,6 +147,7 @@ void RH_NRF51::setModeRx()
 	NRF_RADIO->EVENTS_DISABLED = 0U; // So we can detect end of transmission
 	NRF_RADIO->TASKS_RXEN = 1;
 	_mode = RHModeRx;
+	RH_TRACE_EVENT(RHTrace::RHTraceMode, _mode);
     }
 }
 
@@ -159,20 +161,34 @@ void RH_NRF51::setModeTx()
 	NRF_RADIO->EVENTS_DISABLED = 0U; // So we can detect end of transmission
 	NRF_RADIO->TASKS_TXEN = 1;
 	_mode = RHModeTx;
+	RH_TRACE_EVENT(RHTrace::RHTraceMode, _mode);
     }
 }
 
 bool RH_NRF51::send(const uint8_t* data, uint8_t len)
 {
+    Segment segment = { data, len, NULL };
+    return sendSegments(&segment);
+}
+
+bool RH_NRF51::sendSegments(const Segment* segments)
+{
+    uint16_t len = segmentsLength(segments);
     if (len > RH_NRF51_MAX_MESSAGE_LEN)
 	return false;
+    RH_TRACE_EVENT(RHTrace::RHTraceSend, len);
     // Set up the headers
     _buf[0] = len + RH_NRF51_HEADER_LEN;
     _buf[1] = _txHeaderTo;
     _buf[2] = _txHeaderFrom;
     _buf[3] = _txHeaderId;
     _buf[4] = _txHeaderFlags;
-    memcpy(_buf+RH_NRF51_HEADER_LEN+1, data, len);
+    uint8_t* p = _buf+RH_NRF51_HEADER_LEN+1;
+    for (; segments; segments = segments->next)
+    {
+	memcpy(p, segments->data, segments->len);
+	p += segments->len;
+    }
 
     _rxBufValid = false;
     setModeTx();
@@ -192,6 +208,8 @@ bool RH_NRF51::waitPacketSent()
     {
 	YIELD;
     }
+    _txTimestamp = micros(); // As near as polling can tell
+    RH_TRACE_EVENT(RHTrace::RHTraceTxDone, ((uint16_t)_txHeaderTo << 8) | _txHeaderId);
     setModeIdle();
 
     return true;
@@ -233,9 +251,12 @@ void RH_NRF51::validateRxBuf()
 	_rxHeaderTo == _thisAddress ||
 	_rxHeaderTo == RH_BROADCAST_ADDRESS)
     {
-	_rxGood++;
+	_rxTimestamp = micros(); // As near as polling can tell
+	countRxGood();
 	_rxBufValid = true;
     }
+    else
+	_rxFiltered++;
 }
 
 bool RH_NRF51::available()
@@ -251,6 +272,7 @@ bool RH_NRF51::available()
 	{
 	    // Bad CRC, restart the radio	    
 	    _rxBad++;
+	    _rxCrcErrors++;
 	    setModeRx();
 	    return false;
 	}
@@ -114,6 +114,7 @@ void RH_NRF905::setModeIdle()
 	digitalWrite(_chipEnablePin, LOW);
 	digitalWrite(_txEnablePin, LOW);
 	_mode = RHModeIdle;
+	RH_TRACE_EVENT(RHTrace::RHTraceMode, _mode);
     }
 }
 
@@ -124,6 +125,7 @@ void RH_NRF905::setModeRx()
 	digitalWrite(_txEnablePin, LOW);
 	digitalWrite(_chipEnablePin, HIGH);
 	_mode = RHModeRx;
+	RH_TRACE_EVENT(RHTrace::RHTraceMode, _mode);
     }
 }
 
@@ -135,21 +137,26 @@ void RH_NRF905::setModeTx()
 	digitalWrite(_txEnablePin, HIGH);
 	digitalWrite(_chipEnablePin, HIGH);
 	_mode = RHModeTx;
+	RH_TRACE_EVENT(RHTrace::RHTraceMode, _mode);
     }
 }
 
 bool RH_NRF905::send(const uint8_t* data, uint8_t len)
 {
+    Segment segment = { data, len, NULL };
+    return sendSegments(&segment);
+}
+
+bool RH_NRF905::sendSegments(const Segment* segments)
+{
+    uint16_t len = segmentsLength(segments);
     if (len > RH_NRF905_MAX_MESSAGE_LEN)
 	return false;
-    // Set up the headers
-    _buf[0] = _txHeaderTo;
-    _buf[1] = _txHeaderFrom;
-    _buf[2] = _txHeaderId;
-    _buf[3] = _txHeaderFlags;
-    _buf[4] = len;
-    memcpy(_buf+RH_NRF905_HEADER_LEN, data, len);
-    spiBurstWrite(RH_NRF905_REG_W_TX_PAYLOAD, _buf, len + RH_NRF905_HEADER_LEN);
+    RH_TRACE_EVENT(RHTrace::RHTraceSend, len);
+    // The headers and then the message, in one burst
+    uint8_t headers[RH_NRF905_HEADER_LEN] = { _txHeaderTo, _txHeaderFrom, _txHeaderId, _txHeaderFlags, (uint8_t)len };
+    Segment h = { headers, sizeof(headers), segments };
+    spiBurstWrite(RH_NRF905_REG_W_TX_PAYLOAD, &h);
     setModeTx();
     // Radio will return to Standby mode after transmission is complete
     _txGood++;
@@ -163,6 +170,8 @@ bool RH_NRF905::waitPacketSent()
 
     while (!(statusRead() & RH_NRF905_STATUS_DR))
 	YIELD;
+    _txTimestamp = micros(); // As near as polling can tell
+    RH_TRACE_EVENT(RHTrace::RHTraceTxDone, ((uint16_t)_txHeaderTo << 8) | _txHeaderId);
     setModeIdle();
     return true;
 }
@@ -213,10 +222,13 @@ void RH_NRF905::validateRxBuf()
 	_rxHeaderTo == _thisAddress ||
 	_rxHeaderTo == RH_BROADCAST_ADDRESS)
     {
-	_rxGood++;
+	_rxTimestamp = micros(); // As near as polling can tell
+	countRxGood();
 	_bufLen = len + RH_NRF905_HEADER_LEN; // _buf still includes the headers
 	_rxBufValid = true;
     }
+    else
+	_rxFiltered++;
 }
 
 bool RH_NRF905::available()
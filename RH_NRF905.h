@@ -345,6 +345,12 @@ public:
     /// successfully transmitted).
     bool send(const uint8_t* data, uint8_t len);
 
+    /// Like send(), but the message is made of a list of segments, which are written to the TX payload
+    /// after the headers in a single SPI burst.
+    /// \param [in] segments The first segment of the message
+    /// \return true on success
+    bool sendSegments(const Segment* segments);
+
     /// Blocks until the current message (if any) 
     /// has been transmitted
     /// \return true on success, false if the chip is not in transmit mode
@@ -64,6 +64,8 @@ RH_RF22::RH_RF22(uint8_t slaveSelectPin, uint8_t interruptPin, RHGenericSPI& spi
     _idleMode = RH_RF22_XTON; // Default idle state is READY mode
     _polynomial = CRC_16_IBM; // Historical
     _myInterruptIndex = 0xff; // Not allocated yet
+    _dataRate = 0;
+    _preambleNibbles = 8;
 }
 
 void RH_RF22::setIdleMode(uint8_t idleMode)
@@ -178,20 +180,12 @@ bool RH_RF22::init()
 // C++ level interrupt handler for this instance
 void RH_RF22::handleInterrupt()
 {
+    uint32_t now = micros(); // Before any SPI traffic, for the timestamps
     uint8_t _lastInterruptFlags[2];
     // Read the interrupt flags which clears the interrupt
     spiBurstRead(RH_RF22_REG_03_INTERRUPT_STATUS1, _lastInterruptFlags, 2);
-
-#if 0
-    // DEVELOPER TESTING ONLY
-    // Caution: Serial printing in this interrupt routine can cause mysterious crashes
-    Serial.print("interrupt ");
-    Serial.print(_lastInterruptFlags[0], HEX);
-    Serial.print(" ");
-    Serial.println(_lastInterruptFlags[1], HEX);
-    if (_lastInterruptFlags[0] == 0 && _lastInterruptFlags[1] == 0)
-	Serial.println("FUNNY: no interrupt!");
-#endif
+    // Serial printing in this interrupt routine can cause mysterious crashes. Use RHTrace instead
+    RH_TRACE_EVENT(RHTrace::RHTraceInterrupt, ((uint16_t)_lastInterruptFlags[0] << 8) | _lastInterruptFlags[1]);
 
 #if 0
     // DEVELOPER TESTING ONLY
@@ -210,7 +204,10 @@ void RH_RF22::handleInterrupt()
 	if (_mode == RHModeTx)
 	    restartTransmit();
 	else if (_mode == RHModeRx)
+	{
+	    _rxOverruns++;
 	    clearRxBuf();
+	}
 //	Serial.println("IFFERROR");  
     }
     // Caution, any delay here may cause a FF underflow or overflow
@@ -243,10 +240,13 @@ void RH_RF22::handleInterrupt()
     {
 //	Serial.println("IPKSENT");   
 	_txGood++; 
+	_txTimestamp = now;
+	RH_TRACE_EVENT(RHTrace::RHTraceTxDone, ((uint16_t)_txHeaderTo << 8) | _txHeaderId);
 	// Transmission does not automatically clear the tx buffer.
 	// Could retransmit if we wanted
 	// RH_RF22 transitions automatically to Idle
 	_mode = RHModeIdle;
+	txQueueNext(); // Start the next queued message, if any
     }
     if (_lastInterruptFlags[0] & RH_RF22_IPKVALID)
     {
@@ -263,6 +263,7 @@ void RH_RF22::handleInterrupt()
 	    _rxBad++;
 	    _mode = RHModeIdle;
 	    clearRxBuf();
+	    errorNotify(RHErrorRxBad);
 	    return; // Hmmm receiver buffer overflow. 
 	}
 
@@ -271,19 +272,31 @@ void RH_RF22::handleInterrupt()
 	_rxHeaderFrom = spiRead(RH_RF22_REG_48_RECEIVED_HEADER2);
 	_rxHeaderId = spiRead(RH_RF22_REG_49_RECEIVED_HEADER1);
 	_rxHeaderFlags = spiRead(RH_RF22_REG_4A_RECEIVED_HEADER0);
-	_rxGood++;
+	_rxTimestamp = now;
+	countRxGood();
 	_bufLen = len;
 	_mode = RHModeIdle;
 	_rxBufValid = true;
+	if (rxQueueEnabled())
+	{
+	    // Queue it and go straight back to RX for the next one
+	    rxQueuePut(_buf, _bufLen);
+	    clearRxBuf();
+	    setModeRx();
+	}
+	else
+	    rxNotify();
     }
     if (_lastInterruptFlags[0] & RH_RF22_ICRCERROR)
     {
 //	Serial.println("ICRCERR");  
 	_rxBad++;
+	_rxCrcErrors++;
 	clearRxBuf();
 	resetRxFifo();
 	_mode = RHModeIdle;
 	setModeRx(); // Keep trying
+	errorNotify(RHErrorRxBad);
     }
     if (_lastInterruptFlags[1] & RH_RF22_IPREAVAL)
     {
@@ -428,6 +441,16 @@ uint8_t RH_RF22::rssiRead()
     return spiRead(RH_RF22_REG_26_RSSI);
 }
 
+bool RH_RF22::isChannelActive()
+{
+    if (_mode != RHModeRx)
+    {
+	setModeRx();
+	delay(1); // Let the RSSI settle
+    }
+    return (-120 + (rssiRead() / 2)) > _cadThreshold;
+}
+
 uint8_t RH_RF22::ezmacStatusRead()
 {
     return spiRead(RH_RF22_REG_31_EZMAC_STATUS);
@@ -444,6 +467,7 @@ void RH_RF22::setModeIdle()
     {
 	setOpMode(_idleMode);
 	_mode = RHModeIdle;
+	RH_TRACE_EVENT(RHTrace::RHTraceMode, _mode);
     }
 }
 
@@ -453,6 +477,7 @@ bool RH_RF22::sleep()
     {
 	setOpMode(0);
 	_mode = RHModeSleep;
+	RH_TRACE_EVENT(RHTrace::RHTraceMode, _mode);
     }
     return true;
 }
@@ -463,6 +488,7 @@ void RH_RF22::setModeRx()
     {
 	setOpMode(_idleMode | RH_RF22_RXON);
 	_mode = RHModeRx;
+	RH_TRACE_EVENT(RHTrace::RHTraceMode, _mode);
     }
 }
 
@@ -476,6 +502,7 @@ void RH_RF22::setModeTx()
 	// RX FIFO
 	resetRxFifo();
 	_mode = RHModeTx;
+	RH_TRACE_EVENT(RHTrace::RHTraceMode, _mode);
     }
 }
 
@@ -494,6 +521,11 @@ void RH_RF22::setModemRegisters(const ModemConfig* config)
     spiWrite(RH_RF22_REG_58_CHARGE_PUMP_CURRENT_TRIMMING,           config->reg_58);
     spiWrite(RH_RF22_REG_69_AGC_OVERRIDE1,                          config->reg_69);
     spiBurstWrite(RH_RF22_REG_6E_TX_DATA_RATE1,                    &config->reg_6e, 5);
+
+    // TX data rate is txdr * 1MHz / 2^(16 + 5 * txdtrtscale)
+    uint32_t txdr = ((uint32_t)config->reg_6e << 8) | config->reg_6f;
+    uint8_t scale = (config->reg_70 & 0x20) ? 21 : 16;
+    _dataRate = ((uint64_t)txdr * 1000000) >> scale;
 }
 
 // Set one of the canned FSK Modem configs
@@ -514,6 +546,16 @@ bool RH_RF22::setModemConfig(ModemConfigChoice index)
 void RH_RF22::setPreambleLength(uint8_t nibbles)
 {
     spiWrite(RH_RF22_REG_34_PREAMBLE_LENGTH, nibbles);
+    _preambleNibbles = nibbles;
+}
+
+uint32_t RH_RF22::timeOnAir(uint8_t len)
+{
+    if (!_dataRate)
+	return 0; // Not configured yet
+    // Preamble, 2 sync words, 4 headers, length, payload, 2 CRC octets
+    uint32_t bits = (_preambleNibbles * 4) + ((2 + 4 + 1 + len + 2) * 8);
+    return ((uint64_t)bits * 1000000) / _dataRate;
 }
 
 // Caution doesnt set sync word len in Header Control 2 0x33
@@ -538,13 +580,15 @@ bool RH_RF22::available()
 	    return false;
 	setModeRx(); // Make sure we are receiving
     }
-    return _rxBufValid;
+    return _rxBufValid || rxQueueCount();
 }
 
 bool RH_RF22::recv(uint8_t* buf, uint8_t* len)
 {
     if (!available())
 	return false;
+    if (rxQueueGet(buf, len))
+	return true;
 
     if (buf && len)
     {
@@ -559,6 +603,24 @@ bool RH_RF22::recv(uint8_t* buf, uint8_t* len)
     return true;
 }
 
+// Caution: _buf is also the transmit buffer, so send() ends the lease
+bool RH_RF22::lease(const uint8_t** buf, uint8_t* len)
+{
+    if (!available())
+	return false;
+    if (rxQueueLease(buf, len))
+	return true;
+    *buf = _buf;
+    *len = _bufLen;
+    return true;
+}
+
+void RH_RF22::release()
+{
+    if (!rxQueueRelease())
+	clearRxBuf();
+}
+
 void RH_RF22::clearTxBuf()
 {
     ATOMIC_BLOCK_START;
@@ -584,20 +646,33 @@ void RH_RF22::restartTransmit()
 }
 
 bool RH_RF22::send(const uint8_t* data, uint8_t len)
+{
+    Segment segment = { data, len, NULL };
+    return sendSegments(&segment);
+}
+
+bool RH_RF22::sendSegments(const Segment* segments)
 {
     bool ret = true;
     waitPacketSent();
+    if (!waitCAD())
+	return false; // Channel stayed busy
     ATOMIC_BLOCK_START;
     spiWrite(RH_RF22_REG_3A_TRANSMIT_HEADER3, _txHeaderTo);
     spiWrite(RH_RF22_REG_3B_TRANSMIT_HEADER2, _txHeaderFrom);
     spiWrite(RH_RF22_REG_3C_TRANSMIT_HEADER1, _txHeaderId);
     spiWrite(RH_RF22_REG_3D_TRANSMIT_HEADER0, _txHeaderFlags);
-    if (!fillTxBuf(data, len))
-	ret = false;
-    else
+    clearTxBuf();
+    for (; segments && ret; segments = segments->next)
+	ret = appendTxBuf(segments->data, segments->len);
+    if (!_bufLen)
+	ret = false; // 0 length messages are not permitted
+    if (ret)
+    {
+	RH_TRACE_EVENT(RHTrace::RHTraceSend, _bufLen);
 	startTransmit();
+    }
     ATOMIC_BLOCK_END;
-//    printBuffer("send:", data, len);
     return ret;
 }
 
@@ -632,6 +707,7 @@ void RH_RF22::sendNextFragment()
 	if (len > (RH_RF22_FIFO_SIZE - RH_RF22_TXFFAEM_THRESHOLD - 1))
 	    len = (RH_RF22_FIFO_SIZE - RH_RF22_TXFFAEM_THRESHOLD - 1);
 	spiBurstWrite(RH_RF22_REG_7F_FIFO_ACCESS, _buf + _txBufSentIndex, len);
+	RH_TRACE_EVENT(RHTrace::RHTraceFifoWrite, len);
 //	printBuffer("frag:", _buf  + _txBufSentIndex, len);
 	_txBufSentIndex += len;
     }
@@ -646,6 +722,7 @@ void RH_RF22::readNextFragment()
 
     // Read the RH_RF22_RXFFAFULL_THRESHOLD octets that should be there
     spiBurstRead(RH_RF22_REG_7F_FIFO_ACCESS, _buf + _bufLen, RH_RF22_RXFFAFULL_THRESHOLD);
+    RH_TRACE_EVENT(RHTrace::RHTraceFifoRead, RH_RF22_RXFFAFULL_THRESHOLD);
     _bufLen += RH_RF22_RXFFAFULL_THRESHOLD;
 }
 
@@ -1095,6 +1095,16 @@ public:
     /// \return true if a valid message was copied to buf
     bool        recv(uint8_t* buf, uint8_t* len);
 
+    /// Like recv(), but returns a pointer to the message in the driver instead of copying it.
+    /// The message stays valid until release(). See RHGenericDriver::lease()
+    /// \param[out] buf Set to the address of the message
+    /// \param[out] len Set to the length of the message
+    /// \return true if a message was leased
+    bool        lease(const uint8_t** buf, uint8_t* len);
+
+    /// Releases the message leased by lease(), and allows the driver to receive the next one
+    void        release();
+
     /// Waits until any previous transmit packet is finished being transmitted with waitPacketSent().
     /// Then loads a message into the transmitter and starts the transmitter. Note that a message length
     /// of 0 is NOT permitted. 
@@ -1103,6 +1113,12 @@ public:
     /// \return true if the message length was valid and it was correctly queued for transmit
     bool        send(const uint8_t* data, uint8_t len);
 
+    /// Like send(), but the message is made of a list of segments. Messages may be longer than the FIFO,
+    /// so the segments are gathered into the transmit buffer as usual.
+    /// \param[in] segments The first segment of the message
+    /// \return true if the message length was valid and it was correctly queued for transmit
+    bool        sendSegments(const Segment* segments);
+
     /// Sets the length of the preamble
     /// in 4-bit nibbles. 
     /// Caution: this should be set to the same 
@@ -1151,6 +1167,13 @@ public:
     /// \return The maximum message length supported by this driver
     uint8_t maxMessageLength();
 
+    /// Returns the time on air of a message of the given length, calculated from the
+    /// TX data rate in the current modem configuration and the preamble length. 
+    /// Assumes the 2 sync words, 4 headers and CRC configured by init().
+    /// \param[in] len Length of the message payload, not including the RadioHead headers
+    /// \return The time on air in microseconds
+    virtual uint32_t timeOnAir(uint8_t len);
+
     /// Sets the radio into low-power sleep mode.
     /// If successful, the transport will stay in sleep mode until woken by 
     /// changing mode it idle, transmit or receive (eg by calling send(), recv(), available() etc)
@@ -1158,12 +1181,22 @@ public:
     /// \return true if sleep mode was successfully entered.
     virtual bool    sleep();
 
+    /// Tells whether another node is transmitting, by measuring the RSSI with the receiver on, and comparing it
+    /// with the threshold set by RHGenericDriver::setCADThreshold(). Used by send() for listen before talk.
+    /// \return true if the RSSI is above the threshold
+    virtual bool    isChannelActive();
+
 protected:
     /// This is a low level function to handle the interrupts for one instance of RH_RF22.
     /// Called automatically by isr*()
     /// Should not need to be called.
     void           handleInterrupt();
 
+    /// The interrupt handler starts the next queued message, so the transmit queue is supported.
+    /// See RHGenericDriver::setTxQueue()
+    /// \return true
+    virtual bool    txQueueSupported() { return true; }
+
     /// Clears the receiver buffer.
     /// Internal use only
     void           clearRxBuf();
@@ -1283,6 +1316,11 @@ protected:
   
     /// Time in millis since the last preamble was received (and the last time the RSSI was measured)
     uint32_t            _lastPreambleTime;
+    /// TX data rate in bits per second from the most recent setModemRegisters(), for timeOnAir()
+    uint32_t            _dataRate;
+
+    /// The most recent preamble length set by setPreambleLength(), for timeOnAir()
+    uint8_t             _preambleNibbles;
 };
 
 /// @example rf22_client.pde
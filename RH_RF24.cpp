@@ -65,6 +65,9 @@ RH_RF24::RH_RF24(uint8_t slaveSelectPin, uint8_t interruptPin, uint8_t sdnPin, R
     _sdnPin = sdnPin;
     _idleMode = RH_RF24_DEVICE_STATE_READY;
     _myInterruptIndex = 0xff; // Not allocated yet
+    _dataRate = 0;
+    _preambleLength = 4;
+    _syncWordsLen = 2;
 }
 
 void RH_RF24::setIdleMode(uint8_t idleMode)
@@ -191,8 +194,11 @@ bool RH_RF24::init()
 // C++ level interrupt handler for this instance
 void RH_RF24::handleInterrupt()
 {
+    uint32_t now = micros(); // Before any SPI traffic, for the timestamps
     uint8_t status[8];
     command(RH_RF24_CMD_GET_INT_STATUS, NULL, 0, status, sizeof(status));
+    // The packet handler and modem interrupt flags
+    RH_TRACE_EVENT(RHTrace::RHTraceInterrupt, ((uint16_t)status[2] << 8) | status[4]);
 
     // Decode and handle the interrupt bits we are interested in
 //    if (status[0] & RH_RF24_INT_STATUS_CHIP_INT_STATUS)
@@ -216,6 +222,7 @@ void RH_RF24::handleInterrupt()
 	    // Radio automatically went to _idleMode
 	    _mode = RHModeIdle;
 	    _rxBad++;
+	    _rxCrcErrors++;
 
 	    clearRxFifo();
 	    clearBuffer();
@@ -223,6 +230,8 @@ void RH_RF24::handleInterrupt()
 	if (status[2] & RH_RF24_INT_STATUS_PACKET_SENT)
 	{
 	    _txGood++; 
+	    _txTimestamp = now;
+	    RH_TRACE_EVENT(RHTrace::RHTraceTxDone, ((uint16_t)_txHeaderTo << 8) | _txHeaderId);
 	    // Transmission does not automatically clear the tx buffer.
 	    // Could retransmit if we wanted
 	    // RH_RF24 configured to transition automatically to Idle after packet sent
@@ -237,6 +246,7 @@ void RH_RF24::handleInterrupt()
 	    command(RH_RF24_CMD_GET_MODEM_STATUS, NULL, 0, modem_status, sizeof(modem_status));
 	    _lastRssi = modem_status[3];
 	    _lastPreambleTime = millis();
+	    _rxTimestamp = now;
 	    
 	    // Save it in our buffer
 	    readNextFragment();
@@ -273,9 +283,11 @@ void RH_RF24::validateRxBuf()
 	    _rxHeaderTo == RH_BROADCAST_ADDRESS)
 	{
 	    // Its for us
-	    _rxGood++;
+	    countRxGood();
 	    _rxBufValid = true;
 	}
+	else
+	    _rxFiltered++;
     }
 }
 
@@ -339,10 +351,19 @@ bool RH_RF24::recv(uint8_t* buf, uint8_t* len)
 
 bool RH_RF24::send(const uint8_t* data, uint8_t len)
 {
+    Segment segment = { data, len, NULL };
+    return sendSegments(&segment);
+}
+
+bool RH_RF24::sendSegments(const Segment* segments)
+{
+    uint16_t len = segmentsLength(segments);
     if (len > RH_RF24_MAX_MESSAGE_LEN)
 	return false;
 
     waitPacketSent(); // Make sure we dont interrupt an outgoing message
+    if (!waitCAD())
+	return false; // Channel stayed busy
     setModeIdle(); // Prevent RX while filling the fifo
 
     // Put the payload in the FIFO
@@ -356,9 +377,15 @@ bool RH_RF24::send(const uint8_t* data, uint8_t len)
     _buf[3] = _txHeaderId;
     _buf[4] = _txHeaderFlags;
     // Then the message
-    memcpy(_buf + 1 + RH_RF24_HEADER_LEN, data, len);
+    uint8_t* p = _buf + 1 + RH_RF24_HEADER_LEN;
+    for (; segments; segments = segments->next)
+    {
+	memcpy(p, segments->data, segments->len);
+	p += segments->len;
+    }
     _bufLen = len + 1 + RH_RF24_HEADER_LEN;
     _txBufSentIndex = 0;
+    RH_TRACE_EVENT(RHTrace::RHTraceSend, len);
 
     // Set the field 2 length to the variable payload length
     uint8_t l[] = { (uint8_t)(len + RH_RF24_HEADER_LEN)};
@@ -400,6 +427,7 @@ void RH_RF24::sendNextFragment()
 	    len = fifo_info[1];
 
 	writeTxFifo(_buf + _txBufSentIndex, len);
+	RH_TRACE_EVENT(RHTrace::RHTraceFifoWrite, len);
 	_txBufSentIndex += len;
     }
 }
@@ -416,6 +444,7 @@ void RH_RF24::readNextFragment()
     {
 	// Overflow pending
 	_rxBad++;
+	_rxOverruns++;
 	setModeIdle();
 	clearRxFifo();
 	clearBuffer();
@@ -434,6 +463,7 @@ void RH_RF24::readNextFragment()
     digitalWrite(_slaveSelectPin, HIGH);
     _spi.endTransaction();
     _bufLen += fifo_len;
+    RH_TRACE_EVENT(RHTrace::RHTraceFifoRead, fifo_len);
 }
 
 uint8_t RH_RF24::maxMessageLength()
@@ -450,6 +480,11 @@ void RH_RF24::setModemRegisters(const ModemConfig* config)
     set_properties(0x2004, &config->prop_2004, 1);
     set_properties(0x2005, &config->prop_2005, 1);
     set_properties(0x2006, &config->prop_2006, 1);
+    // With the NCO modulus at the crystal frequency (the chip default) the data rate is 
+    // MODEM_DATA_RATE / TXOSR, where TXOSR is in bits 3:2 of MODEM_TX_NCO_MODE
+    uint32_t rate = ((uint32_t)config->prop_2003 << 16) | ((uint32_t)config->prop_2004 << 8) | config->prop_2005;
+    uint8_t txosr = (config->prop_2006 >> 2) & 0x03;
+    _dataRate = rate / (txosr == 1 ? 40 : (txosr == 2 ? 20 : 10));
     set_properties(0x200b, &config->prop_200b, 1);
     set_properties(0x200c, &config->prop_200c, 1);
     set_properties(0x2018, &config->prop_2018, 1);
@@ -546,6 +581,7 @@ void RH_RF24::setPreambleLength(uint16_t bytes)
     uint8_t config[] = { (uint8_t)bytes, 0x14, 0x00, 0x00, 
 			 RH_RF24_PREAMBLE_FIRST_1 | RH_RF24_PREAMBLE_LENGTH_BYTES | RH_RF24_PREAMBLE_STANDARD_1010};
     set_properties(RH_RF24_PROPERTY_PREAMBLE_TX_LENGTH, config, sizeof(config));
+    _preambleLength = bytes;
 }
 
 bool RH_RF24::setCRCPolynomial(CRCPolynomial polynomial)
@@ -568,6 +604,16 @@ void RH_RF24::setSyncWords(const uint8_t* syncWords, uint8_t len)
     uint8_t config[] = { (uint8_t)(len-1), 0, 0, 0, 0};
     memcpy(config+1, syncWords, len);
     set_properties(RH_RF24_PROPERTY_SYNC_CONFIG, config, sizeof(config));
+    _syncWordsLen = len;
+}
+
+uint32_t RH_RF24::timeOnAir(uint8_t len)
+{
+    if (!_dataRate)
+	return 0; // Not configured yet
+    // Preamble, sync, field 1 (length and CRC), field 2 (headers, payload and CRC)
+    uint32_t bits = (_preambleLength + _syncWordsLen + (1 + 2) + (RH_RF24_HEADER_LEN + len + 2)) * 8;
+    return ((uint64_t)bits * 1000000) / _dataRate;
 }
 
 bool RH_RF24::setFrequency(float centre, float afcPullInRange)
@@ -647,6 +693,7 @@ void RH_RF24::setModeIdle()
 	uint8_t state[] = { _idleMode };
 	command(RH_RF24_CMD_REQUEST_DEVICE_STATE, state, sizeof(state));
 	_mode = RHModeIdle;
+	RH_TRACE_EVENT(RHTrace::RHTraceMode, _mode);
     }
 }
 
@@ -658,6 +705,7 @@ bool RH_RF24::sleep()
 	command(RH_RF24_CMD_REQUEST_DEVICE_STATE, state, sizeof(state));
 
 	_mode = RHModeSleep;
+	RH_TRACE_EVENT(RHTrace::RHTraceMode, _mode);
     }
     return true;
 }
@@ -680,6 +728,7 @@ void RH_RF24::setModeRx()
 	uint8_t rx_config[] = { 0x00, RH_RF24_CONDITION_RX_START_IMMEDIATE, 0x00, 0x00, _idleMode, _idleMode, _idleMode};
 	command(RH_RF24_CMD_START_RX, rx_config, sizeof(rx_config));
 	_mode = RHModeRx;
+	RH_TRACE_EVENT(RHTrace::RHTraceMode, _mode);
     }
 }
 
@@ -695,6 +744,7 @@ void RH_RF24::setModeTx()
 				(uint8_t)((_idleMode << 4) | RH_RF24_CONDITION_RETRANSMIT_NO | RH_RF24_CONDITION_START_IMMEDIATE)};
 	command(RH_RF24_CMD_START_TX, tx_params, sizeof(tx_params));
 	_mode = RHModeTx;
+	RH_TRACE_EVENT(RHTrace::RHTraceMode, _mode);
     }
 }
 
@@ -878,10 +878,23 @@ public:
     /// \return true if the message length was valid and it was correctly queued for transmit
     bool        send(const uint8_t* data, uint8_t len);
 
+    /// Like send(), but the message is made of a list of segments, which are copied into the
+    /// transmit buffer after the headers.
+    /// \param[in] segments The first segment of the message
+    /// \return true if the message length was valid and it was correctly queued for transmit
+    bool        sendSegments(const Segment* segments);
+
     /// The maximum message length supported by this driver
     /// \return The maximum message length supported by this driver
     uint8_t maxMessageLength();
 
+    /// Returns the time on air of a message of the given length, calculated from the data rate and
+    /// TX oversampling in the current modem configuration, and the preamble and sync word lengths.
+    /// Assumes the 2 fields, each with a 16 bit CRC, configured by init().
+    /// \param[in] len Length of the message payload, not including the RadioHead headers
+    /// \return The time on air in microseconds
+    virtual uint32_t timeOnAir(uint8_t len);
+
     /// Sets the length of the preamble
     /// in bytes. 
     /// Caution: this should be set to the same 
@@ -1090,6 +1103,15 @@ private:
     /// Time in millis since the last preamble was received (and the last time the RSSI was measured)
     uint32_t            _lastPreambleTime;
 
+    /// Data rate in bits per second from the most recent setModemRegisters(), for timeOnAir()
+    uint32_t            _dataRate;
+
+    /// The most recent preamble length set by setPreambleLength(), for timeOnAir()
+    uint16_t            _preambleLength;
+
+    /// The number of sync words set by setSyncWords(), for timeOnAir()
+    uint8_t             _syncWordsLen;
+
 };
 
 /// @example rf24_client.pde
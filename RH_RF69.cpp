@@ -90,6 +90,11 @@ RH_RF69::RH_RF69(uint8_t slaveSelectPin, uint8_t interruptPin, RHGenericSPI& spi
     _interruptPin = interruptPin;
     _idleMode = RH_RF69_OPMODE_MODE_STDBY;
     _myInterruptIndex = 0xff; // Not allocated yet
+    _bitRate = 0;
+    _packetConfig1 = 0;
+    _preambleLength = 4;
+    _syncWordsLen = 0;
+    _encrypted = false;
 }
 
 void RH_RF69::setIdleMode(uint8_t idleMode)
@@ -196,13 +201,18 @@ bool RH_RF69::init()
 // We use this to get PACKETSDENT and PAYLOADRADY interrupts.
 void RH_RF69::handleInterrupt()
 {
+    uint32_t now = micros(); // Before any SPI traffic, for the timestamps
     // Get the interrupt cause
     uint8_t irqflags2 = spiRead(RH_RF69_REG_28_IRQFLAGS2);
+    RH_TRACE_EVENT(RHTrace::RHTraceInterrupt, irqflags2);
     if (_mode == RHModeTx && (irqflags2 & RH_RF69_IRQFLAGS2_PACKETSENT))
     {
 	// A transmitter message has been fully sent
 	setModeIdle(); // Clears FIFO
 	_txGood++;
+	_txTimestamp = now;
+	RH_TRACE_EVENT(RHTrace::RHTraceTxDone, ((uint16_t)_txHeaderTo << 8) | _txHeaderId);
+	txQueueNext(); // Start the next queued message, if any
 //	Serial.println("PACKETSENT");
     }
     // Must look for PAYLOADREADY, not CRCOK, since only PAYLOADREADY occurs _after_ AES decryption
@@ -212,10 +222,20 @@ void RH_RF69::handleInterrupt()
 	// A complete message has been received with good CRC
 	_lastRssi = -((int8_t)(spiRead(RH_RF69_REG_24_RSSIVALUE) >> 1));
 	_lastPreambleTime = millis();
+	_rxTimestamp = now;
 
 	setModeIdle();
 	// Save it in our buffer
 	readFifo();
+	if (_rxBufValid && rxQueueEnabled())
+	{
+	    // Queue it and go straight back to RX for the next one
+	    rxQueuePut(_buf, _bufLen);
+	    _rxBufValid = false;
+	    setModeRx();
+	}
+	else if (_rxBufValid)
+	    rxNotify();
 //	Serial.println("PAYLOADREADY");
     }
 }
@@ -247,9 +267,11 @@ void RH_RF69::readFifo()
     	    // And now the real payload
     	    for (_bufLen = 0; _bufLen < (payloadlen - RH_RF69_HEADER_LEN); _bufLen++)
     		_buf[_bufLen] = _spi.transfer(0);
-    	    _rxGood++;
+    	    countRxGood();
     	    _rxBufValid = true;
     	}
+    	else
+    	    _rxFiltered++;
     }
     digitalWrite(_slaveSelectPin, HIGH);
     _spi.endTransaction();
@@ -310,6 +332,16 @@ int8_t RH_RF69::rssiRead()
     return -((int8_t)(spiRead(RH_RF69_REG_24_RSSIVALUE) >> 1));
 }
 
+bool RH_RF69::isChannelActive()
+{
+    if (_mode != RHModeRx)
+    {
+	setModeRx();
+	delay(1); // Let the RSSI settle
+    }
+    return rssiRead() > _cadThreshold;
+}
+
 void RH_RF69::setOpMode(uint8_t mode)
 {
     uint8_t opmode = spiRead(RH_RF69_REG_01_OPMODE);
@@ -334,6 +366,7 @@ void RH_RF69::setModeIdle()
 	}
 	setOpMode(_idleMode);
 	_mode = RHModeIdle;
+	RH_TRACE_EVENT(RHTrace::RHTraceMode, _mode);
     }
 }
 
@@ -343,6 +376,7 @@ bool RH_RF69::sleep()
     {
 	spiWrite(RH_RF69_REG_01_OPMODE, RH_RF69_OPMODE_MODE_SLEEP);
 	_mode = RHModeSleep;
+	RH_TRACE_EVENT(RHTrace::RHTraceMode, _mode);
     }
     return true;
 }
@@ -360,6 +394,7 @@ void RH_RF69::setModeRx()
 	spiWrite(RH_RF69_REG_25_DIOMAPPING1, RH_RF69_DIOMAPPING1_DIO0MAPPING_01); // Set interrupt line 0 PayloadReady
 	setOpMode(RH_RF69_OPMODE_MODE_RX); // Clears FIFO
 	_mode = RHModeRx;
+	RH_TRACE_EVENT(RHTrace::RHTraceMode, _mode);
     }
 }
 
@@ -377,6 +412,7 @@ void RH_RF69::setModeTx()
 	spiWrite(RH_RF69_REG_25_DIOMAPPING1, RH_RF69_DIOMAPPING1_DIO0MAPPING_00); // Set interrupt line 0 PacketSent
 	setOpMode(RH_RF69_OPMODE_MODE_TX); // Clears FIFO
 	_mode = RHModeTx;
+	RH_TRACE_EVENT(RHTrace::RHTraceMode, _mode);
     }
 }
 
@@ -417,6 +453,11 @@ void RH_RF69::setModemRegisters(const ModemConfig* config)
     spiBurstWrite(RH_RF69_REG_02_DATAMODUL,     &config->reg_02, 5);
     spiBurstWrite(RH_RF69_REG_19_RXBW,          &config->reg_19, 2);
     spiWrite(RH_RF69_REG_37_PACKETCONFIG1,       config->reg_37);
+
+    // Bit rate is FXOSC / BitRate(15:0)
+    uint16_t bitrate = ((uint16_t)config->reg_03 << 8) | config->reg_04;
+    _bitRate = bitrate ? (uint32_t)(RH_RF69_FXOSC / bitrate) : 0;
+    _packetConfig1 = config->reg_37;
 }
 
 // Set one of the canned FSK Modem configs
@@ -437,6 +478,7 @@ void RH_RF69::setPreambleLength(uint16_t bytes)
 {
     spiWrite(RH_RF69_REG_2C_PREAMBLEMSB, bytes >> 8);
     spiWrite(RH_RF69_REG_2D_PREAMBLELSB, bytes & 0xff);
+    _preambleLength = bytes;
 }
 
 void RH_RF69::setSyncWords(const uint8_t* syncWords, uint8_t len)
@@ -446,9 +488,13 @@ void RH_RF69::setSyncWords(const uint8_t* syncWords, uint8_t len)
     {
 	spiBurstWrite(RH_RF69_REG_2F_SYNCVALUE1, syncWords, len);
 	syncconfig |= RH_RF69_SYNCCONFIG_SYNCON;
+	_syncWordsLen = len;
     }
     else
+    {
 	syncconfig &= ~RH_RF69_SYNCCONFIG_SYNCON;
+	_syncWordsLen = 0;
+    }
     syncconfig &= ~RH_RF69_SYNCCONFIG_SYNCSIZE;
     syncconfig |= (len-1) << 3;
     spiWrite(RH_RF69_REG_2E_SYNCCONFIG, syncconfig);
@@ -465,20 +511,42 @@ void RH_RF69::setEncryptionKey(uint8_t* key)
     {
 	spiWrite(RH_RF69_REG_3D_PACKETCONFIG2, spiRead(RH_RF69_REG_3D_PACKETCONFIG2) & ~RH_RF69_PACKETCONFIG2_AESON);
     }
+    _encrypted = key != NULL;
+}
+
+uint32_t RH_RF69::timeOnAir(uint8_t len)
+{
+    if (!_bitRate)
+	return 0; // Not configured yet
+    // The headers and payload are padded to whole AES blocks when encrypted
+    uint16_t payload = RH_RF69_HEADER_LEN + len;
+    if (_encrypted)
+	payload = (payload + 15) & ~15;
+    // Everything after the sync words is Manchester encoded if enabled
+    uint32_t bits = (1 + payload + ((_packetConfig1 & RH_RF69_PACKETCONFIG1_CRC_ON) ? 2 : 0)) * 8;
+    if ((_packetConfig1 & RH_RF69_PACKETCONFIG1_DCFREE) == RH_RF69_PACKETCONFIG1_DCFREE_MANCHESTER)
+	bits *= 2;
+    bits += (_preambleLength + _syncWordsLen) * 8;
+    return ((uint64_t)bits * 1000000) / _bitRate;
 }
 
 bool RH_RF69::available()
 {
-    if (_mode == RHModeTx)
-	return false;
-    setModeRx(); // Make sure we are receiving
-    return _rxBufValid;
+    if (!_rxBufValid)
+    {
+	if (_mode == RHModeTx)
+	    return false;
+	setModeRx(); // Make sure we are receiving, but not while a message is in _buf, which may be leased
+    }
+    return _rxBufValid || rxQueueCount();
 }
 
 bool RH_RF69::recv(uint8_t* buf, uint8_t* len)
 {
     if (!available())
 	return false;
+    if (rxQueueGet(buf, len))
+	return true;
 
     if (buf && len)
     {
@@ -493,12 +561,39 @@ bool RH_RF69::recv(uint8_t* buf, uint8_t* len)
     return true;
 }
 
+bool RH_RF69::lease(const uint8_t** buf, uint8_t* len)
+{
+    if (!available())
+	return false;
+    if (rxQueueLease(buf, len))
+	return true;
+    *buf = _buf;
+    *len = _bufLen;
+    return true;
+}
+
+void RH_RF69::release()
+{
+    if (!rxQueueRelease())
+	_rxBufValid = false; // Got the most recent message
+}
+
 bool RH_RF69::send(const uint8_t* data, uint8_t len)
 {
+    Segment segment = { data, len, NULL };
+    return sendSegments(&segment);
+}
+
+bool RH_RF69::sendSegments(const Segment* segments)
+{
+    uint16_t len = segmentsLength(segments);
     if (len > RH_RF69_MAX_MESSAGE_LEN)
 	return false;
 
     waitPacketSent(); // Make sure we dont interrupt an outgoing message
+    if (!waitCAD())
+	return false; // Channel stayed busy
+    RH_TRACE_EVENT(RHTrace::RHTraceSend, len);
     setModeIdle(); // Prevent RX while filling the fifo
 
     ATOMIC_BLOCK_START;
@@ -512,8 +607,13 @@ bool RH_RF69::send(const uint8_t* data, uint8_t len)
     _spi.transfer(_txHeaderId);
     _spi.transfer(_txHeaderFlags);
     // Now the payload
-    while (len--)
-	_spi.transfer(*data++);
+    for (; segments; segments = segments->next)
+    {
+	const uint8_t* data = segments->data;
+	uint8_t i;
+	for (i = 0; i < segments->len; i++)
+	    _spi.transfer(data[i]);
+    }
     digitalWrite(_slaveSelectPin, HIGH);
     _spi.endTransaction();
     ATOMIC_BLOCK_END;
@@ -797,6 +797,16 @@ public:
     /// \return true if a valid message was copied to buf
     bool        recv(uint8_t* buf, uint8_t* len);
 
+    /// Like recv(), but returns a pointer to the message in the driver instead of copying it.
+    /// The message stays valid until release(). See RHGenericDriver::lease()
+    /// \param[out] buf Set to the address of the message
+    /// \param[out] len Set to the length of the message
+    /// \return true if a message was leased
+    bool        lease(const uint8_t** buf, uint8_t* len);
+
+    /// Releases the message leased by lease(), and allows the driver to receive the next one
+    void        release();
+
     /// Waits until any previous transmit packet is finished being transmitted with waitPacketSent().
     /// Then loads a message into the transmitter and starts the transmitter. Note that a message length
     /// of 0 is NOT permitted. 
@@ -805,6 +815,12 @@ public:
     /// \return true if the message length was valid and it was correctly queued for transmit
     bool        send(const uint8_t* data, uint8_t len);
 
+    /// Like send(), but the message is made of a list of segments, which are written to the FIFO
+    /// after the length and headers in a single SPI burst.
+    /// \param[in] segments The first segment of the message
+    /// \return true if the message length was valid and it was correctly queued for transmit
+    bool        sendSegments(const Segment* segments);
+
     /// Sets the length of the preamble
     /// in bytes. 
     /// Caution: this should be set to the same 
@@ -837,6 +853,13 @@ public:
     /// \return The maximum message length supported by this driver
     uint8_t maxMessageLength();
 
+    /// Returns the time on air of a message of the given length, calculated from the bit rate,
+    /// DC-free encoding and CRC in the current modem configuration, the preamble and sync word lengths,
+    /// and the padding to whole 16 octet blocks when encryption is enabled.
+    /// \param[in] len Length of the message payload, not including the RadioHead headers
+    /// \return The time on air in microseconds
+    virtual uint32_t timeOnAir(uint8_t len);
+
     /// Prints the value of a single register
     /// to the Serial device if RH_HAVE_SERIAL is defined for the current platform
     /// For debugging/testing only
@@ -865,6 +888,11 @@ public:
     /// \return true if sleep mode was successfully entered.
     virtual bool    sleep();
 
+    /// Tells whether another node is transmitting, by measuring the RSSI with the receiver on, and comparing it
+    /// with the threshold set by RHGenericDriver::setCADThreshold(). Used by send() for listen before talk.
+    /// \return true if the RSSI is above the threshold
+    virtual bool    isChannelActive();
+
 protected:
     /// This is a low level function to handle the interrupts for one instance of RF69.
     /// Called automatically by isr*()
@@ -875,6 +903,11 @@ protected:
     /// Should not need to be called by user code.
     void           readFifo();
 
+    /// The interrupt handler starts the next queued message, so the transmit queue is supported.
+    /// See RHGenericDriver::setTxQueue()
+    /// \return true
+    virtual bool    txQueueSupported() { return true; }
+
 protected:
     /// Low level interrupt service routine for RF69 connected to interrupt 0
     static void         isr0();
@@ -918,6 +951,20 @@ protected:
 
     /// Time in millis since the last preamble was received (and the last time the RSSI was measured)
     uint32_t            _lastPreambleTime;
+    /// Bit rate in bits per second from the most recent setModemRegisters(), for timeOnAir()
+    uint32_t            _bitRate;
+
+    /// RH_RF69_REG_37_PACKETCONFIG1 from the most recent setModemRegisters(), for timeOnAir()
+    uint8_t             _packetConfig1;
+
+    /// The most recent preamble length set by setPreambleLength(), for timeOnAir()
+    uint16_t            _preambleLength;
+
+    /// Number of sync words set by setSyncWords(), 0 if disabled, for timeOnAir()
+    uint8_t             _syncWordsLen;
+
+    /// True if an encryption key was set by setEncryptionKey(), for timeOnAir()
+    bool                _encrypted;
 };
 
 /// @example rf69_client.pde
@@ -26,10 +26,13 @@ PROGMEM static const RH_RF95::ModemConfig MODEM_CONFIG_TABLE[] =
 RH_RF95::RH_RF95(uint8_t slaveSelectPin, uint8_t interruptPin, RHGenericSPI& spi)
     :
     RHSPIDriver(slaveSelectPin, spi),
-    _rxBufValid(0)
+    _rxBufValid(0),
+    _cad(false)
 {
     _interruptPin = interruptPin;
     _myInterruptIndex = 0xff; // Not allocated yet
+    memset(&_modemConfig, 0, sizeof(_modemConfig));
+    _preambleLength = 8;
 }
 
 bool RH_RF95::init()
@@ -124,12 +127,17 @@ bool RH_RF95::init()
 // We use this to get RxDone and TxDone interrupts
 void RH_RF95::handleInterrupt()
 {
+    uint32_t now = micros(); // Before any SPI traffic, for the timestamps
     // Read the interrupt register
     //Serial.println("HandleInterrupt");
     uint8_t irq_flags = spiRead(RH_RF95_REG_12_IRQ_FLAGS);
+    RH_TRACE_EVENT(RHTrace::RHTraceInterrupt, irq_flags);
     if (_mode == RHModeRx && irq_flags & (RH_RF95_RX_TIMEOUT | RH_RF95_PAYLOAD_CRC_ERROR))
     {
 	_rxBad++;
+	if (irq_flags & RH_RF95_PAYLOAD_CRC_ERROR)
+	    _rxCrcErrors++;
+	errorNotify(RHErrorRxBad);
     }
     else if (_mode == RHModeRx && irq_flags & RH_RF95_RX_DONE)
     {
@@ -146,16 +154,38 @@ void RH_RF95::handleInterrupt()
 	// this is according to the doc, but is it really correct?
 	// weakest receiveable signals are reported RSSI at about -66
 	_lastRssi = spiRead(RH_RF95_REG_1A_PKT_RSSI_VALUE) - 137;
+	_rxTimestamp = now;
 
 	// We have received a message.
 	validateRxBuf(); 
 	if (_rxBufValid)
-	    setModeIdle(); // Got one 
+	{
+	    if (rxQueueEnabled())
+	    {
+		// Queue it and stay in continuous receive mode for the next one
+		rxQueuePut(_buf + RH_RF95_HEADER_LEN, _bufLen - RH_RF95_HEADER_LEN);
+		_rxBufValid = false;
+	    }
+	    else
+	    {
+		setModeIdle(); // Got one 
+		rxNotify();
+	    }
+	}
     }
     else if (_mode == RHModeTx && irq_flags & RH_RF95_TX_DONE)
     {
 	_txGood++;
+	_txTimestamp = now;
+	RH_TRACE_EVENT(RHTrace::RHTraceTxDone, ((uint16_t)_txHeaderTo << 8) | _txHeaderId);
+	setModeIdle();
+	txQueueNext(); // Start the next queued message, if any
+    }
+    else if (_mode == RHModeCad && irq_flags & RH_RF95_CAD_DONE)
+    {
+	_cad = irq_flags & RH_RF95_CAD_DETECTED;
 	setModeIdle();
+	wakeup();
     }
     
     spiWrite(RH_RF95_REG_12_IRQ_FLAGS, 0xff); // Clear all IRQ flags
@@ -195,17 +225,22 @@ void RH_RF95::validateRxBuf()
 	_rxHeaderTo == _thisAddress ||
 	_rxHeaderTo == RH_BROADCAST_ADDRESS)
     {
-	_rxGood++;
+	countRxGood();
 	_rxBufValid = true;
     }
+    else
+	_rxFiltered++;
 }
 
 bool RH_RF95::available()
 {
-    if (_mode == RHModeTx)
-	return false;
-    setModeRx();
-    return _rxBufValid; // Will be set by the interrupt handler when a good message is received
+    if (!_rxBufValid)
+    {
+	if (_mode == RHModeTx)
+	    return false;
+	setModeRx(); // Not while a message is in _buf, which may be leased
+    }
+    return _rxBufValid || rxQueueCount(); // Will be set by the interrupt handler when a good message is received
 }
 
 void RH_RF95::clearRxBuf()
@@ -220,6 +255,8 @@ bool RH_RF95::recv(uint8_t* buf, uint8_t* len)
 {
     if (!available())
 	return false;
+    if (rxQueueGet(buf, len))
+	return true;
     if (buf && len)
     {
 	ATOMIC_BLOCK_START;
@@ -233,23 +270,47 @@ bool RH_RF95::recv(uint8_t* buf, uint8_t* len)
     return true;
 }
 
+bool RH_RF95::lease(const uint8_t** buf, uint8_t* len)
+{
+    if (!available())
+	return false;
+    if (rxQueueLease(buf, len))
+	return true;
+    *buf = _buf + RH_RF95_HEADER_LEN;
+    *len = _bufLen - RH_RF95_HEADER_LEN;
+    return true;
+}
+
+void RH_RF95::release()
+{
+    if (!rxQueueRelease())
+	clearRxBuf(); // This message accepted and cleared
+}
+
 bool RH_RF95::send(const uint8_t* data, uint8_t len)
 {
+    Segment segment = { data, len, NULL };
+    return sendSegments(&segment);
+}
+
+bool RH_RF95::sendSegments(const Segment* segments)
+{
+    uint16_t len = segmentsLength(segments);
     if (len > RH_RF95_MAX_MESSAGE_LEN)
 	return false;
 
     waitPacketSent(); // Make sure we dont interrupt an outgoing message
+    if (!waitCAD())
+	return false; // Channel stayed busy
+    RH_TRACE_EVENT(RHTrace::RHTraceSend, len);
     setModeIdle();
 
     // Position at the beginning of the FIFO
     spiWrite(RH_RF95_REG_0D_FIFO_ADDR_PTR, 0);
-    // The headers
-    spiWrite(RH_RF95_REG_00_FIFO, _txHeaderTo);
-    spiWrite(RH_RF95_REG_00_FIFO, _txHeaderFrom);
-    spiWrite(RH_RF95_REG_00_FIFO, _txHeaderId);
-    spiWrite(RH_RF95_REG_00_FIFO, _txHeaderFlags);
-    // The message data
-    spiBurstWrite(RH_RF95_REG_00_FIFO, data, len);
+    // The headers and the message data in one burst
+    uint8_t headers[RH_RF95_HEADER_LEN] = { _txHeaderTo, _txHeaderFrom, _txHeaderId, _txHeaderFlags };
+    Segment h = { headers, sizeof(headers), segments };
+    spiBurstWrite(RH_RF95_REG_00_FIFO, &h);
     spiWrite(RH_RF95_REG_22_PAYLOAD_LENGTH, len + RH_RF95_HEADER_LEN);
 
     setModeTx(); // Start the transmitter
@@ -295,6 +356,7 @@ void RH_RF95::setModeIdle()
     {
 	spiWrite(RH_RF95_REG_01_OP_MODE, RH_RF95_MODE_STDBY);
 	_mode = RHModeIdle;
+	RH_TRACE_EVENT(RHTrace::RHTraceMode, _mode);
     }
 }
 
@@ -304,6 +366,7 @@ bool RH_RF95::sleep()
     {
 	spiWrite(RH_RF95_REG_01_OP_MODE, RH_RF95_MODE_SLEEP);
 	_mode = RHModeSleep;
+	RH_TRACE_EVENT(RHTrace::RHTraceMode, _mode);
     }
     return true;
 }
@@ -314,6 +377,7 @@ void RH_RF95::setModeRx()
     {
        //Serial.println("SetModeRx");
        _mode = RHModeRx;
+       RH_TRACE_EVENT(RHTrace::RHTraceMode, _mode);
 	   spiWrite(RH_RF95_REG_01_OP_MODE, RH_RF95_MODE_RXCONTINUOUS);
 	   spiWrite(RH_RF95_REG_40_DIO_MAPPING1, 0x00); // Interrupt on RxDone
     }
@@ -324,11 +388,36 @@ void RH_RF95::setModeTx()
     if (_mode != RHModeTx)
     {
     _mode = RHModeTx;       // set first to avoid possible race condition
+	RH_TRACE_EVENT(RHTrace::RHTraceMode, _mode);
 	spiWrite(RH_RF95_REG_01_OP_MODE, RH_RF95_MODE_TX);
 	spiWrite(RH_RF95_REG_40_DIO_MAPPING1, 0x40); // Interrupt on TxDone
     }
 }
 
+bool RH_RF95::isChannelActive()
+{
+    if (_mode != RHModeCad)
+    {
+	_mode = RHModeCad; // set first to avoid possible race condition
+	RH_TRACE_EVENT(RHTrace::RHTraceMode, _mode);
+	spiWrite(RH_RF95_REG_01_OP_MODE, RH_RF95_MODE_CAD);
+	spiWrite(RH_RF95_REG_40_DIO_MAPPING1, 0x80); // Interrupt on CadDone
+    }
+    // CAD takes about 2 symbols, much less than the time on air of the shortest message
+    unsigned long timeout = timeOnAir(0) / 1000 + 10;
+    unsigned long starttime = millis();
+    while (_mode == RHModeCad)
+    {
+	if (millis() - starttime > timeout)
+	{
+	    setModeIdle(); // No CadDone interrupt: assume the channel is clear
+	    return false;
+	}
+	waitEvent(timeout - (millis() - starttime));
+    }
+    return _cad;
+}
+
 void RH_RF95::setTxPower(int8_t power, bool useRFO)
 {
     // Sigh, different behaviours depending on whther the module use PA_BOOST or the RFO pin
@@ -377,6 +466,7 @@ void RH_RF95::setModemRegisters(const ModemConfig* config)
     spiWrite(RH_RF95_REG_1D_MODEM_CONFIG1,       config->reg_1d);
     spiWrite(RH_RF95_REG_1E_MODEM_CONFIG2,       config->reg_1e);
     spiWrite(RH_RF95_REG_26_MODEM_CONFIG3,       config->reg_26);
+    _modemConfig = *config;
 }
 
 // Set one of the canned FSK Modem configs
@@ -397,5 +487,42 @@ void RH_RF95::setPreambleLength(uint16_t bytes)
 {
     spiWrite(RH_RF95_REG_20_PREAMBLE_MSB, bytes >> 8);
     spiWrite(RH_RF95_REG_21_PREAMBLE_LSB, bytes & 0xff);
+    _preambleLength = bytes;
+}
+
+// Bandwidths in Hz, indexed by the Bw field (bits 7-4) of RH_RF95_REG_1D_MODEM_CONFIG1
+PROGMEM static const uint32_t BANDWIDTH_TABLE[] =
+{
+    7800, 10400, 15600, 20800, 31250, 41700, 62500, 125000, 250000, 500000
+};
+
+// See the SX1276/77/78/79 datasheet section 4.1.1.7 
+uint32_t RH_RF95::timeOnAir(uint8_t len)
+{
+    // Decode the modem configuration registers. Caution: the field layouts in the 
+    // RH_RF95_REG_1D_MODEM_CONFIG1 etc defines above are those of the SX1272, not the SX1276
+    uint8_t bw = _modemConfig.reg_1d >> 4;
+    if (bw >= sizeof(BANDWIDTH_TABLE) / sizeof(BANDWIDTH_TABLE[0]))
+	return 0; // Reserved
+    uint32_t bandwidth;
+    memcpy_P(&bandwidth, &BANDWIDTH_TABLE[bw], sizeof(bandwidth));
+    int32_t cr  = (_modemConfig.reg_1d >> 1) & 0x07;   // 1 to 4 for 4/5 to 4/8
+    int32_t ih  = _modemConfig.reg_1d & 0x01;          // Implicit header
+    int32_t sf  = _modemConfig.reg_1e >> 4;            // 6 to 12
+    int32_t crc = (_modemConfig.reg_1e & 0x04) ? 1 : 0; // RxPayloadCrcOn
+    int32_t de  = (_modemConfig.reg_26 & 0x08) ? 1 : 0; // LowDataRateOptimize
+    if (sf < 6)
+	return 0; // Not configured yet
+
+    // Payload symbols
+    int32_t pl = len + RH_RF95_HEADER_LEN;
+    int32_t num = 8 * pl - 4 * sf + 28 + 16 * crc - 20 * ih;
+    int32_t den = 4 * (sf - 2 * de);
+    int32_t n = num > 0 ? (num + den - 1) / den : 0; // ceil(), never less than 0
+    int32_t payloadSymbols = 8 + n * (cr + 4);
+
+    // Preamble is the programmed length plus 4.25 symbols. Work in quarter symbols
+    uint32_t quarterSymbols = 4 * (_preambleLength + payloadSymbols) + 17;
+    return ((uint64_t)quarterSymbols * 1000000 << sf) / (4 * bandwidth);
 }
 
@@ -606,6 +606,16 @@ public:
     /// \return true if a valid message was copied to buf
     virtual bool    recv(uint8_t* buf, uint8_t* len);
 
+    /// Like recv(), but returns a pointer to the message in the driver instead of copying it.
+    /// The message stays valid until release(). See RHGenericDriver::lease()
+    /// \param[out] buf Set to the address of the message
+    /// \param[out] len Set to the length of the message
+    /// \return true if a message was leased
+    virtual bool    lease(const uint8_t** buf, uint8_t* len);
+
+    /// Releases the message leased by lease(), and allows the driver to receive the next one
+    virtual void    release();
+
     /// Waits until any previous transmit packet is finished being transmitted with waitPacketSent().
     /// Then loads a message into the transmitter and starts the transmitter. Note that a message length
     /// of 0 is permitted. 
@@ -614,6 +624,12 @@ public:
     /// \return true if the message length was valid and it was correctly queued for transmit
     virtual bool    send(const uint8_t* data, uint8_t len);
 
+    /// Like send(), but the message is made of a list of segments, which are written to the FIFO
+    /// together with the headers in a single SPI burst.
+    /// \param[in] segments The first segment of the message
+    /// \return true if the message length was valid and it was correctly queued for transmit
+    virtual bool    sendSegments(const Segment* segments);
+
     /// Sets the length of the preamble
     /// in bytes. 
     /// Caution: this should be set to the same 
@@ -627,6 +643,14 @@ public:
     /// \return The maximum legal message length
     virtual uint8_t maxMessageLength();
 
+    /// Returns the time on air of a message of the given length, calculated from the current
+    /// modem configuration (spreading factor, bandwidth, coding rate, CRC, header mode and 
+    /// low data rate optimisation) and preamble length, using the formula in the Semtech 
+    /// SX1276/77/78/79 datasheet section 4.1.1.7.
+    /// \param[in] len Length of the message payload, not including the RadioHead headers
+    /// \return The time on air in microseconds
+    virtual uint32_t timeOnAir(uint8_t len);
+
     /// Sets the transmitter and receiver 
     /// centre frequency.
     /// \param[in] centre Frequency in MHz. 137.0 to 1020.0. Caution: RFM95/96/97/98 comes in several
@@ -674,6 +698,11 @@ public:
     /// \return true if sleep mode was successfully entered.
     virtual bool    sleep();
 
+    /// Uses LoRa Channel Activity Detection to tell whether another node is transmitting. Takes about 2 symbols.
+    /// Used by send() for listen before talk. See RHGenericDriver::setCADTimeout()
+    /// \return true if a LoRa preamble was detected
+    virtual bool    isChannelActive();
+
 protected:
     /// This is a low level function to handle the interrupts for one instance of RH_RF95.
     /// Called automatically by isr*()
@@ -686,6 +715,11 @@ protected:
     /// Clear our local receive buffer
     void clearRxBuf();
 
+    /// The interrupt handler starts the next queued message, so the transmit queue is supported.
+    /// See RHGenericDriver::setTxQueue()
+    /// \return true
+    virtual bool    txQueueSupported() { return true; }
+
 private:
     /// Low level interrupt service routine for device connected to interrupt 0
     static void         isr0();
@@ -717,6 +751,15 @@ private:
 
     /// True when there is a valid message in the buffer
     volatile bool       _rxBufValid;
+
+    /// Result of the last Channel Activity Detection
+    volatile bool       _cad;
+
+    /// The most recent modem configuration set by setModemRegisters(), for timeOnAir()
+    ModemConfig         _modemConfig;
+
+    /// The most recent preamble length set by setPreambleLength(), for timeOnAir()
+    uint16_t            _preambleLength;
 };
 
 /// @example rf95_client.pde
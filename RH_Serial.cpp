@@ -164,6 +164,7 @@ void RH_Serial::validateRxBuf()
     if (_rxRecdFcs != _rxFcs)
     {
 	_rxBad++;
+	_rxCrcErrors++;
 	return;
     }
 
@@ -176,9 +177,12 @@ void RH_Serial::validateRxBuf()
 	_rxHeaderTo == _thisAddress ||
 	_rxHeaderTo == RH_BROADCAST_ADDRESS)
     {
-	_rxGood++;
+	_rxTimestamp = micros(); // As near as polling can tell
+	countRxGood();
 	_rxBufValid = true;
     }
+    else
+	_rxFiltered++;
 }
 
 bool RH_Serial::recv(uint8_t* buf, uint8_t* len)
@@ -200,6 +204,17 @@ bool RH_Serial::recv(uint8_t* buf, uint8_t* len)
 // Caution: this may block
 bool RH_Serial::send(const uint8_t* data, uint8_t len)
 {
+    Segment segment = { data, len, NULL };
+    return sendSegments(&segment);
+}
+
+// Caution: this may block
+bool RH_Serial::sendSegments(const Segment* segments)
+{
+    uint16_t len = segmentsLength(segments);
+    if (len > maxMessageLength())
+	return false;
+    RH_TRACE_EVENT(RHTrace::RHTraceSend, len);
     _txFcs = 0xffff;    // Initial value
     _serial.write(DLE); // Not in FCS
     _serial.write(STX); // Not in FCS
@@ -209,8 +224,13 @@ bool RH_Serial::send(const uint8_t* data, uint8_t len)
     txData(_txHeaderId);
     txData(_txHeaderFlags);
     // Now the payload
-    while (len--)
-	txData(*data++);
+    for (; segments; segments = segments->next)
+    {
+	const uint8_t* data = segments->data;
+	uint8_t i;
+	for (i = 0; i < segments->len; i++)
+	    txData(data[i]);
+    }
     // End of message
     _serial.write(DLE);
     _txFcs = RHcrc_ccitt_update(_txFcs, DLE);
@@ -220,6 +240,7 @@ bool RH_Serial::send(const uint8_t* data, uint8_t len)
     // Now send the calculated FCS for this message
     _serial.write((_txFcs >> 8) & 0xff);
     _serial.write(_txFcs & 0xff);
+    _txTimestamp = micros(); // Queued for the UART, maybe not yet sent
     return true;
 }
 
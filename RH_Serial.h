@@ -189,6 +189,12 @@ public:
     /// \return true if the message length was valid and it was correctly queued for transmit
     virtual bool send(const uint8_t* data, uint8_t len);
 
+    /// Like send(), but the message is made of a list of segments, which are written
+    /// to the serial port one after the other. See RHGenericDriver::sendSegments()
+    /// \param[in] segments The first segment of the message
+    /// \return true if the message length was valid and it was correctly queued for transmit
+    virtual bool sendSegments(const Segment* segments);
+
     /// Returns the maximum message length 
     /// available in this Driver.
     /// \return The maximum legal message length
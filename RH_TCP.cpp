@@ -16,22 +16,114 @@
 #include <arpa/inet.h>
 #include <unistd.h>
 #include <sys/ioctl.h>
+#include <sys/uio.h>
+#include <sys/time.h>
 #include <netdb.h>
 #include <string>
 
+// The driver that handles delay() when running in virtual time
+RH_TCP* RH_TCP::_virtualTimeDriver = NULL;
+
 RH_TCP::RH_TCP(const char* server)
     : _server(server),
-      _rxBufLen(0),
+      _socket(-1),
+      _socketBufHead(0),
+      _socketBufLen(0),
+      _rxQueueHead(0),
+      _rxQueueLen(0),
       _rxBufValid(false),
-      _socket(-1)
+      _txDoneMicros(0),
+      _virtualTime(false),
+      _virtualMicros(0),
+      _timeReceived(false)
 {
+    setAirtimeProfile(AirtimeEther);
 }
     
 bool RH_TCP::init()
 {   
     if (!connectToServer())
 	return false;
-    return sendThisAddress(_thisAddress);
+    if (!sendThisAddress(_thisAddress))
+	return false;
+    detectVirtualTime();
+    _mode = RHModeIdle;
+    return true;
+}
+
+void RH_TCP::detectVirtualTime()
+{
+    // A simulator running in virtual time sends us the time as soon as we connect.
+    // Other simulators send nothing until there is a packet for us.
+    fd_set         input;
+    struct timeval timer;
+    FD_ZERO(&input);
+    FD_SET(_socket, &input);
+    timer.tv_sec  = 0;
+    timer.tv_usec = RH_TCP_VIRTUAL_TIME_DETECT_TIMEOUT * 1000;
+    _timeReceived = false;
+    if (select(_socket + 1, &input, NULL, NULL, &timer) > 0)
+	checkForEvents();
+    if (_virtualTime)
+	waitForTime(); // The simulator treats new clients as waiting, and sends the time again in our turn
+}
+
+void RH_TCP::waitVirtual(uint64_t until, bool wakeOnPacket)
+{
+    RHTcpWait m;
+    m.length = htonl(sizeof(m) - sizeof(m.length));
+    m.type = RH_TCP_MESSAGE_TYPE_WAIT;
+    m.untilHi = htonl(until >> 32);
+    m.untilLo = htonl(until & 0xffffffff);
+    m.wakeOnPacket = wakeOnPacket;
+    _timeReceived = false;
+    if (write(_socket, &m, sizeof(m)) < 0)
+    {
+	fprintf(stderr,"RH_TCP::waitVirtual write error: %s\n", strerror(errno));
+	exit(1);
+    }
+    waitForTime();
+}
+
+void RH_TCP::waitForTime()
+{
+    // Block until the simulator tells us the new time
+    while (!_timeReceived)
+    {
+	fd_set input;
+	FD_ZERO(&input);
+	FD_SET(_socket, &input);
+	if (select(_socket + 1, &input, NULL, NULL, NULL) < 0 && errno != EINTR)
+	{
+	    fprintf(stderr, "RH_TCP::waitVirtual: select failed %s\n", strerror(errno));
+	    exit(1);
+	}
+	checkForEvents();
+    }
+}
+
+void RH_TCP::virtualDelay(unsigned long ms)
+{
+    _virtualTimeDriver->waitVirtual(_virtualTimeDriver->_virtualMicros + (uint64_t)ms * 1000, false);
+}
+
+void RH_TCP::setVirtualTime(uint64_t micros)
+{
+    if (!_virtualTime)
+    {
+	// First time message, so the simulator is running in virtual time.
+	// From now on all time comes from the simulator.
+	// This message only tells us that: we run when the next one arrives
+	_virtualTime = true;
+	_virtualTimeDriver = this;
+	simulator_set_delay_handler(virtualDelay);
+	// Make random numbers (eg RHReliableDatagram retry timeouts) the same on every run
+	srandom(_thisAddress);
+    }
+    else
+	_timeReceived = true;
+    _virtualMicros = micros;
+    simulator_set_virtual_time(micros);
 }
     
 bool RH_TCP::connectToServer()
@@ -107,18 +199,48 @@ bool RH_TCP::connectToServer()
 
 void RH_TCP::clearRxBuf()
 {
+    // Discard the packet at the head of the receive queue
+    if (_rxQueueLen)
+    {
+	_rxQueueHead = (_rxQueueHead + 1) % RH_TCP_RX_QUEUE_LEN;
+	_rxQueueLen--;
+    }
     _rxBufValid = false;
-    _rxBufLen = 0;
+}
+
+void RH_TCP::copyFromSocketBuf(uint16_t offset, uint8_t* dest, uint16_t len)
+{
+    // Copy out of the ring in at most 2 pieces
+    uint16_t start = (_socketBufHead + offset) % RH_TCP_SOCKETBUF_LEN;
+    uint16_t first = RH_TCP_SOCKETBUF_LEN - start;
+    if (first > len)
+	first = len;
+    memcpy(dest, _socketBuf + start, first);
+    memcpy(dest + first, _socketBuf, len - first);
+}
+
+uint32_t RH_TCP::socketBufUint32(uint16_t offset)
+{
+    uint32_t value;
+    copyFromSocketBuf(offset, (uint8_t*)&value, sizeof(value));
+    return ntohl(value);
 }
 
 void RH_TCP::checkForEvents()
 {
-    #define RH_TCP_SOCKETBUF_LEN 500
-    static uint8_t socketBuf[RH_TCP_SOCKETBUF_LEN]; // Room for several messages
-    static uint16_t socketBufLen = 0;
+    // Read at most the amount of space we have left in the ring, 
+    // which may be in 2 pieces if it wraps around the end of the buffer
+    uint16_t tail = (_socketBufHead + _socketBufLen) % RH_TCP_SOCKETBUF_LEN;
+    uint16_t space = RH_TCP_SOCKETBUF_LEN - _socketBufLen;
+    if (space == 0)
+	return; // Cant happen: there is room for a complete message, and complete messages are always consumed
+    struct iovec iov[2];
+    iov[0].iov_base = _socketBuf + tail;
+    iov[0].iov_len = RH_TCP_SOCKETBUF_LEN - tail < space ? RH_TCP_SOCKETBUF_LEN - tail : space;
+    iov[1].iov_base = _socketBuf;
+    iov[1].iov_len = space - iov[0].iov_len;
 
-    // Read at most the amount of space we have left in the buffer
-    ssize_t count = read(_socket, socketBuf + socketBufLen, sizeof(socketBuf) - socketBufLen);
+    ssize_t count = readv(_socket, iov, iov[1].iov_len ? 2 : 1);
     if (count < 0)
     {
 	if (errno != EAGAIN)
@@ -135,72 +257,104 @@ void RH_TCP::checkForEvents()
     }
     else
     {
-	socketBufLen += count;
-	while (socketBufLen >= 5)
+	_socketBufLen += count;
+	// Parse messages in place in the ring
+	while (_socketBufLen >= sizeof(uint32_t) + 1)
 	{
-	    RHTcpTypeMessage* message = ((RHTcpTypeMessage*)socketBuf);
-	    uint32_t len = ntohl(message->length);
-	    uint32_t messageLen = len + sizeof(message->length);
-	    if (len > sizeof(socketBuf) - sizeof(message->length))
+	    uint32_t len = socketBufUint32(0);
+	    uint32_t messageLen = len + sizeof(uint32_t);
+	    if (len == 0 || messageLen > RH_TCP_SOCKETBUF_LEN)
 	    {
 		// Bogus length
 		fprintf(stderr, "RH_TCP::checkForEvents read ridiculous length: %d. Corrupt message stream? Aborting\n", len);
 		exit(1);
 	    }
-	    if (socketBufLen >= len + sizeof(message->length))
+	    if (_socketBufLen < messageLen)
+		break; // Wait for the rest of the message
+
+	    // Got all of this message
+	    uint8_t type = _socketBuf[(_socketBufHead + sizeof(uint32_t)) % RH_TCP_SOCKETBUF_LEN];
+	    if (type == RH_TCP_MESSAGE_TYPE_PACKET && len >= 1 + RH_TCP_HEADER_LEN)
 	    {
-		// Got at least all of this message
-		if (message->type == RH_TCP_MESSAGE_TYPE_PACKET && len >= 5)
+		// REVISIT: need to check if we are actually receiving?
+		// Its a new packet, queue the headers and payload
+		if (_rxQueueLen < RH_TCP_RX_QUEUE_LEN)
+		{
+		    RxPacket* packet = &_rxQueue[(_rxQueueHead + _rxQueueLen) % RH_TCP_RX_QUEUE_LEN];
+		    packet->len = len - 1 - RH_TCP_HEADER_LEN;
+		    packet->timestamp = micros();
+		    copyFromSocketBuf(sizeof(uint32_t) + 1, packet->headers, RH_TCP_HEADER_LEN);
+		    copyFromSocketBuf(sizeof(uint32_t) + 1 + RH_TCP_HEADER_LEN, packet->payload, packet->len);
+		    _rxQueueLen++;
+		}
+		else
 		{
-		    // REVISIT: need to check if we are actually receiving?
-		    // Its a new packet, extract the headers and payload
-		    RHTcpPacket* packet = ((RHTcpPacket*)socketBuf);
-		    _rxHeaderTo    = packet->to;
-		    _rxHeaderFrom  = packet->from;
-		    _rxHeaderId    = packet->id;
-		    _rxHeaderFlags = packet->flags;
-		    uint32_t payloadLen = len - 5;
-		    if (payloadLen <= sizeof(_rxBuf))
-		    {
-			// Enough room in our receiver buffer
-			memcpy(_rxBuf, packet->payload, payloadLen);
-			_rxBufLen = payloadLen;
-			_rxBufFull = true;
-		    }
+		    _rxBad++; // Queue full, packet lost
+		    _rxOverruns++;
 		}
-		// check for other message types here
-		// Now remove the used message by copying the trailing bytes (maybe start of a new message?)
-		// to the top of the buffer
-		memcpy(socketBuf, socketBuf + messageLen, sizeof(socketBuf) - messageLen);
-		socketBufLen -= messageLen;
 	    }
+	    else if (type == RH_TCP_MESSAGE_TYPE_TIME && len >= 9)
+	    {
+		uint64_t hi = socketBufUint32(sizeof(uint32_t) + 1);
+		setVirtualTime((hi << 32) | socketBufUint32(sizeof(uint32_t) + 5));
+	    }
+	    // check for other message types here
+	    // Now consume the message
+	    _socketBufHead = (_socketBufHead + messageLen) % RH_TCP_SOCKETBUF_LEN;
+	    _socketBufLen -= messageLen;
 	}
+	if (_socketBufLen == 0)
+	    _socketBufHead = 0; // Keep the next read contiguous
     }
 }
 
 void RH_TCP::validateRxBuf()
 {
-    // The headers have already been extracted
-    if (_promiscuous ||
-	_rxHeaderTo == _thisAddress ||
-	_rxHeaderTo == RH_BROADCAST_ADDRESS)
+    // Discard packets that are not for us until we find one that is
+    while (!_rxBufValid && _rxQueueLen)
     {
-	_rxGood++;
-	_rxBufValid = true;
+	RxPacket* packet = &_rxQueue[_rxQueueHead];
+	_rxHeaderTo    = packet->headers[0];
+	_rxHeaderFrom  = packet->headers[1];
+	_rxHeaderId    = packet->headers[2];
+	_rxHeaderFlags = packet->headers[3];
+	if (_promiscuous ||
+	    _rxHeaderTo == _thisAddress ||
+	    _rxHeaderTo == RH_BROADCAST_ADDRESS)
+	{
+	    _rxTimestamp = packet->timestamp;
+	    countRxGood();
+	    _rxBufValid = true;
+	}
+	else
+	{
+	    _rxFiltered++;
+	    clearRxBuf();
+	}
     }
 }
 
+bool RH_TCP::checkAvailable()
+{
+    checkForEvents();
+    validateRxBuf();
+    return _rxBufValid;
+}
+
 bool RH_TCP::available()
 {
     if (_socket < 0)
 	return false;
-    checkForEvents();
-    if (_rxBufFull)
+    checkTransmitDone();
+    if (checkAvailable())
+	return true;
+    if (_virtualTime)
     {
-	validateRxBuf();
-	_rxBufFull= false;
+	// Polling a real radio takes time, else polling loops would never end
+	waitVirtual(_virtualMicros + RH_TCP_VIRTUAL_POLL_INTERVAL, true);
+	return checkAvailable();
     }
-    return _rxBufValid;
+    return false;
 }
 
 // Block until something is available
@@ -212,29 +366,49 @@ void RH_TCP::waitAvailable()
 // Block until something is available or timeout expires
 bool RH_TCP::waitAvailableTimeout(uint16_t timeout)
 {
-    int            max_fd;
-    fd_set         input;
-    int            result;
-
-    FD_ZERO(&input);
-    FD_SET(_socket, &input);
-    max_fd = _socket + 1;
-
-    if (timeout)
+    if (_virtualTime)
     {
-	struct timeval timer;
-	// Timeout is in milliseconds
-	timer.tv_sec  = timeout / 1000;
-	timer.tv_usec = (timeout % 1000) * 1000;
-	result = select(max_fd, &input, NULL, NULL, &timer);
+	uint64_t until = timeout ? _virtualMicros + (uint64_t)timeout * 1000 : RH_TCP_WAIT_FOREVER;
+	while (!checkAvailable())
+	{
+	    if (_virtualMicros >= until)
+		return false;
+	    waitVirtual(until, true);
+	}
+	return true;
     }
-    else
+
+    // One read can get several packets, so check the queue before waiting for the socket
+    unsigned long starttime = millis();
+    while (!checkAvailable())
     {
-	result = select(max_fd, &input, NULL, NULL, NULL);
+	fd_set         input;
+	int            result;
+
+	FD_ZERO(&input);
+	FD_SET(_socket, &input);
+	if (timeout)
+	{
+	    long left = (long)timeout - (long)(millis() - starttime);
+	    if (left <= 0)
+		return false;
+	    struct timeval timer;
+	    // Timeout is in milliseconds
+	    timer.tv_sec  = left / 1000;
+	    timer.tv_usec = (left % 1000) * 1000;
+	    result = select(_socket + 1, &input, NULL, NULL, &timer);
+	}
+	else
+	{
+	    result = select(_socket + 1, &input, NULL, NULL, NULL);
+	}
+	if (result < 0 && errno != EINTR)
+	{
+	    fprintf(stderr, "RH_TCP::waitAvailableTimeout: select failed %s\n", strerror(errno));
+	    return false;
+	}
     }
-    if (result < 0)
-	fprintf(stderr, "RH_TCP::waitAvailableTimeout: select failed %s\n", strerror(errno));
-    return result > 0;
+    return true;
 }
 
 bool RH_TCP::recv(uint8_t* buf, uint8_t* len)
@@ -244,19 +418,133 @@ bool RH_TCP::recv(uint8_t* buf, uint8_t* len)
 
     if (buf && len)
     {
-	if (*len > _rxBufLen)
-	    *len = _rxBufLen;
-	memcpy(buf, _rxBuf, *len);
+	RxPacket* packet = &_rxQueue[_rxQueueHead];
+	if (*len > packet->len)
+	    *len = packet->len;
+	memcpy(buf, packet->payload, *len);
     }
     clearRxBuf();
     return true;
 }
 
+bool RH_TCP::lease(const uint8_t** buf, uint8_t* len)
+{
+    if (!available())
+	return false;
+    RxPacket* packet = &_rxQueue[_rxQueueHead];
+    *buf = packet->payload;
+    *len = packet->len;
+    return true;
+}
+
+void RH_TCP::release()
+{
+    clearRxBuf();
+}
+
+// Airtime profiles for some common radios and modulations. 
+// Overhead includes the length octet and CRC, but not the RadioHead headers, which are part of the frame
+static const RH_TCP::AirtimeProfile AIRTIME_PROFILE_TABLE[] =
+{
+    //  bits/s  preamble us  overhead
+    {   10000,          0,      0 }, // AirtimeEther, same as etherSimulator default
+    {    5469,      12544,      5 }, // AirtimeRF95Bw125Cr45Sf128, 8 symbol preamble + 4.25 symbol sync
+    {     183,     401408,      5 }, // AirtimeRF95Bw125Cr48Sf4096
+    {    2400,      20000,      3 }, // AirtimeRF22GFSK_Rb2_4Fd36, 4 octet preamble + 2 octet sync
+    {  125000,        384,      3 }, // AirtimeRF22GFSK_Rb125Fd125
+    { 2000000,        159,      2 }, // AirtimeNRF24DataRate2Mbps, 130us PLL settling + preamble, address and PCF
+    {  250000,        358,      2 }, // AirtimeNRF24DataRate250kbps
+};
+
+void RH_TCP::setAirtimeProfile(const AirtimeProfile* profile)
+{
+    if (profile->bitsPerSecond)
+	_airtimeProfile = *profile;
+}
+
+bool RH_TCP::setAirtimeProfile(AirtimeProfileChoice index)
+{
+    if (index >= (signed int)(sizeof(AIRTIME_PROFILE_TABLE) / sizeof(AirtimeProfile)))
+	return false;
+    setAirtimeProfile(&AIRTIME_PROFILE_TABLE[index]);
+    return true;
+}
+
+uint32_t RH_TCP::timeOnAir(uint8_t len)
+{
+    uint32_t bits = (len + RH_TCP_HEADER_LEN + _airtimeProfile.overheadOctets) * 8;
+    return _airtimeProfile.preambleMicros + ((uint64_t)bits * 1000000) / _airtimeProfile.bitsPerSecond;
+}
+
+uint64_t RH_TCP::nowMicros()
+{
+    if (_virtualTime)
+	return _virtualMicros;
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+void RH_TCP::waitMicros(uint64_t until)
+{
+    if (_virtualTime)
+	waitVirtual(until, false);
+    else
+    {
+	uint64_t now = nowMicros();
+	if (until > now)
+	    usleep(until - now);
+    }
+}
+
+void RH_TCP::checkTransmitDone()
+{
+    if (_mode == RHModeTx && nowMicros() >= _txDoneMicros)
+	_mode = RHModeIdle;
+}
+
+bool RH_TCP::waitPacketSent()
+{
+    if (_mode == RHModeTx)
+	waitMicros(_txDoneMicros);
+    checkTransmitDone();
+    return true;
+}
+
+bool RH_TCP::waitPacketSent(uint16_t timeout)
+{
+    if (_mode == RHModeTx)
+    {
+	uint64_t until = nowMicros() + (uint64_t)timeout * 1000;
+	waitMicros(until < _txDoneMicros ? until : _txDoneMicros);
+    }
+    checkTransmitDone();
+    if (_mode == RHModeTx)
+    {
+	_txTimeouts++;
+	return false;
+    }
+    return true;
+}
+
 bool RH_TCP::send(const uint8_t* data, uint8_t len)
 {
-    bool ret = sendPacket(data, len);
-    delay(10); // Wait for transmit to succeed. REVISIT: depends on length and speed
-    return ret;
+    if (len > RH_TCP_MAX_MESSAGE_LEN)
+	return false;
+
+    waitPacketSent(); // Make sure we dont interrupt an outgoing message
+    if (!waitCAD())
+	return false; // Channel stayed busy
+    uint32_t airtime = timeOnAir(len);
+    RH_TRACE_EVENT(RHTrace::RHTraceSend, len);
+    if (!sendPacket(data, len, airtime))
+	return false;
+    // The transmitter is busy until the simulated transmission is complete
+    _txDoneMicros = nowMicros() + airtime;
+    _txTimestamp = micros() + airtime;
+    _mode = RHModeTx;
+    _txGood++;
+    return true;
 }
 
 uint8_t RH_TCP::maxMessageLength()
@@ -268,6 +556,8 @@ void RH_TCP::setThisAddress(uint8_t address)
 {
     RHGenericDriver::setThisAddress(address);
     sendThisAddress(_thisAddress);
+    if (_virtualTime)
+	srandom(_thisAddress); // Repeatable, but different for each node
 }
 
 bool RH_TCP::sendThisAddress(uint8_t thisAddress)
@@ -282,19 +572,29 @@ bool RH_TCP::sendThisAddress(uint8_t thisAddress)
     return sent > 0;
 }
 
-bool RH_TCP::sendPacket(const uint8_t* data, uint8_t len)
+bool RH_TCP::sendPacket(const uint8_t* data, uint8_t len, uint32_t airtime)
 {
     if (_socket < 0)
 	return false;
-    RHTcpPacket m;
-    m.length = htonl(len + 4);
-    m.type  = RH_TCP_MESSAGE_TYPE_PACKET;
-    m.to    = _txHeaderTo;
-    m.from  = _txHeaderFrom;
-    m.id    = _txHeaderId;
-    m.flags = _txHeaderFlags;
-    memcpy(m.payload, data, len);
-    ssize_t sent = write(_socket, &m, len + 8);
+    // Send the airtime and the packet with one write
+#pragma pack(push, 1)
+    struct
+    {
+	RHTcpAirtime a;
+	RHTcpPacket  p;
+    } m;
+#pragma pack(pop)
+    m.a.length  = htonl(sizeof(m.a) - sizeof(m.a.length));
+    m.a.type    = RH_TCP_MESSAGE_TYPE_AIRTIME;
+    m.a.airtime = htonl(airtime);
+    m.p.length  = htonl(1 + RH_TCP_HEADER_LEN + len); // type, headers and payload
+    m.p.type    = RH_TCP_MESSAGE_TYPE_PACKET;
+    m.p.to      = _txHeaderTo;
+    m.p.from    = _txHeaderFrom;
+    m.p.id      = _txHeaderId;
+    m.p.flags   = _txHeaderFlags;
+    memcpy(m.p.payload, data, len);
+    ssize_t sent = write(_socket, &m, sizeof(m.a) + sizeof(m.p.length) + 1 + RH_TCP_HEADER_LEN + len);
     return sent > 0;
 }
 
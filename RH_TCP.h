@@ -8,6 +8,20 @@
 #include <RHGenericDriver.h>
 #include <RHTcpProtocol.h>
 
+// Size of the ring buffer for octets read from the simulator socket.
+// Must hold at least one complete message
+#define RH_TCP_SOCKETBUF_LEN 1024
+
+// Number of received packets that can be queued awaiting recv().
+// Further packets are dropped and counted by rxBad()
+#define RH_TCP_RX_QUEUE_LEN 8
+
+// How long init() waits for a simulator running in virtual time to announce itself, in milliseconds
+#define RH_TCP_VIRTUAL_TIME_DETECT_TIMEOUT 100
+
+// In virtual time, how much virtual time an unsuccessful call to available() takes, in microseconds
+#define RH_TCP_VIRTUAL_POLL_INTERVAL 1000
+
 /////////////////////////////////////////////////////////////////////
 /// \class RH_TCP RH_TCP.h <RH_TCP.h>
 /// \brief Driver to send and receive unaddressed, unreliable datagrams via sockets on a Linux simulator
@@ -19,7 +33,7 @@
 /// RH_TCP class sends messages to and from other simulator sketches via sockets to a 'Luminiferous Ether' 
 /// simulator server (provided).
 /// Multiple instances of simulated clients and servers can run on a single Linux server,
-/// passing messages to each other via the etherSimulator.pl server.
+/// passing messages to each other via the etherSimulator.pl or etherSimulator server.
 ///
 /// Simple RadioHead sketches can be compiled and run on Linux using a build script and some support files.
 ///
@@ -33,6 +47,9 @@
 /// tools/simBuild examples/simulator/simulator_reliable_datagram_server/simulator_reliable_datagram_server.pde
 /// # in one window, run the simulator server:
 /// tools/etherSimulator.pl
+/// # or, for large numbers of simulated sketches, build and run the native simulator server instead:
+/// g++ -O2 -I . -I RHutil tools/etherSimulator.cpp RHEther.cpp RHPcap.cpp -o etherSimulator
+/// ./etherSimulator
 /// # in another window, run the server
 /// ./simulator_reliable_datagram_server 
 /// # in another window, run the client:
@@ -48,7 +65,9 @@
 /// \endcode
 ///
 /// You can change the listen port and the simulated baud rate with 
-/// command line arguments passed to etherSimulator.pl
+/// command line arguments passed to etherSimulator.pl or etherSimulator.
+/// Both accept the same config file format (see tools/chain.conf). etherSimulator also accepts
+/// network topologies and the radio propagation model (see RHEther and tools/topology.pl).
 ///
 /// \par Implementation
 ///
@@ -58,6 +77,50 @@
 /// The simulated sketches send messages out to the 'ether' over the TCP connection to the etherServer.
 /// etherServer manages the delivery of each message to any other RH_TCP sketches that are running.
 ///
+/// tools/etherSimulator.cpp is a native C++ version of etherServer.pl, which uses epoll and
+/// a high resolution timer so it can serve thousands of connected sketches with microsecond
+/// delivery timing. It prints the number of packets forwarded per second at intervals set by its -s option.
+/// The model of the ether itself (link probabilities, transmission times and collisions) is in the RHEther class.
+///
+/// \par Receive queue
+///
+/// Each RH_TCP instance has its own socket buffer and a queue of up to RH_TCP_RX_QUEUE_LEN received packets,
+/// so bursts of packets from the simulator are not lost, and several RH_TCP instances can be used in one
+/// process. If the queue is full, further packets are dropped and counted by rxBad().
+///
+/// \par Time on air
+///
+/// send() returns immediately, and the driver stays in RHModeTx until the simulated
+/// transmission is complete. waitPacketSent() blocks until then.
+/// The time on air of each packet is computed by timeOnAir() from an airtime profile
+/// (bit rate, preamble time and overhead octets) set with setAirtimeProfile(). Predefined profiles
+/// are provided for some common radios, so simulations can reflect the channel capacity of the real radios.
+/// The default profile AirtimeEther matches the etherSimulator default bit rate.
+/// The time on air is also sent to the simulator with each packet. etherSimulator uses it to schedule delivery 
+/// of the packet to the other nodes (etherSimulator.pl ignores it and uses its own bit rate).
+///
+/// \par Virtual time
+///
+/// When etherSimulator is started with the -v option, it runs the simulation in virtual time: 
+/// the ether owns a simulated clock, and 
+/// millis(), delay(), waitAvailableTimeout(), waitAvailable() and polling with available() 
+/// in all the connected sketches use the simulated clock. 
+/// The ether only runs one sketch at a time, and only advances the clock when all the sketches are waiting,
+/// so simulations run as fast as the CPU allows, and give the same results on every run 
+/// (provided the sketches have unique addresses).
+/// RH_TCP detects virtual time automatically when it connects to the simulator in init(), so no 
+/// changes to sketches are required. 
+/// In virtual time, an unsuccessful call to available() takes RH_TCP_VIRTUAL_POLL_INTERVAL microseconds
+/// of virtual time, and the random number generator is seeded with the node address.
+/// Sketches must not spin waiting for millis() to change without calling delay() or one of the wait functions,
+/// since virtual time will not advance.
+/// \code
+/// # Run 2 sketches in virtual time, using a fixed random seed for the ether
+/// ./etherSimulator -v -n 2 -r 1234 &
+/// ./simulator_reliable_datagram_server &
+/// ./simulator_reliable_datagram_client
+/// \endcode
+///
 /// \par Prerequisites
 ///
 /// g++ compiler installed and in your $PATH
@@ -67,6 +130,31 @@
 class RH_TCP : public RHGenericDriver
 {
 public:
+    /// \brief Describes the time on air of packets sent by a simulated radio
+    ///
+    /// Used by timeOnAir() to compute how long each packet takes to transmit.
+    /// You can pass your own profile to setAirtimeProfile() if none of the choices in
+    /// AirtimeProfileChoice suit your radio.
+    typedef struct
+    {
+	uint32_t   bitsPerSecond;  ///< Raw bit rate of the modulation. Must not be 0
+	uint32_t   preambleMicros; ///< Fixed time per packet for preamble, sync word, PLL settling etc, in microseconds
+	uint8_t    overheadOctets; ///< Octets sent in addition to the RadioHead headers and payload, such as length and CRC
+    } AirtimeProfile;
+
+    /// Choices for setAirtimeProfile() for a selected subset of common radios and data rates.
+    /// These are indexes into AIRTIME_PROFILE_TABLE.
+    typedef enum
+    {
+	AirtimeEther = 0,              ///< 10000 bps, no overhead, same as the etherSimulator default. The default
+	AirtimeRF95Bw125Cr45Sf128,     ///< RH_RF95 default LoRa modem config
+	AirtimeRF95Bw125Cr48Sf4096,    ///< RH_RF95 slow+long range LoRa modem config
+	AirtimeRF22GFSK_Rb2_4Fd36,     ///< RH_RF22 default modem config
+	AirtimeRF22GFSK_Rb125Fd125,    ///< RH_RF22 fastest GFSK modem config
+	AirtimeNRF24DataRate2Mbps,     ///< RH_NRF24 default data rate
+	AirtimeNRF24DataRate250kbps,   ///< RH_NRF24 slowest data rate
+    } AirtimeProfileChoice;
+
     /// Constructor
     /// \param[in] server Name and optionally the port number of the ether simulator server to contact.
     /// Format is "name[:port]", where name can be any valid host name or address (IPV4 or IPV6).
@@ -109,6 +197,16 @@ public:
     /// \return true if a valid message was copied to buf
     virtual bool recv(uint8_t* buf, uint8_t* len);
 
+    /// Like recv(), but returns a pointer to the message in the receive queue instead of copying it.
+    /// The message stays valid until release(). See RHGenericDriver::lease()
+    /// \param[out] buf Set to the address of the message
+    /// \param[out] len Set to the length of the message
+    /// \return true if a message was leased
+    virtual bool lease(const uint8_t** buf, uint8_t* len);
+
+    /// Releases the message leased by lease()
+    virtual void release();
+
     /// Waits until any previous transmit packet is finished being transmitted with waitPacketSent().
     /// Then loads a message into the transmitter and starts the transmitter. Note that a message length
     /// of 0 is NOT permitted. If the message is too long for the underlying radio technology, send() will
@@ -118,6 +216,29 @@ public:
     /// \return true if the message length was valid and it was correctly queued for transmit
     virtual bool send(const uint8_t* data, uint8_t len);
 
+    /// Blocks until the simulated transmission of the last packet sent is complete.
+    /// \return true
+    virtual bool waitPacketSent();
+
+    /// Blocks until the simulated transmission of the last packet sent is complete, or the timeout expires
+    /// \param[in] timeout The maximum time to wait in milliseconds.
+    /// \return true if the transmission completed within the timeout period. False if it timed out.
+    virtual bool waitPacketSent(uint16_t timeout);
+
+    /// Sets the airtime profile used to compute the time on air of each packet sent.
+    /// \param[in] profile The profile to use. It is copied.
+    void setAirtimeProfile(const AirtimeProfile* profile);
+
+    /// Select one of the predefined airtime profiles. 
+    /// \param[in] index The profile choice.
+    /// \return true if index is a valid choice.
+    bool setAirtimeProfile(AirtimeProfileChoice index);
+
+    /// Returns the simulated time on air of a message, as determined by the current airtime profile
+    /// \param[in] len Length of the message payload, not including the RadioHead headers
+    /// \return The time on air in microseconds
+    virtual uint32_t timeOnAir(uint8_t len);
+
     /// Returns the maximum message length 
     /// available in this Driver.
     /// \return The maximum legal message length
@@ -134,6 +255,11 @@ public:
     /// \param[in] address The address of this node.
     void setThisAddress(uint8_t address);
 
+    /// Tells whether this driver is running in virtual time, under the control of
+    /// an etherSimulator started with the -v option. 
+    /// \return true if running in virtual time
+    bool virtualTime() { return _virtualTime; }
+
 protected:
 
 private:
@@ -144,9 +270,36 @@ private:
     /// Check for new messages from the ether simulator server
     void checkForEvents();
 
-    /// Clear the receive buffer
+    /// Discard the packet at the head of the receive queue
     void clearRxBuf();
 
+    /// Check for new messages and see if there is a valid message in the receive buffer.
+    /// Does not take any virtual time
+    /// \return true if a valid message is available
+    bool checkAvailable();
+
+    /// Waits briefly for a message from a simulator running in virtual time. 
+    /// If one is received, switches to virtual time and waits to be scheduled
+    void detectVirtualTime();
+
+    /// Tells the simulator we are waiting, and blocks until it sends the new virtual time.
+    /// Messages received while waiting are processed.
+    /// \param[in] until Virtual time in microseconds to wait until
+    /// \param[in] wakeOnPacket If true, the simulator may wake us earlier when a packet is delivered
+    void waitVirtual(uint64_t until, bool wakeOnPacket);
+
+    /// Blocks until the simulator sends the virtual time, which lets us run, unless it has already
+    /// been received since _timeReceived was cleared. Messages received while waiting are processed.
+    void waitForTime();
+
+    /// Called when a RHTcpTime message is received. Switches to virtual time if necessary
+    /// \param[in] micros The new virtual time in microseconds
+    void setVirtualTime(uint64_t micros);
+
+    /// Delay handler installed in the simulator when running in virtual time.
+    /// \param[in] ms The delay in milliseconds
+    static void virtualDelay(unsigned long ms);
+
     /// Sends thisAddress to the ether simulator server
     /// in a RHTcpThisAddress message.
     /// \param[in] thisAddress The node address of this node
@@ -157,8 +310,19 @@ private:
     /// other nodes
     /// \param[in] data Array of data to be sent
     /// \param[in] len Number of bytes of data to send (> 0)
+    /// \param[in] airtime Time on air of the packet in microseconds, sent to the simulator before the packet
     /// \return true if successful
-    bool sendPacket(const uint8_t* data, uint8_t len);
+    bool sendPacket(const uint8_t* data, uint8_t len, uint32_t airtime);
+
+    /// Returns the current time in microseconds, real or virtual
+    uint64_t nowMicros();
+
+    /// Blocks until the given time, real or virtual
+    /// \param[in] until Time to wait until in microseconds, as returned by nowMicros()
+    void waitMicros(uint64_t until);
+
+    /// Returns to idle mode if the current transmission is complete
+    void checkTransmitDone();
 
     /// Address and port of the server to which messages are sent
     /// and received using the protocol RHTcpPRotocol
@@ -167,17 +331,67 @@ private:
     /// The TCP socket used to communicate with the message server
     int         _socket;
 
-    /// Buffer to receive RHTcpProtocol messages
-    uint8_t     _rxBuf[RH_TCP_MAX_PAYLOAD_LEN + 5];
-    uint16_t    _rxBufLen;
+    /// \brief A packet received from the simulator, awaiting recv()
+    typedef struct
+    {
+	uint8_t     headers[RH_TCP_HEADER_LEN];      ///< TO, FROM, ID, FLAGS
+	uint8_t     len;                             ///< Length of the payload
+	uint8_t     payload[RH_TCP_MAX_MESSAGE_LEN]; ///< Payload
+	uint32_t    timestamp;                       ///< micros() when it was read from the socket
+    } RxPacket;
+
+    /// Ring buffer of octets read from the socket, not yet parsed into messages
+    uint8_t     _socketBuf[RH_TCP_SOCKETBUF_LEN];
+
+    /// Index of the first unparsed octet in _socketBuf
+    uint16_t    _socketBufHead;
+
+    /// Number of unparsed octets in _socketBuf
+    uint16_t    _socketBufLen;
+
+    /// Queue of received packets
+    RxPacket    _rxQueue[RH_TCP_RX_QUEUE_LEN];
+
+    /// Index of the oldest packet in _rxQueue
+    uint8_t     _rxQueueHead;
+
+    /// Number of packets in _rxQueue
+    uint8_t     _rxQueueLen;
+
+    /// The packet at the head of _rxQueue is addressed to us
     bool        _rxBufValid;
 
-    /// Check whether the latest received message is complete and uncorrupted
+    /// The current airtime profile
+    AirtimeProfile  _airtimeProfile;
+
+    /// Time when the current transmission will be complete, as returned by nowMicros()
+    uint64_t        _txDoneMicros;
+
+    /// Find the first packet in the receive queue that is addressed to us, discarding others
     void            validateRxBuf();
 
-    // Used in the interrupt handlers
-    /// Buf is filled but not validated
-    volatile bool   _rxBufFull;
+    /// Copies octets out of the socket ring buffer
+    /// \param[in] offset Offset of the first octet from the head of the ring
+    /// \param[out] dest Where to copy the octets
+    /// \param[in] len Number of octets to copy
+    void            copyFromSocketBuf(uint16_t offset, uint8_t* dest, uint16_t len);
+
+    /// Reads a network byte order uint32_t from the socket ring buffer
+    /// \param[in] offset Offset of the first octet from the head of the ring
+    /// \return The value in host byte order
+    uint32_t        socketBufUint32(uint16_t offset);
+
+    /// True if running in virtual time
+    bool            _virtualTime;
+
+    /// The current virtual time in microseconds, as received from the simulator
+    uint64_t        _virtualMicros;
+
+    /// Set when a RHTcpTime message that lets us run is received
+    bool            _timeReceived;
+
+    /// The driver running in virtual time, used by virtualDelay()
+    static RH_TCP*  _virtualTimeDriver;
 
 };
 
@@ -105,6 +105,19 @@ unsigned long millis()
   return difference;
 }
 
+unsigned long micros()
+{
+  //Declare a variable to store current time
+  struct timeval RHCurrentTime;
+  //Get current time
+  gettimeofday(&RHCurrentTime,NULL);
+  //Calculate the difference between our start time and the end time
+  unsigned long difference = ((RHCurrentTime.tv_sec - RHStartTime.tv_sec) * 1000000);
+  difference += (RHCurrentTime.tv_usec - RHStartTime.tv_usec);
+  //Return the calculated value
+  return difference;
+}
+
 void delay (unsigned long ms)
 {
   //Implement Delay function
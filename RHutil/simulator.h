@@ -21,9 +21,22 @@ extern char** _simulator_argv;
 // Definitions for various Arduino functions
 extern void delay(unsigned long ms);
 extern unsigned long millis();
+extern unsigned long micros();
 extern long random(long to);
 extern long random(long from, long to);
 
+// Virtual time support, used by RH_TCP when the ether simulator runs in virtual time.
+// Once simulator_set_virtual_time() has been called, millis() and micros() return the virtual time
+// instead of the real time, and delay() calls the delay handler (if any) instead of sleeping,
+// so the handler can advance the virtual time.
+extern void simulator_set_virtual_time(uint64_t micros);
+extern void simulator_set_delay_handler(void (*handler)(unsigned long ms));
+
+// Once a random handler has been set, random(from, to) and random(to) call it instead of the
+// C library random(), so that a simulator can record and replay the random numbers used by sketches.
+// NULL restores the default.
+extern void simulator_set_random_handler(long (*handler)(long from, long to));
+
 // Equavalent to HardwareSerial in Arduino
 // but outputs to stdout
 class SerialSimulator
@@ -118,6 +118,10 @@
 /// Works with tools/etherSimulator.pl to pass messages between simulated sketches, allowing
 /// testing of Manager classes on Linux and without need for real radios or other transport hardware.
 ///
+/// - RH_Ether
+/// For use with simulations of many nodes within a single process on Linux. Works with RHEtherSimulator,
+/// which runs each node as a task in virtual time and passes messages between them in memory.
+///
 /// Drivers can be used on their own to provide unaddressed, unreliable datagrams. 
 /// All drivers have the same identical API.
 /// Or you can use any Driver with any of the Managers described below.
@@ -130,6 +134,7 @@
 ///
 /// - RHDatagram
 /// Addressed, unreliable variable length messages, with optional broadcast facilities.
+/// RHDatagramT is the same, but bound to one driver class at compile time, so calls to the driver can be inlined.
 ///
 /// - RHReliableDatagram
 /// Addressed, reliable, retransmitted, acknowledged variable length messages.
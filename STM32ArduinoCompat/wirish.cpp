@@ -393,6 +393,18 @@ unsigned long millis()
     return systick_count;
 }
 
+// Adds the part of the current millisecond counted down so far by SysTick
+unsigned long micros()
+{
+    unsigned long ms, ticks;
+    do
+    {
+	ms = systick_count;
+	ticks = SysTick->LOAD - SysTick->VAL;
+    } while (ms != systick_count); // SysTick interrupt happened meanwhile, try again
+    return ms * 1000 + ticks / (SystemCoreClock / 1000000);
+}
+
 long random(long from, long to)
 {
     return from + (RNG_GetRandomNumber() % (to - from));
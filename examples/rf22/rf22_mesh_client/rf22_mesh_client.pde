@@ -3,8 +3,8 @@
 // Example sketch showing how to create a simple addressed, routed reliable messaging client
 // with the RHMesh class.
 // It is designed to work with the other examples rf22_mesh_server*
-// Hint: you can simulate other network topologies by setting the 
-// RH_TEST_NETWORK define in RHRouter.h
+// Hint: you can simulate other network topologies with
+// setLinkFilter() in RHRouter.h
 
 // Mesh has much greater memory requirements, and you may need to limit the
 // max message length to prevent wierd crashes
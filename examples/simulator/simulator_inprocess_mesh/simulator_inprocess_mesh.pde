@@ -0,0 +1,108 @@
+// simulator_inprocess_mesh.pde
+// -*- mode: C++ -*-
+// Example sketch showing how to simulate a whole network of RHMesh nodes 
+// in a single process, using RHEtherSimulator and RH_Ether.
+// NUM_NODES nodes are arranged in a line, and each node can only hear its immediate neighbours.
+// Node 1 repeatedly sends a message to the node at the far end of the line,
+// and waits for a reply. All the other nodes act as mesh servers.
+// The simulation runs in virtual time, as fast as the CPU allows.
+//
+// Build and run on Linux with:
+// tools/simBuild examples/simulator/simulator_inprocess_mesh/simulator_inprocess_mesh.pde
+// ./simulator_inprocess_mesh
+
+#include <RHMesh.h>
+#include <RH_Ether.h>
+
+#define NUM_NODES 10
+#define CLIENT_ADDRESS 1
+#define SERVER_ADDRESS NUM_NODES
+
+// How long to run the simulation, in virtual microseconds
+#define RUN_TIME 60000000
+
+// The simulated ether
+RHEtherSimulator ether;
+
+// A driver and a manager for each node
+RH_Ether* drivers[NUM_NODES];
+RHMesh*   managers[NUM_NODES];
+
+uint8_t data[] = "Hello World!";
+uint8_t reply[] = "And hello back to you";
+
+void clientSetup(void* arg)
+{
+  RHMesh* manager = (RHMesh*)arg;
+  if (!manager->init())
+    Serial.println("init failed");
+}
+
+void clientLoop(void* arg)
+{
+  RHMesh* manager = (RHMesh*)arg;
+  uint8_t buf[RH_MESH_MAX_MESSAGE_LEN];
+
+  printf("%lu: sending to node %d\n", millis(), SERVER_ADDRESS);
+  if (manager->sendtoWait(data, sizeof(data), SERVER_ADDRESS) == RH_ROUTER_ERROR_NONE)
+  {
+    // Now wait for a reply from the far end
+    uint8_t len = sizeof(buf);
+    uint8_t from;    
+    if (manager->recvfromAckTimeout(buf, &len, 3000, &from))
+      printf("%lu: got reply from node %d: %s\n", millis(), from, (char*)buf);
+    else
+      printf("%lu: no reply\n", millis());
+  }
+  else
+    printf("%lu: sendtoWait failed\n", millis());
+  delay(1000);
+}
+
+void serverSetup(void* arg)
+{
+  RHMesh* manager = (RHMesh*)arg;
+  if (!manager->init())
+    Serial.println("init failed");
+}
+
+void serverLoop(void* arg)
+{
+  RHMesh* manager = (RHMesh*)arg;
+  uint8_t buf[RH_MESH_MAX_MESSAGE_LEN];
+  uint8_t len = sizeof(buf);
+  uint8_t from;
+
+  // Routes messages for other nodes while waiting
+  if (manager->recvfromAck(buf, &len, &from))
+    manager->sendtoWait(reply, sizeof(reply), from);
+}
+
+void setup() 
+{
+  uint8_t i;
+
+  // Each node can only hear its immediate neighbours
+  // Could also be read from a config file with ether.readConfig(), see tools/topology.pl
+  for (i = 1; i < NUM_NODES; i++)
+    ether.setLink(i, i + 1);
+
+  for (i = 0; i < NUM_NODES; i++)
+  {
+    drivers[i] = new RH_Ether(ether);
+    managers[i] = new RHMesh(*drivers[i], i + 1);
+    if (i + 1 == CLIENT_ADDRESS)
+      ether.addTask(clientSetup, clientLoop, managers[i]);
+    else
+      ether.addTask(serverSetup, serverLoop, managers[i]);
+  }
+  ether.run(RUN_TIME);
+  printf("transmitted: %llu delivered: %llu dropped: %llu collided: %llu\n",
+	 (unsigned long long)ether.transmitted(), (unsigned long long)ether.delivered(),
+	 (unsigned long long)ether.dropped(), (unsigned long long)ether.collided());
+  exit(0);
+}
+
+void loop()
+{
+}
@@ -0,0 +1,694 @@
+// etherSimulator.cpp
+// Simulates the luminiferous ether for RH_TCP.
+// Connects multiple instances of RH_TCP clients together and passes
+// simulated messages between them.
+// A native replacement for etherSimulator.pl, capable of handling thousands of connected nodes.
+// Uses epoll, so it builds and runs on Linux only.
+//
+// Build with:
+// cd whatever/RadioHead
+// g++ -O2 -I . -I RHutil tools/etherSimulator.cpp RHEther.cpp RHPcap.cpp -o etherSimulator
+//
+// usage: etherSimulator [-h] [-c configfile] [-b bitspersec] [-p portnumber] [-s statsinterval]
+//                        [-v] [-n numnodes] [-r seed] [-w pcapfile] [-R recordfile] [-P replayfile]
+//
+// -v runs the simulation in virtual time: the simulator owns the clock used by all the
+// connected RH_TCP sketches, and advances it whenever all of them are waiting. Only one sketch runs
+// at a time, in order of node address, so the results are the same on every run.
+// -n is the number of sketches to wait for before virtual time starts.
+// -r seeds the random number generator used to decide whether packets are delivered,
+// default is 1 in virtual time, else random.
+//
+// Collisions between packets are modelled by RHEther, including the capture effect
+// if the config file gives the positions of the nodes. See tools/capture.conf.
+// The config file can also give the network topology with link lines, such as those
+// generated by tools/topology.pl. See tools/testnetwork1.conf.
+// -w writes every packet transmitted to a pcap file. See RHPcap for the format.
+// The timestamps are real time, or virtual time since the start of the simulation.
+// -R records every ether event and random number to a log file, and -P replays a log, reporting
+// the first difference between the run and the log. See RHEther. Use with -v, since runs in real time
+// can not be reproduced. Set RH_SIMULATOR_SEED in the environment of sketches that call random()
+// before the first message from etherSimulator.
+// On SIGINT or SIGTERM, prints the final statistics and the number of collisions at each node, and exits.
+//
+// Copyright (C) 2016 Mike McCauley
+
+#include <RHEther.h>
+#include <RHTcpProtocol.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <vector>
+
+// Maximum number of epoll events handled per call to epoll_wait
+#define MAX_EVENTS 256
+
+// Largest RH_TCP message we accept from a client, including its length
+#define MAX_MESSAGE_LEN (sizeof(uint32_t) + 1 + RH_TCP_MAX_PAYLOAD_LEN)
+
+// Tags for the non-client file descriptors in the epoll data
+#define TAG_LISTEN -1
+#define TAG_TIMER  -2
+
+// Set by signal handler when we are asked to stop
+static volatile sig_atomic_t stopping = 0;
+
+static void handleStop(int /*sig*/)
+{
+    stopping = 1;
+}
+
+// Returns the current time in microseconds since 1970-01-01 UTC
+static uint64_t now_micros()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// State of a connected RH_TCP client
+class Client
+{
+public:
+    Client(int fd, int node) : fd(fd), node(node), rxLen(0), txStart(0),
+			       airtime(0), closed(false), blocked(false), until(0), wakeOnPacket(false), woken(false) {}
+
+    int                  fd;
+    int                  node;     // Index in the ether
+    uint8_t              rxBuf[MAX_MESSAGE_LEN];
+    uint32_t             rxLen;
+    std::vector<uint8_t> txBuf;    // Data not yet accepted by the socket
+    uint32_t             txStart;  // Offset of the first unsent octet in txBuf
+    uint32_t             airtime;  // Time on air of the next packet, 0 if not known
+    bool                 closed;   // Disconnected, to be deleted by freeClosedClients()
+
+    // Virtual time state
+    bool                 blocked;      // Sent a RHTcpWait, waiting for a RHTcpTime
+    uint64_t             until;        // Virtual time to wake up
+    bool                 wakeOnPacket; // Wake up early if a packet is delivered
+    bool                 woken;        // A packet was delivered, wake up now
+};
+
+// The ether, connecting clients over TCP sockets
+class TcpEther : public RHEther
+{
+public:
+    TcpEther() : _epoll(-1), _timer(-1), _timerArmed(false),
+		 _virtual(false), _minNodes(0), _started(false), _scheduling(false), _virtualNow(0) {}
+
+    bool begin(uint16_t port);
+    void setVirtualTime(uint32_t minNodes);
+    void run(uint32_t statsInterval);
+
+protected:
+    virtual void deliver(int node, const uint8_t* frame, uint8_t len);
+
+private:
+    void acceptClients();
+    void readClient(Client* c);
+    void writeClient(Client* c);
+    void handleMessage(Client* c, const uint8_t* msg, uint32_t len);
+    void closeClient(Client* c);
+    void freeClosedClients();
+    void armTimer();
+    void printStats(uint64_t now, uint64_t elapsed);
+    void printCollisions();
+    uint64_t now();
+    void queueMessage(Client* c, uint8_t type, const uint8_t* data, uint8_t len);
+    void queueTime(Client* c);
+    void sendTime(Client* c);
+    void schedule();
+
+    int                  _listen;
+    int                  _epoll;
+    int                  _timer;
+    bool                 _timerArmed;
+    uint64_t             _timerWhen;
+    std::vector<Client*> _clients; // Indexed by node index
+    std::vector<Client*> _closed;  // Closed clients that may still be in use
+    uint64_t             _lastTransmitted;
+    uint64_t             _lastDelivered;
+
+    bool                 _virtual;     // Running in virtual time
+    uint32_t             _minNodes;    // Number of clients to wait for before starting virtual time
+    bool                 _started;     // Virtual time has started
+    bool                 _scheduling;  // schedule() is running
+    uint64_t             _virtualNow;  // Current virtual time in microseconds
+};
+
+void TcpEther::setVirtualTime(uint32_t minNodes)
+{
+    _virtual = true;
+    _minNodes = minNodes;
+}
+
+// The current time in microseconds, real or virtual
+uint64_t TcpEther::now()
+{
+    return _virtual ? _virtualNow : now_micros();
+}
+
+bool TcpEther::begin(uint16_t port)
+{
+    // Dual stack IPv6 socket accepts IPv4 connections too
+    int family = AF_INET6;
+    _listen = socket(AF_INET6, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (_listen < 0)
+    {
+	family = AF_INET;
+	_listen = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    }
+    if (_listen < 0)
+    {
+	fprintf(stderr, "etherSimulator: socket failed: %s\n", strerror(errno));
+	return false;
+    }
+    int on = 1;
+    setsockopt(_listen, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+    int rc;
+    if (family == AF_INET6)
+    {
+	int off = 0;
+	setsockopt(_listen, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off));
+	struct sockaddr_in6 addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin6_family = AF_INET6;
+	addr.sin6_addr = in6addr_any;
+	addr.sin6_port = htons(port);
+	rc = bind(_listen, (struct sockaddr*)&addr, sizeof(addr));
+    }
+    else
+    {
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons(port);
+	rc = bind(_listen, (struct sockaddr*)&addr, sizeof(addr));
+    }
+    if (rc < 0 || listen(_listen, SOMAXCONN) < 0)
+    {
+	fprintf(stderr, "etherSimulator: could not listen on port %d: %s\n", port, strerror(errno));
+	return false;
+    }
+
+    _epoll = epoll_create1(0);
+    _timer = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK);
+    if (_epoll < 0 || _timer < 0)
+    {
+	fprintf(stderr, "etherSimulator: epoll/timerfd setup failed: %s\n", strerror(errno));
+	return false;
+    }
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.u64 = (uint32_t)TAG_LISTEN;
+    epoll_ctl(_epoll, EPOLL_CTL_ADD, _listen, &ev);
+    ev.data.u64 = (uint32_t)TAG_TIMER;
+    epoll_ctl(_epoll, EPOLL_CTL_ADD, _timer, &ev);
+    return true;
+}
+
+void TcpEther::acceptClients()
+{
+    while (1)
+    {
+	int fd = accept4(_listen, NULL, NULL, SOCK_NONBLOCK);
+	if (fd < 0)
+	{
+	    if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+		fprintf(stderr, "etherSimulator: accept failed: %s\n", strerror(errno));
+	    return;
+	}
+	int on = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+	int node = addNode();
+	if (node >= (int)_clients.size())
+	    _clients.resize(node + 1, NULL);
+	Client* c = new Client(fd, node);
+	_clients[node] = c;
+
+	struct epoll_event ev;
+	ev.events = EPOLLIN;
+	ev.data.u64 = (uint32_t)node;
+	epoll_ctl(_epoll, EPOLL_CTL_ADD, fd, &ev);
+
+	// Tell the client we are running in virtual time. It then waits until schedule()
+	// sends it the time again, so it never runs at the same time as another client
+	if (_virtual)
+	{
+	    c->blocked = true;
+	    c->until = _virtualNow;
+	    queueTime(c);
+	    if (!c->closed)
+		schedule();
+	}
+    }
+}
+
+// A client can be closed while it is still in use further up the stack, for example
+// when writing to it fails during readClient(), so it is only deleted by freeClosedClients()
+void TcpEther::closeClient(Client* c)
+{
+    if (c->closed)
+	return;
+    epoll_ctl(_epoll, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    removeNode(c->node);
+    _clients[c->node] = NULL;
+    c->closed = true;
+    _closed.push_back(c);
+    if (_virtual && !_scheduling)
+	schedule();
+}
+
+// Delete the clients closed by closeClient(). Call only when no client is in use
+void TcpEther::freeClosedClients()
+{
+    size_t i;
+    for (i = 0; i < _closed.size(); i++)
+	delete _closed[i];
+    _closed.clear();
+}
+
+void TcpEther::readClient(Client* c)
+{
+    while (1)
+    {
+	ssize_t count = read(c->fd, c->rxBuf + c->rxLen, sizeof(c->rxBuf) - c->rxLen);
+	if (count < 0)
+	{
+	    if (errno == EINTR)
+		continue;
+	    if (errno != EAGAIN && errno != EWOULDBLOCK)
+		closeClient(c);
+	    return;
+	}
+	if (count == 0)
+	{
+	    // Client disconnected
+	    closeClient(c);
+	    return;
+	}
+	c->rxLen += count;
+
+	// Handle every complete message in the buffer
+	uint32_t offset = 0;
+	while (c->rxLen - offset >= sizeof(uint32_t))
+	{
+	    uint32_t len;
+	    memcpy(&len, c->rxBuf + offset, sizeof(len));
+	    len = ntohl(len);
+	    if (len == 0 || len > MAX_MESSAGE_LEN - sizeof(uint32_t))
+	    {
+		fprintf(stderr, "etherSimulator: ridiculous message length %u from node %d. Disconnecting\n", len, c->node);
+		closeClient(c);
+		return;
+	    }
+	    if (c->rxLen - offset < sizeof(uint32_t) + len)
+		break; // Incomplete, wait for the rest
+	    handleMessage(c, c->rxBuf + offset + sizeof(uint32_t), len);
+	    if (c->closed)
+		return; // Writing to it failed
+	    offset += sizeof(uint32_t) + len;
+	}
+	// Keep any partial message at the start of the buffer
+	if (offset)
+	{
+	    memmove(c->rxBuf, c->rxBuf + offset, c->rxLen - offset);
+	    c->rxLen -= offset;
+	}
+    }
+}
+
+// msg points to the message type, len includes the type
+void TcpEther::handleMessage(Client* c, const uint8_t* msg, uint32_t len)
+{
+    uint8_t type = msg[0];
+    if (type == RH_TCP_MESSAGE_TYPE_THISADDRESS && len >= 2)
+    {
+	// Client notifies us of its node address
+	setNodeAddress(c->node, msg[1]);
+    }
+    else if (type == RH_TCP_MESSAGE_TYPE_PACKET && len >= 1 + RH_TCP_HEADER_LEN)
+    {
+	// New packet for transmission to all the other clients
+	if (c->airtime)
+	    transmit(c->node, msg + 1, len - 1, now(), c->airtime);
+	else
+	    transmit(c->node, msg + 1, len - 1, now());
+	c->airtime = 0;
+    }
+    else if (type == RH_TCP_MESSAGE_TYPE_AIRTIME && len >= 5)
+    {
+	// Client tells us the time on air of its next packet
+	uint32_t airtime;
+	memcpy(&airtime, msg + 1, sizeof(airtime));
+	c->airtime = ntohl(airtime);
+    }
+    else if (type == RH_TCP_MESSAGE_TYPE_WAIT && len >= 10 && _virtual)
+    {
+	// Client is blocked until the given time
+	uint32_t hi, lo;
+	memcpy(&hi, msg + 1, sizeof(hi));
+	memcpy(&lo, msg + 5, sizeof(lo));
+	c->until = ((uint64_t)ntohl(hi) << 32) | ntohl(lo);
+	c->wakeOnPacket = msg[9];
+	c->woken = false;
+	c->blocked = true;
+	schedule();
+    }
+    // Else ignore it
+}
+
+void TcpEther::deliver(int node, const uint8_t* frame, uint8_t len)
+{
+    Client* c = _clients[node];
+    if (!c)
+	return;
+
+    if (c->blocked && c->wakeOnPacket)
+	c->woken = true;
+    queueMessage(c, RH_TCP_MESSAGE_TYPE_PACKET, frame, len);
+}
+
+// Queue a message of the given type for sending to the client
+void TcpEther::queueMessage(Client* c, uint8_t type, const uint8_t* data, uint8_t len)
+{
+    uint32_t msglen = htonl(len + 1);
+    bool wasEmpty = c->txBuf.size() == c->txStart;
+    c->txBuf.insert(c->txBuf.end(), (uint8_t*)&msglen, (uint8_t*)&msglen + sizeof(msglen));
+    c->txBuf.push_back(type);
+    c->txBuf.insert(c->txBuf.end(), data, data + len);
+    if (wasEmpty)
+	writeClient(c);
+}
+
+// Queue a message telling a client the virtual time
+void TcpEther::queueTime(Client* c)
+{
+    uint32_t time[2];
+    time[0] = htonl(_virtualNow >> 32);
+    time[1] = htonl(_virtualNow & 0xffffffff);
+    queueMessage(c, RH_TCP_MESSAGE_TYPE_TIME, (uint8_t*)time, sizeof(time));
+}
+
+// Tell a client the virtual time, which lets it run
+void TcpEther::sendTime(Client* c)
+{
+    c->blocked = false;
+    c->woken = false;
+    queueTime(c);
+}
+
+// Run the next client in virtual time. Advances virtual time when all clients are
+// blocked and none are due to run at the current time.
+// Only one client runs at a time, and clients due at the same time run in order of their
+// node address, then order of connection, so that simulations are repeatable.
+void TcpEther::schedule()
+{
+    int i;
+    // Nothing to do while any client is running
+    for (i = 0; i < (int)_clients.size(); i++)
+	if (_clients[i] && !_clients[i]->blocked)
+	    return;
+    if (!_started)
+    {
+	if (numNodes() < _minNodes || numNodes() == 0)
+	    return;
+	_started = true;
+    }
+
+    while (1)
+    {
+	// Find the first client due to run now
+	Client* next = NULL;
+	for (i = 0; i < (int)_clients.size(); i++)
+	{
+	    Client* c = _clients[i];
+	    if (c && (c->woken || c->until <= _virtualNow)
+		&& (!next || nodeAddress(c->node) < nodeAddress(next->node)))
+		next = c;
+	}
+	if (next)
+	{
+	    sendTime(next);
+	    return;
+	}
+
+	// Everyone is waiting for the future, advance to the next event or wakeup time
+	uint64_t when = RH_TCP_WAIT_FOREVER;
+	nextEventTime(&when);
+	for (i = 0; i < (int)_clients.size(); i++)
+	    if (_clients[i] && _clients[i]->until < when)
+		when = _clients[i]->until;
+	if (when == RH_TCP_WAIT_FOREVER)
+	    return; // Everyone is waiting forever
+	_virtualNow = when;
+	_scheduling = true; // Deliveries may close clients
+	processEvents(_virtualNow);
+	_scheduling = false;
+    }
+}
+
+void TcpEther::writeClient(Client* c)
+{
+    while (c->txStart < c->txBuf.size())
+    {
+	ssize_t count = write(c->fd, &c->txBuf[c->txStart], c->txBuf.size() - c->txStart);
+	if (count < 0)
+	{
+	    if (errno == EINTR)
+		continue;
+	    if (errno == EAGAIN || errno == EWOULDBLOCK)
+		break;
+	    closeClient(c);
+	    return;
+	}
+	c->txStart += count;
+    }
+
+    struct epoll_event ev;
+    ev.data.u64 = (uint32_t)c->node;
+    if (c->txStart < c->txBuf.size())
+    {
+	// Socket is full, wait until it can take more
+	ev.events = EPOLLIN | EPOLLOUT;
+    }
+    else
+    {
+	c->txBuf.clear();
+	c->txStart = 0;
+	ev.events = EPOLLIN;
+    }
+    epoll_ctl(_epoll, EPOLL_CTL_MOD, c->fd, &ev);
+}
+
+// Make sure the timer fires at the time of the next delivery
+void TcpEther::armTimer()
+{
+    uint64_t when;
+    if (_virtual || !nextEventTime(&when))
+	return;
+    if (_timerArmed && _timerWhen == when)
+	return; // Already set for this
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = when / 1000000;
+    its.it_value.tv_nsec = (when % 1000000) * 1000;
+    if (its.it_value.tv_sec == 0 && its.it_value.tv_nsec == 0)
+	its.it_value.tv_nsec = 1; // 0 would disarm
+    timerfd_settime(_timer, TFD_TIMER_ABSTIME, &its, NULL);
+    _timerArmed = true;
+    _timerWhen = when;
+}
+
+void TcpEther::printStats(uint64_t /*now*/, uint64_t elapsed)
+{
+    double secs = elapsed / 1000000.0;
+    if (_virtual)
+	printf("virtual time: %.3f s ", _virtualNow / 1000000.0);
+    printf("nodes: %u transmitted: %.1f pkt/s forwarded: %.1f pkt/s total transmitted: %llu delivered: %llu dropped: %llu collided: %llu\n",
+	   numNodes(),
+	   (transmitted() - _lastTransmitted) / secs,
+	   (delivered() - _lastDelivered) / secs,
+	   (unsigned long long)transmitted(),
+	   (unsigned long long)delivered(),
+	   (unsigned long long)dropped(),
+	   (unsigned long long)collided());
+    fflush(stdout);
+    _lastTransmitted = transmitted();
+    _lastDelivered = delivered();
+}
+
+// Print the number of collisions at each node that has had any
+void TcpEther::printCollisions()
+{
+    int i;
+    printf("collisions by node:\n");
+    for (i = 0; i < (int)_clients.size(); i++)
+	if (_clients[i] && collisions(i))
+	    printf("node %d (address %d): %u\n", i, nodeAddress(i), collisions(i));
+    fflush(stdout);
+}
+
+void TcpEther::run(uint32_t statsInterval)
+{
+    struct epoll_event events[MAX_EVENTS];
+    uint64_t lastStats = now_micros();
+    _lastTransmitted = 0;
+    _lastDelivered = 0;
+
+    while (!stopping)
+    {
+	armTimer();
+	int timeout = statsInterval ? 1000 : -1;
+	int n = epoll_wait(_epoll, events, MAX_EVENTS, timeout);
+	if (n < 0 && errno != EINTR)
+	{
+	    fprintf(stderr, "etherSimulator: epoll_wait failed: %s\n", strerror(errno));
+	    return;
+	}
+	int i;
+	for (i = 0; i < n; i++)
+	{
+	    int tag = (int)(uint32_t)events[i].data.u64;
+	    if (tag == TAG_LISTEN)
+		acceptClients();
+	    else if (tag == TAG_TIMER)
+	    {
+		uint64_t expirations;
+		if (read(_timer, &expirations, sizeof(expirations)) > 0)
+		    _timerArmed = false;
+	    }
+	    else if (tag >= 0 && tag < (int)_clients.size() && _clients[tag])
+	    {
+		Client* c = _clients[tag];
+		if (events[i].events & EPOLLOUT)
+		    writeClient(c);
+		if (!c->closed && events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+		    readClient(c);
+	    }
+	}
+	uint64_t now = now_micros();
+	if (!_virtual)
+	    processEvents(now);
+	freeClosedClients();
+
+	if (statsInterval && now - lastStats >= (uint64_t)statsInterval * 1000000)
+	{
+	    printStats(now, now - lastStats);
+	    lastStats = now;
+	}
+    }
+    printStats(now_micros(), now_micros() - lastStats);
+    printCollisions();
+    if (replayed() || diverged())
+	printf("replay: %llu lines matched the log%s\n", (unsigned long long)replayed(),
+	       diverged() ? ", then diverged" : "");
+}
+
+static void usage(const char* name)
+{
+    printf("usage: %s [-h] [-c configfile] [-b bitspersec] [-p portnumber] [-s statsinterval] [-v] [-n numnodes] [-r seed] [-w pcapfile] [-R recordfile] [-P replayfile]\n", name);
+    exit(1);
+}
+
+int main(int argc, char** argv)
+{
+    const char* config = NULL;
+    uint32_t bps = RH_ETHER_DEFAULT_BPS;
+    uint16_t port = 4000;
+    uint32_t statsInterval = 10; // Seconds, 0 means never
+    bool virtualTime = false;
+    uint32_t minNodes = 0;
+    bool seeded = false;
+    uint32_t seed = 1;
+    const char* pcapFile = NULL;
+    const char* recordFile = NULL;
+    const char* replayFile = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "hc:b:p:s:vn:r:w:R:P:")) != -1)
+    {
+	switch (opt)
+	{
+	    case 'c':
+		config = optarg;
+		break;
+	    case 'b':
+		bps = strtoul(optarg, NULL, 0);
+		break;
+	    case 'p':
+		port = strtoul(optarg, NULL, 0);
+		break;
+	    case 's':
+		statsInterval = strtoul(optarg, NULL, 0);
+		break;
+	    case 'v':
+		virtualTime = true;
+		break;
+	    case 'n':
+		minNodes = strtoul(optarg, NULL, 0);
+		break;
+	    case 'r':
+		seed = strtoul(optarg, NULL, 0);
+		seeded = true;
+		break;
+	    case 'w':
+		pcapFile = optarg;
+		break;
+	    case 'R':
+		recordFile = optarg;
+		break;
+	    case 'P':
+		replayFile = optarg;
+		break;
+	    default:
+		usage(argv[0]);
+	}
+    }
+
+    signal(SIGPIPE, SIG_IGN); // Disconnected clients are detected by read and write
+    signal(SIGINT, handleStop); // Print final stats and exit
+    signal(SIGTERM, handleStop);
+    TcpEther ether;
+    ether.setBitsPerSecond(bps);
+    if (virtualTime)
+	ether.setVirtualTime(minNodes);
+    if (seeded || virtualTime)
+	ether.setSeed(seed);
+    if (config && !ether.readConfig(config))
+	exit(1);
+    RHPcap pcap;
+    if (pcapFile)
+    {
+	if (!pcap.open(pcapFile))
+	    exit(1);
+	ether.setPcap(&pcap);
+    }
+    if (recordFile && !ether.record(recordFile))
+	exit(1);
+    if (replayFile && !ether.replay(replayFile))
+	exit(1);
+    if (replayFile && !virtualTime)
+	fprintf(stderr, "etherSimulator: replay without -v will probably diverge\n");
+    if (!ether.begin(port))
+	exit(1);
+    ether.run(statsInterval);
+    pcap.close();
+    return 0;
+}
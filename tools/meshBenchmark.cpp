@@ -0,0 +1,565 @@
+// meshBenchmark.cpp
+//
+// Performance benchmark for RHMesh and RHRouter.
+// Runs a network of simulated RHMesh nodes in a single process using RHEtherSimulator,
+// drives a traffic pattern through RHMesh::sendtoWait() and recvfromAck(), and reports
+// the results as JSON, so they can be compared from release to release.
+//
+// Build with:
+// tools/simBuild tools/meshBenchmark.cpp
+//
+// usage: meshBenchmark [-h] [-n numnodes] [-c configfile] [-t pattern] [-i interval] [-l length]
+//                      [-d duration] [-D drain] [-b bitspersec] [-k sink] [-r seed] [-o outputfile]
+//                      [-R recordfile] [-P replayfile] [-a cadtimeout] [-T slots]
+//                      [-L interval]
+// -n is the number of nodes, with addresses 1 to numnodes. Default 10.
+// -c gives the topology and radio model in the format read by RHEther::readConfig(), for example
+// generated by tools/topology.pl. Default is a chain of numnodes nodes.
+// -t is the traffic pattern:
+//    sink      every node sends to the sink node (default)
+//    pairs     every node sends to randomly chosen nodes
+//    broadcast every node broadcasts to its neighbours
+// -i is the mean interval between messages sent by each node in milliseconds. Messages
+// are sent at random (exponentially distributed) intervals. Default 10000.
+// -l is the length of the application payload in octets, at least 4. Default 20.
+// -d is how long nodes send messages for, in seconds of virtual time. Default 600.
+// -D is how long to wait afterwards for messages in flight, in seconds. Default 30.
+// -b is the simulated bit rate. Default RH_ETHER_DEFAULT_BPS.
+// -k is the address of the sink node for the sink pattern. Default 1.
+// -r seeds the random number generators. Runs with the same arguments and seed give the same results.
+// The wall clock time taken by the run is printed on stderr, not with the results.
+// -o writes the results to a file instead of stdout.
+// -R records every ether event and random number to a log file, and -P replays a log, reporting
+// the first difference between the run and the log. See RHEther.
+// -a enables listen before talk: each node waits up to cadtimeout milliseconds for the channel
+// to be clear before transmitting. See RHGenericDriver::setCADTimeout(). Default 0 (disabled).
+// -T wraps each driver in RHTDMA with the given number of slots, with the sink as the coordinator.
+// All nodes must be in range of the sink. Default 0 (disabled, pure ALOHA).
+// -L wraps each driver in RHLowPowerListen, listening every interval milliseconds. Default 0 (disabled,
+// radios always on). Can not be used with -T.
+//
+// The results are:
+// offered, delivered, delivery_ratio: application messages sent, delivered end-to-end
+// (once each), and the ratio. For broadcasts, each neighbour that should hear a broadcast
+// counts as one offered message.
+// latency_ms: percentiles of the time from calling sendtoWait() to delivery by recvfromAck()
+// route_discovery_ms: number and percentiles of the time taken by route discoveries
+// send_errors: sendtoWait() failures by error code
+// retransmissions: retransmissions by RHReliableDatagram, summed over all nodes
+// cad_timeouts: messages not sent because the channel stayed busy, summed over all nodes
+// tdma_rejects: messages not sent because there was no TDMA slot for them in time, summed over all nodes
+// strobe_trains: messages sent as low power listening strobe trains, summed over all nodes
+// radio_on_ratio: the fraction of the time the radios were not asleep, over all nodes except the sink
+// of the sink pattern, which never sleeps
+// application_bytes: octets of application payload transmitted, counting every hop
+// control_overhead_bytes: all other octets transmitted: headers, acknowledgements,
+// route discovery and route failure messages
+// goodput_bps: application payload bits delivered end-to-end per second
+// ether: frames transmitted, delivered, dropped and collided, as counted by RHEther
+
+#include <RadioHead.h>
+
+#if (RH_PLATFORM == RH_PLATFORM_UNIX)
+
+#include <RHMesh.h>
+#include <RH_Ether.h>
+#include <RHTDMA.h>
+#include <RHLowPowerListen.h>
+#include <vector>
+#include <algorithm>
+#include <math.h>
+#include <unistd.h>
+#include <time.h>
+
+#define PATTERN_SINK      0
+#define PATTERN_PAIRS     1
+#define PATTERN_BROADCAST 2
+
+// Longest time recvfromAckTimeout() can wait
+#define MAX_RECV_TIMEOUT 65535
+
+// Every message carries its sequence number in the first 4 octets of its payload
+#define MIN_PAYLOAD_LEN 4
+
+// Configuration
+static int         numNodes = 10;
+static const char* config = NULL;
+static int         pattern = PATTERN_SINK;
+static const char* patternName = "sink";
+static uint32_t    interval = 10000;
+static uint8_t     payloadLen = 20;
+static uint32_t    duration = 600;
+static uint32_t    drain = 30;
+static uint32_t    bps = RH_ETHER_DEFAULT_BPS;
+static uint8_t     sink = 1;
+static uint32_t    seed = 1;
+static const char* output = NULL;
+static const char* recordFile = NULL;
+static const char* replayFile = NULL;
+static uint32_t    cadTimeout = 0;
+static uint32_t    tdmaSlots = 0;
+static uint32_t    lplInterval = 0;
+
+// The simulated ether
+static RHEtherSimulator ether;
+
+// An application message sent by sendtoWait()
+typedef struct
+{
+    uint8_t  source;
+    uint8_t  dest;
+    uint64_t sent;      // When sendtoWait() was called, virtual microseconds
+    uint32_t expected;  // Number of nodes that should receive it
+    uint32_t received;  // Number of nodes that have received it
+    uint8_t  receivedBy[32]; // Bitmap of nodes that have received it, to detect duplicates
+} Message;
+
+static std::vector<Message> messages;
+static std::vector<double>  latencies;   // Milliseconds
+static std::vector<double>  discoveries; // Milliseconds
+static uint32_t discoveryFailures = 0;
+static uint32_t sendErrors[RH_ROUTER_ERROR_UNABLE_TO_DELIVER + 1];
+static uint64_t applicationBytes = 0;
+static uint64_t overheadBytes = 0;
+static uint64_t deliveredBytes = 0;
+
+/////////////////////////////////////////////////////////////////////
+// Driver that counts the octets transmitted as application payload or overhead
+class BenchmarkDriver : public RH_Ether
+{
+public:
+    BenchmarkDriver(RHEtherSimulator& ether) : RH_Ether(ether) {}
+
+    virtual bool send(const uint8_t* data, uint8_t len)
+    {
+	if (!RH_Ether::send(data, len))
+	    return false;
+	// Application payload follows the RHRouter and RHMesh headers of application messages.
+	// Acknowledgements and mesh control messages are all overhead
+	uint8_t headers = sizeof(RHRouter::RoutedMessageHeader) + sizeof(RHMesh::MeshMessageHeader);
+	if (   !(_txHeaderFlags & RH_FLAGS_ACK)
+	    && len > headers
+	    && data[sizeof(RHRouter::RoutedMessageHeader)] == RH_MESH_MESSAGE_TYPE_APPLICATION)
+	{
+	    applicationBytes += len - headers;
+	    overheadBytes += RH_ETHER_HEADER_LEN + headers;
+	}
+	else
+	    overheadBytes += RH_ETHER_HEADER_LEN + len;
+	return true;
+    }
+};
+
+/////////////////////////////////////////////////////////////////////
+// Mesh manager that times route discoveries
+class BenchmarkMesh : public RHMesh
+{
+public:
+    BenchmarkMesh(RHGenericDriver& driver, uint8_t thisAddress) : RHMesh(driver, thisAddress) {}
+
+protected:
+    virtual bool doArp(uint8_t address)
+    {
+	uint64_t start = ether.now();
+	bool ret = RHMesh::doArp(address);
+	if (ret)
+	    discoveries.push_back((ether.now() - start) / 1000.0);
+	else
+	    discoveryFailures++;
+	return ret;
+    }
+};
+
+// The state of each node
+typedef struct
+{
+    BenchmarkDriver* driver;
+    RHTDMA*          tdma;     // Between the driver and the manager, if -T
+    RHLowPowerListen* lpl;     // Between the driver and the manager, if -L
+    BenchmarkMesh*   manager;
+    uint8_t          address;
+    uint64_t         nextSend; // Virtual microseconds
+} Node;
+
+static std::vector<Node> nodes;
+
+// Returns an exponentially distributed random interval in microseconds with the given mean in milliseconds
+static uint64_t randomInterval(uint32_t mean)
+{
+    // Arduino random() is drawn from the ether, so it is recorded and replayed
+    double u = (random(0, 0x7fffffff) + 1.0) / 0x80000000; // 0 < u <= 1
+    return (uint64_t)(-log(u) * mean * 1000);
+}
+
+// Chooses where the next message from a node goes
+static uint8_t chooseDest(uint8_t source)
+{
+    if (pattern == PATTERN_BROADCAST)
+	return RH_BROADCAST_ADDRESS;
+    if (pattern == PATTERN_SINK)
+	return sink;
+    uint8_t dest;
+    do
+	dest = random(1, numNodes + 1);
+    while (dest == source);
+    return dest;
+}
+
+static void sendMessage(Node* n)
+{
+    if (pattern == PATTERN_SINK && n->address == sink)
+	return; // The sink does not send
+    uint8_t dest = chooseDest(n->address);
+
+    Message m;
+    memset(&m, 0, sizeof(m));
+    m.source = n->address;
+    m.dest = dest;
+    m.sent = ether.now();
+    if (dest == RH_BROADCAST_ADDRESS)
+    {
+	// Every node that the ether topology lets hear us should get it
+	int i;
+	for (i = 1; i <= numNodes; i++)
+	    if (i != n->address && ether.linked(n->address, i) && ether.probability(n->address, i) > 0.0)
+		m.expected++;
+    }
+    else
+	m.expected = 1;
+    uint32_t seq = messages.size();
+    messages.push_back(m);
+
+    uint8_t buf[RH_MESH_MAX_MESSAGE_LEN];
+    memset(buf, 0, payloadLen);
+    memcpy(buf, &seq, sizeof(seq));
+    uint8_t error = n->manager->sendtoWait(buf, payloadLen, dest);
+    if (error <= RH_ROUTER_ERROR_UNABLE_TO_DELIVER)
+	sendErrors[error]++;
+}
+
+static void receiveMessage(Node* n, uint8_t* buf, uint8_t len)
+{
+    uint32_t seq;
+    if (len < sizeof(seq))
+	return;
+    memcpy(&seq, buf, sizeof(seq));
+    if (seq >= messages.size())
+	return;
+    Message* m = &messages[seq];
+    if (m->receivedBy[n->address / 8] & (1 << (n->address % 8)))
+	return; // Duplicate
+    m->receivedBy[n->address / 8] |= 1 << (n->address % 8);
+    m->received++;
+    latencies.push_back((ether.now() - m->sent) / 1000.0);
+    deliveredBytes += len;
+}
+
+void nodeSetup(void* arg)
+{
+    Node* n = (Node*)arg;
+    if (!n->manager->init())
+	fprintf(stderr, "meshBenchmark: init failed for node %d\n", n->address);
+    n->driver->setCADTimeout(cadTimeout);
+    // The sink is a gateway with mains power, so it never sleeps
+    if (n->lpl && pattern == PATTERN_SINK && n->address == sink)
+	n->lpl->setInterval(0);
+    // Slots big enough for the application messages. Route discovery messages are shorter in small networks
+    uint8_t maxLen = sizeof(RHRouter::RoutedMessageHeader) + sizeof(RHMesh::MeshMessageHeader) + payloadLen;
+    if (n->tdma && n->address == sink && !n->tdma->setCoordinator(maxLen))
+	fprintf(stderr, "meshBenchmark: setCoordinator failed\n");
+    n->nextSend = ether.now() + randomInterval(interval);
+}
+
+void nodeLoop(void* arg)
+{
+    Node* n = (Node*)arg;
+    uint64_t now = ether.now();
+    if (now >= n->nextSend && now < (uint64_t)duration * 1000000)
+    {
+	sendMessage(n);
+	n->nextSend += randomInterval(interval);
+	if (n->nextSend < ether.now())
+	    n->nextSend = ether.now(); // Sending took longer than the interval
+	return;
+    }
+
+    // Receive and route messages until it is time to send again
+    uint64_t timeout = (n->nextSend - now + 999) / 1000; // Round up to whole milliseconds
+    if (now >= (uint64_t)duration * 1000000 || timeout > MAX_RECV_TIMEOUT)
+	timeout = MAX_RECV_TIMEOUT;
+    uint8_t buf[RH_MESH_MAX_MESSAGE_LEN];
+    uint8_t len = sizeof(buf);
+    if (n->manager->recvfromAckTimeout(buf, &len, timeout))
+	receiveMessage(n, buf, len);
+}
+
+// Returns the pth percentile of some values
+static double percentile(std::vector<double>& values, double p)
+{
+    if (values.empty())
+	return 0.0;
+    std::sort(values.begin(), values.end());
+    size_t i = (size_t)ceil(p / 100.0 * values.size());
+    return values[i ? i - 1 : 0];
+}
+
+static double mean(std::vector<double>& values)
+{
+    double sum = 0.0;
+    size_t i;
+    for (i = 0; i < values.size(); i++)
+	sum += values[i];
+    return values.empty() ? 0.0 : sum / values.size();
+}
+
+static void printDistribution(FILE* f, const char* name, std::vector<double>& values)
+{
+    fprintf(f, "  \"%s\": {\"count\": %lu, \"mean\": %.3f, \"p50\": %.3f, \"p99\": %.3f, \"max\": %.3f},\n",
+	    name, (unsigned long)values.size(), mean(values), percentile(values, 50), percentile(values, 99),
+	    percentile(values, 100));
+}
+
+// Prints s as a JSON string, with quotes, backslashes and control characters escaped
+static void printString(FILE* f, const char* s)
+{
+    fputc('"', f);
+    for (; *s; s++)
+    {
+	if (*s == '"' || *s == '\\')
+	    fprintf(f, "\\%c", *s);
+	else if ((unsigned char)*s < 0x20)
+	    fprintf(f, "\\u%04x", (unsigned char)*s);
+	else
+	    fputc(*s, f);
+    }
+    fputc('"', f);
+}
+
+static void printResults(FILE* f)
+{
+    uint64_t offered = 0, delivered = 0, retransmissions = 0, cadTimeouts = 0, tdmaRejects = 0, strobeTrains = 0, sleepTime = 0;
+    size_t i;
+    for (i = 0; i < messages.size(); i++)
+    {
+	offered += messages[i].expected;
+	delivered += messages[i].received;
+    }
+    for (i = 0; i < nodes.size(); i++)
+    {
+	retransmissions += nodes[i].manager->retransmissions();
+	RHGenericDriver::Statistics stats;
+	nodes[i].driver->statistics(&stats);
+	cadTimeouts += stats.txCadTimeouts;
+	if (nodes[i].tdma)
+	    tdmaRejects += nodes[i].tdma->tdmaRejects();
+	if (nodes[i].lpl)
+	{
+	    strobeTrains += nodes[i].lpl->strobeTrains();
+	    sleepTime += nodes[i].lpl->sleepTime();
+	}
+    }
+
+    fprintf(f, "{\n");
+    fprintf(f, "  \"benchmark\": \"meshBenchmark\",\n");
+    fprintf(f, "  \"config\": {\"nodes\": %d, \"topology\": ", numNodes);
+    // The config file name comes from the command line
+    printString(f, config ? config : "chain");
+    fprintf(f, ", \"pattern\": \"%s\", \"interval_ms\": %u, "
+	    "\"payload\": %u, \"duration_s\": %u, \"drain_s\": %u, \"bps\": %u, \"sink\": %u, \"seed\": %u, \"cad_timeout_ms\": %u, "
+	    "\"tdma_slots\": %u, \"lpl_interval_ms\": %u},\n",
+	    patternName, interval, payloadLen, duration, drain, bps, sink, seed,
+	    cadTimeout, tdmaSlots, lplInterval);
+    fprintf(f, "  \"offered\": %llu,\n", (unsigned long long)offered);
+    fprintf(f, "  \"delivered\": %llu,\n", (unsigned long long)delivered);
+    fprintf(f, "  \"delivery_ratio\": %.4f,\n", offered ? (double)delivered / offered : 0.0);
+    printDistribution(f, "latency_ms", latencies);
+    fprintf(f, "  \"route_discovery_ms\": {\"count\": %lu, \"failed\": %u, \"mean\": %.3f, \"p50\": %.3f, \"p99\": %.3f},\n",
+	    (unsigned long)discoveries.size(), discoveryFailures, mean(discoveries),
+	    percentile(discoveries, 50), percentile(discoveries, 99));
+    fprintf(f, "  \"send_errors\": {\"none\": %u, \"invalid_length\": %u, \"no_route\": %u, \"timeout\": %u, "
+	    "\"no_reply\": %u, \"unable_to_deliver\": %u},\n",
+	    sendErrors[RH_ROUTER_ERROR_NONE], sendErrors[RH_ROUTER_ERROR_INVALID_LENGTH],
+	    sendErrors[RH_ROUTER_ERROR_NO_ROUTE], sendErrors[RH_ROUTER_ERROR_TIMEOUT],
+	    sendErrors[RH_ROUTER_ERROR_NO_REPLY], sendErrors[RH_ROUTER_ERROR_UNABLE_TO_DELIVER]);
+    fprintf(f, "  \"retransmissions\": %llu,\n", (unsigned long long)retransmissions);
+    fprintf(f, "  \"cad_timeouts\": %llu,\n", (unsigned long long)cadTimeouts);
+    fprintf(f, "  \"tdma_rejects\": %llu,\n", (unsigned long long)tdmaRejects);
+    fprintf(f, "  \"strobe_trains\": %llu,\n", (unsigned long long)strobeTrains);
+    int sleepers = pattern == PATTERN_SINK ? numNodes - 1 : numNodes;
+    fprintf(f, "  \"radio_on_ratio\": %.4f,\n", 1.0 - sleepTime / ((duration + drain) * 1000.0 * sleepers));
+    fprintf(f, "  \"application_bytes\": %llu,\n", (unsigned long long)applicationBytes);
+    fprintf(f, "  \"control_overhead_bytes\": %llu,\n", (unsigned long long)overheadBytes);
+    fprintf(f, "  \"goodput_bps\": %.3f,\n", deliveredBytes * 8.0 / (duration + drain));
+    fprintf(f, "  \"ether\": {\"transmitted\": %llu, \"delivered\": %llu, \"dropped\": %llu, \"collided\": %llu}",
+	    (unsigned long long)ether.transmitted(), (unsigned long long)ether.delivered(),
+	    (unsigned long long)ether.dropped(), (unsigned long long)ether.collided());
+    if (replayFile)
+	fprintf(f, ",\n  \"replay\": {\"matched\": %llu, \"diverged\": %s}",
+		(unsigned long long)ether.replayed(), ether.diverged() ? "true" : "false");
+    fprintf(f, "\n}\n");
+}
+
+static void usage(const char* name)
+{
+    fprintf(stderr, "usage: %s [-h] [-n numnodes] [-c configfile] [-t sink|pairs|broadcast] [-i interval] [-l length] [-d duration] [-D drain] [-b bitspersec] [-k sink] [-r seed] [-o outputfile] [-R recordfile] [-P replayfile] [-a cadtimeout] [-T slots] [-L interval]\n", name);
+    exit(1);
+}
+
+void setup()
+{
+    int opt;
+    // Parsed as ints, so out of range values are rejected rather than truncated
+    int length = payloadLen;
+    int sinkAddress = sink;
+    while ((opt = getopt(_simulator_argc, _simulator_argv, "hn:c:t:i:l:d:D:b:k:r:o:R:P:a:T:L:")) != -1)
+    {
+	switch (opt)
+	{
+	    case 'n':
+		numNodes = atoi(optarg);
+		break;
+	    case 'c':
+		config = optarg;
+		break;
+	    case 't':
+		patternName = optarg;
+		if (!strcmp(optarg, "sink"))
+		    pattern = PATTERN_SINK;
+		else if (!strcmp(optarg, "pairs"))
+		    pattern = PATTERN_PAIRS;
+		else if (!strcmp(optarg, "broadcast"))
+		    pattern = PATTERN_BROADCAST;
+		else
+		    usage(_simulator_argv[0]);
+		break;
+	    case 'i':
+		interval = atoi(optarg);
+		break;
+	    case 'l':
+		length = atoi(optarg);
+		break;
+	    case 'd':
+		duration = atoi(optarg);
+		break;
+	    case 'D':
+		drain = atoi(optarg);
+		break;
+	    case 'b':
+		bps = atoi(optarg);
+		break;
+	    case 'k':
+		sinkAddress = atoi(optarg);
+		break;
+	    case 'r':
+		seed = strtoul(optarg, NULL, 0);
+		break;
+	    case 'o':
+		output = optarg;
+		break;
+	    case 'R':
+		recordFile = optarg;
+		break;
+	    case 'P':
+		replayFile = optarg;
+		break;
+	    case 'a':
+		cadTimeout = atoi(optarg);
+		break;
+	    case 'T':
+		tdmaSlots = atoi(optarg);
+		break;
+	    case 'L':
+		lplInterval = atoi(optarg);
+		break;
+	    case 'h':
+	    default:
+		usage(_simulator_argv[0]);
+	}
+    }
+    if (   numNodes < 2 || numNodes > 254 || sinkAddress < 1 || sinkAddress > numNodes || interval == 0
+	|| length < MIN_PAYLOAD_LEN || length > (int)RH_MESH_MAX_MESSAGE_LEN || tdmaSlots > RH_TDMA_MAX_SLOTS
+	|| (tdmaSlots && lplInterval) || lplInterval > 0xffff)
+	usage(_simulator_argv[0]);
+    payloadLen = length;
+    sink = sinkAddress;
+
+    ether.setSeed(seed);
+    ether.setBitsPerSecond(bps);
+    if (config)
+    {
+	if (!ether.readConfig(config))
+	    exit(1);
+    }
+    else
+    {
+	int i;
+	for (i = 1; i < numNodes; i++)
+	    ether.setLink(i, i + 1);
+    }
+
+    if (recordFile && !ether.record(recordFile))
+	exit(1);
+    if (replayFile && !ether.replay(replayFile))
+	exit(1);
+
+    nodes.resize(numNodes);
+    RHGenericDriver* transport = NULL; // What the managers send with
+    int i;
+    for (i = 0; i < numNodes; i++)
+    {
+	nodes[i].address = i + 1;
+	nodes[i].driver = new BenchmarkDriver(ether);
+	nodes[i].tdma = NULL;
+	nodes[i].lpl = NULL;
+	if (lplInterval)
+	{
+	    nodes[i].lpl = new RHLowPowerListen(*nodes[i].driver, lplInterval);
+	    transport = nodes[i].lpl;
+	    nodes[i].manager = new BenchmarkMesh(*nodes[i].lpl, i + 1);
+	}
+	else if (tdmaSlots)
+	{
+	    nodes[i].tdma = new RHTDMA(*nodes[i].driver, tdmaSlots);
+	    transport = nodes[i].tdma;
+	    nodes[i].manager = new BenchmarkMesh(*nodes[i].tdma, i + 1);
+	}
+	else
+	{
+	    transport = nodes[i].driver;
+	    nodes[i].manager = new BenchmarkMesh(*nodes[i].driver, i + 1);
+	}
+	ether.addTask(nodeSetup, nodeLoop, &nodes[i]);
+    }
+
+    // The driver wrappers take some of each message for their own headers
+    if (length > transport->maxMessageLength() - (int)sizeof(RHRouter::RoutedMessageHeader) - (int)sizeof(RHMesh::MeshMessageHeader))
+    {
+	fprintf(stderr, "meshBenchmark: length %d is too long for the driver\n", length);
+	exit(1);
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    ether.run((uint64_t)(duration + drain) * 1000000);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    FILE* f = stdout;
+    if (output && !(f = fopen(output, "w")))
+    {
+	fprintf(stderr, "meshBenchmark: could not open %s\n", output);
+	exit(1);
+    }
+    printResults(f);
+    // Not in the results, which depend only on the arguments and seed
+    fprintf(stderr, "meshBenchmark: wall time %.3f s\n", (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9);
+    if (f != stdout)
+	fclose(f);
+    ether.stopRecordReplay();
+    exit(0);
+}
+
+void loop()
+{
+}
+
+#endif
@@ -24,6 +24,12 @@ unsigned long start_millis;
 int    _simulator_argc;
 char** _simulator_argv;
 
+// Virtual time in microseconds, set by simulator_set_virtual_time()
+static bool     virtual_time = false;
+static uint64_t virtual_micros = 0;
+static void     (*delay_handler)(unsigned long ms) = NULL;
+static long     (*random_handler)(long from, long to) = NULL;
+
 // Returns milliseconds since beginning of day
 unsigned long time_in_millis()
 {    
@@ -40,8 +46,10 @@ int main(int argc, char** argv)
     _simulator_argc = argc;
     _simulator_argv = argv;
     start_millis = time_in_millis();
-    // Seed the random number generator
-    srand(getpid() ^ (unsigned) time(NULL)/2);
+    // Seed the random number generator. Set RH_SIMULATOR_SEED in the environment
+    // to make runs repeatable
+    const char* seed = getenv("RH_SIMULATOR_SEED");
+    srand(seed ? strtoul(seed, NULL, 0) : getpid() ^ (unsigned) time(NULL)/2);
     setup();
     while (1)
 	loop();
@@ -49,17 +57,52 @@ int main(int argc, char** argv)
 
 void delay(unsigned long ms)
 {
-    usleep(ms * 1000);
+    if (delay_handler)
+	delay_handler(ms);
+    else
+	usleep(ms * 1000);
 }
 
 // Arduino equivalent, milliseconds since process start
+// or the virtual time if set
 unsigned long millis()
 {
+    if (virtual_time)
+	return virtual_micros / 1000;
     return time_in_millis() - start_millis;
 }
 
+// Arduino equivalent, microseconds since process start
+// or the virtual time if set
+unsigned long micros()
+{
+    if (virtual_time)
+	return virtual_micros;
+    struct timeval te; 
+    gettimeofday(&te, NULL);
+    return (te.tv_sec * 1000000LL + te.tv_usec) - start_millis * 1000LL;
+}
+
+void simulator_set_virtual_time(uint64_t micros)
+{
+    virtual_time = true;
+    virtual_micros = micros;
+}
+
+void simulator_set_delay_handler(void (*handler)(unsigned long ms))
+{
+    delay_handler = handler;
+}
+
+void simulator_set_random_handler(long (*handler)(long from, long to))
+{
+    random_handler = handler;
+}
+
 long random(long from, long to)
 {
+    if (random_handler)
+	return random_handler(from, to);
     return from + (random() % (to - from));
 }
 
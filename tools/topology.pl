@@ -0,0 +1,156 @@
+#!/usr/bin/perl
+#
+# topology.pl
+# Generates network topologies for etherSimulator and RHEtherSimulator, as config files
+# containing an adjacency table of link:nodea:nodeb lines. See RHEther.h.
+#
+# Examples:
+# topology.pl chain 10 >chain10.conf        1-2-3-...-10
+# topology.pl grid 5 4 >grid5x4.conf        5 wide, 4 high, each node linked to its 4 neighbours
+# topology.pl star 8 >star8.conf            node 1 linked to nodes 2 to 8
+# topology.pl -s 3 -c random 50 0.2         50 nodes placed at random in a unit square, linked to all
+#                                           nodes within 0.2, and retried until connected
+# Many topologies can be generated for benchmarks with a different seed for each:
+# for s in `seq 1 100`; do topology.pl -s $s -c random 30 0.25 >random$s.conf; done
+
+use Getopt::Long;
+use strict;
+
+my $help;
+my $first = 1;          # Address of the first node
+my $seed = 1;           # Random seed for random topologies
+my $connected;          # Retry random topologies until connected
+my $probability;        # Probability of delivery on each link
+my $size;               # Write node positions scaled to this many metres
+
+my @options =
+    (
+     'h'     => \$help,                # Help, show usage
+     'f=n'   => \$first,               # First node address
+     's=n'   => \$seed,                # Random seed
+     'c'     => \$connected,           # Random topologies must be connected
+     'p=f'   => \$probability,         # Link probability
+     'd=f'   => \$size,                # Positions in metres
+    );
+
+&GetOptions(@options) || &usage;
+&usage if $help || !@ARGV;
+
+my @args = @ARGV;
+my $type = shift;
+my (@x, @y, @links);
+srand($seed);
+
+if ($type eq 'chain' && @ARGV == 1)
+{
+    my ($n) = @ARGV;
+    for my $i (0 .. $n - 1)
+    {
+	($x[$i], $y[$i]) = ($i, 0);
+	push(@links, [$i - 1, $i]) if $i > 0;
+    }
+}
+elsif ($type eq 'grid' && @ARGV == 2)
+{
+    my ($w, $h) = @ARGV;
+    for my $j (0 .. $h - 1)
+    {
+	for my $i (0 .. $w - 1)
+	{
+	    my $n = $j * $w + $i;
+	    ($x[$n], $y[$n]) = ($i, $j);
+	    push(@links, [$n - 1, $n]) if $i > 0;
+	    push(@links, [$n - $w, $n]) if $j > 0;
+	}
+    }
+}
+elsif ($type eq 'star' && @ARGV == 1)
+{
+    my ($n) = @ARGV;
+    ($x[0], $y[0]) = (0, 0);
+    for my $i (1 .. $n - 1)
+    {
+	my $a = 2 * 3.14159265 * $i / ($n - 1);
+	($x[$i], $y[$i]) = (cos($a), sin($a));
+	push(@links, [0, $i]);
+    }
+}
+elsif ($type eq 'random' && @ARGV == 2)
+{
+    my ($n, $radius) = @ARGV;
+    my $tries = 0;
+    do
+    {
+	die "Could not generate a connected topology, try a larger radius\n"
+	    if ++$tries > 1000;
+	@links = ();
+	for my $i (0 .. $n - 1)
+	{
+	    ($x[$i], $y[$i]) = (rand(), rand());
+	    for my $j (0 .. $i - 1)
+	    {
+		push(@links, [$j, $i])
+		    if ($x[$i] - $x[$j]) ** 2 + ($y[$i] - $y[$j]) ** 2 <= $radius ** 2;
+	    }
+	}
+    } while ($connected && !isConnected($n, @links));
+}
+else
+{
+    &usage;
+}
+
+die "Too many nodes, the last address would be above 254\n"
+    if $first + @x - 1 > 254;
+
+print "# Generated by: topology.pl -s $seed @args\n";
+print "# " . scalar(@x) . " nodes, " . scalar(@links) . " links\n";
+if (defined $size)
+{
+    # Random topologies are in a unit square, others have unit spacing
+    for my $i (0 .. $#x)
+    {
+	printf("position:%d:%.1f:%.1f\n", $first + $i, $x[$i] * $size, $y[$i] * $size);
+    }
+}
+for my $l (@links)
+{
+    print "link:" . ($first + $l->[0]) . ":" . ($first + $l->[1]) . "\n";
+    print "probability:" . ($first + $l->[0]) . ":" . ($first + $l->[1]) . ":$probability\n"
+	if defined $probability;
+}
+
+# Tells whether all n nodes are connected by the links
+sub isConnected
+{
+    my ($n, @links) = @_;
+
+    my %adjacent;
+    for my $l (@links)
+    {
+	push(@{$adjacent{$l->[0]}}, $l->[1]);
+	push(@{$adjacent{$l->[1]}}, $l->[0]);
+    }
+    my %seen = (0 => 1);
+    my @todo = (0);
+    while (@todo)
+    {
+	my $i = shift(@todo);
+	for my $j (@{$adjacent{$i}})
+	{
+	    push(@todo, $j) unless $seen{$j}++;
+	}
+    }
+    return keys(%seen) == $n;
+}
+
+sub usage
+{
+    print "usage: $0 [-h] [-f firstaddress] [-s seed] [-c] [-p probability] [-d metres] topology\n";
+    print "where topology is one of:\n";
+    print "  chain nodes\n";
+    print "  grid width height\n";
+    print "  star nodes\n";
+    print "  random nodes radius\n";
+    exit;
+}